@@ -0,0 +1,317 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+#include "cpp_redis/builders/reply_builder.hpp"
+
+#include "redispack/codec.h"
+#include "redispack/connection.h"
+#include "redispack/hash.h"
+#include "redispack/resp.h"
+#include "redispack/scan.h"
+#include "redispack/set.h"
+#include "redispack/util.h"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// redispack
+namespace resp = redispack::resp;
+
+// std
+using std::cout;
+using std::fixed;
+using std::function;
+using std::setprecision;
+using std::setw;
+using std::string;
+using std::vector;
+
+namespace {
+    /** Number of elements in the multi-bulk reply under test. */
+    static constexpr size_t ELEMENT_COUNT = 1000000;
+
+    /** Number of documents in the codec benchmark. */
+    static constexpr size_t DOCUMENT_COUNT = 200;
+
+    /** Number of timed runs, of which the best is reported. */
+    static constexpr size_t RUN_COUNT = 5;
+
+    /** Number of synchronous commands per round-trip benchmark. */
+    static constexpr size_t ROUND_TRIP_COUNT = 10000;
+
+    /**
+     * Runs the given function a few times and prints the best wall time.
+     */
+    void report(const string &name, const size_t bytes, const function<size_t()> &fn) {
+        using clock = std::chrono::steady_clock;
+
+        auto best = std::chrono::duration<double>::max();
+        size_t check = 0;
+
+        for (size_t i = 0; i < RUN_COUNT; ++i) {
+            const auto start = clock::now();
+            check = fn();
+            const auto elapsed = clock::now() - start;
+
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+
+        const auto secs = best.count();
+
+        cout << setw(32) << std::left << name
+            << fixed << setprecision(2)
+            << setw(10) << std::right << secs * 1000.0 << " ms"
+            << setw(10) << bytes / secs / (1024.0 * 1024.0) << " MiB/s"
+            << "  (" << check << ")\n";
+    }
+
+    /**
+     * Runs the given round trips a few times and prints the best latency per round trip.
+     */
+    void report_rtt(const string &name, const function<size_t()> &fn) {
+        using clock = std::chrono::steady_clock;
+
+        auto best = std::chrono::duration<double>::max();
+        size_t check = 0;
+
+        for (size_t i = 0; i < RUN_COUNT; ++i) {
+            const auto start = clock::now();
+            check = fn();
+            const auto elapsed = clock::now() - start;
+
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+
+        const auto secs = best.count();
+
+        cout << setw(32) << std::left << name
+            << fixed << setprecision(2)
+            << setw(10) << std::right << secs * 1e6 / ROUND_TRIP_COUNT << " us/op"
+            << setw(12) << ROUND_TRIP_COUNT / secs << " ops/s"
+            << "  (" << check << ")\n";
+    }
+
+    /**
+     * Reports the round-trip latency of the hash and set workloads over the uri.
+     */
+    void report_transport(const string &name, const string &uri) {
+        const auto client_res = redispack::make_and_connect_uri(uri);
+
+        if (client_res.is_err()) {
+            cout << name << " (" << uri << ") cannot connect, skipped\n";
+            return;
+        }
+
+        const auto client_ptr = client_res.get_unchecked();
+        redispack::hash<int, string> h(client_ptr, "redispack_bench_rtt_hash");
+        redispack::set<int> s(client_ptr, "redispack_bench_rtt_set");
+
+        report_rtt(name + " hash set", [&h] {
+            size_t count = 0;
+
+            for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i) {
+                count += h.set(static_cast<int>(i % 100), "value");
+            }
+
+            return count;
+        });
+
+        report_rtt(name + " hash get", [&h] {
+            size_t count = 0;
+
+            for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i) {
+                count += h.get(static_cast<int>(i % 100)).is_some();
+            }
+
+            return count;
+        });
+
+        report_rtt(name + " set add", [&s] {
+            size_t count = 0;
+
+            for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i) {
+                count += s.add(static_cast<int>(i % 100));
+            }
+
+            return count;
+        });
+
+        report_rtt(name + " set is_member", [&s] {
+            size_t count = 0;
+
+            for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i) {
+                count += s.is_member(static_cast<int>(i % 100));
+            }
+
+            return count;
+        });
+
+        client_ptr->del({h.get_name(), s.get_name()});
+        client_ptr->sync_commit();
+    }
+
+    /**
+     * Builds a SMEMBERS-like reply holding msgpack encoded strings.
+     */
+    auto make_multi_bulk(const size_t count) -> string {
+        vector<string> members;
+        members.reserve(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            members.push_back(redispack::details::encode_into_str(
+                "member:" + std::to_string(i)));
+        }
+
+        string buf;
+        resp::append_command(buf, members);
+        return buf;
+    }
+
+    /**
+     * Builds JSON-like documents between 5 KB and 50 KB,
+     * which repeat their field names like typical stored documents.
+     */
+    auto make_documents(const size_t count) -> vector<string> {
+        static constexpr size_t MIN_SIZE = 5 * 1024;
+        static constexpr size_t MAX_SIZE = 50 * 1024;
+
+        vector<string> docs;
+        docs.reserve(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            const auto size = MIN_SIZE + (MAX_SIZE - MIN_SIZE) * i / count;
+            string doc = "[";
+
+            for (size_t j = 0; doc.size() < size; ++j) {
+                doc += "{\"id\":" + std::to_string(i * 1000 + j)
+                    + ",\"name\":\"user-" + std::to_string(j * 7919 % 1000)
+                    + "\",\"active\":" + (j % 3 == 0 ? "false" : "true")
+                    + ",\"score\":" + std::to_string(j * 31 % 100) + "},";
+            }
+
+            doc.back() = ']';
+            docs.push_back(std::move(doc));
+        }
+
+        return docs;
+    }
+
+    /**
+     * Reports the encoded size and the encode and decode times of the codec.
+     */
+    template <class Codec>
+    void report_codec(const string &name, const Codec &codec, const vector<string> &docs) {
+        size_t raw_bytes = 0;
+        vector<string> encoded;
+        encoded.reserve(docs.size());
+
+        for (const auto &doc : docs) {
+            raw_bytes += doc.size();
+            encoded.push_back(codec.encode(doc));
+        }
+
+        size_t wire_bytes = 0;
+
+        for (const auto &value : encoded) {
+            wire_bytes += value.size();
+        }
+
+        cout << name << ": " << wire_bytes << " bytes on the wire, "
+            << fixed << setprecision(2) << 100.0 * wire_bytes / raw_bytes << "% of raw\n";
+
+        report(name + " encode", raw_bytes, [&codec, &docs] {
+            size_t bytes = 0;
+
+            for (const auto &doc : docs) {
+                bytes += codec.encode(doc).size();
+            }
+
+            return bytes;
+        });
+
+        report(name + " decode", raw_bytes, [&codec, &encoded] {
+            size_t count = 0;
+
+            for (const auto &value : encoded) {
+                count += codec.template decode<string>(value.data(), value.size()).is_some();
+            }
+
+            return count;
+        });
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+#ifdef _WIN32
+    //! Windows netword DLL init
+    WORD version = MAKEWORD(2, 2);
+    WSADATA data;
+
+    if (WSAStartup(version, &data) != 0) {
+        std::cerr << "WSAStartup() failure\n";
+        return 127;
+    }
+#endif
+
+    const auto buf = make_multi_bulk(ELEMENT_COUNT);
+    cout << "multi-bulk reply: " << ELEMENT_COUNT << " elements, " << buf.size() << " bytes\n";
+
+    report("cpp_redis reply_builder", buf.size(), [&buf] {
+        cpp_redis::builders::reply_builder builder;
+        builder << buf;
+        return builder.reply_available()
+            ? builder.get_front().as_array().size()
+            : 0;
+    });
+
+    const vector<resp::scan_mode> modes{
+        resp::scan_mode::scalar, resp::scan_mode::sse2, resp::scan_mode::avx2};
+
+    const vector<string> mode_names{"scalar", "sse2", "avx2"};
+
+    for (size_t i = 0; i < modes.size(); ++i) {
+        if (resp::resolve_scan_mode(modes[i]) != modes[i]) {
+            cout << mode_names[i] << " is not supported, skipped\n";
+            continue;
+        }
+
+        report("scan_crlf " + mode_names[i], buf.size(), [&buf, &modes, i] {
+            vector<size_t> positions;
+            resp::scan_crlf(buf.data(), buf.size(), positions, modes[i]);
+            return positions.size();
+        });
+
+        report("resp::parser " + mode_names[i], buf.size(), [&buf, &modes, i] {
+            resp::parser p(modes[i]);
+            p.parse(buf.data(), buf.size());
+            return p.root().size();
+        });
+    }
+
+    const auto docs = make_documents(DOCUMENT_COUNT);
+    report_codec("msgpack_codec", redispack::msgpack_codec(), docs);
+    report_codec("lz_codec", redispack::lz_codec(), docs);
+
+    // e.g. bench redis://127.0.0.1:6379 unix:///tmp/redis.sock
+    if (argc >= 3) {
+        report_transport("tcp", argv[1]);
+        report_transport("uds", argv[2]);
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    return 0;
+}
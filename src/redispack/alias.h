@@ -2,6 +2,7 @@
 
 #include "cpp_redis/redis_client.hpp"
 #include "cpp_redis/redis_error.hpp"
+#include "cpp_redis/redis_subscriber.hpp"
 
 #include <memory>
 
@@ -14,4 +15,10 @@ namespace redispack {
 
     /** Alias to the common form of redis_client shared ownership pointer. **/
     using redis_client_ptr = std::shared_ptr<redis_client>;
+
+    /** Alias to cpp_redis::redis_subscriber. */
+    using redis_subscriber = ::cpp_redis::redis_subscriber;
+
+    /** Alias to the common form of redis_subscriber shared ownership pointer. **/
+    using redis_subscriber_ptr = std::shared_ptr<redis_subscriber>;
 }
\ No newline at end of file
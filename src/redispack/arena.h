@@ -0,0 +1,240 @@
+/**
+ * Provides a monotonic arena and its standard allocator adaptor, so that
+ * a burst of request-scoped containers can be allocated from a few large
+ * blocks and then freed all at once.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Hands out memory by bumping a cursor within large blocks, and only
+     * frees the memory when the arena is released or destroyed.
+     *
+     * Not thread-safe, meant to be used by a single request at a time.
+     */
+    class monotonic_arena {
+    public:
+        /** Default size of each block requested from the global heap. */
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+        /**
+         * Constructs the arena without allocating any block yet.
+         *
+         * @param block_size size of each block requested from the global heap
+         */
+        explicit monotonic_arena(const size_t block_size = DEFAULT_BLOCK_SIZE) noexcept;
+
+        /** Frees all the blocks. */
+        ~monotonic_arena();
+
+        monotonic_arena(const monotonic_arena &) = delete;
+        auto operator=(const monotonic_arena &) -> monotonic_arena & = delete;
+
+        /**
+         * Allocates memory which is only freed on release.
+         *
+         * @param size number of bytes to allocate
+         * @param alignment required alignment, must be a power of two
+         * @return pointer to the allocated memory
+         * @throws std::bad_alloc if the size cannot be represented with its block header
+         */
+        auto allocate(const size_t size, const size_t alignment) -> void *;
+
+        /**
+         * Frees all the blocks at once, invalidating all the memory handed out.
+         */
+        void release() noexcept;
+
+        /** @return number of bytes handed out since the last release. */
+        auto allocated() const noexcept -> size_t;
+
+    private:
+        /** Header placed in front of every block. */
+        struct block {
+            /** Previously allocated block. */
+            block *prev;
+        };
+
+        /** Size of each block requested from the global heap. */
+        size_t block_size;
+
+        /** Most recently allocated block. */
+        block *head;
+
+        /** Next free byte in the head block. */
+        uintptr_t cursor;
+
+        /** Past the last byte of the head block. */
+        uintptr_t limit;
+
+        /** Number of bytes handed out since the last release. */
+        size_t used;
+    };
+
+    /**
+     * Standard allocator adaptor over a monotonic_arena.
+     *
+     * Deallocation is a no-op, the memory is reclaimed when the arena is released.
+     */
+    template <class T>
+    class arena_allocator {
+    public:
+        /** Allocated type. */
+        using value_type = T;
+
+        /**
+         * Constructs the allocator which allocates from the given arena.
+         */
+        arena_allocator(monotonic_arena &arena) noexcept;
+
+        /**
+         * Rebinds the allocator from another value type.
+         */
+        template <class U>
+        arena_allocator(const arena_allocator<U> &rhs) noexcept;
+
+        /**
+         * Allocates space for n values from the arena.
+         *
+         * @throws std::bad_array_new_length if n values overflow the byte count
+         */
+        auto allocate(const size_t n) -> T *;
+
+        /** No-op, the memory is reclaimed when the arena is released. */
+        void deallocate(T *ptr, const size_t n) noexcept;
+
+        /** @return arena to allocate from. */
+        auto get_arena() const noexcept -> monotonic_arena &;
+
+    private:
+        /** Arena to allocate from. */
+        monotonic_arena *arena_ptr;
+    };
+
+    /** @return true if both allocators allocate from the same arena. */
+    template <class T, class U>
+    auto operator==(const arena_allocator<T> &lhs, const arena_allocator<U> &rhs) noexcept
+        -> bool;
+
+    /** @return true if both allocators do not allocate from the same arena. */
+    template <class T, class U>
+    auto operator!=(const arena_allocator<T> &lhs, const arena_allocator<U> &rhs) noexcept
+        -> bool;
+
+    // implementation section
+
+    inline monotonic_arena::monotonic_arena(const size_t block_size) noexcept :
+        block_size(block_size),
+        head(nullptr),
+        cursor(0),
+        limit(0),
+        used(0) {
+
+    }
+
+    inline monotonic_arena::~monotonic_arena() {
+        release();
+    }
+
+    inline auto monotonic_arena::allocate(const size_t size, const size_t alignment) -> void * {
+        if (size > std::numeric_limits<size_t>::max() - alignment - sizeof(block)) {
+            throw std::bad_alloc();
+        }
+
+        const auto align_mask = static_cast<uintptr_t>(alignment - 1);
+        auto aligned = (cursor + align_mask) & ~align_mask;
+
+        if (!head || aligned > limit || size > limit - aligned) {
+            // oversized requests get a block of their own
+            const auto data_size = size + alignment > block_size
+                ? size + alignment
+                : block_size;
+
+            const auto raw = static_cast<char *>(::operator new(sizeof(block) + data_size));
+            const auto new_block = reinterpret_cast<block *>(raw);
+            new_block->prev = head;
+
+            head = new_block;
+            cursor = reinterpret_cast<uintptr_t>(raw + sizeof(block));
+            limit = cursor + data_size;
+            aligned = (cursor + align_mask) & ~align_mask;
+        }
+
+        cursor = aligned + size;
+        used += size;
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    inline void monotonic_arena::release() noexcept {
+        while (head) {
+            const auto prev = head->prev;
+            ::operator delete(head);
+            head = prev;
+        }
+
+        cursor = 0;
+        limit = 0;
+        used = 0;
+    }
+
+    inline auto monotonic_arena::allocated() const noexcept -> size_t {
+        return used;
+    }
+
+    template <class T>
+    arena_allocator<T>::arena_allocator(monotonic_arena &arena) noexcept :
+        arena_ptr(&arena) {
+
+    }
+
+    template <class T>
+    template <class U>
+    arena_allocator<T>::arena_allocator(const arena_allocator<U> &rhs) noexcept :
+        arena_ptr(&rhs.get_arena()) {
+
+    }
+
+    template <class T>
+    auto arena_allocator<T>::allocate(const size_t n) -> T * {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+
+        return static_cast<T *>(arena_ptr->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    template <class T>
+    void arena_allocator<T>::deallocate(T *, const size_t) noexcept {
+        // reclaimed when the arena is released
+    }
+
+    template <class T>
+    auto arena_allocator<T>::get_arena() const noexcept -> monotonic_arena & {
+        return *arena_ptr;
+    }
+
+    template <class T, class U>
+    auto operator==(const arena_allocator<T> &lhs, const arena_allocator<U> &rhs) noexcept
+        -> bool {
+
+        return &lhs.get_arena() == &rhs.get_arena();
+    }
+
+    template <class T, class U>
+    auto operator!=(const arena_allocator<T> &lhs, const arena_allocator<U> &rhs) noexcept
+        -> bool {
+
+        return !(lhs == rhs);
+    }
+}
@@ -0,0 +1,549 @@
+/**
+ * Provides a set of dense unsigned integers on top of the redis bitmap
+ * functions, which stores one bit per possible member and runs the set
+ * algebra on the server.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "expiry.h"
+#include "keyspace.h"
+#include "router.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Provides set like functionalities for dense unsigned integers,
+     * where member n is bit n of a redis string.
+     *
+     * All the data is stored in the redis server. The string grows up to the
+     * largest member, so this suits members that are dense from 0, e.g. ids.
+     */
+    class bitset_set {
+    public:
+        /** Type of the members. */
+        using value_t = uint32_t;
+
+        /**
+         * Constructs this instance with the given client connection and key (name).
+         */
+        bitset_set(const redis_client_ptr &client_ptr, const std::string &name);
+
+        /**
+         * Constructs this instance with the given router and key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        bitset_set(const std::shared_ptr<replica_router> &router_ptr, const std::string &name);
+
+        /**
+         * setbit to 1
+         * @return true if the member is new
+         */
+        auto add(const uint32_t member) -> bool;
+
+        /**
+         * bitfield with a 1-bit set per member, in a single round trip.
+         * @param begin_it begin iterator of members to add
+         * @param end_it end iterator of members to add
+         * @return number of new members
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto add(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
+
+        /**
+         * bitcount
+         * @return number of members
+         */
+        auto card() const -> size_t;
+
+        /**
+         * Deletes the set.
+         * @return true if the set existed
+         */
+        auto clear() -> bool;
+
+        /**
+         * getbit
+         * @return true if the member is in the set
+         */
+        auto is_member(const uint32_t member) const -> bool;
+
+        /**
+         * bitfield_ro with a 1-bit get per member, in a single round trip.
+         * Requires Redis 6.2 or later.
+         *
+         * @param begin_it begin iterator of members to check
+         * @param end_it end iterator of members to check
+         * @return whether each member is in the set, in the order of the members
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto are_members(const TBeginIter &begin_it, const TEndIter &end_it) const
+            -> std::vector<bool>;
+
+        /**
+         * get of the whole bitmap
+         * @return all the members in ascending order
+         */
+        auto members() const -> std::vector<uint32_t>;
+
+        /**
+         * get of the whole bitmap
+         * @param out output iterator to write the members into, in ascending order
+         * @return output iterator past the last written member
+         */
+        template <class OutIt>
+        auto members(OutIt out) const -> OutIt;
+
+        /**
+         * setbit to 0
+         * @return true if the member was in the set
+         */
+        auto rem(const uint32_t member) -> bool;
+
+        /**
+         * bitfield with a 1-bit reset per member, in a single round trip.
+         * @param begin_it begin iterator of members to remove
+         * @param end_it end iterator of members to remove
+         * @return number of removed members
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto rem(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
+
+        /**
+         * bitop and, stored on the server.
+         * @return set at dest_name holding the intersection of *this and rhs
+         * @throws std::runtime_error if the server rejects the bitop.
+         */
+        auto inter(const bitset_set &rhs, const std::string &dest_name) const -> bitset_set;
+
+        /**
+         * bitop or, stored on the server.
+         * @return set at dest_name holding the union of *this and rhs
+         * @throws std::runtime_error if the server rejects the bitop.
+         */
+        auto union_(const bitset_set &rhs, const std::string &dest_name) const -> bitset_set;
+
+        /**
+         * bitop xor, stored on the server.
+         * @return set at dest_name holding the members in exactly one of *this and rhs
+         * @throws std::runtime_error if the server rejects the bitop.
+         */
+        auto xor_(const bitset_set &rhs, const std::string &dest_name) const -> bitset_set;
+
+        /**
+         * Performs the pexpire command on the set key.
+         *
+         * @return true if the timeout was set, false if the set does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the set key.
+         *
+         * @return Some(remaining time) if the set has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return set key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+    private:
+        /**
+         * Sets a bit per distinct member with bitfield, split into commands of at most
+         * BITFIELD_BATCH members which are pipelined together.
+         *
+         * @return number of bits which changed.
+         * @throws std::runtime_error if the server rejects any of the commands.
+         */
+        auto set_bits(std::vector<uint32_t> members, const bool bit) -> size_t;
+
+        /**
+         * Performs the bitop command into the destination key.
+         * @return set at the destination key.
+         */
+        auto bitop(const std::string &op, const bitset_set &rhs, const std::string &dest_name)
+            const -> bitset_set;
+
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
+        /** Holds a shared ownership to access the database. */
+        mutable redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Set key (name). */
+        std::string name;
+    };
+
+    namespace details {
+        /** Maximum number of members per bitfield command. */
+        static constexpr size_t BITFIELD_BATCH = 4096;
+
+        /**
+         * Writes the members of the bitmap in ascending order,
+         * where the most significant bit of the first byte is member 0.
+         *
+         * @return output iterator past the last written member.
+         */
+        template <class OutIt>
+        auto decode_bitmap(const std::string &bitmap, OutIt out) -> OutIt;
+
+        /**
+         * @return the integers of an array reply, with non-integers as 0.
+         */
+        auto reply_integers(const cpp_redis::reply &r) -> std::vector<int64_t>;
+    }
+
+    // implementation section
+
+    inline bitset_set::bitset_set(const redis_client_ptr &client_ptr, const std::string &name) :
+        client_ptr(client_ptr),
+        name(name) {
+
+    }
+
+    inline bitset_set::bitset_set(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name) {
+
+    }
+
+    inline auto bitset_set::add(const uint32_t member) -> bool {
+        bool is_new = false;
+
+        // sent as a raw command, since the offset may not fit an int
+        client_ptr->send({"SETBIT", name, std::to_string(member), "1"},
+            [&is_new](cpp_redis::reply &r) {
+                static constexpr auto WAS_UNSET_RET_VAL = 0;
+                is_new = r.is_integer() && r.as_integer() == WAS_UNSET_RET_VAL;
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return is_new;
+    }
+
+    template <class TBeginIter, class TEndIter, class>
+    auto bitset_set::add(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
+        return set_bits(std::vector<uint32_t>(begin_it, end_it), true);
+    }
+
+    inline auto bitset_set::card() const -> size_t {
+        size_t cardinality = 0;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->bitcount(name,
+            [&cardinality](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    cardinality = static_cast<size_t>(r.as_integer());
+                }
+            });
+
+        details::sync_commit(read_client_ptr);
+        return cardinality;
+    }
+
+    inline auto bitset_set::clear() -> bool {
+        const auto deleted = details::del_impl(client_ptr, name);
+        mark_write();
+        return deleted;
+    }
+
+    inline auto bitset_set::is_member(const uint32_t member) const -> bool {
+        bool is_present = false;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->send({"GETBIT", name, std::to_string(member)},
+            [&is_present](cpp_redis::reply &r) {
+                static constexpr auto IS_SET_RET_VAL = 1;
+                is_present = r.is_integer() && r.as_integer() == IS_SET_RET_VAL;
+            });
+
+        details::sync_commit(read_client_ptr);
+        return is_present;
+    }
+
+    template <class TBeginIter, class TEndIter, class>
+    auto bitset_set::are_members(const TBeginIter &begin_it, const TEndIter &end_it) const
+        -> std::vector<bool> {
+
+        const std::vector<uint32_t> members(begin_it, end_it);
+        std::vector<bool> are_present(members.size(), false);
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        for (size_t begin = 0; begin < members.size(); begin += details::BITFIELD_BATCH) {
+            const auto end = std::min(members.size(), begin + details::BITFIELD_BATCH);
+
+            std::vector<std::string> cmd{"BITFIELD_RO", name};
+            cmd.reserve(2 + (end - begin) * 3);
+
+            for (auto i = begin; i < end; ++i) {
+                cmd.push_back("GET");
+                cmd.push_back("u1");
+                cmd.push_back(std::to_string(members[i]));
+            }
+
+            read_client_ptr->send(cmd,
+                [&are_present, begin](cpp_redis::reply &r) {
+                    const auto bits = details::reply_integers(r);
+
+                    for (size_t i = 0; i < bits.size() && begin + i < are_present.size(); ++i) {
+                        are_present[begin + i] = bits[i] != 0;
+                    }
+                });
+        }
+
+        details::sync_commit(read_client_ptr);
+        return are_present;
+    }
+
+    inline auto bitset_set::members() const -> std::vector<uint32_t> {
+        std::vector<uint32_t> mems;
+        members(std::back_inserter(mems));
+        return mems;
+    }
+
+    template <class OutIt>
+    auto bitset_set::members(OutIt out) const -> OutIt {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->get(name,
+            [&out](cpp_redis::reply &r) {
+                if (r.is_bulk_string()) {
+                    out = details::decode_bitmap(r.as_string(), std::move(out));
+                }
+            });
+
+        details::sync_commit(read_client_ptr);
+        return out;
+    }
+
+    inline auto bitset_set::rem(const uint32_t member) -> bool {
+        bool was_present = false;
+
+        client_ptr->send({"SETBIT", name, std::to_string(member), "0"},
+            [&was_present](cpp_redis::reply &r) {
+                static constexpr auto WAS_SET_RET_VAL = 1;
+                was_present = r.is_integer() && r.as_integer() == WAS_SET_RET_VAL;
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return was_present;
+    }
+
+    template <class TBeginIter, class TEndIter, class>
+    auto bitset_set::rem(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
+        return set_bits(std::vector<uint32_t>(begin_it, end_it), false);
+    }
+
+    inline auto bitset_set::inter(const bitset_set &rhs, const std::string &dest_name) const
+        -> bitset_set {
+
+        return bitop("AND", rhs, dest_name);
+    }
+
+    inline auto bitset_set::union_(const bitset_set &rhs, const std::string &dest_name) const
+        -> bitset_set {
+
+        return bitop("OR", rhs, dest_name);
+    }
+
+    inline auto bitset_set::xor_(const bitset_set &rhs, const std::string &dest_name) const
+        -> bitset_set {
+
+        return bitop("XOR", rhs, dest_name);
+    }
+
+    inline auto bitset_set::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    inline auto bitset_set::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    inline auto bitset_set::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    inline auto bitset_set::get_name() const -> const std::string & {
+        return name;
+    }
+
+    inline auto bitset_set::set_bits(std::vector<uint32_t> members, const bool bit) -> size_t {
+        // a repeated member would otherwise count its own change twice
+        std::sort(members.begin(), members.end());
+        members.erase(std::unique(members.begin(), members.end()), members.end());
+
+        // counts the bits which held the opposite value before
+        const int64_t prev_bit = bit ? 0 : 1;
+        size_t changed_count = 0;
+        bool is_failed = false;
+
+        for (size_t begin = 0; begin < members.size(); begin += details::BITFIELD_BATCH) {
+            const auto end = std::min(members.size(), begin + details::BITFIELD_BATCH);
+
+            std::vector<std::string> cmd{"BITFIELD", name};
+            cmd.reserve(2 + (end - begin) * 4);
+
+            for (auto i = begin; i < end; ++i) {
+                cmd.push_back("SET");
+                cmd.push_back("u1");
+                cmd.push_back(std::to_string(members[i]));
+                cmd.push_back(bit ? "1" : "0");
+            }
+
+            const auto bit_count = end - begin;
+
+            client_ptr->send(cmd,
+                [&changed_count, &is_failed, prev_bit, bit_count](cpp_redis::reply &r) {
+                    const auto old_bits = details::reply_integers(r);
+
+                    if (r.is_error() || old_bits.size() != bit_count) {
+                        is_failed = true;
+                        return;
+                    }
+
+                    for (const auto old_bit : old_bits) {
+                        if (old_bit == prev_bit) {
+                            ++changed_count;
+                        }
+                    }
+                });
+        }
+
+        // all the batches travel in a single round trip
+        details::sync_commit(client_ptr);
+
+        if (is_failed) {
+            throw std::runtime_error("Unable to set the bits of bitset set " + name);
+        }
+
+        mark_write();
+        return changed_count;
+    }
+
+    inline auto bitset_set::bitop(
+        const std::string &op,
+        const bitset_set &rhs,
+        const std::string &dest_name) const -> bitset_set {
+
+        bool is_stored = false;
+
+        // replies with the size of the destination, or an error e.g. on a wrong type key
+        client_ptr->send({"BITOP", op, dest_name, name, rhs.name},
+            [&is_stored](cpp_redis::reply &r) {
+                is_stored = r.is_integer();
+            });
+
+        details::sync_commit(client_ptr);
+
+        if (!is_stored) {
+            throw std::runtime_error("Unable to store the bitop " + op + " into " + dest_name);
+        }
+
+        mark_write();
+
+        return router_ptr ? bitset_set(router_ptr, dest_name) : bitset_set(client_ptr, dest_name);
+    }
+
+    inline auto bitset_set::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    inline void bitset_set::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
+
+    namespace details {
+        template <class OutIt>
+        auto decode_bitmap(const std::string &bitmap, OutIt out) -> OutIt {
+            static constexpr size_t BITS_PER_BYTE = 8;
+
+            for (size_t i = 0; i < bitmap.size(); ++i) {
+                const auto byte = static_cast<uint8_t>(bitmap[i]);
+
+                // skips the empty bytes, which are most of a sparse bitmap
+                if (byte == 0) {
+                    continue;
+                }
+
+                for (size_t bit = 0; bit < BITS_PER_BYTE; ++bit) {
+                    if (byte & (0x80 >> bit)) {
+                        *out = static_cast<uint32_t>(i * BITS_PER_BYTE + bit);
+                        ++out;
+                    }
+                }
+            }
+
+            return out;
+        }
+
+        inline auto reply_integers(const cpp_redis::reply &r) -> std::vector<int64_t> {
+            std::vector<int64_t> values;
+
+            if (!r.is_array()) {
+                return values;
+            }
+
+            values.reserve(r.as_array().size());
+
+            for (const auto &sub : r.as_array()) {
+                values.push_back(sub.is_integer() ? sub.as_integer() : 0);
+            }
+
+            return values;
+        }
+    }
+}
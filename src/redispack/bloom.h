@@ -0,0 +1,539 @@
+/**
+ * Provides a bloom filter on top of the redis bitmap functions, which
+ * answers most negative lookups without touching the much larger key
+ * holding the actual members.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "bitset_set.h"
+#include "codec.h"
+#include "expiry.h"
+#include "hll.h"
+#include "keyspace.h"
+#include "router.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Sizes the filter from the expected number of members.
+     *
+     * Every process sharing a filter key must use the same options,
+     * since they determine the bit positions of each member.
+     */
+    struct bloom_options {
+        /** Number of members the filter is expected to hold. */
+        size_t expected_count;
+
+        /** False positive rate once the expected number of members is reached. */
+        double false_positive_rate;
+    };
+
+    /**
+     * @return defaults of 1 million expected members at a false positive rate of 1%.
+     */
+    auto default_bloom_options() noexcept -> bloom_options;
+
+    /**
+     * Provides probabilistic membership tests, where contains may return false
+     * positives but never false negatives.
+     *
+     * All the data is stored in the redis server, as a bitmap of
+     * m bits with k bits set per member. Each member is stored with the Codec
+     * before being hashed, so that it matches the members of the other containers.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class bloom {
+    public:
+        /** Alias to the T template type, which is the member type. */
+        using value_t = T;
+
+        /** Alias to the Codec template type, which stores the members before hashing. */
+        using codec_t = Codec;
+
+        /**
+         * Constructs this instance with the given client connection and key (name).
+         */
+        bloom(
+            const redis_client_ptr &client_ptr,
+            const std::string &name,
+            const bloom_options &options = default_bloom_options(),
+            const Codec &codec = Codec());
+
+        /**
+         * Constructs this instance with the given router and key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        bloom(
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::string &name,
+            const bloom_options &options = default_bloom_options(),
+            const Codec &codec = Codec());
+
+        /**
+         * bitfield with a 1-bit set per hash of the member.
+         * @return true if the member was definitely not in the filter before
+         */
+        auto add(const T &member) -> bool;
+
+        /**
+         * bitfield with a 1-bit set per hash of each member,
+         * split into commands which are pipelined together.
+         *
+         * @param begin_it begin iterator of members to add
+         * @param end_it end iterator of members to add
+         * @return number of members which were definitely not in the filter before
+         * @throws std::runtime_error if any command fails, e.g. the key holds another type
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto add_many(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
+
+        /**
+         * bitfield_ro with a 1-bit get per hash of the member.
+         * Requires Redis 6.2 or later.
+         *
+         * @return false if the member is definitely not in the filter
+         * @throws std::runtime_error if the command fails, e.g. before Redis 6.2
+         */
+        auto contains(const T &member) const -> bool;
+
+        /**
+         * bitfield_ro with a 1-bit get per hash of each member,
+         * split into commands which are pipelined together.
+         * Requires Redis 6.2 or later.
+         *
+         * @param begin_it begin iterator of members to check
+         * @param end_it end iterator of members to check
+         * @return false for each member definitely not in the filter, in the order of the members
+         * @throws std::runtime_error if any command fails, e.g. before Redis 6.2
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto contains_many(const TBeginIter &begin_it, const TEndIter &end_it) const
+            -> std::vector<bool>;
+
+        /**
+         * Deletes the filter.
+         * @return true if the filter existed
+         */
+        auto clear() -> bool;
+
+        /**
+         * Performs the pexpire command on the filter key.
+         *
+         * @return true if the timeout was set, false if the filter does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the filter key.
+         *
+         * @return Some(remaining time) if the filter has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * @return number of bits of the filter (m).
+         */
+        auto get_bit_count() const noexcept -> uint64_t;
+
+        /**
+         * @return number of bits set per member (k).
+         */
+        auto get_hash_count() const noexcept -> size_t;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return filter key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+        /**
+         * @return codec used to store the members before hashing.
+         */
+        auto get_codec() const noexcept -> const Codec &;
+
+    private:
+        /**
+         * @return bit positions of every member, hash_count per member.
+         */
+        template <class TBeginIter, class TEndIter>
+        auto positions_of(const TBeginIter &begin_it, const TEndIter &end_it) const
+            -> std::vector<uint64_t>;
+
+        /** @return number of members per bitfield command. */
+        auto members_per_cmd() const noexcept -> size_t;
+
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
+        /** Holds a shared ownership to access the database. */
+        mutable redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Filter key (name). */
+        std::string name;
+
+        /** Number of bits of the filter (m). */
+        uint64_t bit_count;
+
+        /** Number of bits set per member (k). */
+        size_t hash_count;
+
+        /** Stores the members before hashing. */
+        Codec codec;
+    };
+
+    namespace details {
+        /** Seeds of the two hashes, which are combined into every bit position. */
+        static constexpr uint64_t BLOOM_HASH_SEED_1 = 0x9747b28cULL;
+        static constexpr uint64_t BLOOM_HASH_SEED_2 = 0x85ebca6bULL;
+
+        /** Largest bitmap redis allows, which is a string of 512MB. */
+        static constexpr uint64_t BLOOM_MAX_BITS = 1ULL << 32;
+
+        /**
+         * @return optimal number of bits, -n ln(p) / ln(2)^2, within [1, BLOOM_MAX_BITS].
+         */
+        auto bloom_bit_count(const size_t expected_count, const double false_positive_rate)
+            noexcept -> uint64_t;
+
+        /**
+         * @return optimal number of bits set per member, m / n ln(2), at least 1.
+         */
+        auto bloom_hash_count(const uint64_t bit_count, const size_t expected_count) noexcept
+            -> size_t;
+
+        /**
+         * Appends the bit positions of the encoded member, derived from two hashes
+         * as h1 + i * h2 (Kirsch & Mitzenmacher), so that only two hashes are computed.
+         */
+        void bloom_positions(
+            const std::string &member_str,
+            const uint64_t bit_count,
+            const size_t hash_count,
+            std::vector<uint64_t> &out);
+    }
+
+    // implementation section
+
+    inline auto default_bloom_options() noexcept -> bloom_options {
+        static constexpr size_t DEFAULT_EXPECTED_COUNT = 1000000;
+        static constexpr auto DEFAULT_FALSE_POSITIVE_RATE = 0.01;
+
+        return bloom_options{DEFAULT_EXPECTED_COUNT, DEFAULT_FALSE_POSITIVE_RATE};
+    }
+
+    template <class T, class Codec>
+    bloom<T, Codec>::bloom(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const bloom_options &options,
+        const Codec &codec) :
+
+        client_ptr(client_ptr),
+        name(name),
+        bit_count(details::bloom_bit_count(options.expected_count, options.false_positive_rate)),
+        hash_count(details::bloom_hash_count(bit_count, options.expected_count)),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    bloom<T, Codec>::bloom(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name,
+        const bloom_options &options,
+        const Codec &codec) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name),
+        bit_count(details::bloom_bit_count(options.expected_count, options.false_positive_rate)),
+        hash_count(details::bloom_hash_count(bit_count, options.expected_count)),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::add(const T &member) -> bool {
+        return add_many(&member, &member + 1) == 1;
+    }
+
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto bloom<T, Codec>::add_many(const TBeginIter &begin_it, const TEndIter &end_it)
+        -> size_t {
+
+        const auto positions = positions_of(begin_it, end_it);
+        const auto member_count = positions.size() / hash_count;
+        const auto batch = members_per_cmd();
+
+        size_t new_count = 0;
+        bool is_failed = false;
+
+        for (size_t begin = 0; begin < member_count; begin += batch) {
+            const auto end = std::min(member_count, begin + batch);
+
+            std::vector<std::string> cmd{"BITFIELD", name};
+            cmd.reserve(2 + (end - begin) * hash_count * 4);
+
+            for (auto i = begin * hash_count; i < end * hash_count; ++i) {
+                cmd.push_back("SET");
+                cmd.push_back("u1");
+                cmd.push_back(std::to_string(positions[i]));
+                cmd.push_back("1");
+            }
+
+            const auto bit_count = (end - begin) * hash_count;
+
+            client_ptr->send(cmd,
+                [this, &new_count, &is_failed, bit_count](cpp_redis::reply &r) {
+                    const auto old_bits = details::reply_integers(r);
+
+                    // an error reply would otherwise count as no member being new
+                    if (r.is_error() || old_bits.size() != bit_count) {
+                        is_failed = true;
+                        return;
+                    }
+
+                    // a member is new if any of its bits was not set before
+                    for (size_t i = 0; i < old_bits.size(); i += hash_count) {
+                        const auto member_end = std::min(old_bits.size(), i + hash_count);
+
+                        if (std::any_of(
+                            old_bits.cbegin() + i, old_bits.cbegin() + member_end,
+                            [](const int64_t bit) { return bit == 0; })) {
+
+                            ++new_count;
+                        }
+                    }
+                });
+        }
+
+        // all the batches travel in a single round trip
+        details::sync_commit(client_ptr);
+
+        if (is_failed) {
+            throw std::runtime_error("Unable to add into bloom filter " + name);
+        }
+
+        mark_write();
+        return new_count;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::contains(const T &member) const -> bool {
+        return contains_many(&member, &member + 1).front();
+    }
+
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto bloom<T, Codec>::contains_many(const TBeginIter &begin_it, const TEndIter &end_it) const
+        -> std::vector<bool> {
+
+        const auto positions = positions_of(begin_it, end_it);
+        const auto member_count = positions.size() / hash_count;
+        const auto batch = members_per_cmd();
+
+        std::vector<bool> are_present(member_count, false);
+        bool is_failed = false;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        for (size_t begin = 0; begin < member_count; begin += batch) {
+            const auto end = std::min(member_count, begin + batch);
+
+            std::vector<std::string> cmd{"BITFIELD_RO", name};
+            cmd.reserve(2 + (end - begin) * hash_count * 3);
+
+            for (auto i = begin * hash_count; i < end * hash_count; ++i) {
+                cmd.push_back("GET");
+                cmd.push_back("u1");
+                cmd.push_back(std::to_string(positions[i]));
+            }
+
+            const auto bit_count = (end - begin) * hash_count;
+
+            read_client_ptr->send(cmd,
+                [this, &are_present, &is_failed, begin, bit_count](cpp_redis::reply &r) {
+                    const auto bits = details::reply_integers(r);
+
+                    // an error reply would otherwise read as every member being absent
+                    if (r.is_error() || bits.size() != bit_count) {
+                        is_failed = true;
+                        return;
+                    }
+
+                    // a member may be present only if all of its bits are set
+                    for (size_t i = 0; i + hash_count <= bits.size(); i += hash_count) {
+                        const auto index = begin + i / hash_count;
+
+                        if (index < are_present.size()) {
+                            are_present[index] = std::all_of(
+                                bits.cbegin() + i, bits.cbegin() + i + hash_count,
+                                [](const int64_t bit) { return bit != 0; });
+                        }
+                    }
+                });
+        }
+
+        details::sync_commit(read_client_ptr);
+
+        if (is_failed) {
+            throw std::runtime_error("Unable to check bloom filter " + name);
+        }
+
+        return are_present;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::clear() -> bool {
+        const auto deleted = details::del_impl(client_ptr, name);
+        mark_write();
+        return deleted;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::get_bit_count() const noexcept -> uint64_t {
+        return bit_count;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::get_hash_count() const noexcept -> size_t {
+        return hash_count;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::get_name() const -> const std::string & {
+        return name;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::get_codec() const noexcept -> const Codec & {
+        return codec;
+    }
+
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter>
+    auto bloom<T, Codec>::positions_of(const TBeginIter &begin_it, const TEndIter &end_it) const
+        -> std::vector<uint64_t> {
+
+        std::vector<uint64_t> positions;
+
+        for (auto it = begin_it; it != end_it; ++it) {
+            details::bloom_positions(codec.encode(*it), bit_count, hash_count, positions);
+        }
+
+        return positions;
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::members_per_cmd() const noexcept -> size_t {
+        // keeps each command at about BITFIELD_BATCH bits, whatever k is
+        return std::max<size_t>(1, details::BITFIELD_BATCH / hash_count);
+    }
+
+    template <class T, class Codec>
+    auto bloom<T, Codec>::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    template <class T, class Codec>
+    void bloom<T, Codec>::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
+
+    namespace details {
+        inline auto bloom_bit_count(
+            const size_t expected_count,
+            const double false_positive_rate) noexcept -> uint64_t {
+
+            static const auto LN2_SQUARED = std::log(2.0) * std::log(2.0);
+
+            const auto n = static_cast<double>(std::max<size_t>(1, expected_count));
+            const auto p = std::min(std::max(false_positive_rate, 1e-12), 0.5);
+            const auto m = std::ceil(-n * std::log(p) / LN2_SQUARED);
+
+            return m >= static_cast<double>(BLOOM_MAX_BITS)
+                ? BLOOM_MAX_BITS
+                : std::max<uint64_t>(1, static_cast<uint64_t>(m));
+        }
+
+        inline auto bloom_hash_count(const uint64_t bit_count, const size_t expected_count)
+            noexcept -> size_t {
+
+            const auto n = static_cast<double>(std::max<size_t>(1, expected_count));
+            const auto k = std::round(static_cast<double>(bit_count) / n * std::log(2.0));
+
+            return std::max<size_t>(1, static_cast<size_t>(k));
+        }
+
+        inline void bloom_positions(
+            const std::string &member_str,
+            const uint64_t bit_count,
+            const size_t hash_count,
+            std::vector<uint64_t> &out) {
+
+            const auto h1 = murmur_hash64a(member_str.data(), member_str.size(), BLOOM_HASH_SEED_1);
+
+            // odd, so that the positions do not collapse when m is a power of 2
+            const auto h2 =
+                murmur_hash64a(member_str.data(), member_str.size(), BLOOM_HASH_SEED_2) | 1;
+
+            for (size_t i = 0; i < hash_count; ++i) {
+                out.push_back((h1 + i * h2) % bit_count);
+            }
+        }
+    }
+}
@@ -0,0 +1,478 @@
+/**
+ * Provides bulk loading of hash and set contents, which streams entries
+ * from a range or generator into multi-field HSET / multi-member SADD
+ * commands with bounded memory.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "hash.h"
+#include "router.h"
+#include "set.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Progress of a bulk load, reported after every sent chunk and at the end.
+     */
+    struct bulk_load_progress {
+        /** Number of entries acknowledged by the server. */
+        size_t entries;
+
+        /** Number of encoded bytes acknowledged by the server. */
+        size_t bytes;
+
+        /** Number of chunks acknowledged by the server. */
+        size_t chunks;
+
+        /** Number of chunks which the server replied with an error. */
+        size_t failed_chunks;
+
+        /** Time elapsed since the bulk load started. */
+        std::chrono::duration<double> elapsed;
+
+        /** @return acknowledged entries per second. */
+        auto entries_per_sec() const noexcept -> double;
+    };
+
+    /**
+     * Controls the chunking and backpressure of a bulk load.
+     */
+    struct bulk_load_options {
+        /** Encoded bytes per chunk, each chunk is sent as a single command. */
+        size_t chunk_bytes;
+
+        /**
+         * Maximum number of chunks sent but not acknowledged, which is also the
+         * maximum number of encoded chunks waiting to be sent.
+         */
+        size_t max_in_flight;
+
+        /** Called on the calling thread after every sent chunk, may be empty. */
+        std::function<void(const bulk_load_progress &)> on_progress;
+    };
+
+    /**
+     * @return defaults of 1 MiB per chunk with 8 chunks in flight, without progress reporting.
+     */
+    auto default_bulk_load_options() -> bulk_load_options;
+
+    /**
+     * Loads all the key value pairs in range into the hash.
+     * The range is iterated and encoded on a separate producer thread.
+     *
+     * @param h hash to load into
+     * @param begin_it begin iterator of std::pair<K, V> like entries
+     * @param end_it end iterator of std::pair<K, V> like entries
+     * @param options controls the chunking and backpressure
+     * @return final progress of the bulk load.
+     */
+    template <class K, class V, class Codec, class TBeginIter, class TEndIter,
+        class = details::iterator_category_t<TBeginIter>>
+    auto bulk_load(
+        hash<K, V, Codec> &h,
+        TBeginIter begin_it,
+        TEndIter end_it,
+        const bulk_load_options &options = default_bulk_load_options()) -> bulk_load_progress;
+
+    /**
+     * Loads all the key value pairs generated into the hash.
+     * The generator is called and encoded on a separate producer thread.
+     *
+     * @param h hash to load into
+     * @param gen called for each entry, returns Some(std::pair<K, V>) or None to end
+     * @param options controls the chunking and backpressure
+     * @return final progress of the bulk load.
+     */
+    template <class K, class V, class Codec, class Gen>
+    auto bulk_load(
+        hash<K, V, Codec> &h,
+        Gen gen,
+        const bulk_load_options &options = default_bulk_load_options()) -> bulk_load_progress;
+
+    /**
+     * Loads all the members in range into the set.
+     * The range is iterated and encoded on a separate producer thread.
+     *
+     * @param s set to load into
+     * @param begin_it begin iterator of members
+     * @param end_it end iterator of members
+     * @param options controls the chunking and backpressure
+     * @return final progress of the bulk load.
+     */
+    template <class T, class Codec, class TBeginIter, class TEndIter,
+        class = details::iterator_category_t<TBeginIter>>
+    auto bulk_load(
+        set<T, Codec> &s,
+        TBeginIter begin_it,
+        TEndIter end_it,
+        const bulk_load_options &options = default_bulk_load_options()) -> bulk_load_progress;
+
+    /**
+     * Loads all the members generated into the set.
+     * The generator is called and encoded on a separate producer thread.
+     *
+     * @param s set to load into
+     * @param gen called for each member, returns Some(member) or None to end
+     * @param options controls the chunking and backpressure
+     * @return final progress of the bulk load.
+     */
+    template <class T, class Codec, class Gen>
+    auto bulk_load(
+        set<T, Codec> &s,
+        Gen gen,
+        const bulk_load_options &options = default_bulk_load_options()) -> bulk_load_progress;
+
+    namespace details {
+        /**
+         * Bulk load implementation, where encoding runs on a producer thread and
+         * sending runs on the calling thread.
+         *
+         * @param client_ptr client to send the chunks with
+         * @param router_ptr router whose read-your-writes window starts once loaded,
+         * null if not routed
+         * @param prefix command name and key, in front of every chunk
+         * @param next_entry appends the next encoded entry into the given command and
+         * adds its encoded size to the given byte count, returns false when there are no more entries
+         * @param options controls the chunking and backpressure
+         * @return final progress of the bulk load.
+         */
+        template <class NextEntry>
+        auto bulk_load_impl(
+            const redis_client_ptr &client_ptr,
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::vector<std::string> &prefix,
+            NextEntry next_entry,
+            const bulk_load_options &options) -> bulk_load_progress;
+    }
+
+    // implementation section
+
+    inline auto bulk_load_progress::entries_per_sec() const noexcept -> double {
+        return elapsed.count() > 0.0
+            ? static_cast<double>(entries) / elapsed.count()
+            : 0.0;
+    }
+
+    inline auto default_bulk_load_options() -> bulk_load_options {
+        static constexpr size_t DEFAULT_CHUNK_BYTES = 1024 * 1024;
+        static constexpr size_t DEFAULT_MAX_IN_FLIGHT = 8;
+
+        return bulk_load_options{DEFAULT_CHUNK_BYTES, DEFAULT_MAX_IN_FLIGHT, nullptr};
+    }
+
+    template <class K, class V, class Codec, class TBeginIter, class TEndIter, class>
+    auto bulk_load(
+        hash<K, V, Codec> &h,
+        TBeginIter begin_it,
+        TEndIter end_it,
+        const bulk_load_options &options) -> bulk_load_progress {
+
+        const auto &codec = h.get_codec();
+
+        return details::bulk_load_impl(
+            h.get_client_ptr(),
+            h.get_router_ptr(),
+            {"HSET", h.get_name()},
+            [&begin_it, &end_it, &codec](std::vector<std::string> &cmd, size_t &bytes) {
+                if (begin_it == end_it) {
+                    return false;
+                }
+
+                cmd.push_back(details::encode_into_str(details::as_member<K>(begin_it->first)));
+                cmd.push_back(codec.encode(details::as_member<V>(begin_it->second)));
+                bytes += cmd[cmd.size() - 2].size() + cmd.back().size();
+                ++begin_it;
+
+                return true;
+            },
+            options);
+    }
+
+    template <class K, class V, class Codec, class Gen>
+    auto bulk_load(
+        hash<K, V, Codec> &h,
+        Gen gen,
+        const bulk_load_options &options) -> bulk_load_progress {
+
+        const auto &codec = h.get_codec();
+
+        return details::bulk_load_impl(
+            h.get_client_ptr(),
+            h.get_router_ptr(),
+            {"HSET", h.get_name()},
+            [&gen, &codec](std::vector<std::string> &cmd, size_t &bytes) {
+                auto has_entry = false;
+
+                gen().match_some(
+                    [&cmd, &bytes, &has_entry, &codec](std::pair<K, V> &&entry) {
+                        cmd.push_back(details::encode_into_str(entry.first));
+                        cmd.push_back(codec.encode(entry.second));
+                        bytes += cmd[cmd.size() - 2].size() + cmd.back().size();
+                        has_entry = true;
+                    });
+
+                return has_entry;
+            },
+            options);
+    }
+
+    template <class T, class Codec, class TBeginIter, class TEndIter, class>
+    auto bulk_load(
+        set<T, Codec> &s,
+        TBeginIter begin_it,
+        TEndIter end_it,
+        const bulk_load_options &options) -> bulk_load_progress {
+
+        const auto &codec = s.get_codec();
+
+        return details::bulk_load_impl(
+            s.get_client_ptr(),
+            s.get_router_ptr(),
+            {"SADD", s.get_name()},
+            [&begin_it, &end_it, &codec](std::vector<std::string> &cmd, size_t &bytes) {
+                if (begin_it == end_it) {
+                    return false;
+                }
+
+                cmd.push_back(codec.encode(details::as_member<T>(*begin_it)));
+                bytes += cmd.back().size();
+                ++begin_it;
+
+                return true;
+            },
+            options);
+    }
+
+    template <class T, class Codec, class Gen>
+    auto bulk_load(
+        set<T, Codec> &s,
+        Gen gen,
+        const bulk_load_options &options) -> bulk_load_progress {
+
+        const auto &codec = s.get_codec();
+
+        return details::bulk_load_impl(
+            s.get_client_ptr(),
+            s.get_router_ptr(),
+            {"SADD", s.get_name()},
+            [&gen, &codec](std::vector<std::string> &cmd, size_t &bytes) {
+                auto has_entry = false;
+
+                gen().match_some(
+                    [&cmd, &bytes, &has_entry, &codec](T &&member) {
+                        cmd.push_back(codec.encode(member));
+                        bytes += cmd.back().size();
+                        has_entry = true;
+                    });
+
+                return has_entry;
+            },
+            options);
+    }
+
+    namespace details {
+        template <class NextEntry>
+        auto bulk_load_impl(
+            const redis_client_ptr &client_ptr,
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::vector<std::string> &prefix,
+            NextEntry next_entry,
+            const bulk_load_options &options) -> bulk_load_progress {
+
+            using clock = std::chrono::steady_clock;
+
+            /** Encoded command ready to be sent. */
+            struct chunk {
+                std::vector<std::string> cmd;
+                size_t entries;
+                size_t bytes;
+            };
+
+            /**
+             * State shared with the reply callbacks, which are owned by the client
+             * and may outlive this call if it unwinds with chunks still in flight.
+             */
+            struct shared_state {
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::deque<chunk> ready;
+                size_t in_flight;
+                bool is_produced;
+                bool is_stopping;
+                bulk_load_progress progress;
+            };
+
+            const auto chunk_bytes = std::max<size_t>(1, options.chunk_bytes);
+            const auto max_in_flight = std::max<size_t>(1, options.max_in_flight);
+            const auto start = clock::now();
+
+            const auto state_ptr = std::make_shared<shared_state>();
+            auto &state = *state_ptr;
+            state.in_flight = 0;
+            state.is_produced = false;
+            state.is_stopping = false;
+            state.progress = bulk_load_progress{0, 0, 0, 0, std::chrono::duration<double>(0)};
+
+            std::exception_ptr producer_error;
+
+            // encodes in the background, blocking while too many chunks are waiting to be sent
+            std::thread producer([&] {
+                try {
+                    while (true) {
+                        chunk c{prefix, 0, 0};
+
+                        while (c.bytes < chunk_bytes && next_entry(c.cmd, c.bytes)) {
+                            ++c.entries;
+                        }
+
+                        if (c.entries == 0) {
+                            break;
+                        }
+
+                        std::unique_lock<std::mutex> lock(state.mutex);
+
+                        state.cv.wait(lock, [&] {
+                            return state.ready.size() < max_in_flight || state.is_stopping;
+                        });
+
+                        if (state.is_stopping) {
+                            break;
+                        }
+
+                        state.ready.push_back(std::move(c));
+                        state.cv.notify_all();
+                    }
+                }
+                catch (...) {
+                    producer_error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.is_produced = true;
+                state.cv.notify_all();
+            });
+
+            const auto stop_producer = [&state, &producer] {
+                {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    state.is_stopping = true;
+                }
+
+                state.cv.notify_all();
+                producer.join();
+            };
+
+            // the chunks sent so far may already be written, even if the load fails
+            const auto mark_write = [&router_ptr] {
+                if (router_ptr) {
+                    router_ptr->mark_write();
+                }
+            };
+
+            try {
+                // sends on the calling thread, blocking while too many chunks are not acknowledged
+                while (true) {
+                    std::unique_lock<std::mutex> lock(state.mutex);
+
+                    state.cv.wait(lock, [&] {
+                        return (!state.ready.empty() && state.in_flight < max_in_flight)
+                            || (state.ready.empty() && state.is_produced);
+                    });
+
+                    if (state.ready.empty()) {
+                        break;
+                    }
+
+                    auto c = std::move(state.ready.front());
+                    state.ready.pop_front();
+                    ++state.in_flight;
+                    state.cv.notify_all();
+                    lock.unlock();
+
+                    const auto entries = c.entries;
+                    const auto bytes = c.bytes;
+
+                    client_ptr->send(c.cmd,
+                        [state_ptr, entries, bytes](cpp_redis::reply &r) {
+                            std::lock_guard<std::mutex> lock(state_ptr->mutex);
+                            --state_ptr->in_flight;
+                            ++state_ptr->progress.chunks;
+
+                            if (r.is_error()) {
+                                ++state_ptr->progress.failed_chunks;
+                            }
+                            else {
+                                state_ptr->progress.entries += entries;
+                                state_ptr->progress.bytes += bytes;
+                            }
+
+                            state_ptr->cv.notify_all();
+                        });
+
+                    client_ptr->commit();
+
+                    if (options.on_progress) {
+                        lock.lock();
+                        auto snapshot = state.progress;
+                        lock.unlock();
+
+                        snapshot.elapsed = clock::now() - start;
+                        options.on_progress(snapshot);
+                    }
+                }
+            }
+            catch (...) {
+                // the callbacks still in flight only touch the shared state
+                stop_producer();
+                mark_write();
+                throw;
+            }
+
+            producer.join();
+
+            // waits for the remaining acknowledgements
+            client_ptr->sync_commit();
+            mark_write();
+
+            if (producer_error) {
+                std::rethrow_exception(producer_error);
+            }
+
+            std::unique_lock<std::mutex> lock(state.mutex);
+            auto progress = state.progress;
+            lock.unlock();
+
+            progress.elapsed = clock::now() - start;
+
+            if (options.on_progress) {
+                options.on_progress(progress);
+            }
+
+            return progress;
+        }
+    }
+}
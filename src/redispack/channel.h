@@ -0,0 +1,544 @@
+/**
+ * Provides typed publish / subscribe channels from redis, where the
+ * messages are stored with a codec, and a bounded lock-free ring buffer
+ * to hand the received messages over to worker threads.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    namespace details {
+        /** Assumed size of a cache line, to pad the hot atomic counters apart. */
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        /**
+         * @return smallest power of 2 not less than the value, at least 1.
+         */
+        auto round_up_pow2(const size_t value) noexcept -> size_t;
+    }
+
+    /**
+     * Selects which publish command the channel uses.
+     */
+    enum class channel_scope {
+        /** PUBLISH, which every node of a cluster forwards to its subscribers. */
+        global,
+
+        /** SPUBLISH, which stays within the shard owning the channel, requires Redis 7.0. */
+        sharded,
+    };
+
+    /**
+     * Single message received from a channel.
+     */
+    template <class T>
+    struct channel_message {
+        /** Channel the message was published to. */
+        std::string channel;
+
+        /** Decoded value. */
+        T value;
+    };
+
+    /**
+     * Publishes typed messages onto a channel.
+     *
+     * Each message is stored with the Codec.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class channel {
+    public:
+        /** Alias to the T template type, which is the message type. */
+        using value_t = T;
+
+        /** Alias to the Codec template type, which stores the messages. */
+        using codec_t = Codec;
+
+        /**
+         * Constructs this instance with the given client connection and channel name.
+         */
+        channel(
+            const redis_client_ptr &client_ptr,
+            const std::string &name,
+            const channel_scope scope = channel_scope::global,
+            const Codec &codec = Codec());
+
+        /**
+         * publish / spublish
+         * @param value message to publish
+         * @return number of subscribers which received the message.
+         */
+        auto publish(const T &value) -> size_t;
+
+        /**
+         * publish / spublish for every value, pipelined into a single round trip.
+         * @param begin_it begin iterator of messages to publish
+         * @param end_it end iterator of messages to publish
+         * @return total number of deliveries across the messages.
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto publish_many(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
+
+        /**
+         * @return client used to access the database.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return channel name.
+         */
+        auto get_name() const -> const std::string &;
+
+        /**
+         * @return which publish command the channel uses.
+         */
+        auto get_scope() const noexcept -> channel_scope;
+
+        /**
+         * @return codec used to store the messages.
+         */
+        auto get_codec() const noexcept -> const Codec &;
+
+    private:
+        /** Holds a shared ownership to access the database. */
+        redis_client_ptr client_ptr;
+
+        /** Channel name. */
+        std::string name;
+
+        /** Selects which publish command the channel uses. */
+        channel_scope scope;
+
+        /** Stores the messages. */
+        Codec codec;
+    };
+
+    /**
+     * Bounded multi-producer multi-consumer queue, which never takes a lock.
+     *
+     * Each cell carries a sequence number, so that a producer and a consumer
+     * only ever contend on the position counters and never on the same cell.
+     */
+    template <class T>
+    class message_ring {
+    public:
+        /**
+         * Constructs the ring.
+         * @param capacity maximum number of queued values, rounded up to a power of 2
+         */
+        explicit message_ring(const size_t capacity);
+
+        message_ring(const message_ring &) = delete;
+        auto operator=(const message_ring &) -> message_ring & = delete;
+
+        /**
+         * Queues the value if there is space left.
+         * Thread-safe.
+         *
+         * @return true if queued, false if the ring is full.
+         */
+        auto try_push(T &&value) -> bool;
+
+        /**
+         * Takes the oldest value if any.
+         * Thread-safe.
+         *
+         * @return Some(value) if the ring was not empty, otherwise None.
+         */
+        auto try_pop() -> rustfp::Option<T>;
+
+        /**
+         * @return maximum number of queued values.
+         */
+        auto capacity() const noexcept -> size_t;
+
+    private:
+        /** Single slot of the ring. */
+        struct cell {
+            /** Position the cell is ready for, to be pushed into or popped from. */
+            std::atomic<size_t> sequence;
+
+            /** Queued value. */
+            T value;
+        };
+
+        /** Slots of the ring. */
+        std::vector<cell> cells;
+
+        /** Capacity - 1, to wrap the positions around. */
+        size_t mask;
+
+        /** Keeps the producers' counter away from the consumers' cache line. */
+        char enqueue_pad[details::CACHE_LINE_SIZE];
+
+        /** Position of the next push. */
+        std::atomic<size_t> enqueue_pos;
+
+        /** Keeps the consumers' counter away from the producers' cache line. */
+        char dequeue_pad[details::CACHE_LINE_SIZE];
+
+        /** Position of the next pop. */
+        std::atomic<size_t> dequeue_pos;
+    };
+
+    /**
+     * Receives typed messages on a dedicated subscriber connection.
+     *
+     * The callbacks run on the network thread of the subscriber, and should
+     * hand the work over (e.g. to a message_ring) rather than do it in place.
+     * Messages which fail to decode are skipped.
+     *
+     * Sharded channels cannot be subscribed to, since the subscriber only
+     * understands the message and pmessage replies.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class channel_subscriber {
+    public:
+        /** Alias to the ring which receives the messages. */
+        using ring_ptr = std::shared_ptr<message_ring<channel_message<T>>>;
+
+        /**
+         * Constructs this instance with the given subscriber connection,
+         * which should not be shared with other channel_subscriber instances.
+         */
+        explicit channel_subscriber(
+            const redis_subscriber_ptr &subscriber_ptr,
+            const Codec &codec = Codec());
+
+        /**
+         * subscribe
+         * @param name channel name
+         * @param callback callback taking channel_message<T> &&
+         */
+        template <class F>
+        void subscribe(const std::string &name, F &&callback);
+
+        /**
+         * subscribe, pushing the messages into the ring, and dropping them if full.
+         * @param name channel name
+         * @param ring ring consumed by the worker threads
+         */
+        void subscribe_into(const std::string &name, const ring_ptr &ring);
+
+        /**
+         * psubscribe
+         * @param pattern glob-style pattern of channel names
+         * @param callback callback taking channel_message<T> &&
+         */
+        template <class F>
+        void psubscribe(const std::string &pattern, F &&callback);
+
+        /**
+         * psubscribe, pushing the messages into the ring, and dropping them if full.
+         * @param pattern glob-style pattern of channel names
+         * @param ring ring consumed by the worker threads
+         */
+        void psubscribe_into(const std::string &pattern, const ring_ptr &ring);
+
+        /**
+         * unsubscribe
+         * @param name channel name
+         */
+        void unsubscribe(const std::string &name);
+
+        /**
+         * punsubscribe
+         * @param pattern glob-style pattern of channel names
+         */
+        void punsubscribe(const std::string &pattern);
+
+        /**
+         * @return number of messages dropped because their ring was full.
+         */
+        auto get_dropped_count() const noexcept -> size_t;
+
+        /**
+         * @return subscriber connection.
+         */
+        auto get_subscriber_ptr() const -> const redis_subscriber_ptr &;
+
+    private:
+        /**
+         * @return subscriber callback which decodes the message for the given callback.
+         */
+        template <class F>
+        auto decoding_callback(F &&callback) const
+            -> redis_subscriber::subscribe_callback_t;
+
+        /**
+         * @return callback which pushes the message into the ring.
+         */
+        auto ring_callback(const ring_ptr &ring) const
+            -> std::function<void(channel_message<T> &&)>;
+
+        /** Holds a shared ownership to the subscriber connection. */
+        redis_subscriber_ptr subscriber_ptr;
+
+        /** Stores the messages. */
+        Codec codec;
+
+        /** Shared with the callbacks, which may outlive this instance. */
+        std::shared_ptr<std::atomic<size_t>> dropped_count_ptr;
+    };
+
+    // implementation section
+
+    template <class T, class Codec>
+    channel<T, Codec>::channel(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const channel_scope scope,
+        const Codec &codec) :
+
+        client_ptr(client_ptr),
+        name(name),
+        scope(scope),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    auto channel<T, Codec>::publish(const T &value) -> size_t {
+        return publish_many(&value, &value + 1);
+    }
+
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto channel<T, Codec>::publish_many(const TBeginIter &begin_it, const TEndIter &end_it)
+        -> size_t {
+
+        const auto cmd_name = scope == channel_scope::sharded ? "SPUBLISH" : "PUBLISH";
+        size_t delivered_count = 0;
+
+        for (auto it = begin_it; it != end_it; ++it) {
+            client_ptr->send({cmd_name, name, codec.encode(*it)},
+                [&delivered_count](cpp_redis::reply &r) {
+                    if (r.is_integer()) {
+                        delivered_count += static_cast<size_t>(r.as_integer());
+                    }
+                });
+        }
+
+        // all the messages travel in a single round trip
+        details::sync_commit(client_ptr);
+        return delivered_count;
+    }
+
+    template <class T, class Codec>
+    auto channel<T, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class T, class Codec>
+    auto channel<T, Codec>::get_name() const -> const std::string & {
+        return name;
+    }
+
+    template <class T, class Codec>
+    auto channel<T, Codec>::get_scope() const noexcept -> channel_scope {
+        return scope;
+    }
+
+    template <class T, class Codec>
+    auto channel<T, Codec>::get_codec() const noexcept -> const Codec & {
+        return codec;
+    }
+
+    template <class T>
+    message_ring<T>::message_ring(const size_t capacity) :
+        cells(details::round_up_pow2(capacity)),
+        mask(cells.size() - 1),
+        enqueue_pos(0),
+        dequeue_pos(0) {
+
+        for (size_t i = 0; i < cells.size(); ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template <class T>
+    auto message_ring<T>::try_push(T &&value) -> bool {
+        auto pos = enqueue_pos.load(std::memory_order_relaxed);
+
+        while (true) {
+            auto &c = cells[pos & mask];
+            const auto seq = c.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+            if (diff == 0) {
+                // claims the cell, a failed exchange reloads pos with the current position
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(value);
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                // the cell still holds the value from one lap ago
+                return false;
+            }
+            else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template <class T>
+    auto message_ring<T>::try_pop() -> rustfp::Option<T> {
+        auto pos = dequeue_pos.load(std::memory_order_relaxed);
+
+        while (true) {
+            auto &c = cells[pos & mask];
+            const auto seq = c.sequence.load(std::memory_order_acquire);
+
+            const auto diff =
+                static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    auto value = std::move(c.value);
+
+                    // frees the cell for the push one lap ahead
+                    c.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return rustfp::Some(std::move(value));
+                }
+            }
+            else if (diff < 0) {
+                return rustfp::None;
+            }
+            else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template <class T>
+    auto message_ring<T>::capacity() const noexcept -> size_t {
+        return cells.size();
+    }
+
+    template <class T, class Codec>
+    channel_subscriber<T, Codec>::channel_subscriber(
+        const redis_subscriber_ptr &subscriber_ptr,
+        const Codec &codec) :
+
+        subscriber_ptr(subscriber_ptr),
+        codec(codec),
+        dropped_count_ptr(std::make_shared<std::atomic<size_t>>(0)) {
+
+    }
+
+    template <class T, class Codec>
+    template <class F>
+    void channel_subscriber<T, Codec>::subscribe(const std::string &name, F &&callback) {
+        subscriber_ptr->subscribe(name, decoding_callback(std::forward<F>(callback)));
+        subscriber_ptr->commit();
+    }
+
+    template <class T, class Codec>
+    void channel_subscriber<T, Codec>::subscribe_into(
+        const std::string &name,
+        const ring_ptr &ring) {
+
+        subscribe(name, ring_callback(ring));
+    }
+
+    template <class T, class Codec>
+    template <class F>
+    void channel_subscriber<T, Codec>::psubscribe(const std::string &pattern, F &&callback) {
+        subscriber_ptr->psubscribe(pattern, decoding_callback(std::forward<F>(callback)));
+        subscriber_ptr->commit();
+    }
+
+    template <class T, class Codec>
+    void channel_subscriber<T, Codec>::psubscribe_into(
+        const std::string &pattern,
+        const ring_ptr &ring) {
+
+        psubscribe(pattern, ring_callback(ring));
+    }
+
+    template <class T, class Codec>
+    void channel_subscriber<T, Codec>::unsubscribe(const std::string &name) {
+        subscriber_ptr->unsubscribe(name);
+        subscriber_ptr->commit();
+    }
+
+    template <class T, class Codec>
+    void channel_subscriber<T, Codec>::punsubscribe(const std::string &pattern) {
+        subscriber_ptr->punsubscribe(pattern);
+        subscriber_ptr->commit();
+    }
+
+    template <class T, class Codec>
+    auto channel_subscriber<T, Codec>::get_dropped_count() const noexcept -> size_t {
+        return dropped_count_ptr->load(std::memory_order_relaxed);
+    }
+
+    template <class T, class Codec>
+    auto channel_subscriber<T, Codec>::get_subscriber_ptr() const -> const redis_subscriber_ptr & {
+        return subscriber_ptr;
+    }
+
+    template <class T, class Codec>
+    template <class F>
+    auto channel_subscriber<T, Codec>::decoding_callback(F &&callback) const
+        -> redis_subscriber::subscribe_callback_t {
+
+        // copies everything it needs, since it runs on the network thread
+        return [codec = codec, callback = std::forward<F>(callback)](
+            const std::string &name, const std::string &msg) mutable {
+
+            auto value_opt = codec.template decode<T>(msg.data(), msg.size());
+
+            std::move(value_opt).match_some(
+                [&callback, &name](T &&value) {
+                    callback(channel_message<T>{name, std::move(value)});
+                });
+        };
+    }
+
+    template <class T, class Codec>
+    auto channel_subscriber<T, Codec>::ring_callback(const ring_ptr &ring) const
+        -> std::function<void(channel_message<T> &&)> {
+
+        return [ring, dropped_count_ptr = dropped_count_ptr](channel_message<T> &&msg) {
+            if (!ring->try_push(std::move(msg))) {
+                dropped_count_ptr->fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+    }
+
+    namespace details {
+        inline auto round_up_pow2(const size_t value) noexcept -> size_t {
+            size_t pow2 = 1;
+
+            while (pow2 < value) {
+                pow2 <<= 1;
+            }
+
+            return pow2;
+        }
+    }
+}
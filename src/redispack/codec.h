@@ -0,0 +1,368 @@
+/**
+ * Provides the codecs which turn container values into the bytes stored
+ * in the redis server and back.
+ *
+ * Compressed values are framed as:
+ * marker (0xc1) | dictionary id | raw size (LEB128) | LZ block
+ *
+ * The marker byte is never used by msgpack, so compressed and plain msgpack
+ * values can coexist in the same container.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "lz.h"
+#include "util.h"
+
+#include "rustfp/option.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Default codec, which stores values as plain msgpack.
+     */
+    struct msgpack_codec {
+        /** @return value encoded as msgpack. */
+        template <class V>
+        auto encode(const V &value) const -> std::string;
+
+        /** @return Some(value) decoded from msgpack, otherwise None. */
+        template <class V>
+        auto decode(const char *data, const size_t size) const -> rustfp::Option<V>;
+    };
+
+    /**
+     * Codec which stores integers as plain decimal strings instead of msgpack,
+     * which Redis keeps as native integers, e.g. so that a set of integers can use
+     * the compact intset encoding, and which also allows INCRBY and HINCRBY.
+     */
+    struct integer_codec {
+        /** @return integer as a decimal string. */
+        template <class V>
+        auto encode(const V &value) const -> std::string;
+
+        /** @return Some(value) parsed from the decimal string if it fits in V, otherwise None. */
+        template <class V>
+        auto decode(const char *data, const size_t size) const -> rustfp::Option<V>;
+    };
+
+    /**
+     * Codec which compresses the msgpack encoded values from a size threshold,
+     * and stores smaller values as plain msgpack.
+     *
+     * Values are only stored compressed if that actually makes them smaller.
+     */
+    class lz_codec {
+    public:
+        /** Default encoded size from which values are compressed. */
+        static constexpr size_t DEFAULT_THRESHOLD = 512;
+
+        /**
+         * Constructs the codec with the given threshold.
+         *
+         * @param threshold encoded size from which values are compressed
+         */
+        explicit lz_codec(const size_t threshold = DEFAULT_THRESHOLD) noexcept;
+
+        /** @return value encoded as msgpack, compressed if at least the threshold. */
+        template <class V>
+        auto encode(const V &value) const -> std::string;
+
+        /** @return Some(value) decoded from either compressed or plain msgpack, otherwise None. */
+        template <class V>
+        auto decode(const char *data, const size_t size) const -> rustfp::Option<V>;
+
+        /** @return encoded size from which values are compressed. */
+        auto get_threshold() const noexcept -> size_t;
+
+    private:
+        /** Encoded size from which values are compressed. */
+        size_t threshold;
+    };
+
+    namespace details {
+        /** First byte of a compressed value, which msgpack never uses. */
+        static constexpr unsigned char CODEC_MARKER = 0xc1;
+
+        /** Dictionary id of values compressed without a dictionary. */
+        static constexpr unsigned char NO_DICTIONARY_ID = 0;
+
+        /** @return true if the bytes are a compressed frame. */
+        auto is_compressed(const char *data, const size_t size) noexcept -> bool;
+
+        /**
+         * @return the dictionary id of a compressed frame.
+         */
+        auto compressed_dictionary_id(const char *data) noexcept -> unsigned char;
+
+        /**
+         * Compresses the raw bytes into a frame, only if the frame turns out smaller.
+         *
+         * @param raw bytes to compress
+         * @param dict_id dictionary id to tag the frame with
+         * @param dict_ptr dictionary to compress against, null if none
+         * @return the frame, or the raw bytes as-is if compressing does not help.
+         */
+        auto compress_frame(
+            std::string raw,
+            const unsigned char dict_id,
+            const lz::dictionary *dict_ptr) -> std::string;
+
+        /**
+         * Decompresses a frame into out, which is overwritten.
+         *
+         * @param data frame bytes
+         * @param size frame size
+         * @param out string to decompress into
+         * @param dict_ptr dictionary the frame was compressed against, null if none
+         * @return false if the frame is corrupted.
+         */
+        auto decompress_frame(
+            const char *data,
+            const size_t size,
+            std::string &out,
+            const lz::dictionary *dict_ptr) -> bool;
+
+        /**
+         * Parses an optionally negative decimal integer, which must fit in V.
+         * @return false if the bytes are not such an integer.
+         */
+        template <class V>
+        auto parse_decimal(const char *data, const size_t size, V &value) noexcept -> bool;
+
+        /** Appends the value as LEB128. */
+        void append_varint(std::string &out, uint64_t value);
+
+        /**
+         * Reads a LEB128 value, advancing the position.
+         * @return false if the input ends before the value does.
+         */
+        auto read_varint(const char *&pos, const char *end, uint64_t &value) noexcept -> bool;
+    }
+
+    // implementation section
+
+    template <class V>
+    auto msgpack_codec::encode(const V &value) const -> std::string {
+        return details::encode_into_str(value);
+    }
+
+    template <class V>
+    auto msgpack_codec::decode(const char *data, const size_t size) const -> rustfp::Option<V> {
+        return details::decode_from_str<V>(data, size);
+    }
+
+    template <class V>
+    auto integer_codec::encode(const V &value) const -> std::string {
+        static_assert(std::is_integral<V>::value && !std::is_same<V, bool>::value,
+            "integer_codec only stores integer types");
+
+        return std::to_string(value);
+    }
+
+    template <class V>
+    auto integer_codec::decode(const char *data, const size_t size) const -> rustfp::Option<V> {
+        static_assert(std::is_integral<V>::value && !std::is_same<V, bool>::value,
+            "integer_codec only stores integer types");
+
+        V value;
+
+        if (!details::parse_decimal(data, size, value)) {
+            return rustfp::None;
+        }
+
+        return rustfp::Some(value);
+    }
+
+    inline lz_codec::lz_codec(const size_t threshold) noexcept :
+        threshold(threshold) {
+
+    }
+
+    template <class V>
+    auto lz_codec::encode(const V &value) const -> std::string {
+        auto raw = details::encode_into_str(value);
+
+        if (raw.size() < threshold) {
+            return raw;
+        }
+
+        return details::compress_frame(std::move(raw), details::NO_DICTIONARY_ID, nullptr);
+    }
+
+    template <class V>
+    auto lz_codec::decode(const char *data, const size_t size) const -> rustfp::Option<V> {
+        if (!details::is_compressed(data, size)) {
+            return details::decode_from_str<V>(data, size);
+        }
+
+        // reuses the decompression buffer across calls
+        thread_local std::string raw;
+
+        if (details::compressed_dictionary_id(data) != details::NO_DICTIONARY_ID
+            || !details::decompress_frame(data, size, raw, nullptr)) {
+
+            return rustfp::None;
+        }
+
+        return details::decode_from_str<V>(raw.data(), raw.size());
+    }
+
+    inline auto lz_codec::get_threshold() const noexcept -> size_t {
+        return threshold;
+    }
+
+    namespace details {
+        inline auto is_compressed(const char *data, const size_t size) noexcept -> bool {
+            return size >= 2 && static_cast<unsigned char>(data[0]) == CODEC_MARKER;
+        }
+
+        inline auto compressed_dictionary_id(const char *data) noexcept -> unsigned char {
+            return static_cast<unsigned char>(data[1]);
+        }
+
+        inline auto compress_frame(
+            std::string raw,
+            const unsigned char dict_id,
+            const lz::dictionary *dict_ptr) -> std::string {
+
+            std::string frame;
+            frame.push_back(static_cast<char>(CODEC_MARKER));
+            frame.push_back(static_cast<char>(dict_id));
+            append_varint(frame, raw.size());
+
+            if (dict_ptr) {
+                lz::compress(raw.data(), raw.size(), frame, *dict_ptr);
+            }
+            else {
+                lz::compress(raw.data(), raw.size(), frame);
+            }
+
+            return frame.size() < raw.size() ? frame : raw;
+        }
+
+        inline auto decompress_frame(
+            const char *data,
+            const size_t size,
+            std::string &out,
+            const lz::dictionary *dict_ptr) -> bool {
+
+            static constexpr size_t HEADER_SIZE = 2;
+
+            auto pos = data + HEADER_SIZE;
+            const auto end = data + size;
+            uint64_t raw_size = 0;
+
+            if (!read_varint(pos, end, raw_size)) {
+                return false;
+            }
+
+            out.clear();
+
+            if (!dict_ptr) {
+                return lz::decompress(
+                    pos, static_cast<size_t>(end - pos), static_cast<size_t>(raw_size), out);
+            }
+
+            const auto &dict = dict_ptr->get_bytes();
+
+            return lz::decompress(
+                pos, static_cast<size_t>(end - pos), static_cast<size_t>(raw_size),
+                out, dict.data(), dict.size());
+        }
+
+        template <class V>
+        auto parse_decimal(const char *data, const size_t size, V &value) noexcept -> bool {
+            static constexpr uint64_t MAX_U64 = std::numeric_limits<uint64_t>::max();
+
+            const auto is_negative = size > 0 && data[0] == '-';
+            const size_t start = is_negative ? 1 : 0;
+
+            if (size == start || (is_negative && !std::is_signed<V>::value)) {
+                return false;
+            }
+
+            uint64_t magnitude = 0;
+
+            for (auto i = start; i < size; ++i) {
+                if (data[i] < '0' || data[i] > '9') {
+                    return false;
+                }
+
+                const auto digit = static_cast<uint64_t>(data[i] - '0');
+
+                if (magnitude > (MAX_U64 - digit) / 10) {
+                    return false;
+                }
+
+                magnitude = magnitude * 10 + digit;
+            }
+
+            const auto max = static_cast<uint64_t>(std::numeric_limits<V>::max());
+
+            if (!is_negative) {
+                if (magnitude > max) {
+                    return false;
+                }
+
+                value = static_cast<V>(magnitude);
+                return true;
+            }
+
+            // the most negative value has one more magnitude than the maximum
+            if (magnitude > max + 1) {
+                return false;
+            }
+
+            value = magnitude == 0
+                ? static_cast<V>(0)
+                : static_cast<V>(-static_cast<V>(magnitude - 1) - 1);
+
+            return true;
+        }
+
+        inline void append_varint(std::string &out, uint64_t value) {
+            static constexpr uint64_t LOW_BITS = 0x7f;
+            static constexpr uint64_t MORE_BIT = 0x80;
+
+            while (value > LOW_BITS) {
+                out.push_back(static_cast<char>((value & LOW_BITS) | MORE_BIT));
+                value >>= 7;
+            }
+
+            out.push_back(static_cast<char>(value));
+        }
+
+        inline auto read_varint(const char *&pos, const char *end, uint64_t &value) noexcept
+            -> bool {
+
+            static constexpr uint64_t LOW_BITS = 0x7f;
+            static constexpr uint64_t MORE_BIT = 0x80;
+            static constexpr unsigned MAX_SHIFT = 63;
+
+            value = 0;
+
+            for (unsigned shift = 0; pos < end && shift <= MAX_SHIFT; shift += 7) {
+                const auto b = static_cast<unsigned char>(*pos++);
+                value |= (b & LOW_BITS) << shift;
+
+                if (!(b & MORE_BIT)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    }
+}
@@ -15,6 +15,8 @@
 #include <cstddef>
 #include <exception>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 
 namespace redispack {
@@ -24,8 +26,63 @@ namespace redispack {
     namespace details {
         static constexpr auto DEFAULT_HOST = "127.0.0.1";
         static constexpr auto DEFAULT_PORT = 6379;
+
+        /** Port which makes tacopie connect to the host as a unix socket path. */
+        static constexpr size_t UNIX_SOCKET_PORT = 0;
+
+        /** Largest valid tcp port. */
+        static constexpr size_t MAX_PORT = 65535;
+
+        /**
+         * Guards swapping the default io_service while a connection binds to a reactor.
+         */
+        auto reactor_bind_mutex() -> std::mutex &;
+
+        /**
+         * Constructs the client or subscriber under reactor_bind_mutex, since tacopie binds
+         * it to the default io_service, which may be swapped to a reactor meanwhile.
+         */
+        template <class Client>
+        auto make_default_bound() -> std::shared_ptr<Client>;
+
+        /**
+         * Connects the client or subscriber to the endpoint of the uri.
+         * @return connected client or subscriber, or the parsing or connection error.
+         */
+        template <class Client>
+        auto make_and_connect_uri_impl(const std::string &uri) noexcept
+            -> rustfp::Result<std::shared_ptr<Client>, std::unique_ptr<std::exception>>;
     }
 
+    /**
+     * Address of a server, either over tcp or over a unix socket.
+     */
+    struct endpoint {
+        /** Hostname of the server, or path of the socket if a unix socket. */
+        std::string host;
+
+        /** Port of the server, 0 if a unix socket. */
+        size_t port;
+
+        /**
+         * @return true if the endpoint is a unix socket.
+         */
+        auto is_unix_socket() const noexcept -> bool;
+    };
+
+    /**
+     * Parses the server address, which may be any of:
+     * - redis://host[:port] or tcp://host[:port], with [ipv6] hosts in brackets
+     * - unix:///path/to/redis.sock
+     * - /path/to/redis.sock
+     *
+     * @param uri server address
+     * @return endpoint wrapped in Ok<endpoint>, or the reason of the invalid uri
+     * as Err<std::unique_ptr<std::exception>>
+     */
+    auto parse_endpoint(const std::string &uri) noexcept
+        -> rustfp::Result<endpoint, std::unique_ptr<std::exception>>;
+
     /**
      * Creates and immediately connects the client to the
      * server.
@@ -40,15 +97,162 @@ namespace redispack {
         const size_t port = details::DEFAULT_PORT) noexcept
         -> rustfp::Result<std::shared_ptr<redis_client>, std::unique_ptr<std::exception>>;
 
+    /**
+     * Creates and immediately connects the subscriber to the
+     * server, which holds a connection of its own.
+     *
+     * @param hostname of the server, defaults to 127.0.0.1
+     * @param port of the server, defaults to 6379
+     * @return subscriber shared pointer wrapped in Ok<std::shared_ptr>,
+     * any exception is caught and returned as Err<std::unique_ptr<std::exception>>
+     */
+    auto make_and_connect_subscriber(
+        const std::string &host = details::DEFAULT_HOST,
+        const size_t port = details::DEFAULT_PORT) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_subscriber>, std::unique_ptr<std::exception>>;
+
+    /**
+     * Creates and immediately connects the client to the
+     * server over a unix socket, which skips the loopback tcp stack
+     * when the server runs on the same host. Not supported on Windows.
+     *
+     * @param path of the socket, e.g. /var/run/redis/redis.sock
+     * @return client shared pointer wrapped in Ok<std::shared_ptr>,
+     * any exception is caught and returned as Err<std::unique_ptr<std::exception>>
+     */
+    auto make_and_connect_unix(const std::string &path) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_client>, std::unique_ptr<std::exception>>;
+
+    /**
+     * Creates and immediately connects the client to the
+     * server at the address accepted by parse_endpoint.
+     *
+     * @param uri server address, e.g. redis://127.0.0.1:6379 or unix:///tmp/redis.sock
+     * @return client shared pointer wrapped in Ok<std::shared_ptr>,
+     * any exception is caught and returned as Err<std::unique_ptr<std::exception>>
+     */
+    auto make_and_connect_uri(const std::string &uri) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_client>, std::unique_ptr<std::exception>>;
+
+    /**
+     * Creates and immediately connects the subscriber to the
+     * server at the address accepted by parse_endpoint.
+     *
+     * @param uri server address, e.g. redis://127.0.0.1:6379 or unix:///tmp/redis.sock
+     * @return subscriber shared pointer wrapped in Ok<std::shared_ptr>,
+     * any exception is caught and returned as Err<std::unique_ptr<std::exception>>
+     */
+    auto make_and_connect_subscriber_uri(const std::string &uri) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_subscriber>, std::unique_ptr<std::exception>>;
+
     // implementation section
 
+    inline auto endpoint::is_unix_socket() const noexcept -> bool {
+        return port == details::UNIX_SOCKET_PORT;
+    }
+
+    inline auto parse_endpoint(const std::string &uri) noexcept
+        -> rustfp::Result<endpoint, std::unique_ptr<std::exception>> {
+
+        static const std::string UNIX_SCHEME = "unix://";
+        static const std::string REDIS_SCHEME = "redis://";
+        static const std::string TCP_SCHEME = "tcp://";
+
+        const auto invalid = [&uri](const std::string &reason) {
+            return rustfp::Err(std::unique_ptr<std::exception>(
+                std::make_unique<std::invalid_argument>(reason + ": " + uri)));
+        };
+
+        const auto has_scheme = [&uri](const std::string &scheme) {
+            return uri.compare(0, scheme.size(), scheme) == 0;
+        };
+
+        if (has_scheme(UNIX_SCHEME) || (!uri.empty() && uri.front() == '/')) {
+            const auto path = has_scheme(UNIX_SCHEME) ? uri.substr(UNIX_SCHEME.size()) : uri;
+
+            if (path.empty() || path.front() != '/') {
+                return invalid("Unix socket path must be absolute");
+            }
+
+            return rustfp::Ok(endpoint{path, details::UNIX_SOCKET_PORT});
+        }
+
+        std::string authority;
+
+        if (has_scheme(REDIS_SCHEME)) {
+            authority = uri.substr(REDIS_SCHEME.size());
+        }
+        else if (has_scheme(TCP_SCHEME)) {
+            authority = uri.substr(TCP_SCHEME.size());
+        }
+        else {
+            return invalid("Unsupported scheme");
+        }
+
+        // drops the database number or options, which are not part of the endpoint
+        authority = authority.substr(0, authority.find_first_of("/?"));
+
+        if (authority.find('@') != std::string::npos) {
+            return invalid("Credentials are not supported");
+        }
+
+        std::string host;
+        std::string port_str;
+
+        if (!authority.empty() && authority.front() == '[') {
+            const auto close_pos = authority.find(']');
+
+            if (close_pos == std::string::npos) {
+                return invalid("Unterminated IPv6 host");
+            }
+
+            host = authority.substr(1, close_pos - 1);
+            const auto rest = authority.substr(close_pos + 1);
+
+            if (!rest.empty() && rest.front() != ':') {
+                return invalid("Unexpected characters after IPv6 host");
+            }
+
+            port_str = rest.empty() ? "" : rest.substr(1);
+        }
+        else {
+            const auto colon_pos = authority.find(':');
+            host = authority.substr(0, colon_pos);
+            port_str = colon_pos == std::string::npos ? "" : authority.substr(colon_pos + 1);
+        }
+
+        if (host.empty()) {
+            host = details::DEFAULT_HOST;
+        }
+
+        if (port_str.empty()) {
+            return rustfp::Ok(endpoint{host, static_cast<size_t>(details::DEFAULT_PORT)});
+        }
+
+        size_t port = 0;
+
+        for (const auto c : port_str) {
+            if (c < '0' || c > '9' || port > details::MAX_PORT) {
+                return invalid("Invalid port");
+            }
+
+            port = port * 10 + static_cast<size_t>(c - '0');
+        }
+
+        if (port == 0 || port > details::MAX_PORT) {
+            return invalid("Invalid port");
+        }
+
+        return rustfp::Ok(endpoint{host, port});
+    }
+
     inline auto make_and_connect(
         const std::string &host,
         const size_t port) noexcept
         -> rustfp::Result<std::shared_ptr<redis_client>, std::unique_ptr<std::exception>> {
 
         try {
-            auto client_ptr = std::make_shared<redis_client>(); 
+            auto client_ptr = details::make_default_bound<redis_client>();
             client_ptr->connect(host, port);
             return rustfp::Ok(std::move(client_ptr));
         }
@@ -56,4 +260,74 @@ namespace redispack {
             return rustfp::Err(std::make_unique<std::exception>(e));
         }
     }
+
+    inline auto make_and_connect_subscriber(
+        const std::string &host,
+        const size_t port) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_subscriber>, std::unique_ptr<std::exception>> {
+
+        try {
+            auto subscriber_ptr = details::make_default_bound<redis_subscriber>();
+            subscriber_ptr->connect(host, port);
+            return rustfp::Ok(std::move(subscriber_ptr));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::exception>(e));
+        }
+    }
+
+    inline auto make_and_connect_unix(const std::string &path) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_client>, std::unique_ptr<std::exception>> {
+
+        return make_and_connect(path, details::UNIX_SOCKET_PORT);
+    }
+
+    inline auto make_and_connect_uri(const std::string &uri) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_client>, std::unique_ptr<std::exception>> {
+
+        return details::make_and_connect_uri_impl<redis_client>(uri);
+    }
+
+    inline auto make_and_connect_subscriber_uri(const std::string &uri) noexcept
+        -> rustfp::Result<std::shared_ptr<redis_subscriber>, std::unique_ptr<std::exception>> {
+
+        return details::make_and_connect_uri_impl<redis_subscriber>(uri);
+    }
+
+    namespace details {
+        inline auto reactor_bind_mutex() -> std::mutex & {
+            static std::mutex bind_mutex;
+            return bind_mutex;
+        }
+
+        template <class Client>
+        auto make_default_bound() -> std::shared_ptr<Client> {
+            std::lock_guard<std::mutex> lock(reactor_bind_mutex());
+            return std::make_shared<Client>();
+        }
+
+        template <class Client>
+        auto make_and_connect_uri_impl(const std::string &uri) noexcept
+            -> rustfp::Result<std::shared_ptr<Client>, std::unique_ptr<std::exception>> {
+
+            using result_t =
+                rustfp::Result<std::shared_ptr<Client>, std::unique_ptr<std::exception>>;
+
+            return parse_endpoint(uri).match(
+                [](endpoint &&ep) -> result_t {
+                    try {
+                        auto client_ptr = make_default_bound<Client>();
+                        client_ptr->connect(ep.host, ep.port);
+                        return rustfp::Ok(std::move(client_ptr));
+                    }
+                    catch (const std::exception &e) {
+                        return rustfp::Err(std::make_unique<std::exception>(e));
+                    }
+                },
+
+                [](std::unique_ptr<std::exception> &&e) -> result_t {
+                    return rustfp::Err(std::move(e));
+                });
+        }
+    }
 }
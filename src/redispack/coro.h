@@ -0,0 +1,759 @@
+/**
+ * Provides C++20 coroutine (co_await) versions of the hash and set
+ * operations, which suspend until the reply arrives instead of blocking
+ * in sync_commit, and resume on a configurable executor.
+ *
+ * Only available when compiling with coroutine support, e.g. -std=c++20.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define REDISPACK_HAS_COROUTINES 1
+#endif
+
+#ifdef REDISPACK_HAS_COROUTINES
+
+#include "alias.h"
+#include "decode.h"
+#include "hash.h"
+#include "router.h"
+#include "set.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Runs the resumption of suspended coroutines.
+     */
+    class executor {
+    public:
+        virtual ~executor() = default;
+
+        /**
+         * Schedules the function to be run, may be called from any thread.
+         */
+        virtual void post(std::function<void()> fn) = 0;
+    };
+
+    /**
+     * Runs the function immediately, so coroutines resume on the cpp_redis
+     * network thread that delivered the reply.
+     */
+    class inline_executor : public executor {
+    public:
+        void post(std::function<void()> fn) override;
+    };
+
+    /**
+     * Queues the functions until a thread explicitly runs them,
+     * which is mainly useful for tests and single-threaded event loops.
+     */
+    class manual_executor : public executor {
+    public:
+        void post(std::function<void()> fn) override;
+
+        /**
+         * Runs the next queued function, waiting for one to be posted if empty.
+         */
+        void run_one();
+
+        /**
+         * Runs the next queued function only if there is one.
+         *
+         * @return true if a function was run.
+         */
+        auto try_run_one() -> bool;
+
+    private:
+        /** Guards the queue. */
+        std::mutex queue_mutex;
+
+        /** Signals that a function has been posted. */
+        std::condition_variable queue_cv;
+
+        /** Posted functions, in order. */
+        std::deque<std::function<void()>> queue;
+    };
+
+    /**
+     * @return shared executor which resumes on the cpp_redis network thread.
+     */
+    auto get_inline_executor() -> executor &;
+
+    /**
+     * Lazily started coroutine task, which starts when awaited or explicitly started.
+     */
+    template <class T>
+    class task;
+
+    /**
+     * Whether an awaited command reads or writes, which decides where it is routed.
+     */
+    enum class command_kind {
+        /** Read from a replica if routed. */
+        read,
+
+        /** Written to the primary, which starts the read-your-writes window if routed. */
+        write
+    };
+
+    namespace details {
+        /**
+         * State of an awaitable shared with its reply callback, which may outlive the awaitable.
+         */
+        template <class T>
+        struct awaitable_state {
+            /** Converts the reply into the awaited result. */
+            std::function<T(cpp_redis::reply &)> decoder;
+
+            /** Executor to resume the awaiting coroutine on. */
+            executor *exec_ptr;
+
+            /** Awaited result, set before resuming. */
+            std::optional<T> result;
+
+            /** Exception thrown by the decoder, rethrown when resumed. */
+            std::exception_ptr error;
+
+            /** Set by whichever of the reply and a failed send gets to resume the coroutine. */
+            std::atomic<bool> is_claimed{false};
+        };
+
+        /**
+         * Promise parts common to all task types.
+         */
+        struct task_promise_base {
+            /** Resumes the awaiting coroutine, if any, when the task finishes. */
+            struct final_awaiter {
+                auto await_ready() const noexcept -> bool;
+
+                template <class P>
+                auto await_suspend(std::coroutine_handle<P> handle) noexcept
+                    -> std::coroutine_handle<>;
+
+                void await_resume() noexcept;
+            };
+
+            auto initial_suspend() const noexcept -> std::suspend_always;
+
+            auto final_suspend() const noexcept -> final_awaiter;
+
+            void unhandled_exception() noexcept;
+
+            /** Coroutine awaiting this task. */
+            std::coroutine_handle<> continuation;
+
+            /** Exception thrown out of the task. */
+            std::exception_ptr error;
+        };
+
+        /**
+         * Promise of task with a value.
+         */
+        template <class T>
+        struct task_promise : task_promise_base {
+            auto get_return_object() -> task<T>;
+
+            void return_value(T value);
+
+            /** @return the returned value, or rethrows the exception thrown out of the task. */
+            auto take() -> T;
+
+            /** Returned value. */
+            std::optional<T> value;
+        };
+
+        /**
+         * Promise of task without a value.
+         */
+        template <>
+        struct task_promise<void> : task_promise_base {
+            auto get_return_object() -> task<void>;
+
+            void return_void() noexcept;
+
+            /** Rethrows the exception thrown out of the task. */
+            void take();
+        };
+    }
+
+    template <class T>
+    class task {
+    public:
+        using promise_type = details::task_promise<T>;
+
+        /** Constructs the task owning the coroutine. */
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept;
+
+        task(task &&rhs) noexcept;
+        task(const task &) = delete;
+        auto operator=(const task &) -> task & = delete;
+        auto operator=(task &&) -> task & = delete;
+
+        /** Destroys the owned coroutine. */
+        ~task();
+
+        /** Starts the task without awaiting it. */
+        void start();
+
+        /** @return true if the task has run to completion. */
+        auto is_done() const noexcept -> bool;
+
+        /**
+         * @return the result of a completed task,
+         * or rethrows the exception thrown out of it.
+         */
+        auto get() -> T;
+
+        auto await_ready() const noexcept -> bool;
+
+        auto await_suspend(std::coroutine_handle<> continuation) noexcept
+            -> std::coroutine_handle<>;
+
+        auto await_resume() -> T;
+
+    private:
+        /** Owned coroutine. */
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    /**
+     * Sends one command when awaited, then suspends until its reply arrives.
+     */
+    template <class T>
+    class redis_awaitable {
+    public:
+        /** Converts the reply into the awaited result. */
+        using decoder_t = std::function<T(cpp_redis::reply &)>;
+
+        /**
+         * Constructs the awaitable without sending the command yet.
+         *
+         * @param client_ptr client to send the command with
+         * @param cmd command name followed by its arguments
+         * @param decoder converts the reply into the awaited result
+         * @param exec executor to resume the awaiting coroutine on
+         */
+        redis_awaitable(
+            redis_client_ptr client_ptr,
+            std::vector<std::string> cmd,
+            decoder_t decoder,
+            executor &exec);
+
+        /**
+         * Constructs the awaitable without sending the command yet,
+         * which is routed as the sync methods of the container route it.
+         *
+         * @param client_ptr client to send the command with, which is the primary if routed
+         * @param router_ptr routes the reads to the replicas, null if not routed
+         * @param kind whether the command reads or writes
+         * @param cmd command name followed by its arguments
+         * @param decoder converts the reply into the awaited result
+         * @param exec executor to resume the awaiting coroutine on
+         */
+        redis_awaitable(
+            redis_client_ptr client_ptr,
+            std::shared_ptr<replica_router> router_ptr,
+            const command_kind kind,
+            std::vector<std::string> cmd,
+            decoder_t decoder,
+            executor &exec);
+
+        auto await_ready() const noexcept -> bool;
+
+        void await_suspend(std::coroutine_handle<> handle);
+
+        auto await_resume() -> T;
+
+    private:
+        /** Client to send the command with. */
+        redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Whether the command reads or writes. */
+        command_kind kind;
+
+        /** Command name followed by its arguments. */
+        std::vector<std::string> cmd;
+
+        /** Shared with the reply callback, which may run after this awaitable is gone. */
+        std::shared_ptr<details::awaitable_state<T>> state_ptr;
+    };
+
+    /**
+     * Awaitable version of hash::get.
+     */
+    template <class K, class V, class Codec>
+    auto get_co(const hash<K, V, Codec> &h, const K &key, executor &exec = get_inline_executor())
+        -> redis_awaitable<rustfp::Option<V>>;
+
+    /**
+     * Awaitable version of hash::exists.
+     */
+    template <class K, class V, class Codec>
+    auto exists_co(const hash<K, V, Codec> &h, const K &key, executor &exec = get_inline_executor())
+        -> redis_awaitable<bool>;
+
+    /**
+     * Awaitable version of hash::len.
+     */
+    template <class K, class V, class Codec>
+    auto len_co(const hash<K, V, Codec> &h, executor &exec = get_inline_executor())
+        -> redis_awaitable<size_t>;
+
+    /**
+     * Awaitable version of hash::set.
+     */
+    template <class K, class V, class Codec>
+    auto set_co(
+        hash<K, V, Codec> &h, const K &key, const V &value, executor &exec = get_inline_executor())
+        -> redis_awaitable<bool>;
+
+    /**
+     * Awaitable version of set::members.
+     */
+    template <class T, class Codec>
+    auto members_co(const set<T, Codec> &s, executor &exec = get_inline_executor())
+        -> redis_awaitable<std::unordered_set<T>>;
+
+    /**
+     * Awaitable version of set::is_member.
+     */
+    template <class T, class Codec>
+    auto is_member_co(
+        const set<T, Codec> &s, const T &member, executor &exec = get_inline_executor())
+        -> redis_awaitable<bool>;
+
+    /**
+     * Awaitable version of set::card.
+     */
+    template <class T, class Codec>
+    auto card_co(const set<T, Codec> &s, executor &exec = get_inline_executor())
+        -> redis_awaitable<size_t>;
+
+    /**
+     * Awaitable version of set::add.
+     */
+    template <class T, class Codec>
+    auto add_co(
+        set<T, Codec> &s, const std::vector<T> &members, executor &exec = get_inline_executor())
+        -> redis_awaitable<size_t>;
+
+    // implementation section
+
+    inline void inline_executor::post(std::function<void()> fn) {
+        fn();
+    }
+
+    inline void manual_executor::post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            queue.push_back(std::move(fn));
+        }
+
+        queue_cv.notify_one();
+    }
+
+    inline void manual_executor::run_one() {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        queue_cv.wait(lock, [this] { return !queue.empty(); });
+
+        auto fn = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        fn();
+    }
+
+    inline auto manual_executor::try_run_one() -> bool {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+
+        if (queue.empty()) {
+            return false;
+        }
+
+        auto fn = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        fn();
+        return true;
+    }
+
+    inline auto get_inline_executor() -> executor & {
+        static inline_executor exec;
+        return exec;
+    }
+
+    namespace details {
+        inline auto task_promise_base::final_awaiter::await_ready() const noexcept -> bool {
+            return false;
+        }
+
+        template <class P>
+        auto task_promise_base::final_awaiter::await_suspend(
+            std::coroutine_handle<P> handle) noexcept -> std::coroutine_handle<> {
+
+            const auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        inline void task_promise_base::final_awaiter::await_resume() noexcept {
+        }
+
+        inline auto task_promise_base::initial_suspend() const noexcept -> std::suspend_always {
+            return {};
+        }
+
+        inline auto task_promise_base::final_suspend() const noexcept -> final_awaiter {
+            return {};
+        }
+
+        inline void task_promise_base::unhandled_exception() noexcept {
+            error = std::current_exception();
+        }
+
+        template <class T>
+        auto task_promise<T>::get_return_object() -> task<T> {
+            return task<T>(std::coroutine_handle<task_promise>::from_promise(*this));
+        }
+
+        template <class T>
+        void task_promise<T>::return_value(T v) {
+            value.emplace(std::move(v));
+        }
+
+        template <class T>
+        auto task_promise<T>::take() -> T {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+
+            return std::move(*value);
+        }
+
+        inline auto task_promise<void>::get_return_object() -> task<void> {
+            return task<void>(std::coroutine_handle<task_promise>::from_promise(*this));
+        }
+
+        inline void task_promise<void>::return_void() noexcept {
+        }
+
+        inline void task_promise<void>::take() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    template <class T>
+    task<T>::task(std::coroutine_handle<promise_type> handle) noexcept :
+        handle(handle) {
+
+    }
+
+    template <class T>
+    task<T>::task(task &&rhs) noexcept :
+        handle(std::exchange(rhs.handle, nullptr)) {
+
+    }
+
+    template <class T>
+    task<T>::~task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    template <class T>
+    void task<T>::start() {
+        handle.resume();
+    }
+
+    template <class T>
+    auto task<T>::is_done() const noexcept -> bool {
+        return handle.done();
+    }
+
+    template <class T>
+    auto task<T>::get() -> T {
+        return handle.promise().take();
+    }
+
+    template <class T>
+    auto task<T>::await_ready() const noexcept -> bool {
+        return false;
+    }
+
+    template <class T>
+    auto task<T>::await_suspend(std::coroutine_handle<> continuation) noexcept
+        -> std::coroutine_handle<> {
+
+        handle.promise().continuation = continuation;
+        return handle;
+    }
+
+    template <class T>
+    auto task<T>::await_resume() -> T {
+        return handle.promise().take();
+    }
+
+    template <class T>
+    redis_awaitable<T>::redis_awaitable(
+        redis_client_ptr client_ptr,
+        std::vector<std::string> cmd,
+        decoder_t decoder,
+        executor &exec) :
+
+        redis_awaitable(
+            std::move(client_ptr), nullptr, command_kind::write,
+            std::move(cmd), std::move(decoder), exec) {
+
+    }
+
+    template <class T>
+    redis_awaitable<T>::redis_awaitable(
+        redis_client_ptr client_ptr,
+        std::shared_ptr<replica_router> router_ptr,
+        const command_kind kind,
+        std::vector<std::string> cmd,
+        decoder_t decoder,
+        executor &exec) :
+
+        client_ptr(std::move(client_ptr)),
+        router_ptr(std::move(router_ptr)),
+        kind(kind),
+        cmd(std::move(cmd)),
+        state_ptr(std::make_shared<details::awaitable_state<T>>()) {
+
+        state_ptr->decoder = std::move(decoder);
+        state_ptr->exec_ptr = &exec;
+    }
+
+    template <class T>
+    auto redis_awaitable<T>::await_ready() const noexcept -> bool {
+        return false;
+    }
+
+    template <class T>
+    void redis_awaitable<T>::await_suspend(std::coroutine_handle<> handle) {
+        // the coroutine may resume and destroy this awaitable before send returns,
+        // so nothing of this awaitable is touched after sending
+        const auto state = state_ptr;
+        const auto router = kind == command_kind::write ? router_ptr : nullptr;
+        auto client = client_ptr;
+
+        // the lease lasts until the reply arrives, so that the replica stats see the whole read
+        std::shared_ptr<read_lease> lease_ptr;
+
+        if (router_ptr && kind == command_kind::read) {
+            lease_ptr = std::make_shared<read_lease>(router_ptr->acquire_read());
+            client = lease_ptr->get_client_ptr();
+        }
+
+        try {
+            client->send(cmd,
+                [state, handle, router, lease_ptr](cpp_redis::reply &r) mutable {
+                    lease_ptr.reset();
+
+                    if (router) {
+                        router->mark_write();
+                    }
+
+                    if (state->is_claimed.exchange(true)) {
+                        return;
+                    }
+
+                    try {
+                        state->result.emplace(state->decoder(r));
+                    }
+                    catch (...) {
+                        state->error = std::current_exception();
+                    }
+
+                    state->exec_ptr->post([handle] { handle.resume(); });
+                });
+
+            // only commits without waiting, the reply callback resumes the coroutine
+            client->commit();
+        }
+        catch (...) {
+            // the queued callback may still run, e.g. when the client drops its callbacks,
+            // so whichever comes first resumes the coroutine
+            if (state->is_claimed.exchange(true)) {
+                return;
+            }
+
+            throw;
+        }
+    }
+
+    template <class T>
+    auto redis_awaitable<T>::await_resume() -> T {
+        if (state_ptr->error) {
+            std::rethrow_exception(state_ptr->error);
+        }
+
+        return std::move(*state_ptr->result);
+    }
+
+    template <class K, class V, class Codec>
+    auto get_co(const hash<K, V, Codec> &h, const K &key, executor &exec)
+        -> redis_awaitable<rustfp::Option<V>> {
+
+        return redis_awaitable<rustfp::Option<V>>(
+            h.get_client_ptr(),
+            h.get_router_ptr(),
+            command_kind::read,
+            {"HGET", h.get_name(), details::encode_into_str(key)},
+            [codec = h.get_codec()](cpp_redis::reply &r) -> rustfp::Option<V> {
+                if (r.is_bulk_string()) {
+                    const auto &str = r.as_string();
+                    return codec.template decode<V>(str.data(), str.size());
+                }
+
+                return rustfp::None;
+            },
+            exec);
+    }
+
+    template <class K, class V, class Codec>
+    auto exists_co(const hash<K, V, Codec> &h, const K &key, executor &exec)
+        -> redis_awaitable<bool> {
+
+        return redis_awaitable<bool>(
+            h.get_client_ptr(),
+            h.get_router_ptr(),
+            command_kind::read,
+            {"HEXISTS", h.get_name(), details::encode_into_str(key)},
+            [](cpp_redis::reply &r) {
+                return r.is_integer() && r.as_integer() == 1;
+            },
+            exec);
+    }
+
+    template <class K, class V, class Codec>
+    auto len_co(const hash<K, V, Codec> &h, executor &exec) -> redis_awaitable<size_t> {
+        return redis_awaitable<size_t>(
+            h.get_client_ptr(),
+            h.get_router_ptr(),
+            command_kind::read,
+            {"HLEN", h.get_name()},
+            [](cpp_redis::reply &r) {
+                return r.is_integer() ? static_cast<size_t>(r.as_integer()) : 0;
+            },
+            exec);
+    }
+
+    template <class K, class V, class Codec>
+    auto set_co(hash<K, V, Codec> &h, const K &key, const V &value, executor &exec)
+        -> redis_awaitable<bool> {
+
+        return redis_awaitable<bool>(
+            h.get_client_ptr(),
+            h.get_router_ptr(),
+            command_kind::write,
+            {"HSET", h.get_name(),
+                details::encode_into_str(key), h.get_codec().encode(value)},
+            [](cpp_redis::reply &r) {
+                return r.is_integer() && r.as_integer() == 1;
+            },
+            exec);
+    }
+
+    template <class T, class Codec>
+    auto members_co(const set<T, Codec> &s, executor &exec)
+        -> redis_awaitable<std::unordered_set<T>> {
+
+        return redis_awaitable<std::unordered_set<T>>(
+            s.get_client_ptr(),
+            s.get_router_ptr(),
+            command_kind::read,
+            {"SMEMBERS", s.get_name()},
+            [codec = s.get_codec()](cpp_redis::reply &r) {
+                std::unordered_set<T> mems;
+
+                if (r.is_array()) {
+                    mems.reserve(r.as_array().size());
+                }
+
+                details::decode_reply_array<T>(r, std::inserter(mems, mems.end()), codec);
+                return mems;
+            },
+            exec);
+    }
+
+    template <class T, class Codec>
+    auto is_member_co(const set<T, Codec> &s, const T &member, executor &exec)
+        -> redis_awaitable<bool> {
+
+        return redis_awaitable<bool>(
+            s.get_client_ptr(),
+            s.get_router_ptr(),
+            command_kind::read,
+            {"SISMEMBER", s.get_name(), s.get_codec().encode(member)},
+            [](cpp_redis::reply &r) {
+                return r.is_integer() && r.as_integer() == 1;
+            },
+            exec);
+    }
+
+    template <class T, class Codec>
+    auto card_co(const set<T, Codec> &s, executor &exec) -> redis_awaitable<size_t> {
+        return redis_awaitable<size_t>(
+            s.get_client_ptr(),
+            s.get_router_ptr(),
+            command_kind::read,
+            {"SCARD", s.get_name()},
+            [](cpp_redis::reply &r) {
+                return r.is_integer() ? static_cast<size_t>(r.as_integer()) : 0;
+            },
+            exec);
+    }
+
+    template <class T, class Codec>
+    auto add_co(set<T, Codec> &s, const std::vector<T> &members, executor &exec)
+        -> redis_awaitable<size_t> {
+
+        auto cmd = details::str_vectorize_range<T>(members.cbegin(), members.cend(), s.get_codec());
+        cmd.insert(cmd.begin(), {"SADD", s.get_name()});
+
+        return redis_awaitable<size_t>(
+            s.get_client_ptr(),
+            s.get_router_ptr(),
+            command_kind::write,
+            std::move(cmd),
+            [](cpp_redis::reply &r) {
+                return r.is_integer() ? static_cast<size_t>(r.as_integer()) : 0;
+            },
+            exec);
+    }
+}
+
+#endif
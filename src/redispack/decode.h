@@ -0,0 +1,506 @@
+/**
+ * Provides decoding of multi-bulk replies, which splits large replies
+ * into chunks to be decoded across multiple threads, and output iterator
+ * helpers to receive the decoded elements.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Controls how multi-bulk replies are decoded.
+     */
+    struct decode_options {
+        /**
+         * Minimum number of reply elements before decoding is split across threads.
+         * 0 disables parallel decoding.
+         */
+        size_t parallel_threshold;
+
+        /** Number of threads to decode with, including the calling thread. */
+        size_t nb_threads;
+    };
+
+    /**
+     * @return defaults of 65536 elements as threshold and all hardware threads.
+     */
+    auto default_decode_options() noexcept -> decode_options;
+
+    /**
+     * @return process-wide options currently used for decoding.
+     */
+    auto get_decode_options() noexcept -> decode_options;
+
+    /**
+     * Sets the process-wide options used for decoding, applies to all containers.
+     */
+    void set_decode_options(const decode_options &options) noexcept;
+
+    /**
+     * Output iterator which passes every assigned value to a callback,
+     * so that results can be consumed without materializing a container.
+     */
+    template <class F>
+    class sink_iterator {
+    public:
+        using iterator_category = std::output_iterator_tag;
+        using value_type = void;
+        using difference_type = void;
+        using pointer = void;
+        using reference = void;
+
+        /**
+         * Constructs the iterator with the callback to receive the values.
+         */
+        explicit sink_iterator(F fn);
+
+        /**
+         * Passes the assigned value to the callback.
+         */
+        template <class V,
+            class = std::enable_if_t<!std::is_same<std::decay_t<V>, sink_iterator>::value>>
+        auto operator=(V &&value) -> sink_iterator &;
+
+        /** No-op, to satisfy output iterator requirements. */
+        auto operator*() noexcept -> sink_iterator &;
+
+        /** No-op, to satisfy output iterator requirements. */
+        auto operator++() noexcept -> sink_iterator &;
+
+        /** No-op, to satisfy output iterator requirements. */
+        auto operator++(int) noexcept -> sink_iterator &;
+
+    private:
+        /** Shared so that the iterator stays assignable even for lambdas. */
+        std::shared_ptr<F> fn_ptr;
+    };
+
+    /**
+     * Creates an output iterator that passes every assigned value to the callback.
+     *
+     * @param fn callback taking each value
+     * @return output iterator wrapping the callback
+     */
+    template <class F>
+    auto sink(F &&fn) -> sink_iterator<std::decay_t<F>>;
+
+    namespace details {
+        /** Number of chunks per thread, so that faster threads can pick up more chunks. */
+        static constexpr size_t CHUNKS_PER_THREAD = 4;
+
+        /** Storage of the process-wide decode options. */
+        struct decode_options_storage {
+            /** Same as decode_options::parallel_threshold. */
+            std::atomic<size_t> parallel_threshold;
+
+            /** Same as decode_options::nb_threads. */
+            std::atomic<size_t> nb_threads;
+        };
+
+        /**
+         * @return process-wide decode options storage.
+         */
+        auto get_decode_options_storage() noexcept -> decode_options_storage &;
+
+        /**
+         * Process-wide threads which help decoding the large replies,
+         * created on first use and kept for the following replies.
+         */
+        class decode_pool {
+        public:
+            /**
+             * @return process-wide pool, without any thread until the first task.
+             */
+            static auto instance() -> decode_pool &;
+
+            decode_pool();
+
+            /**
+             * Stops and joins the threads, dropping the tasks not yet started.
+             */
+            ~decode_pool();
+
+            decode_pool(const decode_pool &) = delete;
+            auto operator=(const decode_pool &) -> decode_pool & = delete;
+
+            /**
+             * Queues the task, creating threads until there are at least nb_threads.
+             * @throws std::system_error if no thread can run the task.
+             */
+            void submit(std::function<void()> task, const size_t nb_threads);
+
+        private:
+            /** Runs the queued tasks until stopped. */
+            void run();
+
+            /** Guards the tasks and the stop flag. */
+            std::mutex mutex;
+
+            /** Wakes up the threads when a task is queued or when stopping. */
+            std::condition_variable cv;
+
+            /** Tasks not yet started. */
+            std::deque<std::function<void()>> tasks;
+
+            /** Set when the pool is being destroyed. */
+            bool is_stopping;
+
+            /** Threads running the tasks. */
+            std::vector<std::thread> threads;
+        };
+
+        /**
+         * Decodes the msgpack bulk string elements of an array reply into the output iterator.
+         * Elements which fail to decode are skipped.
+         *
+         * Called on the calling thread after the commit, never inside a reply callback,
+         * since the exceptions of a parallel decode are rethrown to the caller.
+         *
+         * @return output iterator past the last decoded element.
+         */
+        template <class T, class OutIt>
+        auto decode_reply_array(const cpp_redis::reply &r, OutIt out) -> OutIt;
+
+        /**
+         * Decodes the bulk string elements of an array reply into the output iterator,
+         * with the given codec. Elements which fail to decode are skipped.
+         * Same as above, never called inside a reply callback.
+         *
+         * @return output iterator past the last decoded element.
+         */
+        template <class T, class OutIt, class Codec>
+        auto decode_reply_array(const cpp_redis::reply &r, OutIt out, const Codec &codec) -> OutIt;
+
+        /**
+         * Decodes the bulk string elements in [begin, end) sequentially.
+         *
+         * @return output iterator past the last decoded element.
+         */
+        template <class T, class OutIt, class Codec>
+        auto decode_reply_range(
+            std::vector<cpp_redis::reply>::const_iterator begin,
+            std::vector<cpp_redis::reply>::const_iterator end,
+            OutIt out,
+            const Codec &codec) -> OutIt;
+
+        /**
+         * Decodes the bulk string elements across the given number of threads,
+         * the calling thread and the threads of the decode pool.
+         * Each chunk is decoded into its own pre-sized buffer, which are then
+         * moved into the output iterator in reply order.
+         * The first exception thrown while decoding is rethrown once all the chunks are done.
+         *
+         * @return output iterator past the last decoded element.
+         */
+        template <class T, class OutIt, class Codec>
+        auto decode_reply_parallel(
+            const std::vector<cpp_redis::reply> &subs,
+            const size_t nb_threads,
+            OutIt out,
+            const Codec &codec) -> OutIt;
+    }
+
+    // implementation section
+
+    inline auto default_decode_options() noexcept -> decode_options {
+        static constexpr size_t DEFAULT_PARALLEL_THRESHOLD = 65536;
+
+        return decode_options{
+            DEFAULT_PARALLEL_THRESHOLD,
+            std::max<size_t>(1, std::thread::hardware_concurrency())};
+    }
+
+    inline auto get_decode_options() noexcept -> decode_options {
+        const auto &storage = details::get_decode_options_storage();
+        return decode_options{storage.parallel_threshold.load(), storage.nb_threads.load()};
+    }
+
+    inline void set_decode_options(const decode_options &options) noexcept {
+        auto &storage = details::get_decode_options_storage();
+        storage.parallel_threshold.store(options.parallel_threshold);
+        storage.nb_threads.store(std::max<size_t>(1, options.nb_threads));
+    }
+
+    template <class F>
+    sink_iterator<F>::sink_iterator(F fn) :
+        fn_ptr(std::make_shared<F>(std::move(fn))) {
+
+    }
+
+    template <class F>
+    template <class V, class>
+    auto sink_iterator<F>::operator=(V &&value) -> sink_iterator & {
+        (*fn_ptr)(std::forward<V>(value));
+        return *this;
+    }
+
+    template <class F>
+    auto sink_iterator<F>::operator*() noexcept -> sink_iterator & {
+        return *this;
+    }
+
+    template <class F>
+    auto sink_iterator<F>::operator++() noexcept -> sink_iterator & {
+        return *this;
+    }
+
+    template <class F>
+    auto sink_iterator<F>::operator++(int) noexcept -> sink_iterator & {
+        return *this;
+    }
+
+    template <class F>
+    auto sink(F &&fn) -> sink_iterator<std::decay_t<F>> {
+        return sink_iterator<std::decay_t<F>>(std::forward<F>(fn));
+    }
+
+    namespace details {
+        inline auto get_decode_options_storage() noexcept -> decode_options_storage & {
+            static decode_options_storage storage{
+                {default_decode_options().parallel_threshold},
+                {default_decode_options().nb_threads}};
+
+            return storage;
+        }
+
+        inline auto decode_pool::instance() -> decode_pool & {
+            static decode_pool pool;
+            return pool;
+        }
+
+        inline decode_pool::decode_pool() :
+            is_stopping(false) {
+
+        }
+
+        inline decode_pool::~decode_pool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                is_stopping = true;
+            }
+
+            cv.notify_all();
+
+            for (auto &thread : threads) {
+                thread.join();
+            }
+        }
+
+        inline void decode_pool::submit(std::function<void()> task, const size_t nb_threads) {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            while (threads.size() < nb_threads) {
+                try {
+                    threads.emplace_back([this] { run(); });
+                }
+                catch (const std::system_error &) {
+                    // runs on the threads already created, if any
+                    if (threads.empty()) {
+                        throw;
+                    }
+
+                    break;
+                }
+            }
+
+            tasks.push_back(std::move(task));
+            cv.notify_one();
+        }
+
+        inline void decode_pool::run() {
+            while (true) {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return is_stopping || !tasks.empty(); });
+
+                if (is_stopping) {
+                    break;
+                }
+
+                auto task = std::move(tasks.front());
+                tasks.pop_front();
+                lock.unlock();
+
+                task();
+            }
+        }
+
+        template <class T, class OutIt>
+        auto decode_reply_array(const cpp_redis::reply &r, OutIt out) -> OutIt {
+            return decode_reply_array<T>(r, std::move(out), msgpack_codec());
+        }
+
+        template <class T, class OutIt, class Codec>
+        auto decode_reply_array(const cpp_redis::reply &r, OutIt out, const Codec &codec) -> OutIt {
+            if (!r.is_array()) {
+                return out;
+            }
+
+            const auto &subs = r.as_array();
+            const auto options = get_decode_options();
+
+            if (options.parallel_threshold > 0
+                && subs.size() >= options.parallel_threshold
+                && options.nb_threads > 1) {
+
+                return decode_reply_parallel<T>(subs, options.nb_threads, std::move(out), codec);
+            }
+
+            return decode_reply_range<T>(subs.cbegin(), subs.cend(), std::move(out), codec);
+        }
+
+        template <class T, class OutIt, class Codec>
+        auto decode_reply_range(
+            std::vector<cpp_redis::reply>::const_iterator begin,
+            std::vector<cpp_redis::reply>::const_iterator end,
+            OutIt out,
+            const Codec &codec) -> OutIt {
+
+            for (; begin != end; ++begin) {
+                if (begin->is_bulk_string()) {
+                    const auto &str = begin->as_string();
+                    auto value_opt = codec.template decode<T>(str.data(), str.size());
+
+                    std::move(value_opt).match_some(
+                        [&out](T &&value) {
+                            *out = std::move(value);
+                            ++out;
+                        });
+                }
+            }
+
+            return out;
+        }
+
+        template <class T, class OutIt, class Codec>
+        auto decode_reply_parallel(
+            const std::vector<cpp_redis::reply> &subs,
+            const size_t nb_threads,
+            OutIt out,
+            const Codec &codec) -> OutIt {
+
+            /**
+             * Progress shared with the helper tasks, which may only start after
+             * all the chunks are done, and then return without touching anything else.
+             */
+            struct decode_state {
+                std::atomic<size_t> next_chunk;
+                std::mutex mutex;
+                std::condition_variable cv;
+                size_t done_count;
+                std::exception_ptr error;
+            };
+
+            const auto chunk_count = std::min(subs.size(), nb_threads * CHUNKS_PER_THREAD);
+            const auto chunk_len = (subs.size() + chunk_count - 1) / chunk_count;
+
+            std::vector<std::vector<T>> chunks(chunk_count);
+
+            const auto state_ptr = std::make_shared<decode_state>();
+            state_ptr->next_chunk = 0;
+            state_ptr->done_count = 0;
+
+            const auto subs_ptr = &subs;
+            const auto chunks_ptr = &chunks;
+            const auto codec_ptr = &codec;
+
+            // threads keep claiming the next undecoded chunk until none is left
+            const auto worker = [state_ptr, subs_ptr, chunks_ptr, codec_ptr,
+                chunk_count, chunk_len] {
+
+                for (auto index = state_ptr->next_chunk.fetch_add(1);
+                    index < chunk_count;
+                    index = state_ptr->next_chunk.fetch_add(1)) {
+
+                    std::exception_ptr error;
+
+                    try {
+                        const auto begin = std::min(subs_ptr->size(), index * chunk_len);
+                        const auto end = std::min(subs_ptr->size(), begin + chunk_len);
+
+                        auto &chunk = (*chunks_ptr)[index];
+                        chunk.reserve(end - begin);
+
+                        decode_reply_range<T>(
+                            subs_ptr->cbegin() + begin,
+                            subs_ptr->cbegin() + end,
+                            std::back_inserter(chunk),
+                            *codec_ptr);
+                    }
+                    catch (...) {
+                        error = std::current_exception();
+                    }
+
+                    std::lock_guard<std::mutex> lock(state_ptr->mutex);
+
+                    if (error && !state_ptr->error) {
+                        state_ptr->error = error;
+                    }
+
+                    if (++state_ptr->done_count == chunk_count) {
+                        state_ptr->cv.notify_all();
+                    }
+                }
+            };
+
+            // helpers which cannot be queued are not needed, the calling thread decodes the rest
+            try {
+                auto &pool = decode_pool::instance();
+
+                for (size_t i = 1; i < nb_threads; ++i) {
+                    pool.submit(worker, nb_threads - 1);
+                }
+            }
+            catch (const std::exception &) {
+            }
+
+            // the calling thread participates as well
+            worker();
+
+            {
+                std::unique_lock<std::mutex> lock(state_ptr->mutex);
+
+                state_ptr->cv.wait(lock, [&state_ptr, chunk_count] {
+                    return state_ptr->done_count == chunk_count;
+                });
+            }
+
+            if (state_ptr->error) {
+                std::rethrow_exception(state_ptr->error);
+            }
+
+            for (auto &chunk : chunks) {
+                out = std::move(chunk.begin(), chunk.end(), std::move(out));
+            }
+
+            return out;
+        }
+    }
+}
@@ -0,0 +1,765 @@
+/**
+ * Provides compression of many small similar values against a shared
+ * dictionary, trained from samples of the values in a hash.
+ *
+ * The dictionaries are stored in a side hash next to the container, keyed by
+ * their id, which is tagged in every compressed frame. Retraining adds a new
+ * version, so values compressed against the older versions stay readable.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "lz.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+#include "rustfp/result.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Controls how a dictionary is trained.
+     */
+    struct dictionary_train_options {
+        /** Maximum number of values to sample. */
+        size_t sample_count;
+
+        /** Maximum size of the dictionary in bytes, of which at most 64 KiB is used. */
+        size_t dictionary_size;
+    };
+
+    /**
+     * @return defaults of 1000 samples and a 16 KiB dictionary.
+     */
+    auto default_dictionary_train_options() noexcept -> dictionary_train_options;
+
+    namespace details {
+        /**
+         * Dictionaries reloaded from the side hash of a container, shared between
+         * the copies of a codec loaded from it.
+         */
+        struct dictionary_store {
+            /** Client to reload with. */
+            redis_client_ptr client_ptr;
+
+            /** Name of the container. */
+            std::string name;
+
+            /** Latest reloaded dictionaries, only accessed with the atomic functions. */
+            std::shared_ptr<const std::map<unsigned char, lz::dictionary>> dicts_ptr;
+
+            /** Set while a reload is in flight, so that a burst of values sends only one. */
+            std::atomic<bool> is_reloading;
+        };
+    }
+
+    /**
+     * Codec which compresses the msgpack encoded values against the latest
+     * dictionary, and decompresses against whichever dictionary the value was
+     * compressed with. Values are stored as plain msgpack until a dictionary exists.
+     *
+     * Copies share the same dictionaries.
+     */
+    class dictionary_codec {
+    public:
+        /** Constructs the codec without any dictionary. */
+        dictionary_codec();
+
+        /**
+         * Constructs the codec with the given dictionaries, of which the one
+         * with the largest id is used to compress.
+         *
+         * @param dicts dictionary contents keyed by their id, 0 is not a valid id
+         */
+        explicit dictionary_codec(const std::map<unsigned char, std::string> &dicts);
+
+        /**
+         * Constructs the codec with the given dictionaries of the container, which reloads
+         * the dictionaries stored for the container once a value refers to an unknown id,
+         * e.g. after another process has trained a newer version.
+         *
+         * @param dicts dictionary contents keyed by their id, 0 is not a valid id
+         * @param client_ptr client to reload with
+         * @param name of the container
+         */
+        dictionary_codec(
+            const std::map<unsigned char, std::string> &dicts,
+            const redis_client_ptr &client_ptr,
+            const std::string &name);
+
+        /** @return value encoded as msgpack, compressed against the latest dictionary. */
+        template <class V>
+        auto encode(const V &value) const -> std::string;
+
+        /**
+         * Decodes the value, which runs within the reply callbacks, so an unknown dictionary
+         * only starts a reload in the background if the codec is loaded from a container.
+         *
+         * @return Some(value) decoded from either compressed or plain msgpack, otherwise None.
+         */
+        template <class V>
+        auto decode(const char *data, const size_t size) const -> rustfp::Option<V>;
+
+        /**
+         * Recovers the plain msgpack bytes of an encoded value into out, which is overwritten.
+         * Starts a reload in the background on an unknown dictionary, as for decode.
+         *
+         * @return false if the value is corrupted or its dictionary is unknown.
+         */
+        auto decompress(const char *data, const size_t size, std::string &out) const -> bool;
+
+        /**
+         * Reloads the dictionaries stored for the container and waits for them,
+         * so must not be called from within a reply callback of the same client.
+         * Does nothing if the codec is not loaded from a container.
+         *
+         * @throws std::runtime_error if a stored dictionary is invalid.
+         */
+        void reload() const;
+
+        /** @return a codec which also has the given dictionary, and compresses against it. */
+        auto with_dictionary(const unsigned char dict_id, const std::string &dict) const
+            -> dictionary_codec;
+
+        /** @return id of the dictionary used to compress, 0 if there is none. */
+        auto get_dictionary_id() const noexcept -> unsigned char;
+
+        /** @return number of dictionaries that values can be decompressed with. */
+        auto dictionary_count() const noexcept -> size_t;
+
+    private:
+        /** Prepared dictionaries keyed by their id, shared between copies. */
+        std::shared_ptr<const std::map<unsigned char, lz::dictionary>> dicts_ptr;
+
+        /** Id of the dictionary used to compress. */
+        unsigned char dict_id;
+
+        /** Dictionary used to compress, owned by dicts_ptr. */
+        const lz::dictionary *dict_ptr;
+
+        /** Dictionaries reloaded from the container, null if not loaded from one. */
+        std::shared_ptr<details::dictionary_store> store_ptr;
+    };
+
+    /**
+     * Trains a dictionary out of the byte segments that are shared by the most samples.
+     *
+     * @param samples values to train with
+     * @param dictionary_size maximum size of the dictionary in bytes
+     * @return the dictionary, with the most useful segments at the end.
+     */
+    auto train_dictionary(const std::vector<std::string> &samples, const size_t dictionary_size)
+        -> std::string;
+
+    /**
+     * Loads all the stored dictionary versions of the hash.
+     *
+     * @param client_ptr client to load with
+     * @param name of the hash
+     * @return codec wrapped in Ok, any exception is caught and returned as Err
+     */
+    auto load_dictionary_codec(
+        const redis_client_ptr &client_ptr,
+        const std::string &name) noexcept
+        -> rustfp::Result<dictionary_codec, std::unique_ptr<std::exception>>;
+
+    /**
+     * Samples the values of the hash, trains a new dictionary version out of
+     * them and stores it. Existing values are left as they are.
+     *
+     * @param client_ptr client to sample and store with
+     * @param name of the hash
+     * @param options controls the sampling and the dictionary size
+     * @return codec which compresses against the new dictionary wrapped in Ok,
+     * any exception is caught and returned as Err
+     */
+    auto train_dictionary_codec(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const dictionary_train_options &options = default_dictionary_train_options()) noexcept
+        -> rustfp::Result<dictionary_codec, std::unique_ptr<std::exception>>;
+
+    namespace details {
+        /** Largest dictionary id, since the id takes a single byte. */
+        static constexpr unsigned char MAX_DICTIONARY_ID = 255;
+
+        /** Number of bytes hashed together when looking for shared content. */
+        static constexpr size_t DICTIONARY_GRAM_SIZE = 6;
+
+        /** Size of the segments that the dictionary is assembled from. */
+        static constexpr size_t DICTIONARY_SEGMENT_SIZE = 32;
+
+        /** @return key of the side hash which stores the dictionaries of the container. */
+        auto dictionary_key(const std::string &name) -> std::string;
+
+        /** @return the gram at the position, which must have DICTIONARY_GRAM_SIZE bytes. */
+        auto load_gram(const char *p) noexcept -> uint64_t;
+
+        /**
+         * Loads the stored dictionaries of the container.
+         * @throws std::runtime_error if a stored dictionary id is invalid.
+         */
+        auto load_dictionaries(redis_client_ptr client_ptr, const std::string &name)
+            -> std::map<unsigned char, std::string>;
+
+        /**
+         * Parses the hgetall reply of the stored dictionaries into dicts.
+         * @return false if a field is not a valid dictionary id, or an element is not a string.
+         */
+        auto parse_dictionaries(
+            const cpp_redis::reply &r,
+            std::map<unsigned char, std::string> &dicts) -> bool;
+
+        /**
+         * @return prepared dictionaries keyed by their id.
+         * @throws std::invalid_argument if an id is 0.
+         */
+        auto prepare_dictionaries(const std::map<unsigned char, std::string> &dicts)
+            -> std::shared_ptr<const std::map<unsigned char, lz::dictionary>>;
+
+        /**
+         * Sends the reload of the stored dictionaries without waiting for the reply,
+         * unless a reload is already in flight.
+         */
+        void reload_dictionaries_async(const std::shared_ptr<dictionary_store> &store_ptr);
+
+        /**
+         * Stores the dictionary under the id, unless the id is already taken.
+         *
+         * @return true if the dictionary was stored.
+         */
+        auto store_dictionary(
+            redis_client_ptr client_ptr,
+            const std::string &name,
+            const unsigned char dict_id,
+            const std::string &dict) -> bool;
+
+        /**
+         * Samples up to count values of the hash with HSCAN, as plain msgpack bytes.
+         */
+        auto sample_hash_values(
+            redis_client_ptr client_ptr,
+            const std::string &name,
+            const dictionary_codec &codec,
+            const size_t count) -> std::vector<std::string>;
+    }
+
+    // implementation section
+
+    inline auto default_dictionary_train_options() noexcept -> dictionary_train_options {
+        static constexpr size_t DEFAULT_SAMPLE_COUNT = 1000;
+        static constexpr size_t DEFAULT_DICTIONARY_SIZE = 16 * 1024;
+
+        return dictionary_train_options{DEFAULT_SAMPLE_COUNT, DEFAULT_DICTIONARY_SIZE};
+    }
+
+    inline dictionary_codec::dictionary_codec() :
+        dictionary_codec(std::map<unsigned char, std::string>()) {
+
+    }
+
+    inline dictionary_codec::dictionary_codec(const std::map<unsigned char, std::string> &dicts) :
+        dicts_ptr(details::prepare_dictionaries(dicts)),
+        dict_id(details::NO_DICTIONARY_ID),
+        dict_ptr(nullptr) {
+
+        if (!dicts_ptr->empty()) {
+            const auto &latest = *dicts_ptr->rbegin();
+            dict_id = latest.first;
+            dict_ptr = &latest.second;
+        }
+    }
+
+    inline dictionary_codec::dictionary_codec(
+        const std::map<unsigned char, std::string> &dicts,
+        const redis_client_ptr &client_ptr,
+        const std::string &name) :
+
+        dictionary_codec(dicts) {
+
+        store_ptr = std::make_shared<details::dictionary_store>();
+        store_ptr->client_ptr = client_ptr;
+        store_ptr->name = name;
+        store_ptr->dicts_ptr = dicts_ptr;
+        store_ptr->is_reloading = false;
+    }
+
+    template <class V>
+    auto dictionary_codec::encode(const V &value) const -> std::string {
+        auto raw = details::encode_into_str(value);
+
+        if (!dict_ptr) {
+            return raw;
+        }
+
+        return details::compress_frame(std::move(raw), dict_id, dict_ptr);
+    }
+
+    template <class V>
+    auto dictionary_codec::decode(const char *data, const size_t size) const -> rustfp::Option<V> {
+        if (!details::is_compressed(data, size)) {
+            return details::decode_from_str<V>(data, size);
+        }
+
+        // reuses the decompression buffer across calls
+        thread_local std::string raw;
+
+        if (!decompress(data, size, raw)) {
+            return rustfp::None;
+        }
+
+        return details::decode_from_str<V>(raw.data(), raw.size());
+    }
+
+    inline auto dictionary_codec::decompress(
+        const char *data,
+        const size_t size,
+        std::string &out) const -> bool {
+
+        if (!details::is_compressed(data, size)) {
+            out.assign(data, size);
+            return true;
+        }
+
+        const auto id = details::compressed_dictionary_id(data);
+
+        if (id == details::NO_DICTIONARY_ID) {
+            return details::decompress_frame(data, size, out, nullptr);
+        }
+
+        const auto it = dicts_ptr->find(id);
+
+        if (it != dicts_ptr->cend()) {
+            return details::decompress_frame(data, size, out, &it->second);
+        }
+
+        if (!store_ptr) {
+            return false;
+        }
+
+        // the dictionary may have been trained after this codec was loaded
+        const auto reloaded_ptr = std::atomic_load(&store_ptr->dicts_ptr);
+        const auto reloaded_it = reloaded_ptr->find(id);
+
+        if (reloaded_it == reloaded_ptr->cend()) {
+            details::reload_dictionaries_async(store_ptr);
+            return false;
+        }
+
+        return details::decompress_frame(data, size, out, &reloaded_it->second);
+    }
+
+    inline void dictionary_codec::reload() const {
+        if (!store_ptr) {
+            return;
+        }
+
+        const auto dicts = details::load_dictionaries(store_ptr->client_ptr, store_ptr->name);
+        std::atomic_store(&store_ptr->dicts_ptr, details::prepare_dictionaries(dicts));
+    }
+
+    inline auto dictionary_codec::with_dictionary(
+        const unsigned char dict_id,
+        const std::string &dict) const -> dictionary_codec {
+
+        std::map<unsigned char, std::string> dicts;
+
+        for (const auto &prepared : *dicts_ptr) {
+            dicts.emplace(prepared.first, prepared.second.get_bytes());
+        }
+
+        dicts[dict_id] = dict;
+
+        auto codec = dictionary_codec(dicts);
+        codec.store_ptr = store_ptr;
+        return codec;
+    }
+
+    inline auto dictionary_codec::get_dictionary_id() const noexcept -> unsigned char {
+        return dict_id;
+    }
+
+    inline auto dictionary_codec::dictionary_count() const noexcept -> size_t {
+        return dicts_ptr->size();
+    }
+
+    inline auto train_dictionary(
+        const std::vector<std::string> &samples,
+        const size_t dictionary_size) -> std::string {
+
+        using details::DICTIONARY_GRAM_SIZE;
+        using details::DICTIONARY_SEGMENT_SIZE;
+
+        // number of samples that each gram appears in
+        std::unordered_map<uint64_t, uint32_t> gram_counts;
+
+        {
+            std::unordered_set<uint64_t> seen;
+
+            for (const auto &sample : samples) {
+                seen.clear();
+
+                for (size_t pos = 0; pos + DICTIONARY_GRAM_SIZE <= sample.size(); ++pos) {
+                    const auto gram = details::load_gram(sample.data() + pos);
+
+                    if (seen.insert(gram).second) {
+                        ++gram_counts[gram];
+                    }
+                }
+            }
+        }
+
+        struct segment {
+            uint64_t score;
+            size_t sample;
+            size_t offset;
+            size_t size;
+
+            auto operator<(const segment &rhs) const noexcept -> bool {
+                return score < rhs.score;
+            }
+        };
+
+        // only grams shared by at least two samples are worth a place in the dictionary
+        const auto score_of = [&samples, &gram_counts](const segment &seg) {
+            static constexpr uint32_t MIN_SHARED_COUNT = 2;
+
+            uint64_t score = 0;
+            const auto data = samples[seg.sample].data() + seg.offset;
+
+            for (size_t pos = 0; pos + DICTIONARY_GRAM_SIZE <= seg.size; ++pos) {
+                const auto count = gram_counts[details::load_gram(data + pos)];
+
+                if (count >= MIN_SHARED_COUNT) {
+                    score += count;
+                }
+            }
+
+            return score;
+        };
+
+        std::priority_queue<segment> candidates;
+
+        for (size_t i = 0; i < samples.size(); ++i) {
+            for (size_t offset = 0; offset < samples[i].size(); offset += DICTIONARY_SEGMENT_SIZE) {
+                segment seg{0, i, offset,
+                    std::min(DICTIONARY_SEGMENT_SIZE, samples[i].size() - offset)};
+
+                seg.score = score_of(seg);
+
+                if (seg.score > 0) {
+                    candidates.push(seg);
+                }
+            }
+        }
+
+        // greedily picks the best segment, rescoring lazily since the grams of
+        // every picked segment no longer count towards the others
+        std::vector<segment> picked;
+        size_t picked_size = 0;
+
+        while (!candidates.empty() && picked_size < dictionary_size) {
+            auto seg = candidates.top();
+            candidates.pop();
+            seg.score = score_of(seg);
+
+            if (seg.score == 0) {
+                continue;
+            }
+
+            if (!candidates.empty() && seg.score < candidates.top().score) {
+                candidates.push(seg);
+                continue;
+            }
+
+            const auto data = samples[seg.sample].data() + seg.offset;
+
+            for (size_t pos = 0; pos + DICTIONARY_GRAM_SIZE <= seg.size; ++pos) {
+                gram_counts[details::load_gram(data + pos)] = 0;
+            }
+
+            picked.push_back(seg);
+            picked_size += seg.size;
+        }
+
+        // the most useful segments go last, closest to the values compressed against them
+        std::string dict;
+        dict.reserve(picked_size);
+
+        for (auto it = picked.crbegin(); it != picked.crend(); ++it) {
+            dict.append(samples[it->sample], it->offset, it->size);
+        }
+
+        if (dict.size() > dictionary_size) {
+            dict.erase(0, dict.size() - dictionary_size);
+        }
+
+        return dict;
+    }
+
+    inline auto load_dictionary_codec(
+        const redis_client_ptr &client_ptr,
+        const std::string &name) noexcept
+        -> rustfp::Result<dictionary_codec, std::unique_ptr<std::exception>> {
+
+        try {
+            return rustfp::Ok(
+                dictionary_codec(details::load_dictionaries(client_ptr, name), client_ptr, name));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    inline auto train_dictionary_codec(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const dictionary_train_options &options) noexcept
+        -> rustfp::Result<dictionary_codec, std::unique_ptr<std::exception>> {
+
+        try {
+            const dictionary_codec codec(
+                details::load_dictionaries(client_ptr, name), client_ptr, name);
+
+            if (codec.get_dictionary_id() == details::MAX_DICTIONARY_ID) {
+                throw std::runtime_error("No dictionary id left for " + name);
+            }
+
+            const auto samples = details::sample_hash_values(
+                client_ptr, name, codec, options.sample_count);
+
+            if (samples.empty()) {
+                throw std::runtime_error("No values to train the dictionary of " + name);
+            }
+
+            const auto dict_id = static_cast<unsigned char>(codec.get_dictionary_id() + 1);
+            const auto dict = train_dictionary(samples, options.dictionary_size);
+
+            // the id is only taken if no one else has trained the same version meanwhile
+            if (!details::store_dictionary(client_ptr, name, dict_id, dict)) {
+                throw std::runtime_error(
+                    "Dictionary " + std::to_string(dict_id) + " of " + name
+                    + " was trained concurrently");
+            }
+
+            return rustfp::Ok(codec.with_dictionary(dict_id, dict));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    namespace details {
+        inline auto dictionary_key(const std::string &name) -> std::string {
+            return name + ":redispack-dict";
+        }
+
+        inline auto load_gram(const char *p) noexcept -> uint64_t {
+            uint64_t gram = 0;
+            std::memcpy(&gram, p, DICTIONARY_GRAM_SIZE);
+            return gram;
+        }
+
+        inline auto load_dictionaries(redis_client_ptr client_ptr, const std::string &name)
+            -> std::map<unsigned char, std::string> {
+
+            std::map<unsigned char, std::string> dicts;
+            bool is_valid = true;
+
+            client_ptr->hgetall(dictionary_key(name),
+                [&dicts, &is_valid](cpp_redis::reply &r) {
+                    is_valid = parse_dictionaries(r, dicts);
+                });
+
+            sync_commit(client_ptr);
+
+            if (!is_valid) {
+                throw std::runtime_error("Invalid dictionary stored for " + name);
+            }
+
+            return dicts;
+        }
+
+        inline auto parse_dictionaries(
+            const cpp_redis::reply &r,
+            std::map<unsigned char, std::string> &dicts) -> bool {
+
+            // a missing hash comes back as an empty array, so anything else is an error
+            if (!r.is_array()) {
+                return false;
+            }
+
+            const auto &elems = r.as_array();
+
+            for (size_t i = 0; i + 1 < elems.size(); i += 2) {
+                if (!elems[i].is_bulk_string() || !elems[i + 1].is_bulk_string()) {
+                    return false;
+                }
+
+                const auto &id_str = elems[i].as_string();
+                char *end = nullptr;
+                const auto id = std::strtoul(id_str.c_str(), &end, 10);
+
+                // rejects an empty id, a sign, or any trailing garbage
+                if (id_str.empty() || id_str.front() < '0' || id_str.front() > '9'
+                    || end != id_str.c_str() + id_str.size()
+                    || id == NO_DICTIONARY_ID || id > MAX_DICTIONARY_ID) {
+
+                    return false;
+                }
+
+                dicts.emplace(static_cast<unsigned char>(id), elems[i + 1].as_string());
+            }
+
+            return true;
+        }
+
+        inline auto prepare_dictionaries(const std::map<unsigned char, std::string> &dicts)
+            -> std::shared_ptr<const std::map<unsigned char, lz::dictionary>> {
+
+            auto prepared_ptr = std::make_shared<std::map<unsigned char, lz::dictionary>>();
+
+            for (const auto &dict : dicts) {
+                if (dict.first == NO_DICTIONARY_ID) {
+                    throw std::invalid_argument("Dictionary id 0 is reserved for no dictionary");
+                }
+
+                prepared_ptr->emplace(dict.first, lz::dictionary(dict.second));
+            }
+
+            return prepared_ptr;
+        }
+
+        inline void reload_dictionaries_async(const std::shared_ptr<dictionary_store> &store_ptr) {
+            if (store_ptr->is_reloading.exchange(true)) {
+                return;
+            }
+
+            const std::weak_ptr<dictionary_store> weak_store_ptr = store_ptr;
+
+            // sending within a reply callback is fine, as long as nothing waits for the reply
+            try {
+                store_ptr->client_ptr->hgetall(dictionary_key(store_ptr->name),
+                    [weak_store_ptr](cpp_redis::reply &r) {
+                        const auto store_ptr = weak_store_ptr.lock();
+
+                        if (!store_ptr) {
+                            return;
+                        }
+
+                        std::map<unsigned char, std::string> dicts;
+
+                        // keeps the previous dictionaries if the stored ones are invalid
+                        if (parse_dictionaries(r, dicts)) {
+                            std::atomic_store(&store_ptr->dicts_ptr, prepare_dictionaries(dicts));
+                        }
+
+                        store_ptr->is_reloading = false;
+                    });
+
+                store_ptr->client_ptr->commit();
+            }
+            catch (const std::exception &) {
+                // retried by the next value of an unknown dictionary
+                store_ptr->is_reloading = false;
+            }
+        }
+
+        inline auto store_dictionary(
+            redis_client_ptr client_ptr,
+            const std::string &name,
+            const unsigned char dict_id,
+            const std::string &dict) -> bool {
+
+            bool is_stored = false;
+
+            client_ptr->hsetnx(dictionary_key(name), std::to_string(dict_id), dict,
+                [&is_stored](cpp_redis::reply &r) {
+                    static constexpr auto FIELD_SET_RET_VAL = 1;
+
+                    if (r.is_integer() && r.as_integer() == FIELD_SET_RET_VAL) {
+                        is_stored = true;
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return is_stored;
+        }
+
+        inline auto sample_hash_values(
+            redis_client_ptr client_ptr,
+            const std::string &name,
+            const dictionary_codec &codec,
+            const size_t count) -> std::vector<std::string> {
+
+            std::vector<std::string> samples;
+            std::string cursor = "0";
+
+            do {
+                std::string next_cursor = "0";
+
+                client_ptr->send({"HSCAN", name, cursor, "COUNT", std::to_string(count)},
+                    [&](cpp_redis::reply &r) {
+                        if (!r.is_array() || r.as_array().size() != 2) {
+                            return;
+                        }
+
+                        const auto &page = r.as_array();
+
+                        if (page[0].is_bulk_string()) {
+                            next_cursor = page[0].as_string();
+                        }
+
+                        if (!page[1].is_array()) {
+                            return;
+                        }
+
+                        const auto &elems = page[1].as_array();
+
+                        // values of unknown dictionaries cannot be learnt from, so are skipped
+                        for (size_t i = 0; i + 1 < elems.size() && samples.size() < count; i += 2) {
+                            if (!elems[i + 1].is_bulk_string()) {
+                                continue;
+                            }
+
+                            const auto &value = elems[i + 1].as_string();
+                            std::string raw;
+
+                            if (codec.decompress(value.data(), value.size(), raw)) {
+                                samples.push_back(std::move(raw));
+                            }
+                        }
+                    });
+
+                sync_commit(client_ptr);
+                cursor = std::move(next_cursor);
+            } while (cursor != "0" && samples.size() < count);
+
+            return samples;
+        }
+    }
+}
@@ -0,0 +1,139 @@
+/**
+ * Contains the key expiry commands shared by all the containers,
+ * and the parsing of their replies.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    namespace details {
+        /**
+         * Performs the pexpire command on the container key.
+         *
+         * @return true if the timeout was set, false if the key does not exist.
+         */
+        auto expire_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the container key.
+         *
+         * @return Some(remaining time) if the key has a timeout, otherwise None.
+         */
+        auto ttl_impl(redis_client_ptr &client_ptr, const std::string &name)
+            -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * Performs the persist command on the container key.
+         *
+         * @return true if the timeout was removed.
+         */
+        auto persist_impl(redis_client_ptr &client_ptr, const std::string &name) -> bool;
+
+        /**
+         * Converts a pttl-like reply value into the remaining time.
+         *
+         * @return Some(remaining time) for non-negative values, None for -1 (no timeout)
+         * and -2 (no such key or field).
+         */
+        auto to_ttl(const int64_t value) -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * @return the first integer of a reply to a per-field command with a single field,
+         * which replies with an array of one integer per field, or def for any other reply.
+         */
+        auto first_field_integer(const cpp_redis::reply &r, const int64_t def) -> int64_t;
+    }
+
+    // implementation section
+
+    namespace details {
+        inline auto expire_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::chrono::milliseconds ttl) -> bool {
+
+            bool is_set = false;
+
+            // sent raw, since pexpire takes an int which wraps beyond about 24 days
+            client_ptr->send({"PEXPIRE", name, std::to_string(ttl.count())},
+                [&is_set](cpp_redis::reply &r) {
+                    static constexpr auto TIMEOUT_SET_RET_VAL = 1;
+
+                    if (r.is_integer() && r.as_integer() == TIMEOUT_SET_RET_VAL) {
+                        is_set = true;
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return is_set;
+        }
+
+        inline auto ttl_impl(redis_client_ptr &client_ptr, const std::string &name)
+            -> rustfp::Option<std::chrono::milliseconds> {
+
+            rustfp::Option<std::chrono::milliseconds> ttl_opt = rustfp::None;
+
+            client_ptr->pttl(name,
+                [&ttl_opt](cpp_redis::reply &r) {
+                    if (r.is_integer()) {
+                        ttl_opt = to_ttl(r.as_integer());
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return ttl_opt;
+        }
+
+        inline auto persist_impl(redis_client_ptr &client_ptr, const std::string &name) -> bool {
+            bool is_removed = false;
+
+            client_ptr->persist(name,
+                [&is_removed](cpp_redis::reply &r) {
+                    static constexpr auto TIMEOUT_REMOVED_RET_VAL = 1;
+
+                    if (r.is_integer() && r.as_integer() == TIMEOUT_REMOVED_RET_VAL) {
+                        is_removed = true;
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return is_removed;
+        }
+
+        inline auto to_ttl(const int64_t value) -> rustfp::Option<std::chrono::milliseconds> {
+            if (value < 0) {
+                return rustfp::None;
+            }
+
+            return rustfp::Some(std::chrono::milliseconds(value));
+        }
+
+        inline auto first_field_integer(const cpp_redis::reply &r, const int64_t def) -> int64_t {
+            if (!r.is_array() || r.as_array().empty() || !r.as_array().front().is_integer()) {
+                return def;
+            }
+
+            return r.as_array().front().as_integer();
+        }
+    }
+}
@@ -9,17 +9,25 @@
 #pragma once
 
 #include "alias.h"
+#include "codec.h"
+#include "decode.h"
+#include "expiry.h"
+#include "router.h"
 #include "util.h"
 
 #include "cpp_redis/cpp_redis"
 #include "msgpack.hpp"
 #include "rustfp/option.h"
 
+#include <chrono>
 #include <cstddef>
 #include <exception>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -28,12 +36,33 @@ namespace redispack {
     
     // declaration section
 
+    /**
+     * Outcome of writing entries together with a timeout.
+     */
+    struct ttl_write_result {
+        /** Number of new entries. */
+        size_t new_count;
+
+        /**
+         * Number of entries the timeout was applied to, 0 if the server
+         * does not support per-field expiry.
+         */
+        size_t expiring_count;
+
+        /**
+         * Number of entries deleted right away instead, since the timeout
+         * was not in the future.
+         */
+        size_t deleted_count;
+    };
+
     /** 
      * Provides hash like functionalities from redis.
      *
      * All the data is stored in the redis server.
+     * Values are stored with the Codec, while keys are always plain msgpack.
      */
-    template <class K, class V>
+    template <class K, class V, class Codec = msgpack_codec>
     class hash {
     public:
         /** Alias to the K template type, which is the key type. */
@@ -42,10 +71,25 @@ namespace redispack {
         /** Alias to the V template type, which is the value type. */
         using value_t = V;
 
+        /** Alias to the Codec template type, which stores the values. */
+        using codec_t = Codec;
+
         /**
          * Constructs this instance with the given client connection and hash key (name).
          */
-        hash(const redis_client_ptr &client_ptr, const std::string &name);
+        hash(
+            const redis_client_ptr &client_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * Constructs this instance with the given router and hash key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        hash(
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
 
         /** 
          * Performs hdel command.
@@ -68,6 +112,17 @@ namespace redispack {
          */
         auto get(const K &key) const -> rustfp::Option<V>;
 
+        /**
+         * Performs the hget command, but only decodes the given member of the value,
+         * which requires a codec that can read a single field, e.g. struct_codec.
+         *
+         * Vx only defers forming the member pointer type, and is always V.
+         *
+         * @return Some(member value) if the entry and its field exist, otherwise None.
+         */
+        template <class M, class Vx = V>
+        auto get_field(const K &key, M Vx::*member) const -> rustfp::Option<M>;
+
         /**
          * Performs the hkeys command.
          *
@@ -75,6 +130,27 @@ namespace redispack {
          */
         auto keys() const -> std::unordered_set<K>;
 
+        /**
+         * Performs the hkeys command, decoding straight into a set that allocates
+         * from alloc, e.g. redispack::arena_allocator for a request-scoped read.
+         *
+         * @param alloc allocator of K for the returned set
+         * @return keys from database, as a copy.
+         */
+        template <class Alloc>
+        auto keys(std::allocator_arg_t, const Alloc &alloc) const
+            -> std::unordered_set<K, std::hash<K>, std::equal_to<K>, Alloc>;
+
+        /**
+         * Performs the hkeys command.
+         *
+         * @param out output iterator to write the decoded keys into,
+         * e.g. std::back_inserter or redispack::sink
+         * @return output iterator past the last written key.
+         */
+        template <class OutIt>
+        auto keys(OutIt out) const -> OutIt;
+
         /** 
          * Performs the hlen command.
          *
@@ -104,6 +180,26 @@ namespace redispack {
          */
         auto vals() const -> std::vector<V>;
 
+        /**
+         * Performs the hvals command, decoding straight into a vector that allocates
+         * from alloc, e.g. redispack::arena_allocator for a request-scoped read.
+         *
+         * @param alloc allocator of V for the returned vector
+         * @return list of values as a copy.
+         */
+        template <class Alloc>
+        auto vals(std::allocator_arg_t, const Alloc &alloc) const -> std::vector<V, Alloc>;
+
+        /**
+         * Performs the hvals command.
+         *
+         * @param out output iterator to write the decoded values into,
+         * e.g. std::back_inserter or redispack::sink
+         * @return output iterator past the last written value.
+         */
+        template <class OutIt>
+        auto vals(OutIt out) const -> OutIt;
+
         /**
          * Additional functionality by zipping the key and value side-by-side.
          *
@@ -111,25 +207,142 @@ namespace redispack {
          */
         auto key_vals() const -> std::unordered_map<K, V>;
 
+        /**
+         * Additional functionality by zipping the key and value side-by-side,
+         * where both the map and the intermediate keys allocate from alloc.
+         *
+         * @param alloc allocator of std::pair<const K, V> for the returned map
+         * @return keys with corresponding values as a copy.
+         */
+        template <class Alloc>
+        auto key_vals(std::allocator_arg_t, const Alloc &alloc) const
+            -> std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, Alloc>;
+
+        /**
+         * Performs the pexpire command on the hash key.
+         *
+         * @return true if the timeout was set, false if the hash does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the hash key.
+         *
+         * @return Some(remaining time) if the hash has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * Performs the persist command on the hash key.
+         *
+         * @return true if the timeout was removed.
+         */
+        auto persist() -> bool;
+
+        /**
+         * Performs the hpexpire command on a single entry, requires Redis 7.4 or later.
+         *
+         * @return true if the timeout was set, false if the entry does not exist
+         * or the server does not support per-field expiry.
+         */
+        auto expire_field(const K &key, const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the hpttl command on a single entry, requires Redis 7.4 or later.
+         *
+         * @return Some(remaining time) if the entry has a timeout, otherwise None.
+         */
+        auto field_ttl(const K &key) const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * Performs the hpersist command on a single entry, requires Redis 7.4 or later.
+         *
+         * @return true if the timeout was removed.
+         */
+        auto persist_field(const K &key) -> bool;
+
+        /**
+         * Performs the hset command followed by the hpexpire command on the same entries,
+         * pipelined into a single round trip. Requires Redis 7.4 or later,
+         * older servers write the entries without the timeout.
+         *
+         * @return number of new entries, number of entries the timeout was applied to
+         * and number of entries deleted because the timeout was not in the future.
+         * Entries deleted by another client in between are in neither count.
+         */
+        auto set_with_ttl(
+            const std::vector<std::pair<K, V>> &entries,
+            const std::chrono::milliseconds ttl) -> ttl_write_result;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return router of the reads, null if not routed.
+         */
+        auto get_router_ptr() const -> const std::shared_ptr<replica_router> &;
+
+        /**
+         * @return hash key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+        /**
+         * @return codec used to store the values.
+         */
+        auto get_codec() const -> const Codec &;
+
     private:
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
         /** Holds a shared ownership to access the database. */
         mutable redis_client_ptr client_ptr;
 
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
         /** Hash key (name). */
         std::string name;
+
+        /** Stores the values. */
+        Codec codec;
     };
 
     // implementation section
 
-    template <class K, class V>
-    hash<K, V>::hash(const redis_client_ptr &client_ptr, const std::string &name) :
+    template <class K, class V, class Codec>
+    hash<K, V, Codec>::hash(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
         client_ptr(client_ptr),
-        name(name) {
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class K, class V, class Codec>
+    hash<K, V, Codec>::hash(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name),
+        codec(codec) {
 
     }
 
-    template <class K, class V>
-    auto hash<K, V>::del(const K &key) -> bool {
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::del(const K &key) -> bool {
         const auto key_strs = std::vector<std::string>{details::encode_into_str(key)};
         bool deleted = false;
 
@@ -141,15 +354,19 @@ namespace redispack {
             });
 
         details::sync_commit(client_ptr);
+        mark_write();
         return deleted;
     }
 
-    template <class K, class V>
-    auto hash<K, V>::exists(const K &key) const -> bool {
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::exists(const K &key) const -> bool {
         const auto key_str = details::encode_into_str(key);
         bool is_present = false;
 
-        client_ptr->hexists(name, key_str,
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->hexists(name, key_str,
             [&is_present](cpp_redis::reply &r) {
                 static constexpr auto CONTAINS_FIELD_RET_VAL = 1;
 
@@ -158,71 +375,126 @@ namespace redispack {
                 }
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
         return is_present;
     }
 
     
-    template <class K, class V>
-    auto hash<K, V>::get(const K &key) const -> rustfp::Option<V> {
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::get(const K &key) const -> rustfp::Option<V> {
         const auto key_str = details::encode_into_str(key);
         rustfp::Option<V> value_opt = rustfp::None;
 
-        client_ptr->hget(name, key_str,
-            [&value_opt](cpp_redis::reply &r) {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->hget(name, key_str,
+            [this, &value_opt](cpp_redis::reply &r) {
                 if (r.is_bulk_string()) {
-                    value_opt = details::decode_from_str<V>(r.as_string());
+                    const auto &str = r.as_string();
+                    value_opt = codec.template decode<V>(str.data(), str.size());
                 }
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
         return std::move(value_opt);
     }
 
-    template <class K, class V>
-    auto hash<K, V>::keys() const -> std::unordered_set<K> {
-        std::unordered_set<K> keys;
-
-        client_ptr->hkeys(name,
-            [&keys](cpp_redis::reply &r) {
-                if (r.is_array()) {
-                    for (const auto &sub_r : r.as_array()) {
-                        if (sub_r.is_bulk_string()) {
-                            auto key_opt = details::decode_from_str<K>(
-                                sub_r.as_string());
-
-                            std::move(key_opt).match_some(
-                                [&keys](K &&key) {
-                                    keys.insert(std::move(key));
-                                });
-                        }
-                    }
+    template <class K, class V, class Codec>
+    template <class M, class Vx>
+    auto hash<K, V, Codec>::get_field(const K &key, M Vx::*member) const -> rustfp::Option<M> {
+        const auto key_str = details::encode_into_str(key);
+        rustfp::Option<M> member_opt = rustfp::None;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->hget(name, key_str,
+            [this, &member_opt, member](cpp_redis::reply &r) {
+                if (r.is_bulk_string()) {
+                    const auto &str = r.as_string();
+                    member_opt = codec.template read_field<Vx>(str.data(), str.size(), member);
                 }
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
+        return member_opt;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::keys() const -> std::unordered_set<K> {
+        return keys(std::allocator_arg, std::allocator<K>());
+    }
+
+    template <class K, class V, class Codec>
+    template <class Alloc>
+    auto hash<K, V, Codec>::keys(std::allocator_arg_t, const Alloc &alloc) const
+        -> std::unordered_set<K, std::hash<K>, std::equal_to<K>, Alloc> {
+
+        std::unordered_set<K, std::hash<K>, std::equal_to<K>, Alloc> keys(0, std::hash<K>(),
+            std::equal_to<K>(), alloc);
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->hkeys(name,
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        if (reply.is_array()) {
+            keys.reserve(reply.as_array().size());
+        }
+
+        details::decode_reply_array<K>(reply, std::inserter(keys, keys.end()));
         return keys;
     }
 
-    template <class K, class V>
-    auto hash<K, V>::len() const -> size_t {
+    template <class K, class V, class Codec>
+    template <class OutIt>
+    auto hash<K, V, Codec>::keys(OutIt out) const -> OutIt {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->hkeys(name,
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        out = details::decode_reply_array<K>(reply, std::move(out));
+        return out;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::len() const -> size_t {
         size_t length = 0;
 
-        client_ptr->hlen(name,
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->hlen(name,
             [&length](cpp_redis::reply &r) {
                 if (r.is_integer()) {
                     length = static_cast<size_t>(r.as_integer());
                 }
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
         return length;
     }
 
-    template <class K, class V>
-    auto hash<K, V>::set(const K &key, const V &value) -> bool {
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::set(const K &key, const V &value) -> bool {
         const auto key_str = details::encode_into_str(key);
-        const auto val_str = details::encode_into_str(value);
+        const auto val_str = codec.encode(value);
 
         bool is_new_field = false;
 
@@ -236,13 +508,14 @@ namespace redispack {
             });
 
         details::sync_commit(client_ptr);
+        mark_write();
         return is_new_field;
     }
 
-    template <class K, class V>
-    auto hash<K, V>::setnx(const K &key, const V &value) -> bool {
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::setnx(const K &key, const V &value) -> bool {
         const auto key_str = details::encode_into_str(key);
-        const auto val_str = details::encode_into_str(value);
+        const auto val_str = codec.encode(value);
 
         bool is_new_field = false;
 
@@ -256,39 +529,76 @@ namespace redispack {
             });
 
         details::sync_commit(client_ptr);
+        mark_write();
         return is_new_field;
     }
 
-    template <class K, class V>
-    auto hash<K, V>::vals() const -> std::vector<V> {
-        std::vector<V> values;
-
-        client_ptr->hvals(name,
-            [&values](cpp_redis::reply &r) {
-                if (r.is_array()) {
-                    for (const auto &sub_r : r.as_array()) {
-                        if (sub_r.is_bulk_string()) {
-                            auto value_opt = details::decode_from_str<V>(sub_r.as_string());
-
-                            std::move(value_opt).match_some(
-                                [&values](V &&value) {
-                                    values.push_back(std::move(value));
-                                });
-                        }
-                    }
-                }
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::vals() const -> std::vector<V> {
+        return vals(std::allocator_arg, std::allocator<V>());
+    }
+
+    template <class K, class V, class Codec>
+    template <class Alloc>
+    auto hash<K, V, Codec>::vals(std::allocator_arg_t, const Alloc &alloc) const
+        -> std::vector<V, Alloc> {
+
+        std::vector<V, Alloc> values(alloc);
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->hvals(name,
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
+
+        if (reply.is_array()) {
+            values.reserve(reply.as_array().size());
+        }
+
+        details::decode_reply_array<V>(reply, std::back_inserter(values), codec);
         return values;
     }
 
-    template <class K, class V>
-    auto hash<K, V>::key_vals() const -> std::unordered_map<K, V> {
-        const auto ks = keys();
+    template <class K, class V, class Codec>
+    template <class OutIt>
+    auto hash<K, V, Codec>::vals(OutIt out) const -> OutIt {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->hvals(name,
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        out = details::decode_reply_array<V>(reply, std::move(out), codec);
+        return out;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::key_vals() const -> std::unordered_map<K, V> {
+        return key_vals(std::allocator_arg, std::allocator<std::pair<const K, V>>());
+    }
+
+    template <class K, class V, class Codec>
+    template <class Alloc>
+    auto hash<K, V, Codec>::key_vals(std::allocator_arg_t, const Alloc &alloc) const
+        -> std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, Alloc> {
+
+        using key_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<K>;
+        const auto ks = keys(std::allocator_arg, key_alloc_t(alloc));
 
-        std::unordered_map<K, V> key_vals;
-        key_vals.reserve(ks.size());
+        std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, Alloc> key_vals(ks.size(),
+            std::hash<K>(), std::equal_to<K>(), alloc);
 
         for (const auto &k : ks) {
             get(k).match_some(
@@ -300,4 +610,168 @@ namespace redispack {
         // nothing to commit here the suboperations will do the commit
         return key_vals;
     }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::get_router_ptr() const -> const std::shared_ptr<replica_router> & {
+        return router_ptr;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::get_name() const -> const std::string & {
+        return name;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::persist() -> bool {
+        const auto is_removed = details::persist_impl(client_ptr, name);
+        mark_write();
+        return is_removed;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::expire_field(const K &key, const std::chrono::milliseconds ttl) -> bool {
+        bool is_set = false;
+
+        client_ptr->send(
+            {"HPEXPIRE", name, std::to_string(ttl.count()), "FIELDS", "1",
+                details::encode_into_str(key)},
+            [&is_set](cpp_redis::reply &r) {
+                static constexpr auto TIMEOUT_SET_RET_VAL = 1;
+                is_set = details::first_field_integer(r, 0) == TIMEOUT_SET_RET_VAL;
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return is_set;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::field_ttl(const K &key) const -> rustfp::Option<std::chrono::milliseconds> {
+        static constexpr auto NO_SUCH_FIELD_RET_VAL = -2;
+        rustfp::Option<std::chrono::milliseconds> ttl_opt = rustfp::None;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->send({"HPTTL", name, "FIELDS", "1", details::encode_into_str(key)},
+            [&ttl_opt](cpp_redis::reply &r) {
+                ttl_opt = details::to_ttl(details::first_field_integer(r, NO_SUCH_FIELD_RET_VAL));
+            });
+
+        details::sync_commit(read_client_ptr);
+        return ttl_opt;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::persist_field(const K &key) -> bool {
+        bool is_removed = false;
+
+        client_ptr->send({"HPERSIST", name, "FIELDS", "1", details::encode_into_str(key)},
+            [&is_removed](cpp_redis::reply &r) {
+                static constexpr auto TIMEOUT_REMOVED_RET_VAL = 1;
+                is_removed = details::first_field_integer(r, 0) == TIMEOUT_REMOVED_RET_VAL;
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return is_removed;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::set_with_ttl(
+        const std::vector<std::pair<K, V>> &entries,
+        const std::chrono::milliseconds ttl) -> ttl_write_result {
+
+        if (entries.empty()) {
+            return ttl_write_result{0, 0, 0};
+        }
+
+        std::vector<std::string> set_cmd{"HSET", name};
+        set_cmd.reserve(2 + entries.size() * 2);
+
+        std::vector<std::string> expire_cmd{
+            "HPEXPIRE", name, std::to_string(ttl.count()), "FIELDS", std::to_string(entries.size())};
+
+        expire_cmd.reserve(5 + entries.size());
+
+        for (const auto &entry : entries) {
+            set_cmd.push_back(details::encode_into_str(entry.first));
+            set_cmd.push_back(codec.encode(entry.second));
+            expire_cmd.push_back(set_cmd[set_cmd.size() - 2]);
+        }
+
+        ttl_write_result result{0, 0, 0};
+
+        client_ptr->send(set_cmd,
+            [&result](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    result.new_count = static_cast<size_t>(r.as_integer());
+                }
+            });
+
+        // sent together with the write, so both travel in a single round trip
+        client_ptr->send(expire_cmd,
+            [&result](cpp_redis::reply &r) {
+                static constexpr auto TIMEOUT_SET_RET_VAL = 1;
+                static constexpr auto FIELD_DELETED_RET_VAL = 2;
+
+                // an error reply when the server does not support per-field expiry
+                if (!r.is_array()) {
+                    return;
+                }
+
+                // any other code, e.g. -2 for a field deleted in between, is in neither count
+                for (const auto &field_r : r.as_array()) {
+                    if (!field_r.is_integer()) {
+                        continue;
+                    }
+
+                    if (field_r.as_integer() == TIMEOUT_SET_RET_VAL) {
+                        ++result.expiring_count;
+                    }
+                    else if (field_r.as_integer() == FIELD_DELETED_RET_VAL) {
+                        ++result.deleted_count;
+                    }
+                }
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return result;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::get_codec() const -> const Codec & {
+        return codec;
+    }
+
+    template <class K, class V, class Codec>
+    auto hash<K, V, Codec>::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    template <class K, class V, class Codec>
+    void hash<K, V, Codec>::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
 }
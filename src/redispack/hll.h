@@ -0,0 +1,822 @@
+/**
+ * Provides the HyperLogLog functions from redis, which count the distinct
+ * members approximately in at most 12 KB per counter, and a local sketch
+ * which aggregates the additions in process before merging them into redis.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "expiry.h"
+#include "keyspace.h"
+#include "router.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    namespace details {
+        /** Number of bits of the hash which select the register, same as redis. */
+        static constexpr size_t HLL_P = 14;
+
+        /** Number of registers, same as redis. */
+        static constexpr size_t HLL_REGISTERS = size_t(1) << HLL_P;
+
+        /** Number of bits of the hash left to count the run of zeros. */
+        static constexpr size_t HLL_Q = 64 - HLL_P;
+
+        /** Number of bits per register in the dense encoding. */
+        static constexpr size_t HLL_BITS = 6;
+
+        /** Size of the header before the registers, holding the magic, encoding and cache. */
+        static constexpr size_t HLL_HEADER_SIZE = 16;
+
+        /** Size of the dense encoding, which redis only accepts in full. */
+        static constexpr size_t HLL_DENSE_SIZE =
+            HLL_HEADER_SIZE + (HLL_REGISTERS * HLL_BITS + 7) / 8;
+
+        /** Seed of the member hash, same as redis. */
+        static constexpr uint64_t HLL_HASH_SEED = 0xadc83b19ULL;
+
+        /**
+         * Merges ARGV[1] into KEYS[1] through the staging KEYS[2], atomically.
+         * The staging key is deleted even if the merge fails, whose error is returned.
+         */
+        static constexpr auto HLL_MERGE_SCRIPT =
+            "redis.call('SET', KEYS[2], ARGV[1]) "
+            "local merged = redis.pcall('PFMERGE', KEYS[1], KEYS[1], KEYS[2]) "
+            "redis.call('DEL', KEYS[2]) "
+            "return merged";
+
+        /** Registers of a sketch, one byte per register. */
+        using hll_registers = std::array<uint8_t, HLL_REGISTERS>;
+    }
+
+    /**
+     * Provides HyperLogLog like functionalities from redis.
+     *
+     * All the data is stored in the redis server.
+     * Members are encoded with the Codec before being hashed by the server.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class hll {
+    public:
+        /** Alias to the T template type, which is the member type. */
+        using value_t = T;
+
+        /** Alias to the Codec template type, which encodes the members. */
+        using codec_t = Codec;
+
+        /**
+         * Constructs this instance with the given client connection and key (name).
+         */
+        hll(
+            const redis_client_ptr &client_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * Constructs this instance with the given router and key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        hll(
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * pfadd
+         * @param member first member to add
+         * @param members other members to add
+         * @return true if the approximated count changed
+         */
+        template <class... Ts>
+        auto add(const T &member, const Ts &... members) -> bool;
+
+        /**
+         * pfadd with all the members in a single command.
+         * @param begin_it begin iterator of members to add
+         * @param end_it end iterator of members to add
+         * @return true if the approximated count changed
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto add(const TBeginIter &begin_it, const TEndIter &end_it) -> bool;
+
+        /**
+         * Deletes the counter.
+         * @return true if the counter existed
+         */
+        auto clear() -> bool;
+
+        /**
+         * pfcount
+         * @return approximated number of distinct members
+         */
+        auto count() const -> size_t;
+
+        /**
+         * pfcount over this and the other counters, without merging them.
+         * @return approximated number of distinct members across all the counters
+         */
+        template <class... Txs>
+        auto count_union(const hll<Txs, Codec> &... others) const -> size_t;
+
+        /**
+         * pfmerge of the other counters into this counter.
+         * @return true if the merge succeeded
+         */
+        template <class... Txs>
+        auto merge(const hll<Txs, Codec> &... sources) -> bool;
+
+        /**
+         * Performs the pexpire command on the counter key.
+         *
+         * @return true if the timeout was set, false if the counter does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the counter key.
+         *
+         * @return Some(remaining time) if the counter has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return counter key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+        /**
+         * @return codec which encodes the members.
+         */
+        auto get_codec() const noexcept -> const Codec &;
+
+    private:
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
+        /** Holds a shared ownership to access the database. */
+        mutable redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Counter key (name). */
+        std::string name;
+
+        /** Encodes the members. */
+        Codec codec;
+    };
+
+    /**
+     * Controls when the local sketch is flushed.
+     */
+    struct hll_sketch_options {
+        /** Time between the flushes of the sketch into the counter. */
+        std::chrono::milliseconds flush_interval;
+    };
+
+    /**
+     * @return defaults of flushing every second.
+     */
+    auto default_hll_sketch_options() noexcept -> hll_sketch_options;
+
+    /**
+     * Aggregates additions to a counter in process, with the same hashing as redis,
+     * and periodically merges the registers into the counter in a single transaction,
+     * so that any number of additions costs one round trip per flush.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class hll_sketch {
+    public:
+        /**
+         * Constructs the sketch and starts the flusher thread.
+         *
+         * @param target counter to merge the sketch into
+         * @param options controls when the sketch is flushed
+         */
+        explicit hll_sketch(
+            const hll<T, Codec> &target,
+            const hll_sketch_options &options = default_hll_sketch_options());
+
+        /**
+         * Stops the flusher thread and flushes the remaining additions.
+         */
+        ~hll_sketch();
+
+        hll_sketch(const hll_sketch &) = delete;
+        auto operator=(const hll_sketch &) -> hll_sketch & = delete;
+
+        /**
+         * Adds the members to the sketch only. Thread-safe.
+         * @return true if any register changed
+         */
+        template <class... Ts>
+        auto add(const T &member, const Ts &... members) -> bool;
+
+        /**
+         * Adds the members to the sketch only. Thread-safe.
+         * @param begin_it begin iterator of members to add
+         * @param end_it end iterator of members to add
+         * @return true if any register changed
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto add(const TBeginIter &begin_it, const TEndIter &end_it) -> bool;
+
+        /**
+         * @return approximated number of distinct members added since the last flush.
+         */
+        auto count() const -> size_t;
+
+        /**
+         * Merges the sketch into the counter and resets the sketch. Thread-safe.
+         * The registers are kept in the sketch if the merge fails.
+         *
+         * @return true if there were additions to merge.
+         */
+        auto flush() -> bool;
+
+    private:
+        /** Flushes periodically until stopped. */
+        void run();
+
+        /** @return true if any register changed, must hold registers_mutex. */
+        auto add_encoded(const std::string &member_str) -> bool;
+
+        /** Counter to merge the sketch into. */
+        hll<T, Codec> target;
+
+        /** Holds a shared ownership to access the database. */
+        redis_client_ptr client_ptr;
+
+        /** Controls when the sketch is flushed. */
+        hll_sketch_options options;
+
+        /** Guards the registers. */
+        mutable std::mutex registers_mutex;
+
+        /** Registers aggregated since the last flush. */
+        details::hll_registers registers;
+
+        /** Set when any register changed since the last flush. */
+        bool is_dirty;
+
+        /** Set when the sketch is being destroyed. */
+        std::atomic<bool> is_stopping;
+
+        /** Only guards the wake-up condition of the flusher thread. */
+        std::mutex wake_mutex;
+
+        /** Wakes up the flusher thread. */
+        std::condition_variable wake_cv;
+
+        /** Flusher thread. */
+        std::thread flusher;
+    };
+
+    namespace details {
+        /**
+         * Performs the pfadd command with all the encoded members.
+         * @return true if the approximated count changed.
+         */
+        auto pfadd_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::vector<std::string> &member_strs) -> bool;
+
+        /**
+         * 64-bit MurmurHash2 by Austin Appleby, same as the member hash in redis,
+         * reading the blocks as little-endian regardless of the platform.
+         */
+        auto murmur_hash64a(const char *data, const size_t size, const uint64_t seed) noexcept
+            -> uint64_t;
+
+        /**
+         * Adds the encoded member into the registers, same as pfadd.
+         * @return true if the register changed.
+         */
+        auto hll_add(hll_registers &registers, const char *data, const size_t size) noexcept
+            -> bool;
+
+        /**
+         * @return approximated number of distinct members, same estimator as pfcount.
+         */
+        auto hll_count(const hll_registers &registers) -> size_t;
+
+        /**
+         * Merges the source registers into the destination by keeping the maximum.
+         */
+        void hll_merge(hll_registers &dst, const hll_registers &src) noexcept;
+
+        /**
+         * @return registers in the dense encoding accepted by pfmerge,
+         * with the cached count marked as stale.
+         */
+        auto hll_dense(const hll_registers &registers) -> std::string;
+
+        /** sigma function of the improved estimator, same as redis. */
+        auto hll_sigma(double x) -> double;
+
+        /** tau function of the improved estimator, same as redis. */
+        auto hll_tau(double x) -> double;
+    }
+
+    // implementation section
+
+    template <class T, class Codec>
+    hll<T, Codec>::hll(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(client_ptr),
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    hll<T, Codec>::hll(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    template <class... Ts>
+    auto hll<T, Codec>::add(const T &member, const Ts &... members) -> bool {
+        const std::vector<std::string> member_strs{codec.encode(member), codec.encode(members)...};
+        const auto is_changed = details::pfadd_impl(client_ptr, name, member_strs);
+        mark_write();
+        return is_changed;
+    }
+
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto hll<T, Codec>::add(const TBeginIter &begin_it, const TEndIter &end_it) -> bool {
+        const auto member_strs = details::str_vectorize_range<T>(begin_it, end_it, codec);
+        const auto is_changed = details::pfadd_impl(client_ptr, name, member_strs);
+        mark_write();
+        return is_changed;
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::clear() -> bool {
+        const auto deleted = details::del_impl(client_ptr, name);
+        mark_write();
+        return deleted;
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::count() const -> size_t {
+        return count_union();
+    }
+
+    template <class T, class Codec>
+    template <class... Txs>
+    auto hll<T, Codec>::count_union(const hll<Txs, Codec> &... others) const -> size_t {
+        size_t cardinality = 0;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->send({"PFCOUNT", name, others.get_name()...},
+            [&cardinality](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    cardinality = static_cast<size_t>(r.as_integer());
+                }
+            });
+
+        details::sync_commit(read_client_ptr);
+        return cardinality;
+    }
+
+    template <class T, class Codec>
+    template <class... Txs>
+    auto hll<T, Codec>::merge(const hll<Txs, Codec> &... sources) -> bool {
+        bool is_merged = false;
+
+        client_ptr->send({"PFMERGE", name, sources.get_name()...},
+            [&is_merged](cpp_redis::reply &r) {
+                is_merged = r.is_simple_string();
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return is_merged;
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::get_name() const -> const std::string & {
+        return name;
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::get_codec() const noexcept -> const Codec & {
+        return codec;
+    }
+
+    template <class T, class Codec>
+    auto hll<T, Codec>::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    template <class T, class Codec>
+    void hll<T, Codec>::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
+
+    inline auto default_hll_sketch_options() noexcept -> hll_sketch_options {
+        static constexpr auto DEFAULT_FLUSH_INTERVAL_MS = 1000;
+        return hll_sketch_options{std::chrono::milliseconds(DEFAULT_FLUSH_INTERVAL_MS)};
+    }
+
+    template <class T, class Codec>
+    hll_sketch<T, Codec>::hll_sketch(
+        const hll<T, Codec> &target,
+        const hll_sketch_options &options) :
+
+        target(target),
+        client_ptr(target.get_client_ptr()),
+        options(options),
+        registers{},
+        is_dirty(false),
+        is_stopping(false) {
+
+        flusher = std::thread([this] { run(); });
+    }
+
+    template <class T, class Codec>
+    hll_sketch<T, Codec>::~hll_sketch() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            is_stopping = true;
+        }
+
+        wake_cv.notify_one();
+        flusher.join();
+    }
+
+    template <class T, class Codec>
+    template <class... Ts>
+    auto hll_sketch<T, Codec>::add(const T &member, const Ts &... members) -> bool {
+        const auto &codec = target.get_codec();
+        const std::vector<std::string> member_strs{codec.encode(member), codec.encode(members)...};
+
+        std::lock_guard<std::mutex> lock(registers_mutex);
+        bool is_changed = false;
+
+        for (const auto &member_str : member_strs) {
+            is_changed = add_encoded(member_str) || is_changed;
+        }
+
+        return is_changed;
+    }
+
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto hll_sketch<T, Codec>::add(const TBeginIter &begin_it, const TEndIter &end_it) -> bool {
+        const auto member_strs = details::str_vectorize_range<T>(
+            begin_it, end_it, target.get_codec());
+
+        std::lock_guard<std::mutex> lock(registers_mutex);
+        bool is_changed = false;
+
+        for (const auto &member_str : member_strs) {
+            is_changed = add_encoded(member_str) || is_changed;
+        }
+
+        return is_changed;
+    }
+
+    template <class T, class Codec>
+    auto hll_sketch<T, Codec>::count() const -> size_t {
+        std::lock_guard<std::mutex> lock(registers_mutex);
+        return details::hll_count(registers);
+    }
+
+    template <class T, class Codec>
+    auto hll_sketch<T, Codec>::flush() -> bool {
+        details::hll_registers flushed{};
+
+        {
+            std::lock_guard<std::mutex> lock(registers_mutex);
+
+            if (!is_dirty) {
+                return false;
+            }
+
+            flushed = registers;
+            registers.fill(0);
+            is_dirty = false;
+        }
+
+        const auto &name = target.get_name();
+        const auto staging_name = name + ":redispack-sketch";
+
+        try {
+            bool is_merged = false;
+
+            // a single script, so the staging key never outlives it even with concurrent
+            // sketches, and no other command on the shared client can interleave into it
+            client_ptr->send(
+                {"EVAL", details::HLL_MERGE_SCRIPT, "2", name, staging_name,
+                    details::hll_dense(flushed)},
+                [&is_merged](cpp_redis::reply &r) {
+                    is_merged = !r.is_error() && !r.is_null();
+                });
+
+            details::sync_commit(client_ptr);
+
+            if (!is_merged) {
+                throw std::runtime_error("Unable to merge the sketch into " + name);
+            }
+        }
+        catch (const std::exception &) {
+            // keeps the additions for the next flush
+            std::lock_guard<std::mutex> lock(registers_mutex);
+            details::hll_merge(registers, flushed);
+            is_dirty = true;
+            throw;
+        }
+
+        return true;
+    }
+
+    template <class T, class Codec>
+    void hll_sketch<T, Codec>::run() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+
+            wake_cv.wait_for(lock, options.flush_interval, [this] {
+                return is_stopping.load();
+            });
+
+            const bool should_stop = is_stopping;
+            lock.unlock();
+
+            try {
+                flush();
+            }
+            catch (const std::exception &) {
+                // retried on the next flush, since the registers are kept
+            }
+
+            if (should_stop) {
+                break;
+            }
+        }
+    }
+
+    template <class T, class Codec>
+    auto hll_sketch<T, Codec>::add_encoded(const std::string &member_str) -> bool {
+        const auto is_changed = details::hll_add(registers, member_str.data(), member_str.size());
+        is_dirty = is_dirty || is_changed;
+        return is_changed;
+    }
+
+    namespace details {
+        inline auto pfadd_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::vector<std::string> &member_strs) -> bool {
+
+            std::vector<std::string> cmd{"PFADD", name};
+            cmd.insert(cmd.end(), member_strs.cbegin(), member_strs.cend());
+
+            bool is_changed = false;
+
+            client_ptr->send(cmd,
+                [&is_changed](cpp_redis::reply &r) {
+                    static constexpr auto CHANGED_RET_VAL = 1;
+
+                    if (r.is_integer() && r.as_integer() == CHANGED_RET_VAL) {
+                        is_changed = true;
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return is_changed;
+        }
+
+        inline auto murmur_hash64a(
+            const char *data,
+            const size_t size,
+            const uint64_t seed) noexcept -> uint64_t {
+
+            static constexpr uint64_t M = 0xc6a4a7935bd1e995ULL;
+            static constexpr int R = 47;
+
+            const auto bytes = reinterpret_cast<const uint8_t *>(data);
+            const auto block_end = size - (size & 7);
+
+            uint64_t h = seed ^ (static_cast<uint64_t>(size) * M);
+
+            for (size_t i = 0; i < block_end; i += 8) {
+                uint64_t k = 0;
+
+                for (size_t j = 0; j < 8; ++j) {
+                    k |= static_cast<uint64_t>(bytes[i + j]) << (j * 8);
+                }
+
+                k *= M;
+                k ^= k >> R;
+                k *= M;
+
+                h ^= k;
+                h *= M;
+            }
+
+            const auto tail_size = size & 7;
+
+            if (tail_size > 0) {
+                for (size_t j = tail_size; j > 0; --j) {
+                    h ^= static_cast<uint64_t>(bytes[block_end + j - 1]) << ((j - 1) * 8);
+                }
+
+                h *= M;
+            }
+
+            h ^= h >> R;
+            h *= M;
+            h ^= h >> R;
+            return h;
+        }
+
+        inline auto hll_add(hll_registers &registers, const char *data, const size_t size) noexcept
+            -> bool {
+
+            auto hash = murmur_hash64a(data, size, HLL_HASH_SEED);
+            const auto index = static_cast<size_t>(hash & (HLL_REGISTERS - 1));
+
+            // the sentinel bit caps the run of zeros, so that the count fits the register
+            hash >>= HLL_P;
+            hash |= uint64_t(1) << HLL_Q;
+
+            uint8_t count = 1;
+
+            for (uint64_t bit = 1; (hash & bit) == 0; bit <<= 1) {
+                ++count;
+            }
+
+            if (count <= registers[index]) {
+                return false;
+            }
+
+            registers[index] = count;
+            return true;
+        }
+
+        inline auto hll_count(const hll_registers &registers) -> size_t {
+            static constexpr double HLL_ALPHA_INF = 0.721347520444481703680;
+
+            std::array<size_t, HLL_Q + 2> histogram{};
+
+            for (const auto reg : registers) {
+                ++histogram[reg];
+            }
+
+            const auto m = static_cast<double>(HLL_REGISTERS);
+            auto z = m * hll_tau((m - static_cast<double>(histogram[HLL_Q + 1])) / m);
+
+            for (size_t j = HLL_Q; j >= 1; --j) {
+                z += static_cast<double>(histogram[j]);
+                z *= 0.5;
+            }
+
+            z += m * hll_sigma(static_cast<double>(histogram[0]) / m);
+            return static_cast<size_t>(std::llround(HLL_ALPHA_INF * m * m / z));
+        }
+
+        inline void hll_merge(hll_registers &dst, const hll_registers &src) noexcept {
+            for (size_t i = 0; i < HLL_REGISTERS; ++i) {
+                dst[i] = std::max(dst[i], src[i]);
+            }
+        }
+
+        inline auto hll_dense(const hll_registers &registers) -> std::string {
+            static constexpr uint8_t STALE_CACHE_BIT = 0x80;
+
+            // magic, dense encoding, 3 unused bytes and 8 bytes of cached count
+            std::string dense(HLL_DENSE_SIZE, '\0');
+            dense.replace(0, 4, "HYLL");
+            dense[HLL_HEADER_SIZE - 1] = static_cast<char>(STALE_CACHE_BIT);
+
+            const auto out = reinterpret_cast<uint8_t *>(&dense[HLL_HEADER_SIZE]);
+
+            // registers are packed from the least significant bit, and may straddle two bytes
+            for (size_t i = 0; i < HLL_REGISTERS; ++i) {
+                const auto byte = i * HLL_BITS / 8;
+                const auto shift = i * HLL_BITS % 8;
+                const auto reg = static_cast<unsigned>(registers[i]);
+
+                out[byte] |= static_cast<uint8_t>(reg << shift);
+
+                if (shift > 8 - HLL_BITS) {
+                    out[byte + 1] |= static_cast<uint8_t>(reg >> (8 - shift));
+                }
+            }
+
+            return dense;
+        }
+
+        inline auto hll_sigma(double x) -> double {
+            if (x == 1.0) {
+                return std::numeric_limits<double>::infinity();
+            }
+
+            double y = 1.0;
+            double z = x;
+            double z_prev = 0.0;
+
+            do {
+                x *= x;
+                z_prev = z;
+                z += x * y;
+                y += y;
+            } while (z_prev != z);
+
+            return z;
+        }
+
+        inline auto hll_tau(double x) -> double {
+            if (x == 0.0 || x == 1.0) {
+                return 0.0;
+            }
+
+            double y = 1.0;
+            double z = 1.0 - x;
+            double z_prev = 0.0;
+
+            do {
+                x = std::sqrt(x);
+                z_prev = z;
+                y *= 0.5;
+                z -= (1.0 - x) * (1.0 - x) * y;
+            } while (z_prev != z);
+
+            return z / 3.0;
+        }
+    }
+}
@@ -0,0 +1,742 @@
+/**
+ * Provides the plain string key functions from redis, where value holds
+ * a single key and keyspace holds every key under a common prefix,
+ * which makes it similar to the cutdown version of std::unordered_map
+ * with batched reads and writes.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "expiry.h"
+#include "router.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Condition for the set command to write the value.
+     */
+    enum class set_condition {
+        /** Always writes. */
+        always,
+
+        /** Only writes if the key does not exist, same as NX. */
+        if_absent,
+
+        /** Only writes if the key already exists, same as XX. */
+        if_present,
+    };
+
+    /**
+     * Controls how the set command writes the value.
+     */
+    struct set_options {
+        /** Timeout of the key, same as PX. 0 keeps the key without a timeout. */
+        std::chrono::milliseconds ttl;
+
+        /** Condition to write the value. */
+        set_condition condition;
+    };
+
+    /**
+     * @return defaults of no timeout and always writing.
+     */
+    auto default_set_options() noexcept -> set_options;
+
+    /**
+     * Provides a single plain string key from redis holding a value.
+     *
+     * All the data is stored in the redis server.
+     * The value is stored with the Codec.
+     */
+    template <class V, class Codec = msgpack_codec>
+    class value {
+    public:
+        /** Alias to the V template type, which is the value type. */
+        using value_t = V;
+
+        /** Alias to the Codec template type, which stores the value. */
+        using codec_t = Codec;
+
+        /**
+         * Constructs this instance with the given client connection and key (name).
+         */
+        value(
+            const redis_client_ptr &client_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * Constructs this instance with the given router and key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        value(
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * Performs the del command.
+         *
+         * @return true if the key existed and was deleted.
+         */
+        auto del() -> bool;
+
+        /**
+         * Performs the get command.
+         *
+         * @return Some(value) if the key exists, otherwise None.
+         */
+        auto get() const -> rustfp::Option<V>;
+
+        /**
+         * Performs the getset command, which also removes any timeout of the key.
+         *
+         * @return Some(previous value) if the key existed, otherwise None.
+         */
+        auto getset(const V &val) -> rustfp::Option<V>;
+
+        /**
+         * Performs the set command.
+         *
+         * @return true if the value was written, false if the condition was not met.
+         */
+        auto set(const V &val, const set_options &options = default_set_options()) -> bool;
+
+        /**
+         * Performs the pexpire command on the key.
+         *
+         * @return true if the timeout was set, false if the key does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the key.
+         *
+         * @return Some(remaining time) if the key has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * Performs the persist command on the key.
+         *
+         * @return true if the timeout was removed.
+         */
+        auto persist() -> bool;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+        /**
+         * @return codec used to store the value.
+         */
+        auto get_codec() const -> const Codec &;
+
+    private:
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
+        /** Holds a shared ownership to access the database. */
+        mutable redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Key (name). */
+        std::string name;
+
+        /** Stores the value. */
+        Codec codec;
+    };
+
+    /**
+     * Provides the plain string keys under a common prefix from redis,
+     * where each entry is a key of its own.
+     *
+     * All the data is stored in the redis server.
+     * Values are stored with the Codec, while keys are plain msgpack appended to the prefix.
+     */
+    template <class K, class V, class Codec = msgpack_codec>
+    class keyspace {
+    public:
+        /** Alias to the K template type, which is the key type. */
+        using key_t = K;
+
+        /** Alias to the V template type, which is the value type. */
+        using value_t = V;
+
+        /** Alias to the Codec template type, which stores the values. */
+        using codec_t = Codec;
+
+        /**
+         * Constructs this instance with the given client connection and key prefix.
+         */
+        keyspace(
+            const redis_client_ptr &client_ptr,
+            const std::string &prefix,
+            const Codec &codec = Codec());
+
+        /**
+         * Constructs this instance with the given router and key prefix,
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        keyspace(
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::string &prefix,
+            const Codec &codec = Codec());
+
+        /**
+         * Performs the del command.
+         *
+         * @return true if the entry existed and was deleted.
+         */
+        auto del(const K &key) -> bool;
+
+        /**
+         * Performs the get command.
+         *
+         * @return Some(value) if the entry exists, otherwise None.
+         */
+        auto get(const K &key) const -> rustfp::Option<V>;
+
+        /**
+         * Performs the mget command on all the keys in a single round trip.
+         *
+         * @param begin begin iterator of the keys
+         * @param end end iterator of the keys
+         * @return Some(value) for each existing entry, otherwise None, in the order of the keys.
+         */
+        template <class KeyIt>
+        auto get_many(KeyIt begin, KeyIt end) const -> std::vector<rustfp::Option<V>>;
+
+        /**
+         * Performs the getset command, which also removes any timeout of the entry.
+         *
+         * @return Some(previous value) if the entry existed, otherwise None.
+         */
+        auto getset(const K &key, const V &val) -> rustfp::Option<V>;
+
+        /**
+         * Performs the set command.
+         *
+         * @return true if the value was written, false if the condition was not met.
+         */
+        auto set(
+            const K &key,
+            const V &val,
+            const set_options &options = default_set_options()) -> bool;
+
+        /**
+         * Performs the mset command on all the entries in a single round trip.
+         *
+         * @param begin begin iterator of the key value pairs
+         * @param end end iterator of the key value pairs
+         * @return number of entries written.
+         * @throws std::runtime_error if the mset is rejected, in which case nothing is written.
+         */
+        template <class EntryIt>
+        auto set_many(EntryIt begin, EntryIt end) -> size_t;
+
+        /**
+         * Performs the pexpire command on a single entry.
+         *
+         * @return true if the timeout was set, false if the entry does not exist.
+         */
+        auto expire(const K &key, const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on a single entry.
+         *
+         * @return Some(remaining time) if the entry has a timeout, otherwise None.
+         */
+        auto ttl(const K &key) const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return key prefix.
+         */
+        auto get_prefix() const -> const std::string &;
+
+        /**
+         * @return codec used to store the values.
+         */
+        auto get_codec() const -> const Codec &;
+
+    private:
+        /** @return full redis key of the entry. */
+        auto to_redis_key(const K &key) const -> std::string;
+
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
+        /** Holds a shared ownership to access the database. */
+        mutable redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Key prefix. */
+        std::string prefix;
+
+        /** Stores the values. */
+        Codec codec;
+    };
+
+    namespace details {
+        /**
+         * Performs the del command on a single key.
+         *
+         * @return true if the key existed and was deleted.
+         */
+        auto del_impl(redis_client_ptr &client_ptr, const std::string &name) -> bool;
+
+        /**
+         * Performs the get command.
+         *
+         * @return Some(value) if the key exists, otherwise None.
+         */
+        template <class V, class Codec>
+        auto get_impl(redis_client_ptr &client_ptr, const std::string &name, const Codec &codec)
+            -> rustfp::Option<V>;
+
+        /**
+         * Performs the getset command with the encoded value.
+         *
+         * @return Some(previous value) if the key existed, otherwise None.
+         */
+        template <class V, class Codec>
+        auto getset_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::string &val_str,
+            const Codec &codec) -> rustfp::Option<V>;
+
+        /**
+         * Performs the set command with the encoded value.
+         *
+         * @return true if the value was written, false if the condition was not met.
+         */
+        auto set_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::string &val_str,
+            const set_options &options) -> bool;
+    }
+
+    // implementation section
+
+    inline auto default_set_options() noexcept -> set_options {
+        return set_options{std::chrono::milliseconds(0), set_condition::always};
+    }
+
+    template <class V, class Codec>
+    value<V, Codec>::value(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(client_ptr),
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class V, class Codec>
+    value<V, Codec>::value(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::del() -> bool {
+        const auto deleted = details::del_impl(client_ptr, name);
+        mark_write();
+        return deleted;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::get() const -> rustfp::Option<V> {
+        auto lease = acquire_read();
+        return details::get_impl<V>(lease.get_client_ptr(), name, codec);
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::getset(const V &val) -> rustfp::Option<V> {
+        auto prev_opt = details::getset_impl<V>(client_ptr, name, codec.encode(val), codec);
+        mark_write();
+        return prev_opt;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::set(const V &val, const set_options &options) -> bool {
+        const auto is_written = details::set_impl(client_ptr, name, codec.encode(val), options);
+        mark_write();
+        return is_written;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::persist() -> bool {
+        const auto is_removed = details::persist_impl(client_ptr, name);
+        mark_write();
+        return is_removed;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::get_name() const -> const std::string & {
+        return name;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::get_codec() const -> const Codec & {
+        return codec;
+    }
+
+    template <class V, class Codec>
+    auto value<V, Codec>::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    template <class V, class Codec>
+    void value<V, Codec>::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
+
+    template <class K, class V, class Codec>
+    keyspace<K, V, Codec>::keyspace(
+        const redis_client_ptr &client_ptr,
+        const std::string &prefix,
+        const Codec &codec) :
+
+        client_ptr(client_ptr),
+        prefix(prefix),
+        codec(codec) {
+
+    }
+
+    template <class K, class V, class Codec>
+    keyspace<K, V, Codec>::keyspace(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &prefix,
+        const Codec &codec) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        prefix(prefix),
+        codec(codec) {
+
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::del(const K &key) -> bool {
+        const auto deleted = details::del_impl(client_ptr, to_redis_key(key));
+        mark_write();
+        return deleted;
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::get(const K &key) const -> rustfp::Option<V> {
+        auto lease = acquire_read();
+        return details::get_impl<V>(lease.get_client_ptr(), to_redis_key(key), codec);
+    }
+
+    template <class K, class V, class Codec>
+    template <class KeyIt>
+    auto keyspace<K, V, Codec>::get_many(KeyIt begin, KeyIt end) const
+        -> std::vector<rustfp::Option<V>> {
+
+        std::vector<std::string> key_strs;
+
+        for (; begin != end; ++begin) {
+            key_strs.push_back(to_redis_key(*begin));
+        }
+
+        std::vector<rustfp::Option<V>> values;
+        values.reserve(key_strs.size());
+
+        // mget rejects an empty list of keys
+        if (key_strs.empty()) {
+            return values;
+        }
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->mget(key_strs,
+            [this, &values](cpp_redis::reply &r) {
+                if (!r.is_array()) {
+                    return;
+                }
+
+                for (const auto &sub : r.as_array()) {
+                    if (sub.is_bulk_string()) {
+                        const auto &str = sub.as_string();
+                        values.push_back(codec.template decode<V>(str.data(), str.size()));
+                    }
+                    else {
+                        values.push_back(rustfp::None);
+                    }
+                }
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        // pads the missing entries if the reply was not an array
+        while (values.size() < key_strs.size()) {
+            values.push_back(rustfp::None);
+        }
+
+        return values;
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::getset(const K &key, const V &val) -> rustfp::Option<V> {
+        auto prev_opt = details::getset_impl<V>(
+            client_ptr, to_redis_key(key), codec.encode(val), codec);
+
+        mark_write();
+        return prev_opt;
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::set(
+        const K &key,
+        const V &val,
+        const set_options &options) -> bool {
+
+        const auto is_written = details::set_impl(
+            client_ptr, to_redis_key(key), codec.encode(val), options);
+
+        mark_write();
+        return is_written;
+    }
+
+    template <class K, class V, class Codec>
+    template <class EntryIt>
+    auto keyspace<K, V, Codec>::set_many(EntryIt begin, EntryIt end) -> size_t {
+        std::vector<std::pair<std::string, std::string>> entry_strs;
+
+        for (; begin != end; ++begin) {
+            entry_strs.emplace_back(to_redis_key(begin->first), codec.encode(begin->second));
+        }
+
+        // mset rejects an empty list of entries
+        if (entry_strs.empty()) {
+            return 0;
+        }
+
+        bool is_written = false;
+
+        client_ptr->mset(entry_strs,
+            [&is_written](cpp_redis::reply &r) {
+                is_written = r.is_simple_string() && r.as_string() == "OK";
+            });
+
+        details::sync_commit(client_ptr);
+
+        if (!is_written) {
+            throw std::runtime_error("Unable to set " + std::to_string(entry_strs.size())
+                + " entries into the keyspace");
+        }
+
+        mark_write();
+        return entry_strs.size();
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::expire(const K &key, const std::chrono::milliseconds ttl)
+        -> bool {
+
+        const auto is_set = details::expire_impl(client_ptr, to_redis_key(key), ttl);
+        mark_write();
+        return is_set;
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::ttl(const K &key) const
+        -> rustfp::Option<std::chrono::milliseconds> {
+
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), to_redis_key(key));
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::get_prefix() const -> const std::string & {
+        return prefix;
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::get_codec() const -> const Codec & {
+        return codec;
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::to_redis_key(const K &key) const -> std::string {
+        return prefix + details::encode_into_str(key);
+    }
+
+    template <class K, class V, class Codec>
+    auto keyspace<K, V, Codec>::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    template <class K, class V, class Codec>
+    void keyspace<K, V, Codec>::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
+
+    namespace details {
+        inline auto del_impl(redis_client_ptr &client_ptr, const std::string &name) -> bool {
+            bool deleted = false;
+
+            client_ptr->del({name},
+                [&deleted](cpp_redis::reply &r) {
+                    if (r.is_integer() && r.as_integer() > 0) {
+                        deleted = true;
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return deleted;
+        }
+
+        template <class V, class Codec>
+        auto get_impl(redis_client_ptr &client_ptr, const std::string &name, const Codec &codec)
+            -> rustfp::Option<V> {
+
+            rustfp::Option<V> value_opt = rustfp::None;
+
+            client_ptr->get(name,
+                [&codec, &value_opt](cpp_redis::reply &r) {
+                    if (r.is_bulk_string()) {
+                        const auto &str = r.as_string();
+                        value_opt = codec.template decode<V>(str.data(), str.size());
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return value_opt;
+        }
+
+        template <class V, class Codec>
+        auto getset_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::string &val_str,
+            const Codec &codec) -> rustfp::Option<V> {
+
+            rustfp::Option<V> prev_opt = rustfp::None;
+
+            client_ptr->getset(name, val_str,
+                [&codec, &prev_opt](cpp_redis::reply &r) {
+                    if (r.is_bulk_string()) {
+                        const auto &str = r.as_string();
+                        prev_opt = codec.template decode<V>(str.data(), str.size());
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return prev_opt;
+        }
+
+        inline auto set_impl(
+            redis_client_ptr &client_ptr,
+            const std::string &name,
+            const std::string &val_str,
+            const set_options &options) -> bool {
+
+            std::vector<std::string> cmd{"SET", name, val_str};
+
+            if (options.ttl.count() > 0) {
+                cmd.push_back("PX");
+                cmd.push_back(std::to_string(options.ttl.count()));
+            }
+
+            if (options.condition == set_condition::if_absent) {
+                cmd.push_back("NX");
+            }
+            else if (options.condition == set_condition::if_present) {
+                cmd.push_back("XX");
+            }
+
+            bool is_written = false;
+
+            // replies with nil instead of OK when the condition is not met
+            client_ptr->send(cmd,
+                [&is_written](cpp_redis::reply &r) {
+                    is_written = r.is_simple_string();
+                });
+
+            sync_commit(client_ptr);
+            return is_written;
+        }
+    }
+}
@@ -0,0 +1,507 @@
+/**
+ * Provides a small LZ77 block compressor in the spirit of LZ4, which trades
+ * compression ratio for speed, with optional preset dictionary support.
+ *
+ * Block format, as a series of sequences:
+ * token | [literal length bytes] | literals | offset (2 bytes LE) | [match length bytes]
+ *
+ * The high nibble of the token is the literal length and the low nibble is the
+ * match length minus MIN_MATCH, where 15 means that more length bytes follow,
+ * each adding up to 255. The last sequence only has literals.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace redispack {
+    namespace lz {
+
+        // declaration section
+
+        /**
+         * Preset dictionary with its match finder table built once,
+         * so that compressing many small values against it stays cheap.
+         * Both are only read while compressing, never copied.
+         */
+        class dictionary {
+        public:
+            /**
+             * Prepares the dictionary, of which only the last 64 KiB is used.
+             *
+             * @param bytes content of the dictionary
+             */
+            explicit dictionary(const std::string &bytes);
+
+            /** @return the used part of the dictionary. */
+            auto get_bytes() const noexcept -> const std::string &;
+
+            /** @return match finder table over the dictionary bytes. */
+            auto get_table() const noexcept -> const std::vector<uint32_t> &;
+
+        private:
+            /** Used part of the dictionary. */
+            std::string bytes;
+
+            /** Match finder table over the dictionary bytes. */
+            std::vector<uint32_t> table;
+        };
+
+        /**
+         * Compresses the bytes and appends the block to out.
+         * Matches may refer back into the dictionary, of which only the last
+         * 64 KiB is used.
+         *
+         * @param src bytes to compress
+         * @param size number of bytes to compress
+         * @param out string to append the compressed block to
+         * @param dict preset dictionary, may be null
+         * @param dict_size size of the dictionary
+         */
+        void compress(
+            const char *src,
+            const size_t size,
+            std::string &out,
+            const char *dict = nullptr,
+            const size_t dict_size = 0);
+
+        /**
+         * Compresses the bytes against the prepared dictionary and appends the block to out.
+         * Decompresses with the dictionary bytes.
+         *
+         * @param src bytes to compress
+         * @param size number of bytes to compress
+         * @param out string to append the compressed block to
+         * @param dict prepared dictionary
+         */
+        void compress(const char *src, const size_t size, std::string &out, const dictionary &dict);
+
+        /**
+         * Decompresses the block and appends the bytes to out,
+         * with the same dictionary used for compression.
+         *
+         * @param src compressed block
+         * @param size size of the compressed block
+         * @param raw_size exact number of bytes the block decompresses into
+         * @param out string to append the decompressed bytes to
+         * @param dict preset dictionary, may be null
+         * @param dict_size size of the dictionary
+         * @return false if the block is corrupted, in which case out is left unchanged.
+         */
+        auto decompress(
+            const char *src,
+            const size_t size,
+            const size_t raw_size,
+            std::string &out,
+            const char *dict = nullptr,
+            const size_t dict_size = 0) -> bool;
+
+        namespace details {
+            /** Shortest match worth encoding. */
+            static constexpr size_t MIN_MATCH = 4;
+
+            /** Furthest match that the 2 bytes offset can refer to. */
+            static constexpr size_t MAX_OFFSET = 65535;
+
+            /** Number of bits of the match finder hash table index. */
+            static constexpr size_t HASH_BITS = 12;
+
+            /**
+             * Fewest number of bits of the input hash table index, which otherwise
+             * grows with the input up to HASH_BITS, so that small inputs clear a small table.
+             */
+            static constexpr size_t MIN_INPUT_HASH_BITS = 6;
+
+            /** Marks an empty hash table slot. */
+            static constexpr uint32_t EMPTY_SLOT = 0xffffffff;
+
+            /** Length nibble which means that more length bytes follow. */
+            static constexpr size_t LENGTH_MASK = 15;
+
+            /** @return hash table index of the 4 bytes at the position. */
+            auto hash4(const char *p) noexcept -> uint32_t;
+
+            /**
+             * Fills the table with the positions of the first size bytes of the window.
+             */
+            void index_prefix(const char *window, const size_t size, std::vector<uint32_t> &table);
+
+            /**
+             * Compresses the input as if it followed right after the prefix,
+             * so that matches may refer back into the prefix without copying it.
+             *
+             * Positions below prefix_size are within the prefix, and the rest are
+             * within the input shifted by prefix_size.
+             *
+             * @param prefix dictionary bytes in front of the input, may be null
+             * @param prefix_size number of prefix bytes
+             * @param prefix_table read-only table of the prefix positions, may be null
+             * @param src bytes to compress
+             * @param size number of bytes to compress
+             * @param table scratch table for the input positions, sized to the input
+             * @param out string to append the compressed block to
+             */
+            void compress_window(
+                const char *prefix,
+                const size_t prefix_size,
+                const std::vector<uint32_t> *prefix_table,
+                const char *src,
+                const size_t size,
+                std::vector<uint32_t> &table,
+                std::string &out);
+
+            /** Appends the extra length bytes of a length beyond the nibble. */
+            void append_length(std::string &out, size_t len);
+
+            /**
+             * Reads the extra length bytes and adds them to len.
+             * @return false if the input ends before the length does.
+             */
+            auto read_length(const unsigned char *&ip, const unsigned char *end, size_t &len)
+                noexcept -> bool;
+
+            /**
+             * Appends a sequence of literals, followed by a match if match_len is not 0.
+             */
+            void append_sequence(
+                std::string &out,
+                const char *literals,
+                const size_t literal_len,
+                const size_t offset,
+                const size_t match_len);
+        }
+
+        // implementation section
+
+        inline dictionary::dictionary(const std::string &bytes) :
+            bytes(bytes.size() > details::MAX_OFFSET
+                ? bytes.substr(bytes.size() - details::MAX_OFFSET)
+                : bytes) {
+
+            details::index_prefix(this->bytes.data(), this->bytes.size(), table);
+        }
+
+        inline auto dictionary::get_bytes() const noexcept -> const std::string & {
+            return bytes;
+        }
+
+        inline auto dictionary::get_table() const noexcept -> const std::vector<uint32_t> & {
+            return table;
+        }
+
+        inline void compress(
+            const char *src,
+            const size_t size,
+            std::string &out,
+            const char *dict,
+            const size_t dict_size) {
+
+            using namespace details;
+
+            // only the usable end of the dictionary is indexed, right where it is
+            const auto prefix_size = dict ? std::min(dict_size, MAX_OFFSET) : 0;
+            const auto prefix = dict ? dict + dict_size - prefix_size : nullptr;
+            thread_local std::vector<uint32_t> prefix_table;
+            thread_local std::vector<uint32_t> table;
+
+            if (prefix_size > 0) {
+                index_prefix(prefix, prefix_size, prefix_table);
+            }
+
+            compress_window(
+                prefix, prefix_size, prefix_size > 0 ? &prefix_table : nullptr,
+                src, size, table, out);
+        }
+
+        inline void compress(
+            const char *src,
+            const size_t size,
+            std::string &out,
+            const dictionary &dict) {
+
+            thread_local std::vector<uint32_t> table;
+
+            // the prepared bytes and table are matched against in place
+            const auto &bytes = dict.get_bytes();
+
+            details::compress_window(
+                bytes.data(), bytes.size(), &dict.get_table(), src, size, table, out);
+        }
+
+        inline auto decompress(
+            const char *src,
+            const size_t size,
+            const size_t raw_size,
+            std::string &out,
+            const char *dict,
+            const size_t dict_size) -> bool {
+
+            using namespace details;
+
+            // back references beyond the decoded bytes reach into the end of the dictionary
+            const auto prefix_size = dict ? std::min(dict_size, MAX_OFFSET) : 0;
+            const auto out_start = out.size();
+
+            // each input byte expands into at most 255 bytes, which rejects
+            // corrupted sizes before reserving for them
+            static constexpr size_t MAX_EXPANSION = 255;
+
+            if (raw_size > size * MAX_EXPANSION + MIN_MATCH + LENGTH_MASK) {
+                return false;
+            }
+
+            const auto limit = out_start + raw_size;
+            out.reserve(limit);
+
+            auto ip = reinterpret_cast<const unsigned char *>(src);
+            const auto ip_end = ip + size;
+
+            const auto fail = [&out, out_start] {
+                out.resize(out_start);
+                return false;
+            };
+
+            while (ip < ip_end) {
+                const auto token = *ip++;
+                size_t literal_len = token >> 4;
+
+                if (literal_len == LENGTH_MASK && !read_length(ip, ip_end, literal_len)) {
+                    return fail();
+                }
+
+                if (static_cast<size_t>(ip_end - ip) < literal_len
+                    || limit - out.size() < literal_len) {
+
+                    return fail();
+                }
+
+                out.append(reinterpret_cast<const char *>(ip), literal_len);
+                ip += literal_len;
+
+                // the last sequence only has literals
+                if (ip == ip_end) {
+                    break;
+                }
+
+                if (ip_end - ip < 2) {
+                    return fail();
+                }
+
+                const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+                ip += 2;
+
+                size_t match_len = token & LENGTH_MASK;
+
+                if (match_len == LENGTH_MASK && !read_length(ip, ip_end, match_len)) {
+                    return fail();
+                }
+
+                match_len += MIN_MATCH;
+
+                const auto decoded_size = out.size() - out_start;
+
+                if (offset == 0
+                    || offset > decoded_size + prefix_size
+                    || limit - out.size() < match_len) {
+
+                    return fail();
+                }
+
+                const auto dst_pos = out.size();
+                out.resize(dst_pos + match_len);
+
+                const auto base = &out[0];
+                size_t i = 0;
+
+                // the match starts in the dictionary, and may run on into the decoded bytes
+                if (offset > decoded_size) {
+                    const auto dict_back = offset - decoded_size;
+                    i = std::min(match_len, dict_back);
+                    std::memcpy(base + dst_pos, dict + dict_size - dict_back, i);
+                }
+
+                // copied byte by byte, since the match may overlap the bytes being written
+                for (; i < match_len; ++i) {
+                    base[dst_pos + i] = base[dst_pos + i - offset];
+                }
+            }
+
+            if (out.size() != limit) {
+                return fail();
+            }
+
+            return true;
+        }
+
+        namespace details {
+            inline auto hash4(const char *p) noexcept -> uint32_t {
+                static constexpr uint32_t HASH_PRIME = 2654435761U;
+
+                uint32_t value;
+                std::memcpy(&value, p, sizeof(value));
+                return (value * HASH_PRIME) >> (32 - HASH_BITS);
+            }
+
+            inline void index_prefix(
+                const char *window,
+                const size_t size,
+                std::vector<uint32_t> &table) {
+
+                table.assign(static_cast<size_t>(1) << HASH_BITS, EMPTY_SLOT);
+
+                for (size_t pos = 0; pos + MIN_MATCH <= size; ++pos) {
+                    table[hash4(window + pos)] = static_cast<uint32_t>(pos);
+                }
+            }
+
+            inline void compress_window(
+                const char *prefix,
+                const size_t prefix_size,
+                const std::vector<uint32_t> *prefix_table,
+                const char *src,
+                const size_t size,
+                std::vector<uint32_t> &table,
+                std::string &out) {
+
+                // the bytes at a position in either the prefix or the input
+                const auto at = [prefix, prefix_size, src](const size_t p) {
+                    return p < prefix_size ? prefix[p] : src[p - prefix_size];
+                };
+
+                // tells if the 4 bytes at the candidate are worth extending into a match
+                const auto is_match = [prefix, prefix_size, src](
+                    const uint32_t candidate, const size_t pos) {
+
+                    if (candidate == EMPTY_SLOT || pos - candidate > MAX_OFFSET) {
+                        return false;
+                    }
+
+                    const auto candidate_ptr = candidate < prefix_size
+                        ? prefix + candidate
+                        : src + (candidate - prefix_size);
+
+                    return std::memcmp(candidate_ptr, src + (pos - prefix_size), MIN_MATCH) == 0;
+                };
+
+                const auto end = prefix_size + size;
+
+                auto input_bits = MIN_INPUT_HASH_BITS;
+
+                while (input_bits < HASH_BITS && (static_cast<size_t>(1) << input_bits) < size) {
+                    ++input_bits;
+                }
+
+                // the input slot keeps the top bits of the prefix slot
+                const auto input_shift = HASH_BITS - input_bits;
+                table.assign(static_cast<size_t>(1) << input_bits, EMPTY_SLOT);
+                out.reserve(out.size() + size / 2 + 16);
+
+                size_t anchor = prefix_size;
+                size_t pos = prefix_size;
+
+                while (pos + MIN_MATCH <= end) {
+                    const auto slot = hash4(src + (pos - prefix_size));
+                    const auto input_slot = slot >> input_shift;
+                    auto candidate = table[input_slot];
+                    table[input_slot] = static_cast<uint32_t>(pos);
+
+                    // the nearer input is preferred, and the prefix is only the fallback
+                    if (!is_match(candidate, pos)) {
+                        candidate = prefix_table ? (*prefix_table)[slot] : EMPTY_SLOT;
+
+                        if (!is_match(candidate, pos)) {
+                            ++pos;
+                            continue;
+                        }
+                    }
+
+                    auto match_len = MIN_MATCH;
+
+                    while (pos + match_len < end
+                        && at(candidate + match_len) == src[pos - prefix_size + match_len]) {
+                        ++match_len;
+                    }
+
+                    append_sequence(
+                        out, src + (anchor - prefix_size), pos - anchor, pos - candidate,
+                        match_len);
+
+                    pos += match_len;
+                    anchor = pos;
+                }
+
+                append_sequence(out, src + (anchor - prefix_size), end - anchor, 0, 0);
+            }
+
+            inline void append_length(std::string &out, size_t len) {
+                static constexpr size_t MAX_LENGTH_BYTE = 255;
+
+                while (len >= MAX_LENGTH_BYTE) {
+                    out.push_back(static_cast<char>(MAX_LENGTH_BYTE));
+                    len -= MAX_LENGTH_BYTE;
+                }
+
+                out.push_back(static_cast<char>(len));
+            }
+
+            inline auto read_length(
+                const unsigned char *&ip,
+                const unsigned char *end,
+                size_t &len) noexcept -> bool {
+
+                static constexpr unsigned char MAX_LENGTH_BYTE = 255;
+
+                while (ip < end) {
+                    const auto b = *ip++;
+                    len += b;
+
+                    if (b != MAX_LENGTH_BYTE) {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            inline void append_sequence(
+                std::string &out,
+                const char *literals,
+                const size_t literal_len,
+                const size_t offset,
+                const size_t match_len) {
+
+                const auto literal_nibble = std::min(literal_len, LENGTH_MASK);
+
+                const auto match_nibble = match_len == 0
+                    ? 0
+                    : std::min(match_len - MIN_MATCH, LENGTH_MASK);
+
+                out.push_back(static_cast<char>((literal_nibble << 4) | match_nibble));
+
+                if (literal_nibble == LENGTH_MASK) {
+                    append_length(out, literal_len - LENGTH_MASK);
+                }
+
+                out.append(literals, literal_len);
+
+                if (match_len == 0) {
+                    return;
+                }
+
+                out.push_back(static_cast<char>(offset & 0xff));
+                out.push_back(static_cast<char>(offset >> 8));
+
+                if (match_nibble == LENGTH_MASK) {
+                    append_length(out, match_len - MIN_MATCH - LENGTH_MASK);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,355 @@
+/**
+ * Provides the memory analysis of the containers, which shows whether Redis
+ * keeps them in the compact listpack / intset encodings, and if not, which
+ * encoded entries push them past the server limits.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "hash.h"
+#include "set.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+#include "rustfp/result.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    namespace details {
+        /** Number of entries sampled for the encoded sizes by default. */
+        static constexpr size_t MEMORY_SAMPLE_COUNT = 1000;
+    }
+
+    /**
+     * Memory footprint of a single container.
+     * The server limits are 0 if unknown, e.g. if the server does not allow CONFIG GET.
+     */
+    struct memory_report {
+        /** Encoding from OBJECT ENCODING, e.g. listpack, intset or hashtable, empty if missing. */
+        std::string encoding;
+
+        /** Bytes used by the key and its value from MEMORY USAGE. */
+        size_t memory_usage;
+
+        /** Number of entries. */
+        size_t len;
+
+        /** Number of entries sampled for the encoded sizes. */
+        size_t sampled;
+
+        /** Largest encoded hash field or set member sampled. */
+        size_t max_field_size;
+
+        /** Largest encoded hash value sampled, 0 for sets. */
+        size_t max_value_size;
+
+        /** Total encoded size of the sampled fields and values. */
+        size_t total_encoded_size;
+
+        /** Most entries kept in the listpack encoding, from the server config. */
+        size_t max_listpack_entries;
+
+        /** Largest field or value kept in the listpack encoding, from the server config. */
+        size_t max_listpack_value;
+
+        /** Most members kept in the intset encoding, from the server config, 0 for hashes. */
+        size_t max_intset_entries;
+
+        /** True if the listpack limits were read from the server config. */
+        bool has_listpack_limits;
+
+        /** @return true if the encoding is one of the compact ones. */
+        auto is_compact() const noexcept -> bool;
+
+        /**
+         * @return Some(true) if the number of entries and the sampled sizes are all within
+         * the listpack limits, Some(false) if the container grows into the hashtable encoding,
+         * or None if the limits are unknown.
+         */
+        auto fits_listpack() const noexcept -> rustfp::Option<bool>;
+    };
+
+    /**
+     * Reports the memory footprint of the hash.
+     *
+     * @param h hash to analyze
+     * @param sample_count maximum number of entries to sample for the encoded sizes
+     * @return report wrapped in Ok, any exception is caught and returned as Err
+     */
+    template <class K, class V, class Codec>
+    auto analyze_memory(
+        const hash<K, V, Codec> &h,
+        const size_t sample_count = details::MEMORY_SAMPLE_COUNT) noexcept
+        -> rustfp::Result<memory_report, std::unique_ptr<std::exception>>;
+
+    /**
+     * Reports the memory footprint of the set.
+     *
+     * @param s set to analyze
+     * @param sample_count maximum number of members to sample for the encoded sizes
+     * @return report wrapped in Ok, any exception is caught and returned as Err
+     */
+    template <class T, class Codec>
+    auto analyze_memory(
+        const set<T, Codec> &s,
+        const size_t sample_count = details::MEMORY_SAMPLE_COUNT) noexcept
+        -> rustfp::Result<memory_report, std::unique_ptr<std::exception>>;
+
+    namespace details {
+        /**
+         * Fills the report of a container, where has_value is true for hashes.
+         */
+        auto analyze_memory_impl(
+            redis_client_ptr client_ptr,
+            const std::string &name,
+            const bool has_value,
+            const size_t sample_count) -> memory_report;
+
+        /**
+         * Performs the config get command with the pattern.
+         * @return the matching parameters and their values.
+         */
+        auto config_get(redis_client_ptr &client_ptr, const std::string &pattern)
+            -> std::map<std::string, std::string>;
+
+        /**
+         * @return Some(size parameter) under its listpack name, falling back to its ziplist name
+         * for older servers, or None if neither exists or the value is not a number.
+         */
+        auto config_size(
+            const std::map<std::string, std::string> &config,
+            const std::string &listpack_name,
+            const std::string &ziplist_name) -> rustfp::Option<size_t>;
+    }
+
+    // implementation section
+
+    inline auto memory_report::is_compact() const noexcept -> bool {
+        return encoding == "listpack" || encoding == "ziplist" || encoding == "intset";
+    }
+
+    inline auto memory_report::fits_listpack() const noexcept -> rustfp::Option<bool> {
+        if (!has_listpack_limits) {
+            return rustfp::None;
+        }
+
+        return rustfp::Some(len <= max_listpack_entries
+            && max_field_size <= max_listpack_value
+            && max_value_size <= max_listpack_value);
+    }
+
+    template <class K, class V, class Codec>
+    auto analyze_memory(const hash<K, V, Codec> &h, const size_t sample_count) noexcept
+        -> rustfp::Result<memory_report, std::unique_ptr<std::exception>> {
+
+        try {
+            return rustfp::Ok(details::analyze_memory_impl(
+                h.get_client_ptr(), h.get_name(), true, sample_count));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    template <class T, class Codec>
+    auto analyze_memory(const set<T, Codec> &s, const size_t sample_count) noexcept
+        -> rustfp::Result<memory_report, std::unique_ptr<std::exception>> {
+
+        try {
+            return rustfp::Ok(details::analyze_memory_impl(
+                s.get_client_ptr(), s.get_name(), false, sample_count));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    namespace details {
+        inline auto analyze_memory_impl(
+            redis_client_ptr client_ptr,
+            const std::string &name,
+            const bool has_value,
+            const size_t sample_count) -> memory_report {
+
+            memory_report report{};
+
+            // all the single reply commands travel in one round trip
+            client_ptr->send({"OBJECT", "ENCODING", name},
+                [&report](cpp_redis::reply &r) {
+                    if (r.is_bulk_string() || r.is_simple_string()) {
+                        report.encoding = r.as_string();
+                    }
+                });
+
+            client_ptr->send({"MEMORY", "USAGE", name},
+                [&report](cpp_redis::reply &r) {
+                    if (r.is_integer()) {
+                        report.memory_usage = static_cast<size_t>(r.as_integer());
+                    }
+                });
+
+            client_ptr->send({has_value ? "HLEN" : "SCARD", name},
+                [&report](cpp_redis::reply &r) {
+                    if (r.is_integer()) {
+                        report.len = static_cast<size_t>(r.as_integer());
+                    }
+                });
+
+            sync_commit(client_ptr);
+
+            const auto config = config_get(client_ptr, has_value ? "hash-max-*" : "set-max-*");
+            const std::string prefix = has_value ? "hash-max-" : "set-max-";
+
+            const auto entries_opt = config_size(
+                config, prefix + "listpack-entries", prefix + "ziplist-entries");
+
+            const auto value_opt = config_size(
+                config, prefix + "listpack-value", prefix + "ziplist-value");
+
+            // 0 is a valid limit, so both limits must be known to tell whether the entries fit
+            report.has_listpack_limits = entries_opt.is_some() && value_opt.is_some();
+
+            entries_opt.match_some([&report](const size_t entries) {
+                report.max_listpack_entries = entries;
+            });
+
+            value_opt.match_some([&report](const size_t value) {
+                report.max_listpack_value = value;
+            });
+
+            if (!has_value) {
+                config_size(config, "set-max-intset-entries", "set-max-intset-entries")
+                    .match_some([&report](const size_t entries) {
+                        report.max_intset_entries = entries;
+                    });
+            }
+
+            // samples the encoded sizes, where hashes alternate between fields and values
+            std::string cursor = "0";
+
+            do {
+                std::string next_cursor = "0";
+
+                client_ptr->send(
+                    {has_value ? "HSCAN" : "SSCAN", name, cursor,
+                        "COUNT", std::to_string(sample_count)},
+
+                    [&](cpp_redis::reply &r) {
+                        if (!r.is_array() || r.as_array().size() != 2) {
+                            return;
+                        }
+
+                        const auto &page = r.as_array();
+
+                        if (page[0].is_bulk_string()) {
+                            next_cursor = page[0].as_string();
+                        }
+
+                        if (!page[1].is_array()) {
+                            return;
+                        }
+
+                        const auto &elems = page[1].as_array();
+                        const size_t stride = has_value ? 2 : 1;
+
+                        for (size_t i = 0;
+                            i + stride <= elems.size() && report.sampled < sample_count;
+                            i += stride) {
+
+                            if (!elems[i].is_bulk_string()
+                                || (has_value && !elems[i + 1].is_bulk_string())) {
+
+                                continue;
+                            }
+
+                            const auto field_size = elems[i].as_string().size();
+                            report.max_field_size = std::max(report.max_field_size, field_size);
+                            report.total_encoded_size += field_size;
+
+                            if (has_value) {
+                                const auto value_size = elems[i + 1].as_string().size();
+                                report.max_value_size = std::max(report.max_value_size, value_size);
+                                report.total_encoded_size += value_size;
+                            }
+
+                            ++report.sampled;
+                        }
+                    });
+
+                sync_commit(client_ptr);
+                cursor = std::move(next_cursor);
+            } while (cursor != "0" && report.sampled < sample_count);
+
+            return report;
+        }
+
+        inline auto config_get(redis_client_ptr &client_ptr, const std::string &pattern)
+            -> std::map<std::string, std::string> {
+
+            std::map<std::string, std::string> config;
+
+            client_ptr->send({"CONFIG", "GET", pattern},
+                [&config](cpp_redis::reply &r) {
+                    if (!r.is_array()) {
+                        return;
+                    }
+
+                    const auto &elems = r.as_array();
+
+                    for (size_t i = 0; i + 1 < elems.size(); i += 2) {
+                        if (elems[i].is_bulk_string() && elems[i + 1].is_bulk_string()) {
+                            config.emplace(elems[i].as_string(), elems[i + 1].as_string());
+                        }
+                    }
+                });
+
+            sync_commit(client_ptr);
+            return config;
+        }
+
+        inline auto config_size(
+            const std::map<std::string, std::string> &config,
+            const std::string &listpack_name,
+            const std::string &ziplist_name) -> rustfp::Option<size_t> {
+
+            auto it = config.find(listpack_name);
+
+            if (it == config.cend()) {
+                it = config.find(ziplist_name);
+            }
+
+            if (it == config.cend()) {
+                return rustfp::None;
+            }
+
+            const auto &str = it->second;
+            char *end = nullptr;
+            const auto size = std::strtoull(str.c_str(), &end, 10);
+
+            // rejects an empty value, a sign, or any trailing garbage
+            if (str.empty() || str.front() < '0' || str.front() > '9'
+                || end != str.c_str() + str.size()) {
+
+                return rustfp::None;
+            }
+
+            return rustfp::Some(static_cast<size_t>(size));
+        }
+    }
+}
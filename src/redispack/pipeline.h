@@ -0,0 +1,577 @@
+/**
+ * Provides automatic pipelining of commands issued concurrently from many
+ * threads on a shared client, so that they are flushed to the server
+ * together instead of each paying for its own commit.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "hash.h"
+#include "set.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Controls when the collected commands are flushed.
+     */
+    struct auto_pipeline_options {
+        /** Number of collected commands which triggers an immediate flush. */
+        size_t max_batch;
+
+        /** Maximum time the first collected command waits for others to join. */
+        std::chrono::microseconds window;
+    };
+
+    /**
+     * @return defaults of 128 commands per batch, with a window of 50 microseconds.
+     */
+    auto default_auto_pipeline_options() noexcept -> auto_pipeline_options;
+
+    /**
+     * Collects commands from any number of threads and flushes them together
+     * on a single client, waking up each caller when its own reply arrives.
+     *
+     * Producers push onto a lock-free stack, which the flusher thread takes
+     * over as a whole and replays in submission order.
+     */
+    class auto_pipeline {
+    public:
+        /**
+         * Constructs the pipeline and starts the flusher thread.
+         *
+         * @param client_ptr connected client to send the commands with
+         * @param options controls when the collected commands are flushed
+         */
+        explicit auto_pipeline(
+            const redis_client_ptr &client_ptr,
+            const auto_pipeline_options &options = default_auto_pipeline_options());
+
+        /**
+         * Flushes the remaining commands and stops the flusher thread.
+         */
+        ~auto_pipeline();
+
+        auto_pipeline(const auto_pipeline &) = delete;
+        auto operator=(const auto_pipeline &) -> auto_pipeline & = delete;
+
+        /**
+         * Queues the command to be flushed together with the other callers' commands.
+         * Thread-safe.
+         *
+         * @param cmd command name followed by its arguments
+         * @return future that is ready when the reply of the command arrives,
+         * or holds the exception if the command could not be sent or its reply never arrives.
+         */
+        auto send(std::vector<std::string> cmd) -> std::future<cpp_redis::reply>;
+
+        /**
+         * Queues the command and blocks until its reply arrives.
+         * Thread-safe.
+         *
+         * @param cmd command name followed by its arguments
+         * @return reply of the command.
+         * @throws the exception of the future if the command could not be sent
+         * or its reply never arrives.
+         */
+        auto send_sync(std::vector<std::string> cmd) -> cpp_redis::reply;
+
+    private:
+        /** Single queued command. */
+        struct request {
+            /** Command name followed by its arguments. */
+            std::vector<std::string> cmd;
+
+            /** Fulfilled with the reply of the command, or with the failure. */
+            std::promise<cpp_redis::reply> promise;
+
+            /** Set once the promise is fulfilled, by either the reply or the failure. */
+            std::atomic<bool> is_settled;
+
+            /** Command queued before this one. */
+            request *next;
+        };
+
+        /** Flushes in batches until stopped. */
+        void run();
+
+        /**
+         * Sends all the collected commands and commits them.
+         * A failure to send is set on the futures of all the collected commands.
+         */
+        void flush();
+
+        /**
+         * Sets the failure on the futures of the commands whose replies never arrived.
+         */
+        void fail_in_flight(const std::exception_ptr &error);
+
+        /** Fulfills the future with the reply, unless already fulfilled. */
+        static void settle(request &req, const cpp_redis::reply &r);
+
+        /** Sets the failure on the future, unless already fulfilled. */
+        static void settle(request &req, const std::exception_ptr &error);
+
+        /** Holds a shared ownership to access the database. */
+        redis_client_ptr client_ptr;
+
+        /** Controls when the collected commands are flushed. */
+        auto_pipeline_options options;
+
+        /** Most recently queued command. */
+        std::atomic<request *> head;
+
+        /** Number of queued commands not yet flushed. */
+        std::atomic<size_t> pending;
+
+        /**
+         * Commands sent but not yet replied, only accessed by the flusher thread.
+         * The reply callbacks hold the ownership, so that a command whose callback is
+         * discarded by the client breaks its promise instead of leaking.
+         */
+        std::vector<std::weak_ptr<request>> in_flight;
+
+        /** Set when the pipeline is being destroyed. */
+        std::atomic<bool> is_stopping;
+
+        /** Only guards the wake-up condition of the flusher thread. */
+        std::mutex wake_mutex;
+
+        /** Wakes up the flusher thread. */
+        std::condition_variable wake_cv;
+
+        /** Flusher thread. */
+        std::thread flusher;
+    };
+
+    /**
+     * Provides the single entry hash functions through an auto pipeline,
+     * so that the calls of many threads on the same hash share round trips.
+     *
+     * Both the reads and the writes go to the client of the pipeline,
+     * which should be the primary of the hash.
+     */
+    template <class K, class V, class Codec = msgpack_codec>
+    class pipelined_hash {
+    public:
+        /**
+         * @param target hash to access, whose name and codec are used
+         * @param pipeline collects the commands, must outlive this instance
+         */
+        pipelined_hash(const hash<K, V, Codec> &target, auto_pipeline &pipeline);
+
+        /**
+         * Performs the hdel command through the pipeline. Thread-safe.
+         * @return true if the key used succeeds to delete an entry.
+         */
+        auto del(const K &key) -> bool;
+
+        /**
+         * Performs the hexists command through the pipeline. Thread-safe.
+         * @return true if the hash contains the entry.
+         */
+        auto exists(const K &key) const -> bool;
+
+        /**
+         * Performs the hget command through the pipeline. Thread-safe.
+         * @return Some(value) if the key exists, otherwise None.
+         */
+        auto get(const K &key) const -> rustfp::Option<V>;
+
+        /**
+         * Performs the hset command through the pipeline. Thread-safe.
+         * @return true if the entry is new, false if the value replaced an existing one.
+         */
+        auto set(const K &key, const V &value) -> bool;
+
+        /**
+         * @return hash which is accessed.
+         */
+        auto get_target() const -> const hash<K, V, Codec> &;
+
+    private:
+        /** Starts the read-your-writes window of the hash if routed. */
+        void mark_write() const noexcept;
+
+        /** Hash which is accessed. */
+        hash<K, V, Codec> target;
+
+        /** Collects the commands. */
+        auto_pipeline &pipeline;
+    };
+
+    /**
+     * Provides the single member set functions through an auto pipeline,
+     * so that the calls of many threads on the same set share round trips.
+     *
+     * Both the reads and the writes go to the client of the pipeline,
+     * which should be the primary of the set.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class pipelined_set {
+    public:
+        /**
+         * @param target set to access, whose name and codec are used
+         * @param pipeline collects the commands, must outlive this instance
+         */
+        pipelined_set(const set<T, Codec> &target, auto_pipeline &pipeline);
+
+        /**
+         * Performs the sadd command through the pipeline. Thread-safe.
+         * @return true if the member is new.
+         */
+        auto add(const T &member) -> bool;
+
+        /**
+         * Performs the sismember command through the pipeline. Thread-safe.
+         * @return true if the member is in the set.
+         */
+        auto is_member(const T &member) const -> bool;
+
+        /**
+         * Performs the srem command through the pipeline. Thread-safe.
+         * @return true if the member was removed.
+         */
+        auto rem(const T &member) -> bool;
+
+        /**
+         * @return set which is accessed.
+         */
+        auto get_target() const -> const set<T, Codec> &;
+
+    private:
+        /** Starts the read-your-writes window of the set if routed. */
+        void mark_write() const noexcept;
+
+        /** Set which is accessed. */
+        set<T, Codec> target;
+
+        /** Collects the commands. */
+        auto_pipeline &pipeline;
+    };
+
+    // implementation section
+
+    inline auto default_auto_pipeline_options() noexcept -> auto_pipeline_options {
+        static constexpr size_t DEFAULT_MAX_BATCH = 128;
+        static constexpr auto DEFAULT_WINDOW_US = 50;
+
+        return auto_pipeline_options{
+            DEFAULT_MAX_BATCH,
+            std::chrono::microseconds(DEFAULT_WINDOW_US)};
+    }
+
+    inline auto_pipeline::auto_pipeline(
+        const redis_client_ptr &client_ptr,
+        const auto_pipeline_options &options) :
+
+        client_ptr(client_ptr),
+        options(options),
+        head(nullptr),
+        pending(0),
+        is_stopping(false) {
+
+        flusher = std::thread([this] { run(); });
+    }
+
+    inline auto_pipeline::~auto_pipeline() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            is_stopping = true;
+        }
+
+        wake_cv.notify_one();
+        flusher.join();
+    }
+
+    inline auto auto_pipeline::send(std::vector<std::string> cmd)
+        -> std::future<cpp_redis::reply> {
+
+        auto req = new request();
+        req->cmd = std::move(cmd);
+        req->is_settled = false;
+        req->next = nullptr;
+
+        auto reply_future = req->promise.get_future();
+
+        // counted before being pushed, so that the count never falls below the queued commands
+        const auto prev_pending = pending.fetch_add(1);
+
+        req->next = head.load(std::memory_order_relaxed);
+
+        while (!head.compare_exchange_weak(
+            req->next, req,
+            std::memory_order_release,
+            std::memory_order_relaxed)) {
+        }
+
+        // the first command starts the window, a full batch cuts the window short
+        if (prev_pending == 0 || prev_pending + 1 >= options.max_batch) {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            wake_cv.notify_one();
+        }
+
+        return reply_future;
+    }
+
+    inline auto auto_pipeline::send_sync(std::vector<std::string> cmd) -> cpp_redis::reply {
+        return send(std::move(cmd)).get();
+    }
+
+    inline void auto_pipeline::run() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+
+            wake_cv.wait(lock, [this] {
+                return is_stopping.load() || pending.load() > 0;
+            });
+
+            if (!is_stopping) {
+                wake_cv.wait_for(lock, options.window, [this] {
+                    return is_stopping.load() || pending.load() >= options.max_batch;
+                });
+            }
+
+            const bool should_stop = is_stopping;
+            lock.unlock();
+
+            flush();
+
+            if (should_stop) {
+                try {
+                    // waits for the outstanding replies, so that no caller is left waiting
+                    client_ptr->sync_commit();
+                    fail_in_flight(std::make_exception_ptr(
+                        std::runtime_error("Pipeline stopped before the reply arrived")));
+                }
+                catch (...) {
+                    fail_in_flight(std::current_exception());
+                }
+
+                break;
+            }
+        }
+    }
+
+    inline void auto_pipeline::flush() {
+        auto req = head.exchange(nullptr, std::memory_order_acquire);
+
+        if (!req) {
+            return;
+        }
+
+        // the stack holds the most recent command first, so reverse into submission order
+        request *ordered = nullptr;
+        size_t count = 0;
+
+        while (req) {
+            const auto next = req->next;
+            req->next = ordered;
+            ordered = req;
+            req = next;
+            ++count;
+        }
+
+        pending.fetch_sub(count);
+
+        std::vector<std::shared_ptr<request>> batch;
+        batch.reserve(count);
+
+        while (ordered) {
+            const auto next = ordered->next;
+            batch.emplace_back(ordered);
+            ordered = next;
+        }
+
+        // only the requests still waiting for their replies are kept
+        in_flight.erase(
+            std::remove_if(in_flight.begin(), in_flight.end(),
+                [](const std::weak_ptr<request> &req_wptr) {
+                    return req_wptr.expired();
+                }),
+            in_flight.end());
+
+        try {
+            for (const auto &req_ptr : batch) {
+                in_flight.emplace_back(req_ptr);
+
+                client_ptr->send(req_ptr->cmd,
+                    [req_ptr](cpp_redis::reply &r) {
+                        settle(*req_ptr, r);
+                    });
+            }
+
+            client_ptr->commit();
+        }
+        catch (...) {
+            // the replies of a failed commit may never arrive
+            const auto error = std::current_exception();
+
+            for (const auto &req_ptr : batch) {
+                settle(*req_ptr, error);
+            }
+        }
+    }
+
+    inline void auto_pipeline::fail_in_flight(const std::exception_ptr &error) {
+        for (const auto &req_wptr : in_flight) {
+            const auto req_ptr = req_wptr.lock();
+
+            if (req_ptr) {
+                settle(*req_ptr, error);
+            }
+        }
+
+        in_flight.clear();
+    }
+
+    inline void auto_pipeline::settle(request &req, const cpp_redis::reply &r) {
+        if (!req.is_settled.exchange(true)) {
+            req.promise.set_value(r);
+        }
+    }
+
+    inline void auto_pipeline::settle(request &req, const std::exception_ptr &error) {
+        if (!req.is_settled.exchange(true)) {
+            req.promise.set_exception(error);
+        }
+    }
+
+    template <class K, class V, class Codec>
+    pipelined_hash<K, V, Codec>::pipelined_hash(
+        const hash<K, V, Codec> &target,
+        auto_pipeline &pipeline) :
+
+        target(target),
+        pipeline(pipeline) {
+
+    }
+
+    template <class K, class V, class Codec>
+    auto pipelined_hash<K, V, Codec>::del(const K &key) -> bool {
+        const auto r = pipeline.send_sync(
+            {"HDEL", target.get_name(), details::encode_into_str(key)});
+
+        mark_write();
+        return r.is_integer() && r.as_integer() > 0;
+    }
+
+    template <class K, class V, class Codec>
+    auto pipelined_hash<K, V, Codec>::exists(const K &key) const -> bool {
+        static constexpr auto CONTAINS_FIELD_RET_VAL = 1;
+
+        const auto r = pipeline.send_sync(
+            {"HEXISTS", target.get_name(), details::encode_into_str(key)});
+
+        return r.is_integer() && r.as_integer() == CONTAINS_FIELD_RET_VAL;
+    }
+
+    template <class K, class V, class Codec>
+    auto pipelined_hash<K, V, Codec>::get(const K &key) const -> rustfp::Option<V> {
+        const auto r = pipeline.send_sync(
+            {"HGET", target.get_name(), details::encode_into_str(key)});
+
+        if (!r.is_bulk_string()) {
+            return rustfp::None;
+        }
+
+        const auto &str = r.as_string();
+        return target.get_codec().template decode<V>(str.data(), str.size());
+    }
+
+    template <class K, class V, class Codec>
+    auto pipelined_hash<K, V, Codec>::set(const K &key, const V &value) -> bool {
+        static constexpr auto IS_NEW_FIELD_RET_VAL = 1;
+
+        const auto r = pipeline.send_sync({
+            "HSET", target.get_name(),
+            details::encode_into_str(key), target.get_codec().encode(value)});
+
+        mark_write();
+        return r.is_integer() && r.as_integer() == IS_NEW_FIELD_RET_VAL;
+    }
+
+    template <class K, class V, class Codec>
+    auto pipelined_hash<K, V, Codec>::get_target() const -> const hash<K, V, Codec> & {
+        return target;
+    }
+
+    template <class K, class V, class Codec>
+    void pipelined_hash<K, V, Codec>::mark_write() const noexcept {
+        if (target.get_router_ptr()) {
+            target.get_router_ptr()->mark_write();
+        }
+    }
+
+    template <class T, class Codec>
+    pipelined_set<T, Codec>::pipelined_set(
+        const set<T, Codec> &target,
+        auto_pipeline &pipeline) :
+
+        target(target),
+        pipeline(pipeline) {
+
+    }
+
+    template <class T, class Codec>
+    auto pipelined_set<T, Codec>::add(const T &member) -> bool {
+        const auto r = pipeline.send_sync(
+            {"SADD", target.get_name(), target.get_codec().encode(member)});
+
+        mark_write();
+        return r.is_integer() && r.as_integer() > 0;
+    }
+
+    template <class T, class Codec>
+    auto pipelined_set<T, Codec>::is_member(const T &member) const -> bool {
+        const auto r = pipeline.send_sync(
+            {"SISMEMBER", target.get_name(), target.get_codec().encode(member)});
+
+        return r.is_integer() && r.as_integer() == 1;
+    }
+
+    template <class T, class Codec>
+    auto pipelined_set<T, Codec>::rem(const T &member) -> bool {
+        const auto r = pipeline.send_sync(
+            {"SREM", target.get_name(), target.get_codec().encode(member)});
+
+        mark_write();
+        return r.is_integer() && r.as_integer() > 0;
+    }
+
+    template <class T, class Codec>
+    auto pipelined_set<T, Codec>::get_target() const -> const set<T, Codec> & {
+        return target;
+    }
+
+    template <class T, class Codec>
+    void pipelined_set<T, Codec>::mark_write() const noexcept {
+        if (target.get_router_ptr()) {
+            target.get_router_ptr()->mark_write();
+        }
+    }
+}
@@ -0,0 +1,497 @@
+/**
+ * Provides a pool of I/O reactors for the client connections, so that
+ * the replies of many connections are read and parsed on several cores
+ * instead of on the single default tacopie io_service.
+ *
+ * Each reactor is a tacopie io_service with its own polling thread and
+ * callback workers, optionally pinned to a CPU on Linux. Connections are
+ * assigned to the reactors round-robin, or to an explicit reactor.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "connection.h"
+
+#include "cpp_redis/cpp_redis"
+#include "cpp_redis/network/tcp_client_iface.hpp"
+#include "rustfp/result.h"
+#include "tacopie/tacopie"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Configures the reactors and the sockets of the connections.
+     */
+    struct connection_options {
+        /** Number of reactors, each with its own polling thread. */
+        size_t io_threads;
+
+        /** Number of callback workers per reactor, which read and parse the replies. */
+        size_t workers_per_io_thread;
+
+        /** CPU of each reactor's workers, reactor i uses cpus[i % size], empty to not pin. */
+        std::vector<size_t> cpus;
+
+        /** Disables Nagle's algorithm on tcp connections, so that small commands are not held. */
+        bool tcp_nodelay;
+
+        /** Socket send buffer size in bytes, 0 for the system default. */
+        size_t send_buffer_size;
+
+        /** Socket receive buffer size in bytes, 0 for the system default. */
+        size_t recv_buffer_size;
+    };
+
+    /**
+     * @return defaults of 1 reactor with 1 worker, without pinning, with tcp_nodelay
+     * and the system default buffer sizes.
+     */
+    auto default_connection_options() noexcept -> connection_options;
+
+    /**
+     * Owns the reactors and creates the connections on them.
+     *
+     * The reactors outlive the pool for as long as any of their connections.
+     */
+    class reactor_pool {
+    public:
+        /**
+         * Creates the reactors and starts their threads.
+         * @param options configures the reactors and the sockets of the connections
+         */
+        explicit reactor_pool(const connection_options &options = default_connection_options());
+
+        reactor_pool(const reactor_pool &) = delete;
+        auto operator=(const reactor_pool &) -> reactor_pool & = delete;
+
+        /**
+         * Creates and immediately connects the client on the next reactor, round-robin.
+         * Thread-safe.
+         *
+         * @param host hostname of the server, or path of the socket if port is 0
+         * @param port of the server, 0 for a unix socket
+         * @return client shared pointer wrapped in Ok<std::shared_ptr>,
+         * any exception is caught and returned as Err<std::unique_ptr<std::exception>>
+         */
+        auto connect(const std::string &host, const size_t port) noexcept
+            -> rustfp::Result<redis_client_ptr, std::unique_ptr<std::exception>>;
+
+        /**
+         * Creates and immediately connects the client on the given reactor,
+         * e.g. to keep the connections of a worker thread on the same core.
+         * Thread-safe.
+         *
+         * @param host hostname of the server, or path of the socket if port is 0
+         * @param port of the server, 0 for a unix socket
+         * @param reactor_index reactor to run the connection on, modulo the reactor count
+         * @return client shared pointer wrapped in Ok<std::shared_ptr>,
+         * any exception is caught and returned as Err<std::unique_ptr<std::exception>>
+         */
+        auto connect(const std::string &host, const size_t port, const size_t reactor_index)
+            noexcept -> rustfp::Result<redis_client_ptr, std::unique_ptr<std::exception>>;
+
+        /**
+         * Creates and immediately connects the client on the next reactor, round-robin,
+         * at the address accepted by parse_endpoint.
+         * Thread-safe.
+         *
+         * @param uri server address, e.g. redis://127.0.0.1:6379 or unix:///tmp/redis.sock
+         * @return client shared pointer wrapped in Ok<std::shared_ptr>,
+         * any exception is caught and returned as Err<std::unique_ptr<std::exception>>
+         */
+        auto connect_uri(const std::string &uri) noexcept
+            -> rustfp::Result<redis_client_ptr, std::unique_ptr<std::exception>>;
+
+        /**
+         * @return number of reactors.
+         */
+        auto reactor_count() const noexcept -> size_t;
+
+        /**
+         * @return options the pool was created with.
+         */
+        auto get_options() const noexcept -> const connection_options &;
+
+    private:
+        /** Configures the reactors and the sockets of the connections. */
+        connection_options options;
+
+        /** Reactors, each with its own polling thread and workers. */
+        std::vector<std::shared_ptr<tacopie::io_service>> reactors;
+
+        /** Reactor of the next round-robin connection. */
+        std::atomic<size_t> next;
+    };
+
+    namespace details {
+        /** Marks a reactor which is not pinned to any CPU. */
+        static constexpr int UNPINNED_CPU = -1;
+
+        /**
+         * Transport of a connection on a given reactor, which applies the socket options
+         * before connecting and pins the workers running its callbacks.
+         */
+        class reactor_tcp_client : public cpp_redis::network::tcp_client_iface {
+        public:
+            /**
+             * Constructs the transport without creating the underlying tacopie client,
+             * which is only created once its socket is connected.
+             */
+            reactor_tcp_client(
+                const std::shared_ptr<tacopie::io_service> &reactor,
+                const connection_options &options,
+                const int cpu);
+
+            void connect(const std::string &addr, std::uint32_t port, std::uint32_t timeout_msecs)
+                override;
+
+            void disconnect(bool wait_for_removal) override;
+
+            auto is_connected() const -> bool override;
+
+            void set_nb_workers(std::size_t nb_threads) override;
+
+            void async_read(read_request &request) override;
+
+            void async_write(write_request &request) override;
+
+            void set_on_disconnection_handler(const disconnection_handler_t &handler) override;
+
+        private:
+            /** Reactor to run the connection on. */
+            std::shared_ptr<tacopie::io_service> reactor;
+
+            /** Underlying tacopie client bound to the reactor, null until connected. */
+            std::unique_ptr<tacopie::tcp_client> client_ptr;
+
+            /** Handler passed on to every underlying tacopie client. */
+            disconnection_handler_t disconnection_handler;
+
+            /** Configures the socket before connecting. */
+            connection_options options;
+
+            /** CPU to pin the workers to, UNPINNED_CPU to not pin. */
+            int cpu;
+        };
+
+        /**
+         * Pins the calling thread to the CPU, once per thread. Only supported on Linux.
+         */
+        void pin_current_thread(const int cpu) noexcept;
+
+        /**
+         * Creates the unconnected socket of the same family tacopie would use for the address.
+         * @throws std::runtime_error if the system is unable to create the socket.
+         */
+        auto create_socket(const std::string &addr, const std::uint32_t port) -> tacopie::fd_t;
+
+        /**
+         * Applies tcp_nodelay and the buffer sizes to the socket, before it connects,
+         * since the buffer sizes also determine the tcp window scale negotiated on connect.
+         * @throws std::runtime_error if a buffer size does not fit into an int,
+         * or if the system rejects an option.
+         */
+        void apply_socket_options(
+            const tacopie::fd_t fd,
+            const connection_options &options,
+            const bool is_unix_socket);
+    }
+
+    // implementation section
+
+    inline auto default_connection_options() noexcept -> connection_options {
+        static constexpr size_t DEFAULT_IO_THREADS = 1;
+        static constexpr size_t DEFAULT_WORKERS_PER_IO_THREAD = 1;
+
+        return connection_options{
+            DEFAULT_IO_THREADS,
+            DEFAULT_WORKERS_PER_IO_THREAD,
+            {},
+            true,
+            0,
+            0};
+    }
+
+    inline reactor_pool::reactor_pool(const connection_options &options) :
+        options(options),
+        next(0) {
+
+        const auto io_threads = std::max<size_t>(1, options.io_threads);
+        reactors.reserve(io_threads);
+
+        for (size_t i = 0; i < io_threads; ++i) {
+            auto reactor = std::make_shared<tacopie::io_service>();
+            reactor->set_nb_workers(std::max<size_t>(1, options.workers_per_io_thread));
+            reactors.push_back(std::move(reactor));
+        }
+    }
+
+    inline auto reactor_pool::connect(const std::string &host, const size_t port) noexcept
+        -> rustfp::Result<redis_client_ptr, std::unique_ptr<std::exception>> {
+
+        return connect(host, port, next.fetch_add(1));
+    }
+
+    inline auto reactor_pool::connect(
+        const std::string &host,
+        const size_t port,
+        const size_t reactor_index) noexcept
+        -> rustfp::Result<redis_client_ptr, std::unique_ptr<std::exception>> {
+
+        const auto index = reactor_index % reactors.size();
+
+        const auto cpu = options.cpus.empty()
+            ? details::UNPINNED_CPU
+            : static_cast<int>(options.cpus[index % options.cpus.size()]);
+
+        try {
+            const auto tcp_client_ptr =
+                std::make_shared<details::reactor_tcp_client>(reactors[index], options, cpu);
+
+            auto client_ptr = std::make_shared<redis_client>(tcp_client_ptr);
+            client_ptr->connect(host, port);
+            return rustfp::Ok(std::move(client_ptr));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    inline auto reactor_pool::connect_uri(const std::string &uri) noexcept
+        -> rustfp::Result<redis_client_ptr, std::unique_ptr<std::exception>> {
+
+        using result_t = rustfp::Result<redis_client_ptr, std::unique_ptr<std::exception>>;
+
+        return parse_endpoint(uri).match(
+            [this](endpoint &&ep) -> result_t {
+                return connect(ep.host, ep.port);
+            },
+
+            [](std::unique_ptr<std::exception> &&e) -> result_t {
+                return rustfp::Err(std::move(e));
+            });
+    }
+
+    inline auto reactor_pool::reactor_count() const noexcept -> size_t {
+        return reactors.size();
+    }
+
+    inline auto reactor_pool::get_options() const noexcept -> const connection_options & {
+        return options;
+    }
+
+    namespace details {
+        inline reactor_tcp_client::reactor_tcp_client(
+            const std::shared_ptr<tacopie::io_service> &reactor,
+            const connection_options &options,
+            const int cpu) :
+
+            reactor(reactor),
+            options(options),
+            cpu(cpu) {
+
+        }
+
+        inline void reactor_tcp_client::connect(
+            const std::string &addr,
+            std::uint32_t port,
+            std::uint32_t timeout_msecs) {
+
+            tacopie::tcp_socket socket(
+                create_socket(addr, port), addr, port, tacopie::tcp_socket::type::UNKNOWN);
+
+            // tacopie connects with the given descriptor, as long as it is valid
+            try {
+                apply_socket_options(socket.get_fd(), options, port == UNIX_SOCKET_PORT);
+                socket.connect(addr, port, timeout_msecs);
+            }
+            catch (...) {
+                socket.close();
+                throw;
+            }
+
+            std::unique_ptr<tacopie::tcp_client> connected_ptr;
+
+            {
+                // tacopie has no way to pass the io_service, and binds each client
+                // to the default io_service at construction
+                std::lock_guard<std::mutex> lock(reactor_bind_mutex());
+                const auto prev_reactor = tacopie::get_default_io_service();
+
+                tacopie::set_default_io_service(reactor);
+                connected_ptr = std::make_unique<tacopie::tcp_client>(std::move(socket));
+                tacopie::set_default_io_service(prev_reactor);
+            }
+
+            connected_ptr->set_on_disconnection_handler(disconnection_handler);
+
+            // a reconnect only happens once the previous client is disconnected
+            client_ptr = std::move(connected_ptr);
+        }
+
+        inline void reactor_tcp_client::disconnect(bool wait_for_removal) {
+            if (client_ptr) {
+                client_ptr->disconnect(wait_for_removal);
+            }
+        }
+
+        inline auto reactor_tcp_client::is_connected() const -> bool {
+            return client_ptr && client_ptr->is_connected();
+        }
+
+        inline void reactor_tcp_client::set_nb_workers(std::size_t nb_threads) {
+            reactor->set_nb_workers(nb_threads);
+        }
+
+        inline void reactor_tcp_client::async_read(read_request &request) {
+            const auto callback = request.async_read_callback;
+            const auto pinned_cpu = cpu;
+
+            client_ptr->async_read({request.size,
+                [callback, pinned_cpu](tacopie::tcp_client::read_result &res) {
+                    // the reply is parsed within the callback, on the pinned worker
+                    pin_current_thread(pinned_cpu);
+
+                    if (!callback) {
+                        return;
+                    }
+
+                    read_result converted{res.success, std::move(res.buffer)};
+                    callback(converted);
+                }});
+        }
+
+        inline void reactor_tcp_client::async_write(write_request &request) {
+            const auto callback = request.async_write_callback;
+            const auto pinned_cpu = cpu;
+
+            client_ptr->async_write({std::move(request.buffer),
+                [callback, pinned_cpu](tacopie::tcp_client::write_result &res) {
+                    pin_current_thread(pinned_cpu);
+
+                    if (!callback) {
+                        return;
+                    }
+
+                    write_result converted{res.success, res.size};
+                    callback(converted);
+                }});
+        }
+
+        inline void reactor_tcp_client::set_on_disconnection_handler(
+            const disconnection_handler_t &handler) {
+
+            disconnection_handler = handler;
+
+            if (client_ptr) {
+                client_ptr->set_on_disconnection_handler(handler);
+            }
+        }
+
+        inline void pin_current_thread(const int cpu) noexcept {
+            thread_local int pinned_cpu = UNPINNED_CPU;
+
+            if (cpu == UNPINNED_CPU || cpu == pinned_cpu) {
+                return;
+            }
+
+#if defined(__linux__)
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+
+            pinned_cpu = cpu;
+        }
+
+        inline auto create_socket(const std::string &addr, const std::uint32_t port)
+            -> tacopie::fd_t {
+
+            // matches the family chosen by tacopie when it creates the socket itself
+            const auto family = port == UNIX_SOCKET_PORT
+                ? AF_UNIX
+                : addr.find(':') != std::string::npos ? AF_INET6 : AF_INET;
+
+            const auto fd = ::socket(family, SOCK_STREAM, 0);
+
+            if (fd == __TACOPIE_INVALID_FD) {
+                throw std::runtime_error("Unable to create the socket for " + addr);
+            }
+
+            return fd;
+        }
+
+        inline void apply_socket_options(
+            const tacopie::fd_t fd,
+            const connection_options &options,
+            const bool is_unix_socket) {
+
+            const auto set_option = [fd](const int level, const int name, const int value) {
+#if defined(_WIN32)
+                const auto ret = setsockopt(
+                    fd, level, name, reinterpret_cast<const char *>(&value), sizeof(value));
+#else
+                const auto ret = setsockopt(fd, level, name, &value, sizeof(value));
+#endif
+
+                if (ret != 0) {
+                    throw std::runtime_error(
+                        "Unable to set socket option " + std::to_string(name));
+                }
+            };
+
+            // unix sockets have no Nagle's algorithm to disable
+            if (options.tcp_nodelay && !is_unix_socket) {
+                set_option(IPPROTO_TCP, TCP_NODELAY, 1);
+            }
+
+            const auto set_buffer_size = [&set_option](const int name, const size_t size) {
+                if (size > static_cast<size_t>(std::numeric_limits<int>::max())) {
+                    throw std::runtime_error(
+                        "Socket buffer size " + std::to_string(size) + " is too large");
+                }
+
+                set_option(SOL_SOCKET, name, static_cast<int>(size));
+            };
+
+            if (options.send_buffer_size > 0) {
+                set_buffer_size(SO_SNDBUF, options.send_buffer_size);
+            }
+
+            if (options.recv_buffer_size > 0) {
+                set_buffer_size(SO_RCVBUF, options.recv_buffer_size);
+            }
+        }
+    }
+}
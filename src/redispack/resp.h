@@ -0,0 +1,854 @@
+/**
+ * Provides a native RESP2/RESP3 parser and command serializer that work
+ * directly over a receive buffer, exposing every string as a non-owning
+ * view into that buffer instead of materializing std::string copies.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "scan.h"
+#include "util.h"
+
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+namespace resp {
+
+    // declaration section
+
+    namespace details {
+        /** Minimum buffer size before the parser pre-indexes the CRLF positions. */
+        static constexpr size_t INDEX_MIN_SIZE = 4096;
+
+        /** Size of the smallest reply, e.g. _\r\n, which bounds the children a buffer holds. */
+        static constexpr size_t MIN_REPLY_SIZE = 3;
+    }
+
+    /**
+     * Non-owning view over a contiguous range of bytes.
+     *
+     * Only valid for as long as the underlying buffer is alive and unmodified.
+     */
+    class str_ref {
+    public:
+        /** Constructs an empty view. */
+        str_ref() noexcept;
+
+        /** Constructs a view over the given pointer and size. */
+        str_ref(const char *ptr, const size_t len) noexcept;
+
+        /** Constructs a view over the given string content. */
+        str_ref(const std::string &str) noexcept;
+
+        /** @return pointer to the first byte. */
+        auto data() const noexcept -> const char *;
+
+        /** @return number of bytes in view. */
+        auto size() const noexcept -> size_t;
+
+        /** @return true if there are no bytes in view. */
+        auto empty() const noexcept -> bool;
+
+        /** @return copy of the bytes in view. */
+        auto to_string() const -> std::string;
+
+        /** @return true if both views hold the same bytes. */
+        auto operator==(const str_ref &rhs) const noexcept -> bool;
+
+        /** @return true if both views do not hold the same bytes. */
+        auto operator!=(const str_ref &rhs) const noexcept -> bool;
+
+    private:
+        /** Pointer to the first byte. */
+        const char *ptr;
+
+        /** Number of bytes in view. */
+        size_t len;
+    };
+
+    /** All the RESP2 and RESP3 reply types. */
+    enum class type : char {
+        simple_string = '+',
+        error = '-',
+        integer = ':',
+        bulk_string = '$',
+        array = '*',
+        null = '_',
+        boolean = '#',
+        double_ = ',',
+        big_number = '(',
+        bulk_error = '!',
+        verbatim_string = '=',
+        map = '%',
+        set = '~',
+        attribute = '|',
+        push = '>',
+    };
+
+    /** Outcome of parsing a reply from a buffer. */
+    enum class parse_status {
+        /** A whole reply has been parsed. */
+        complete,
+
+        /** The buffer ends before the reply does, more bytes are required. */
+        incomplete,
+
+        /** The buffer does not contain a valid reply. */
+        error,
+    };
+
+    /**
+     * Single parsed reply element.
+     *
+     * Elements are stored flattened in pre-order, so the children of an
+     * aggregate directly follow it, and span allows skipping over a whole
+     * subtree.
+     */
+    struct node {
+        /** Reply type. */
+        type kind;
+
+        /** String content for string-like types, in view of the parsed buffer. */
+        str_ref str;
+
+        /** Integer value, boolean value (0 or 1), or aggregate header count. */
+        int64_t integer;
+
+        /** Number of direct children, where a map holds key and value as separate children. */
+        size_t len;
+
+        /** Number of nodes in this subtree, including itself. */
+        size_t span;
+    };
+
+    /**
+     * Read-only view over a parsed reply, similar to cpp_redis::reply
+     * but without owning any of the data.
+     */
+    class reply_view {
+    public:
+        /** Iterates over the direct children of an aggregate reply. */
+        class const_iterator {
+        public:
+            /** Constructs the iterator at the given node. */
+            explicit const_iterator(const node *n) noexcept;
+
+            /** @return view over the current child. */
+            auto operator*() const noexcept -> reply_view;
+
+            /** Moves to the next sibling by skipping the whole current subtree. */
+            auto operator++() noexcept -> const_iterator &;
+
+            /** @return true if both iterators are at the same node. */
+            auto operator==(const const_iterator &rhs) const noexcept -> bool;
+
+            /** @return true if both iterators are not at the same node. */
+            auto operator!=(const const_iterator &rhs) const noexcept -> bool;
+
+        private:
+            /** Current node. */
+            const node *n;
+        };
+
+        /** Constructs the view over the given root node. */
+        explicit reply_view(const node *n) noexcept;
+
+        /** @return reply type. */
+        auto kind() const noexcept -> type;
+
+        /** @return true for arrays, sets and pushes. */
+        auto is_array() const noexcept -> bool;
+
+        /** @return true for maps and attributes. */
+        auto is_map() const noexcept -> bool;
+
+        /** @return true for bulk and verbatim strings. */
+        auto is_bulk_string() const noexcept -> bool;
+
+        /** @return true for simple strings. */
+        auto is_simple_string() const noexcept -> bool;
+
+        /** @return true for simple and bulk errors. */
+        auto is_error() const noexcept -> bool;
+
+        /** @return true for integers and booleans. */
+        auto is_integer() const noexcept -> bool;
+
+        /** @return true for RESP3 null and the RESP2 null bulk string and array. */
+        auto is_null() const noexcept -> bool;
+
+        /** @return string content in view of the parsed buffer. */
+        auto as_str() const noexcept -> str_ref;
+
+        /** @return integer content. */
+        auto as_integer() const noexcept -> int64_t;
+
+        /** @return number of direct children, map entries count as two. */
+        auto size() const noexcept -> size_t;
+
+        /** @return iterator to the first direct child. */
+        auto begin() const noexcept -> const_iterator;
+
+        /** @return iterator past the last direct child. */
+        auto end() const noexcept -> const_iterator;
+
+    private:
+        /** Root node of this view. */
+        const node *n;
+    };
+
+    /**
+     * Parses one reply at a time from a contiguous receive buffer.
+     *
+     * The parsed nodes refer to the given buffer, which must remain alive and
+     * unmodified for as long as the root view is in use. The node storage is
+     * reused across parses to avoid repeated allocations.
+     *
+     * An incomplete parse keeps its progress, so that parsing the same buffer
+     * again once more bytes are appended only parses the appended bytes.
+     *
+     * Large buffers are first scanned with the vectorized CRLF scanner, so that
+     * locating each line end becomes a lookup into the pre-built index.
+     */
+    class parser {
+    public:
+        /**
+         * Constructs the parser with the given scanning instruction set.
+         */
+        explicit parser(const scan_mode mode = scan_mode::automatic);
+
+        /**
+         * Parses a single reply from the front of the given buffer.
+         *
+         * After an incomplete parse, the next call resumes where it stopped, so it must
+         * be given the same bytes followed by the newly received ones, possibly moved
+         * to another address. A buffer smaller than the previous one, or a call to reset,
+         * starts over.
+         *
+         * @param data pointer to the first byte of the receive buffer
+         * @param size number of bytes in the receive buffer
+         * @return complete if a whole reply is parsed, incomplete if more bytes are
+         * required to parse the reply, error if the bytes are not valid RESP.
+         */
+        auto parse(const char *data, const size_t size) -> parse_status;
+
+        /**
+         * Discards the progress of an incomplete parse, so that the next parse starts over.
+         */
+        void reset() noexcept;
+
+        /** @return number of bytes used by the last complete reply. */
+        auto consumed() const noexcept -> size_t;
+
+        /** @return view over the last complete reply. */
+        auto root() const noexcept -> reply_view;
+
+        /**
+         * RESP3 attributes prefix the reply they describe, and nested attributes are skipped.
+         * @return Some(view over the attribute map) in front of the last complete reply,
+         * otherwise None.
+         */
+        auto attribute() const noexcept -> rustfp::Option<reply_view>;
+
+    private:
+        /**
+         * Locates the next CRLF at or after the given position, using the
+         * pre-built index if available.
+         *
+         * @return position of the CR byte, or size if not found.
+         */
+        auto find_crlf(const char *data, const size_t size, const size_t from) noexcept
+            -> size_t;
+
+        /**
+         * Parses the signed decimal integer in [begin, end).
+         *
+         * @return true if the whole range is a valid integer.
+         */
+        static auto parse_integer(const char *begin, const char *end, int64_t &value) noexcept
+            -> bool;
+
+        /**
+         * Parses the nodes from the current position until the reply is complete.
+         *
+         * @return same as parse.
+         */
+        auto parse_nodes(const char *data, const size_t size) -> parse_status;
+
+        /**
+         * Points the string views of the parsed nodes into the buffer at its new address.
+         */
+        void rebase(const char *data) noexcept;
+
+        /**
+         * Closes the aggregates which have received their last child,
+         * starting from the subtree just completed at the given node index.
+         *
+         * @return true if the whole reply is complete.
+         */
+        auto close_subtree(size_t index) -> bool;
+
+        /** Instruction set used to pre-index the CRLF positions. */
+        scan_mode mode;
+
+        /** Flattened nodes of the last parsed reply, after the top-level attribute if any. */
+        std::vector<node> nodes;
+
+        /** Node index of each open aggregate, with its remaining children count. */
+        std::vector<std::pair<size_t, size_t>> open;
+
+        /** Pre-indexed CR positions of the buffer being parsed. */
+        std::vector<size_t> crlfs;
+
+        /** Index into crlfs of the next candidate position. */
+        size_t crlf_cursor = 0;
+
+        /** Whether crlfs holds the index of the buffer being parsed. */
+        bool is_indexed = false;
+
+        /** Number of bytes of the buffer covered by crlfs. */
+        size_t indexed_size = 0;
+
+        /** Whether the last parse was incomplete, and can be resumed. */
+        bool is_partial = false;
+
+        /** Buffer of the last parse, to rebase the nodes if the buffer moved. */
+        const char *prev_data = nullptr;
+
+        /** Size of the buffer of the last parse. */
+        size_t prev_size = 0;
+
+        /** Position of the next node to parse. */
+        size_t pos = 0;
+
+        /** Node index of the reply, after its top-level attribute. */
+        size_t root_index = 0;
+
+        /** Node index of the top-level attribute, only valid if has_attribute. */
+        size_t attribute_index = 0;
+
+        /** Whether the reply is prefixed by a top-level attribute. */
+        bool has_attribute = false;
+
+        /** Number of bytes used by the last complete reply. */
+        size_t used = 0;
+    };
+
+    /**
+     * Appends the given command as a RESP array of bulk strings.
+     *
+     * @param out buffer to append the serialized command into
+     * @param args command name followed by its arguments
+     */
+    template <class Str>
+    void append_command(std::string &out, const std::vector<Str> &args);
+
+    /**
+     * Decodes the msgpack content of a bulk string reply in place,
+     * without copying the reply content.
+     *
+     * @return Some(value) if the reply is a bulk string of V, otherwise None.
+     */
+    template <class V>
+    auto decode(const reply_view &r) -> rustfp::Option<V>;
+
+    // implementation section
+
+    inline str_ref::str_ref() noexcept :
+        ptr(nullptr),
+        len(0) {
+
+    }
+
+    inline str_ref::str_ref(const char *ptr, const size_t len) noexcept :
+        ptr(ptr),
+        len(len) {
+
+    }
+
+    inline str_ref::str_ref(const std::string &str) noexcept :
+        ptr(str.data()),
+        len(str.size()) {
+
+    }
+
+    inline auto str_ref::data() const noexcept -> const char * {
+        return ptr;
+    }
+
+    inline auto str_ref::size() const noexcept -> size_t {
+        return len;
+    }
+
+    inline auto str_ref::empty() const noexcept -> bool {
+        return len == 0;
+    }
+
+    inline auto str_ref::to_string() const -> std::string {
+        return std::string(ptr, len);
+    }
+
+    inline auto str_ref::operator==(const str_ref &rhs) const noexcept -> bool {
+        return len == rhs.len && (len == 0 || std::memcmp(ptr, rhs.ptr, len) == 0);
+    }
+
+    inline auto str_ref::operator!=(const str_ref &rhs) const noexcept -> bool {
+        return !(*this == rhs);
+    }
+
+    inline reply_view::const_iterator::const_iterator(const node *n) noexcept :
+        n(n) {
+
+    }
+
+    inline auto reply_view::const_iterator::operator*() const noexcept -> reply_view {
+        return reply_view(n);
+    }
+
+    inline auto reply_view::const_iterator::operator++() noexcept -> const_iterator & {
+        n += n->span;
+        return *this;
+    }
+
+    inline auto reply_view::const_iterator::operator==(const const_iterator &rhs) const noexcept
+        -> bool {
+
+        return n == rhs.n;
+    }
+
+    inline auto reply_view::const_iterator::operator!=(const const_iterator &rhs) const noexcept
+        -> bool {
+
+        return n != rhs.n;
+    }
+
+    inline reply_view::reply_view(const node *n) noexcept :
+        n(n) {
+
+    }
+
+    inline auto reply_view::kind() const noexcept -> type {
+        return n->kind;
+    }
+
+    inline auto reply_view::is_array() const noexcept -> bool {
+        return n->kind == type::array || n->kind == type::set || n->kind == type::push;
+    }
+
+    inline auto reply_view::is_map() const noexcept -> bool {
+        return n->kind == type::map || n->kind == type::attribute;
+    }
+
+    inline auto reply_view::is_bulk_string() const noexcept -> bool {
+        return n->kind == type::bulk_string || n->kind == type::verbatim_string;
+    }
+
+    inline auto reply_view::is_simple_string() const noexcept -> bool {
+        return n->kind == type::simple_string;
+    }
+
+    inline auto reply_view::is_error() const noexcept -> bool {
+        return n->kind == type::error || n->kind == type::bulk_error;
+    }
+
+    inline auto reply_view::is_integer() const noexcept -> bool {
+        return n->kind == type::integer || n->kind == type::boolean;
+    }
+
+    inline auto reply_view::is_null() const noexcept -> bool {
+        return n->kind == type::null;
+    }
+
+    inline auto reply_view::as_str() const noexcept -> str_ref {
+        return n->str;
+    }
+
+    inline auto reply_view::as_integer() const noexcept -> int64_t {
+        return n->integer;
+    }
+
+    inline auto reply_view::size() const noexcept -> size_t {
+        return n->len;
+    }
+
+    inline auto reply_view::begin() const noexcept -> const_iterator {
+        return const_iterator(n + 1);
+    }
+
+    inline auto reply_view::end() const noexcept -> const_iterator {
+        return const_iterator(n + n->span);
+    }
+
+    inline parser::parser(const scan_mode mode) :
+        mode(mode) {
+
+    }
+
+    inline auto parser::find_crlf(const char *data, const size_t size, const size_t from) noexcept
+        -> size_t {
+
+        if (!is_indexed) {
+            return details::find_crlf(data, size, from);
+        }
+
+        // skips over the CRLFs that are part of bulk string contents
+        while (crlf_cursor < crlfs.size() && crlfs[crlf_cursor] < from) {
+            ++crlf_cursor;
+        }
+
+        return crlf_cursor < crlfs.size() ? crlfs[crlf_cursor] : size;
+    }
+
+    inline auto parser::parse_integer(const char *begin, const char *end, int64_t &value) noexcept
+        -> bool {
+
+        const bool is_negative = begin != end && *begin == '-';
+
+        if (is_negative) {
+            ++begin;
+        }
+
+        if (begin == end) {
+            return false;
+        }
+
+        // the magnitude of the minimum is one more than the maximum
+        const auto limit = static_cast<uint64_t>(std::numeric_limits<int64_t>::max())
+            + (is_negative ? 1 : 0);
+
+        uint64_t acc = 0;
+
+        for (; begin != end; ++begin) {
+            const auto digit = static_cast<unsigned char>(*begin - '0');
+
+            if (digit > 9 || acc > (limit - digit) / 10) {
+                return false;
+            }
+
+            acc = acc * 10 + digit;
+        }
+
+        if (!is_negative) {
+            value = static_cast<int64_t>(acc);
+        }
+        else {
+            // negated as acc - 1 first, since the magnitude of the minimum does not fit
+            value = acc == 0 ? 0 : -static_cast<int64_t>(acc - 1) - 1;
+        }
+
+        return true;
+    }
+
+    inline auto parser::parse(const char *data, const size_t size) -> parse_status {
+        if (!is_partial || size < prev_size) {
+            reset();
+        }
+        else if (data != prev_data) {
+            rebase(data);
+        }
+
+        prev_data = data;
+        prev_size = size;
+
+        // only the bytes not yet indexed are scanned, from the last byte in case it is a CR
+        if (!is_indexed && size >= details::INDEX_MIN_SIZE) {
+            is_indexed = true;
+            indexed_size = pos;
+        }
+
+        if (is_indexed && size > indexed_size) {
+            const auto from = std::max(pos, indexed_size > 0 ? indexed_size - 1 : 0);
+            const auto first = crlfs.size();
+
+            scan_crlf(data + from, size - from, crlfs, mode);
+
+            for (auto i = first; i < crlfs.size(); ++i) {
+                crlfs[i] += from;
+            }
+
+            indexed_size = size;
+        }
+
+        const auto status = parse_nodes(data, size);
+
+        // only an incomplete parse can be resumed, an error starts over
+        is_partial = status == parse_status::incomplete;
+
+        if (status == parse_status::complete) {
+            used = pos;
+        }
+
+        return status;
+    }
+
+    inline auto parser::parse_nodes(const char *data, const size_t size) -> parse_status {
+        while (true) {
+            if (pos >= size) {
+                return parse_status::incomplete;
+            }
+
+            const auto kind = static_cast<type>(data[pos]);
+            const auto line_end = find_crlf(data, size, pos + 1);
+
+            if (line_end == size) {
+                return parse_status::incomplete;
+            }
+
+            const auto line = str_ref(data + pos + 1, line_end - pos - 1);
+            auto next_pos = line_end + 2;
+
+            node n{kind, line, 0, 0, 1};
+            size_t child_count = 0;
+
+            switch (kind) {
+            case type::simple_string:
+            case type::error:
+            case type::double_:
+            case type::big_number:
+                break;
+
+            case type::integer:
+                if (!parse_integer(line.data(), line.data() + line.size(), n.integer)) {
+                    return parse_status::error;
+                }
+                break;
+
+            case type::null:
+                n.str = str_ref();
+                break;
+
+            case type::boolean:
+                if (line.size() != 1 || (line.data()[0] != 't' && line.data()[0] != 'f')) {
+                    return parse_status::error;
+                }
+
+                n.integer = line.data()[0] == 't' ? 1 : 0;
+                break;
+
+            case type::bulk_string:
+            case type::bulk_error:
+            case type::verbatim_string: {
+                int64_t str_len = 0;
+
+                if (!parse_integer(line.data(), line.data() + line.size(), str_len)
+                    || str_len < -1) {
+
+                    return parse_status::error;
+                }
+
+                // RESP2 null bulk string
+                if (str_len == -1) {
+                    n.kind = type::null;
+                    n.str = str_ref();
+                    break;
+                }
+
+                // compared before adding, so that a huge length cannot wrap around
+                if (static_cast<uint64_t>(str_len) + 2 > size - next_pos) {
+                    return parse_status::incomplete;
+                }
+
+                const auto str_end = next_pos + static_cast<size_t>(str_len);
+
+                if (data[str_end] != '\r' || data[str_end + 1] != '\n') {
+                    return parse_status::error;
+                }
+
+                // verbatim string has the 3 bytes format followed by ':' in front
+                static constexpr size_t VERBATIM_PREFIX_LEN = 4;
+                const auto skip_len = kind == type::verbatim_string
+                    && static_cast<size_t>(str_len) >= VERBATIM_PREFIX_LEN
+                    ? VERBATIM_PREFIX_LEN
+                    : 0;
+
+                n.str = str_ref(
+                    data + next_pos + skip_len,
+                    static_cast<size_t>(str_len) - skip_len);
+
+                n.integer = str_len;
+                next_pos = str_end + 2;
+                break;
+            }
+
+            case type::array:
+            case type::set:
+            case type::push:
+            case type::map:
+            case type::attribute: {
+                int64_t count = 0;
+
+                if (!parse_integer(line.data(), line.data() + line.size(), count)
+                    || count < -1) {
+
+                    return parse_status::error;
+                }
+
+                // RESP2 null array
+                if (count == -1) {
+                    n.kind = type::null;
+                    n.str = str_ref();
+                    break;
+                }
+
+                const auto is_pair_wise = kind == type::map || kind == type::attribute;
+                const auto max_count = std::numeric_limits<size_t>::max() / 2;
+
+                if (static_cast<uint64_t>(count) > max_count) {
+                    return parse_status::error;
+                }
+
+                n.str = str_ref();
+                n.integer = count;
+                n.len = static_cast<size_t>(count) * (is_pair_wise ? 2 : 1);
+                child_count = n.len;
+
+                // the count comes from the peer, so only what the received bytes can hold
+                // is reserved, which is exact for multi-bulk replies already received
+                const auto max_children = (size - next_pos) / details::MIN_REPLY_SIZE;
+                nodes.reserve(nodes.size() + 1 + std::min(child_count, max_children));
+                break;
+            }
+
+            default:
+                return parse_status::error;
+            }
+
+            nodes.push_back(n);
+            pos = next_pos;
+
+            if (child_count > 0) {
+                open.emplace_back(nodes.size() - 1, child_count);
+                continue;
+            }
+
+            if (close_subtree(nodes.size() - 1)) {
+                return parse_status::complete;
+            }
+        }
+    }
+
+    inline void parser::reset() noexcept {
+        nodes.clear();
+        open.clear();
+        crlfs.clear();
+        crlf_cursor = 0;
+        is_indexed = false;
+        indexed_size = 0;
+        is_partial = false;
+        prev_data = nullptr;
+        prev_size = 0;
+        pos = 0;
+        root_index = 0;
+        attribute_index = 0;
+        has_attribute = false;
+        used = 0;
+    }
+
+    inline void parser::rebase(const char *data) noexcept {
+        // integer arithmetic, since the previous buffer may not exist anymore
+        const auto prev_base = reinterpret_cast<std::uintptr_t>(prev_data);
+        const auto base = reinterpret_cast<std::uintptr_t>(data);
+
+        for (auto &n : nodes) {
+            if (n.str.data() != nullptr) {
+                const auto offset = reinterpret_cast<std::uintptr_t>(n.str.data()) - prev_base;
+                n.str = str_ref(reinterpret_cast<const char *>(base + offset), n.str.size());
+            }
+        }
+    }
+
+    inline auto parser::close_subtree(size_t index) -> bool {
+        while (true) {
+            if (nodes[index].kind == type::attribute) {
+                // a top-level attribute stays in front of the reply it prefixes
+                if (open.empty()) {
+                    attribute_index = index;
+                    has_attribute = true;
+                    root_index = nodes.size();
+                }
+                else {
+                    nodes.resize(index);
+                }
+
+                // not a child of the enclosing aggregate, the reply it prefixes is
+                return false;
+            }
+
+            if (open.empty()) {
+                return true;
+            }
+
+            auto &top = open.back();
+            --top.second;
+
+            if (top.second > 0) {
+                return false;
+            }
+
+            nodes[top.first].span = nodes.size() - top.first;
+            index = top.first;
+            open.pop_back();
+        }
+    }
+
+    inline auto parser::consumed() const noexcept -> size_t {
+        return used;
+    }
+
+    inline auto parser::root() const noexcept -> reply_view {
+        return reply_view(nodes.data() + root_index);
+    }
+
+    inline auto parser::attribute() const noexcept -> rustfp::Option<reply_view> {
+        if (!has_attribute) {
+            return rustfp::None;
+        }
+
+        return rustfp::Some(reply_view(nodes.data() + attribute_index));
+    }
+
+    template <class Str>
+    void append_command(std::string &out, const std::vector<Str> &args) {
+        size_t reserve_len = 16;
+
+        for (const auto &arg : args) {
+            reserve_len += arg.size() + 16;
+        }
+
+        out.reserve(out.size() + reserve_len);
+
+        out.push_back('*');
+        out.append(std::to_string(args.size()));
+        out.append("\r\n");
+
+        for (const auto &arg : args) {
+            out.push_back('$');
+            out.append(std::to_string(arg.size()));
+            out.append("\r\n");
+            out.append(arg.data(), arg.size());
+            out.append("\r\n");
+        }
+    }
+
+    template <class V>
+    auto decode(const reply_view &r) -> rustfp::Option<V> {
+        if (!r.is_bulk_string()) {
+            return rustfp::None;
+        }
+
+        const auto str = r.as_str();
+        return ::redispack::details::decode_from_str<V>(str.data(), str.size());
+    }
+}
+}
@@ -0,0 +1,946 @@
+/**
+ * Provides an in-memory roaring bitmap of unsigned 32-bit integers, which splits
+ * the integers into chunks by their high 16 bits, and keeps each chunk either
+ * as a sorted array of the low 16 bits or as a 65536-bit bitmap, whichever is smaller.
+ *
+ * Bitmap chunks are combined with SSE2 / AVX2 where available, selected at runtime
+ * the same way as the RESP scanning.
+ *
+ * Container format:
+ * type (1 byte) | array: low 16 bits (2 bytes LE each) | bitmap: 1024 words (8 bytes LE each)
+ *
+ * Bitmap format:
+ * chunk count (4 bytes LE) | per chunk: high 16 bits (2 bytes LE) | size (4 bytes LE) | container
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "scan.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace redispack {
+    namespace roaring {
+
+        // declaration section
+
+        /**
+         * Low 16 bits of the integers sharing the same high 16 bits.
+         */
+        class container {
+        public:
+            /** Maximum cardinality kept as a sorted array, beyond which a bitmap is smaller. */
+            static constexpr size_t ARRAY_MAX = 4096;
+
+            /** Number of 64-bit words in a bitmap. */
+            static constexpr size_t WORD_COUNT = 65536 / 64;
+
+            /**
+             * Constructs an empty array container.
+             */
+            container() = default;
+
+            /**
+             * Adds the low bits.
+             * @return true if the low bits are new.
+             */
+            auto add(const uint16_t low) -> bool;
+
+            /**
+             * Removes the low bits.
+             * @return true if the low bits were present.
+             */
+            auto remove(const uint16_t low) -> bool;
+
+            /** @return true if the low bits are present. */
+            auto contains(const uint16_t low) const noexcept -> bool;
+
+            /** @return number of low bits present. */
+            auto cardinality() const noexcept -> size_t;
+
+            /** @return true if kept as a bitmap instead of a sorted array. */
+            auto is_bitmap() const noexcept -> bool;
+
+            /**
+             * Passes every low bits present to the callback in ascending order.
+             */
+            template <class F>
+            void for_each(F &&fn) const;
+
+            /** @return intersection of both containers. */
+            static auto inter(
+                const container &lhs,
+                const container &rhs,
+                const resp::scan_mode mode = resp::scan_mode::automatic) -> container;
+
+            /** @return union of both containers. */
+            static auto union_(
+                const container &lhs,
+                const container &rhs,
+                const resp::scan_mode mode = resp::scan_mode::automatic) -> container;
+
+            /** @return low bits of lhs which are not in rhs. */
+            static auto diff(
+                const container &lhs,
+                const container &rhs,
+                const resp::scan_mode mode = resp::scan_mode::automatic) -> container;
+
+            /**
+             * Appends the container in the container format to out.
+             */
+            void serialize(std::string &out) const;
+
+            /**
+             * Parses a container in the container format, which must span all the bytes.
+             * @return false if the bytes are malformed.
+             */
+            static auto deserialize(const char *data, const size_t size, container &out) -> bool;
+
+        private:
+            /** Switches to the representation which is smaller for the cardinality. */
+            void normalize();
+
+            /** Sorted low bits, used when not a bitmap. */
+            std::vector<uint16_t> values;
+
+            /** Bit n of the words is low bits n, empty when not a bitmap. */
+            std::vector<uint64_t> words;
+
+            /** Number of low bits present, kept for the bitmap representation. */
+            size_t count = 0;
+        };
+
+        /**
+         * Compressed set of unsigned 32-bit integers.
+         */
+        class bitmap {
+        public:
+            /** Chunks by the high 16 bits, in ascending order. */
+            using chunk_map = std::map<uint16_t, container>;
+
+            /**
+             * Constructs an empty bitmap.
+             */
+            bitmap() = default;
+
+            /**
+             * Adds the integer.
+             * @return true if the integer is new.
+             */
+            auto add(const uint32_t member) -> bool;
+
+            /**
+             * Adds every integer in range.
+             * @return number of new integers.
+             */
+            template <class TBeginIter, class TEndIter>
+            auto add(TBeginIter begin_it, const TEndIter &end_it) -> size_t;
+
+            /**
+             * Removes the integer.
+             * @return true if the integer was present.
+             */
+            auto remove(const uint32_t member) -> bool;
+
+            /** @return true if the integer is present. */
+            auto contains(const uint32_t member) const -> bool;
+
+            /** @return number of integers present. */
+            auto cardinality() const noexcept -> size_t;
+
+            /** @return true if no integer is present. */
+            auto empty() const noexcept -> bool;
+
+            /** @return all the integers in ascending order. */
+            auto members() const -> std::vector<uint32_t>;
+
+            /**
+             * Writes all the integers in ascending order.
+             * @return output iterator past the last written integer.
+             */
+            template <class OutIt>
+            auto members(OutIt out) const -> OutIt;
+
+            /** @return intersection of *this and rhs. */
+            auto inter(
+                const bitmap &rhs,
+                const resp::scan_mode mode = resp::scan_mode::automatic) const -> bitmap;
+
+            /** @return union of *this and rhs. */
+            auto union_(
+                const bitmap &rhs,
+                const resp::scan_mode mode = resp::scan_mode::automatic) const -> bitmap;
+
+            /** @return integers of *this which are not in rhs. */
+            auto diff(
+                const bitmap &rhs,
+                const resp::scan_mode mode = resp::scan_mode::automatic) const -> bitmap;
+
+            /** @return chunks by the high 16 bits. */
+            auto get_chunks() const noexcept -> const chunk_map &;
+
+            /**
+             * Replaces the chunk of the high 16 bits, or removes it if the chunk is empty.
+             */
+            void set_chunk(const uint16_t high, container chunk);
+
+        private:
+            /** Chunks by the high 16 bits, without any empty chunk. */
+            chunk_map chunks;
+        };
+
+        /**
+         * Appends the bitmap in the bitmap format to out.
+         */
+        void serialize(const bitmap &bm, std::string &out);
+
+        /**
+         * Parses a bitmap in the bitmap format, which must span all the bytes.
+         * @return false if the bytes are malformed.
+         */
+        auto deserialize(const char *data, const size_t size, bitmap &out) -> bool;
+
+        /**
+         * Chunk of the integer.
+         */
+        auto high_bits(const uint32_t member) noexcept -> uint16_t;
+
+        /**
+         * Position of the integer within its chunk.
+         */
+        auto low_bits(const uint32_t member) noexcept -> uint16_t;
+
+        namespace details {
+            /** Operation to combine bitmap words with. */
+            enum class word_op {
+                /** lhs & rhs */
+                and_,
+
+                /** lhs | rhs */
+                or_,
+
+                /** lhs & ~rhs */
+                andnot,
+            };
+
+            /**
+             * Combines the bitmap words into out.
+             * @return number of set bits in out.
+             */
+            auto combine_words(
+                const uint64_t *lhs,
+                const uint64_t *rhs,
+                uint64_t *out,
+                const word_op op,
+                const resp::scan_mode mode) -> size_t;
+
+            /** Scalar implementation of combine_words. */
+            void combine_words_scalar(
+                const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, const word_op op);
+
+#ifdef REDISPACK_HAS_SSE2
+            /** SSE2 implementation of combine_words. */
+            void combine_words_sse2(
+                const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, const word_op op);
+#endif
+
+#ifdef REDISPACK_HAS_AVX2
+            /** AVX2 implementation of combine_words. */
+            __attribute__((target("avx2")))
+            void combine_words_avx2(
+                const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, const word_op op);
+#endif
+
+            /** @return number of set bits. */
+            auto popcount(const uint64_t word) noexcept -> size_t;
+
+            /** @return index of the lowest set bit in the non-zero word. */
+            auto lowest_bit64(const uint64_t word) noexcept -> uint32_t;
+
+            /** Appends the value as little-endian. */
+            template <class V>
+            void append_le(std::string &out, const V value);
+
+            /**
+             * Reads a little-endian value, advancing the position.
+             * @return false if the input ends before the value does.
+             */
+            template <class V>
+            auto read_le(const char *&pos, const char *end, V &value) noexcept -> bool;
+        }
+
+        // implementation section
+
+        inline auto container::add(const uint16_t low) -> bool {
+            if (is_bitmap()) {
+                auto &word = words[low / 64];
+                const auto bit = uint64_t(1) << (low % 64);
+
+                if (word & bit) {
+                    return false;
+                }
+
+                word |= bit;
+                ++count;
+                return true;
+            }
+
+            const auto it = std::lower_bound(values.begin(), values.end(), low);
+
+            if (it != values.end() && *it == low) {
+                return false;
+            }
+
+            values.insert(it, low);
+            count = values.size();
+            normalize();
+            return true;
+        }
+
+        inline auto container::remove(const uint16_t low) -> bool {
+            if (is_bitmap()) {
+                auto &word = words[low / 64];
+                const auto bit = uint64_t(1) << (low % 64);
+
+                if (!(word & bit)) {
+                    return false;
+                }
+
+                word &= ~bit;
+                --count;
+                normalize();
+                return true;
+            }
+
+            const auto it = std::lower_bound(values.begin(), values.end(), low);
+
+            if (it == values.end() || *it != low) {
+                return false;
+            }
+
+            values.erase(it);
+            count = values.size();
+            return true;
+        }
+
+        inline auto container::contains(const uint16_t low) const noexcept -> bool {
+            if (is_bitmap()) {
+                return (words[low / 64] >> (low % 64)) & 1;
+            }
+
+            return std::binary_search(values.cbegin(), values.cend(), low);
+        }
+
+        inline auto container::cardinality() const noexcept -> size_t {
+            return count;
+        }
+
+        inline auto container::is_bitmap() const noexcept -> bool {
+            return !words.empty();
+        }
+
+        template <class F>
+        void container::for_each(F &&fn) const {
+            if (!is_bitmap()) {
+                for (const auto low : values) {
+                    fn(low);
+                }
+
+                return;
+            }
+
+            for (size_t i = 0; i < WORD_COUNT; ++i) {
+                for (auto word = words[i]; word != 0; word &= word - 1) {
+                    fn(static_cast<uint16_t>(i * 64 + details::lowest_bit64(word)));
+                }
+            }
+        }
+
+        inline auto container::inter(
+            const container &lhs,
+            const container &rhs,
+            const resp::scan_mode mode) -> container {
+
+            container result;
+
+            if (lhs.is_bitmap() && rhs.is_bitmap()) {
+                result.words.resize(WORD_COUNT);
+
+                result.count = details::combine_words(
+                    lhs.words.data(), rhs.words.data(), result.words.data(),
+                    details::word_op::and_, mode);
+
+                result.normalize();
+                return result;
+            }
+
+            // the smaller side bounds the result, so only its values are probed
+            const auto is_lhs_small = rhs.is_bitmap()
+                || (!lhs.is_bitmap() && lhs.values.size() <= rhs.values.size());
+
+            const auto &small = is_lhs_small ? lhs : rhs;
+            const auto &large = is_lhs_small ? rhs : lhs;
+
+            if (large.is_bitmap() || small.values.size() * 64 < large.values.size()) {
+                for (const auto low : small.values) {
+                    if (large.contains(low)) {
+                        result.values.push_back(low);
+                    }
+                }
+            }
+            else {
+                std::set_intersection(
+                    lhs.values.cbegin(), lhs.values.cend(),
+                    rhs.values.cbegin(), rhs.values.cend(),
+                    std::back_inserter(result.values));
+            }
+
+            result.count = result.values.size();
+            return result;
+        }
+
+        inline auto container::union_(
+            const container &lhs,
+            const container &rhs,
+            const resp::scan_mode mode) -> container {
+
+            container result;
+
+            if (lhs.is_bitmap() && rhs.is_bitmap()) {
+                result.words.resize(WORD_COUNT);
+
+                result.count = details::combine_words(
+                    lhs.words.data(), rhs.words.data(), result.words.data(),
+                    details::word_op::or_, mode);
+
+                return result;
+            }
+
+            if (lhs.is_bitmap() || rhs.is_bitmap()) {
+                result = lhs.is_bitmap() ? lhs : rhs;
+                const auto &array = lhs.is_bitmap() ? rhs : lhs;
+
+                for (const auto low : array.values) {
+                    result.add(low);
+                }
+
+                return result;
+            }
+
+            result.values.reserve(lhs.values.size() + rhs.values.size());
+
+            std::set_union(
+                lhs.values.cbegin(), lhs.values.cend(),
+                rhs.values.cbegin(), rhs.values.cend(),
+                std::back_inserter(result.values));
+
+            result.count = result.values.size();
+            result.normalize();
+            return result;
+        }
+
+        inline auto container::diff(
+            const container &lhs,
+            const container &rhs,
+            const resp::scan_mode mode) -> container {
+
+            container result;
+
+            if (lhs.is_bitmap() && rhs.is_bitmap()) {
+                result.words.resize(WORD_COUNT);
+
+                result.count = details::combine_words(
+                    lhs.words.data(), rhs.words.data(), result.words.data(),
+                    details::word_op::andnot, mode);
+
+                result.normalize();
+                return result;
+            }
+
+            if (lhs.is_bitmap()) {
+                result = lhs;
+
+                for (const auto low : rhs.values) {
+                    result.remove(low);
+                }
+
+                return result;
+            }
+
+            for (const auto low : lhs.values) {
+                if (!rhs.contains(low)) {
+                    result.values.push_back(low);
+                }
+            }
+
+            result.count = result.values.size();
+            return result;
+        }
+
+        inline void container::serialize(std::string &out) const {
+            static constexpr uint8_t ARRAY_TYPE = 0;
+            static constexpr uint8_t BITMAP_TYPE = 1;
+
+            if (is_bitmap()) {
+                out.push_back(static_cast<char>(BITMAP_TYPE));
+
+                for (const auto word : words) {
+                    details::append_le(out, word);
+                }
+            }
+            else {
+                out.push_back(static_cast<char>(ARRAY_TYPE));
+
+                for (const auto low : values) {
+                    details::append_le(out, low);
+                }
+            }
+        }
+
+        inline auto container::deserialize(const char *data, const size_t size, container &out)
+            -> bool {
+
+            static constexpr uint8_t ARRAY_TYPE = 0;
+            static constexpr uint8_t BITMAP_TYPE = 1;
+
+            if (size == 0) {
+                return false;
+            }
+
+            auto pos = data + 1;
+            const auto end = data + size;
+            const auto type = static_cast<uint8_t>(data[0]);
+
+            container parsed;
+
+            if (type == BITMAP_TYPE) {
+                if (static_cast<size_t>(end - pos) != WORD_COUNT * sizeof(uint64_t)) {
+                    return false;
+                }
+
+                parsed.words.resize(WORD_COUNT);
+
+                for (auto &word : parsed.words) {
+                    details::read_le(pos, end, word);
+                    parsed.count += details::popcount(word);
+                }
+            }
+            else if (type == ARRAY_TYPE) {
+                const auto payload_size = static_cast<size_t>(end - pos);
+
+                if (payload_size % sizeof(uint16_t) != 0
+                    || payload_size / sizeof(uint16_t) > ARRAY_MAX) {
+
+                    return false;
+                }
+
+                parsed.values.resize(payload_size / sizeof(uint16_t));
+
+                for (auto &low : parsed.values) {
+                    details::read_le(pos, end, low);
+                }
+
+                // the array must be strictly ascending for the searches to hold
+                for (size_t i = 1; i < parsed.values.size(); ++i) {
+                    if (parsed.values[i - 1] >= parsed.values[i]) {
+                        return false;
+                    }
+                }
+
+                parsed.count = parsed.values.size();
+            }
+            else {
+                return false;
+            }
+
+            parsed.normalize();
+            out = std::move(parsed);
+            return true;
+        }
+
+        inline void container::normalize() {
+            if (is_bitmap() && count <= ARRAY_MAX) {
+                std::vector<uint16_t> lows;
+                lows.reserve(count);
+
+                for_each([&lows](const uint16_t low) {
+                    lows.push_back(low);
+                });
+
+                values = std::move(lows);
+                words.clear();
+                words.shrink_to_fit();
+            }
+            else if (!is_bitmap() && count > ARRAY_MAX) {
+                words.assign(WORD_COUNT, 0);
+
+                for (const auto low : values) {
+                    words[low / 64] |= uint64_t(1) << (low % 64);
+                }
+
+                values.clear();
+                values.shrink_to_fit();
+            }
+        }
+
+        inline auto bitmap::add(const uint32_t member) -> bool {
+            return chunks[high_bits(member)].add(low_bits(member));
+        }
+
+        template <class TBeginIter, class TEndIter>
+        auto bitmap::add(TBeginIter begin_it, const TEndIter &end_it) -> size_t {
+            size_t added_count = 0;
+
+            for (; begin_it != end_it; ++begin_it) {
+                if (add(static_cast<uint32_t>(*begin_it))) {
+                    ++added_count;
+                }
+            }
+
+            return added_count;
+        }
+
+        inline auto bitmap::remove(const uint32_t member) -> bool {
+            const auto it = chunks.find(high_bits(member));
+
+            if (it == chunks.end() || !it->second.remove(low_bits(member))) {
+                return false;
+            }
+
+            if (it->second.cardinality() == 0) {
+                chunks.erase(it);
+            }
+
+            return true;
+        }
+
+        inline auto bitmap::contains(const uint32_t member) const -> bool {
+            const auto it = chunks.find(high_bits(member));
+            return it != chunks.cend() && it->second.contains(low_bits(member));
+        }
+
+        inline auto bitmap::cardinality() const noexcept -> size_t {
+            size_t total = 0;
+
+            for (const auto &chunk : chunks) {
+                total += chunk.second.cardinality();
+            }
+
+            return total;
+        }
+
+        inline auto bitmap::empty() const noexcept -> bool {
+            return chunks.empty();
+        }
+
+        inline auto bitmap::members() const -> std::vector<uint32_t> {
+            std::vector<uint32_t> mems;
+            mems.reserve(cardinality());
+            members(std::back_inserter(mems));
+            return mems;
+        }
+
+        template <class OutIt>
+        auto bitmap::members(OutIt out) const -> OutIt {
+            for (const auto &chunk : chunks) {
+                const auto high = static_cast<uint32_t>(chunk.first) << 16;
+
+                chunk.second.for_each([&out, high](const uint16_t low) {
+                    *out = high | low;
+                    ++out;
+                });
+            }
+
+            return out;
+        }
+
+        inline auto bitmap::inter(const bitmap &rhs, const resp::scan_mode mode) const -> bitmap {
+            bitmap result;
+
+            // only the chunks present on both sides can intersect
+            auto lhs_it = chunks.cbegin();
+            auto rhs_it = rhs.chunks.cbegin();
+
+            while (lhs_it != chunks.cend() && rhs_it != rhs.chunks.cend()) {
+                if (lhs_it->first < rhs_it->first) {
+                    ++lhs_it;
+                }
+                else if (rhs_it->first < lhs_it->first) {
+                    ++rhs_it;
+                }
+                else {
+                    result.set_chunk(
+                        lhs_it->first, container::inter(lhs_it->second, rhs_it->second, mode));
+
+                    ++lhs_it;
+                    ++rhs_it;
+                }
+            }
+
+            return result;
+        }
+
+        inline auto bitmap::union_(const bitmap &rhs, const resp::scan_mode mode) const -> bitmap {
+            bitmap result = *this;
+
+            for (const auto &chunk : rhs.chunks) {
+                const auto it = result.chunks.find(chunk.first);
+
+                if (it == result.chunks.end()) {
+                    result.chunks.emplace(chunk.first, chunk.second);
+                }
+                else {
+                    it->second = container::union_(it->second, chunk.second, mode);
+                }
+            }
+
+            return result;
+        }
+
+        inline auto bitmap::diff(const bitmap &rhs, const resp::scan_mode mode) const -> bitmap {
+            bitmap result;
+
+            for (const auto &chunk : chunks) {
+                const auto it = rhs.chunks.find(chunk.first);
+
+                if (it == rhs.chunks.cend()) {
+                    result.chunks.emplace(chunk.first, chunk.second);
+                }
+                else {
+                    result.set_chunk(
+                        chunk.first, container::diff(chunk.second, it->second, mode));
+                }
+            }
+
+            return result;
+        }
+
+        inline auto bitmap::get_chunks() const noexcept -> const chunk_map & {
+            return chunks;
+        }
+
+        inline void bitmap::set_chunk(const uint16_t high, container chunk) {
+            if (chunk.cardinality() == 0) {
+                chunks.erase(high);
+            }
+            else {
+                chunks[high] = std::move(chunk);
+            }
+        }
+
+        inline void serialize(const bitmap &bm, std::string &out) {
+            const auto &chunks = bm.get_chunks();
+            details::append_le(out, static_cast<uint32_t>(chunks.size()));
+
+            for (const auto &chunk : chunks) {
+                details::append_le(out, chunk.first);
+
+                // the size is patched in after the container is appended
+                const auto size_pos = out.size();
+                details::append_le(out, uint32_t(0));
+
+                chunk.second.serialize(out);
+
+                std::string size_bytes;
+                details::append_le(size_bytes,
+                    static_cast<uint32_t>(out.size() - size_pos - sizeof(uint32_t)));
+
+                out.replace(size_pos, sizeof(uint32_t), size_bytes);
+            }
+        }
+
+        inline auto deserialize(const char *data, const size_t size, bitmap &out) -> bool {
+            auto pos = data;
+            const auto end = data + size;
+            uint32_t chunk_count = 0;
+
+            if (!details::read_le(pos, end, chunk_count)) {
+                return false;
+            }
+
+            bitmap parsed;
+
+            for (uint32_t i = 0; i < chunk_count; ++i) {
+                uint16_t high = 0;
+                uint32_t chunk_size = 0;
+                container chunk;
+
+                if (!details::read_le(pos, end, high)
+                    || !details::read_le(pos, end, chunk_size)
+                    || chunk_size > static_cast<size_t>(end - pos)
+                    || !container::deserialize(pos, chunk_size, chunk)) {
+
+                    return false;
+                }
+
+                pos += chunk_size;
+                parsed.set_chunk(high, std::move(chunk));
+            }
+
+            if (pos != end) {
+                return false;
+            }
+
+            out = std::move(parsed);
+            return true;
+        }
+
+        inline auto high_bits(const uint32_t member) noexcept -> uint16_t {
+            return static_cast<uint16_t>(member >> 16);
+        }
+
+        inline auto low_bits(const uint32_t member) noexcept -> uint16_t {
+            return static_cast<uint16_t>(member & 0xffff);
+        }
+
+        namespace details {
+            inline auto combine_words(
+                const uint64_t *lhs,
+                const uint64_t *rhs,
+                uint64_t *out,
+                const word_op op,
+                const resp::scan_mode mode) -> size_t {
+
+                switch (resp::resolve_scan_mode(mode)) {
+#ifdef REDISPACK_HAS_AVX2
+                case resp::scan_mode::avx2:
+                    combine_words_avx2(lhs, rhs, out, op);
+                    break;
+#endif
+
+#ifdef REDISPACK_HAS_SSE2
+                case resp::scan_mode::sse2:
+                    combine_words_sse2(lhs, rhs, out, op);
+                    break;
+#endif
+
+                default:
+                    combine_words_scalar(lhs, rhs, out, op);
+                    break;
+                }
+
+                size_t count = 0;
+
+                for (size_t i = 0; i < container::WORD_COUNT; ++i) {
+                    count += popcount(out[i]);
+                }
+
+                return count;
+            }
+
+            inline void combine_words_scalar(
+                const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, const word_op op) {
+
+                for (size_t i = 0; i < container::WORD_COUNT; ++i) {
+                    switch (op) {
+                    case word_op::and_:
+                        out[i] = lhs[i] & rhs[i];
+                        break;
+
+                    case word_op::or_:
+                        out[i] = lhs[i] | rhs[i];
+                        break;
+
+                    default:
+                        out[i] = lhs[i] & ~rhs[i];
+                        break;
+                    }
+                }
+            }
+
+#ifdef REDISPACK_HAS_SSE2
+            inline void combine_words_sse2(
+                const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, const word_op op) {
+
+                static constexpr size_t WORDS_PER_VECTOR = 2;
+
+                for (size_t i = 0; i < container::WORD_COUNT; i += WORDS_PER_VECTOR) {
+                    const auto l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhs + i));
+                    const auto r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhs + i));
+
+                    // andnot negates its first operand
+                    const auto combined = op == word_op::and_ ? _mm_and_si128(l, r)
+                        : op == word_op::or_ ? _mm_or_si128(l, r)
+                        : _mm_andnot_si128(r, l);
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), combined);
+                }
+            }
+#endif
+
+#ifdef REDISPACK_HAS_AVX2
+            __attribute__((target("avx2")))
+            inline void combine_words_avx2(
+                const uint64_t *lhs, const uint64_t *rhs, uint64_t *out, const word_op op) {
+
+                static constexpr size_t WORDS_PER_VECTOR = 4;
+
+                for (size_t i = 0; i < container::WORD_COUNT; i += WORDS_PER_VECTOR) {
+                    const auto l = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(lhs + i));
+
+                    const auto r = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(rhs + i));
+
+                    // andnot negates its first operand
+                    const auto combined = op == word_op::and_ ? _mm256_and_si256(l, r)
+                        : op == word_op::or_ ? _mm256_or_si256(l, r)
+                        : _mm256_andnot_si256(r, l);
+
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), combined);
+                }
+            }
+#endif
+
+            inline auto popcount(const uint64_t word) noexcept -> size_t {
+#if defined(_MSC_VER)
+                return static_cast<size_t>(__popcnt64(word));
+#else
+                return static_cast<size_t>(__builtin_popcountll(word));
+#endif
+            }
+
+            inline auto lowest_bit64(const uint64_t word) noexcept -> uint32_t {
+#if defined(_MSC_VER)
+                unsigned long index = 0;
+                _BitScanForward64(&index, word);
+                return static_cast<uint32_t>(index);
+#else
+                return static_cast<uint32_t>(__builtin_ctzll(word));
+#endif
+            }
+
+            template <class V>
+            void append_le(std::string &out, const V value) {
+                for (size_t i = 0; i < sizeof(V); ++i) {
+                    out.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+                }
+            }
+
+            template <class V>
+            auto read_le(const char *&pos, const char *end, V &value) noexcept -> bool {
+                if (static_cast<size_t>(end - pos) < sizeof(V)) {
+                    return false;
+                }
+
+                value = 0;
+
+                for (size_t i = 0; i < sizeof(V); ++i) {
+                    const auto byte = static_cast<V>(static_cast<uint8_t>(pos[i]));
+                    value |= static_cast<V>(byte << (i * 8));
+                }
+
+                pos += sizeof(V);
+                return true;
+            }
+        }
+    }
+}
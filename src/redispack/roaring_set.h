@@ -0,0 +1,724 @@
+/**
+ * Provides a set of sparse unsigned integers stored as a roaring bitmap,
+ * either as one redis hash field per chunk so that queries only fetch the
+ * chunks they touch, or as a single value through roaring_codec.
+ *
+ * The set algebra runs on the client over the fetched chunks.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "decode.h"
+#include "expiry.h"
+#include "keyspace.h"
+#include "roaring.h"
+#include "router.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Stores a whole roaring::bitmap as a single value in the bitmap format,
+     * e.g. value<roaring::bitmap, roaring_codec>.
+     */
+    struct roaring_codec {
+        /**
+         * @return bitmap in the bitmap format.
+         */
+        template <class V>
+        auto encode(const V &value) const -> std::string;
+
+        /**
+         * @return Some(bitmap) if the bytes are in the bitmap format, otherwise None.
+         */
+        template <class V>
+        auto decode(const char *data, const size_t size) const -> rustfp::Option<V>;
+    };
+
+    /**
+     * Provides set like functionalities for sparse unsigned integers,
+     * where each chunk of the roaring bitmap is a field of a redis hash,
+     * keyed by the high 16 bits of its members.
+     *
+     * All the data is stored in the redis server. Writes read the touched chunks
+     * and write them back only if none of them changed in between, retrying otherwise,
+     * so concurrent writers touching the same chunks never lose each other's members.
+     */
+    class roaring_set {
+    public:
+        /** Type of the members. */
+        using value_t = uint32_t;
+
+        /**
+         * Constructs this instance with the given client connection and hash key (name).
+         */
+        roaring_set(const redis_client_ptr &client_ptr, const std::string &name);
+
+        /**
+         * Constructs this instance with the given router and hash key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        roaring_set(const std::shared_ptr<replica_router> &router_ptr, const std::string &name);
+
+        /**
+         * Adds the member, fetching and writing back only its chunk.
+         * @return true if the member is new
+         */
+        auto add(const uint32_t member) -> bool;
+
+        /**
+         * Adds the members, fetching and writing back only their chunks.
+         * @param begin_it begin iterator of members to add
+         * @param end_it end iterator of members to add
+         * @return number of new members
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto add(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
+
+        /**
+         * Fetches all the chunks.
+         * @return number of members
+         */
+        auto card() const -> size_t;
+
+        /**
+         * Deletes the set.
+         * @return true if the set existed
+         */
+        auto clear() -> bool;
+
+        /**
+         * Fetches only the chunk of the member.
+         * @return true if the member is in the set
+         */
+        auto is_member(const uint32_t member) const -> bool;
+
+        /**
+         * Fetches all the chunks.
+         * @return whole set as a bitmap
+         */
+        auto load() const -> roaring::bitmap;
+
+        /**
+         * Fetches only the chunks touched by the members.
+         * @param begin_it begin iterator of members to query
+         * @param end_it end iterator of members to query
+         * @return bitmap holding every chunk touched, including members outside the range
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto load(const TBeginIter &begin_it, const TEndIter &end_it) const -> roaring::bitmap;
+
+        /**
+         * Removes the members, fetching and writing back only their chunks.
+         * @param begin_it begin iterator of members to remove
+         * @param end_it end iterator of members to remove
+         * @return number of removed members
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto rem(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
+
+        /**
+         * Replaces the whole set with the bitmap in a single atomic script.
+         */
+        void store(const roaring::bitmap &bm);
+
+        /**
+         * Fetches only the chunks present in both sets.
+         * @return intersection of *this and rhs
+         */
+        auto inter(const roaring_set &rhs) const -> roaring::bitmap;
+
+        /**
+         * Fetches all the chunks of both sets.
+         * @return union of *this and rhs
+         */
+        auto union_(const roaring_set &rhs) const -> roaring::bitmap;
+
+        /**
+         * Fetches all the chunks of *this, and only the same chunks of rhs.
+         * @return members of *this which are not in rhs
+         */
+        auto diff(const roaring_set &rhs) const -> roaring::bitmap;
+
+        /**
+         * Performs the pexpire command on the set key.
+         *
+         * @return true if the timeout was set, false if the set does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the set key.
+         *
+         * @return Some(remaining time) if the set has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return hash key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+    private:
+        /**
+         * Performs the hkeys command.
+         * @return high 16 bits of every chunk present, in ascending order.
+         */
+        auto fetch_highs() const -> std::vector<uint16_t>;
+
+        /**
+         * Performs the hmget command on the chunks, reading from a replica if routed.
+         * @return bitmap holding the chunks which exist.
+         * @throws std::runtime_error if the reply is an error or a chunk cannot be decoded.
+         */
+        auto fetch_chunks(const std::vector<uint16_t> &highs) const -> roaring::bitmap;
+
+        /**
+         * Performs the hmget command on the chunks with the given client.
+         * @return stored chunk values in the order of highs, empty for missing chunks.
+         * @throws std::runtime_error if the reply is an error or malformed.
+         */
+        auto fetch_chunk_values(
+            redis_client_ptr &read_client_ptr,
+            const std::vector<uint16_t> &highs) const -> std::vector<std::string>;
+
+        /**
+         * @return bitmap holding the fetched chunk values, skipping the missing ones.
+         * @throws std::runtime_error if a chunk cannot be decoded.
+         */
+        auto decode_chunks(
+            const std::vector<uint16_t> &highs,
+            const std::vector<std::string> &values) const -> roaring::bitmap;
+
+        /**
+         * Fetches the chunks from the primary, applies update to them and writes them back,
+         * retrying from the fetch whenever another writer changed any of the chunks.
+         * @param update returns the number of members changed in the bitmap
+         * @return number of members changed
+         * @throws std::runtime_error if the chunks cannot be fetched or stay contended.
+         */
+        template <class F>
+        auto update_chunks(const std::vector<uint16_t> &highs, F &&update) -> size_t;
+
+        /**
+         * Writes back the chunks of the bitmap in a single atomic script,
+         * deleting the chunks which became empty, only if every chunk still holds old_values.
+         * @return true if written, false if another writer changed any of the chunks.
+         */
+        auto write_chunks(
+            const roaring::bitmap &bm,
+            const std::vector<uint16_t> &highs,
+            const std::vector<std::string> &old_values) -> bool;
+
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
+        /** Holds a shared ownership to access the database. */
+        mutable redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Hash key (name). */
+        std::string name;
+    };
+
+    namespace details {
+        /**
+         * Deletes KEYS[1] and sets the field-value pairs of ARGV into it, atomically.
+         * The pairs are set in batches, since unpack is limited by the Lua stack.
+         */
+        static constexpr auto ROARING_STORE_SCRIPT =
+            "redis.call('DEL', KEYS[1]) "
+            "for i = 1, #ARGV, 1000 do "
+            "redis.call('HSET', KEYS[1], unpack(ARGV, i, math.min(i + 999, #ARGV))) "
+            "end";
+
+        /**
+         * Compares each field of KEYS[1] against the expected value of the ARGV triples
+         * (field, expected value, new value), where empty stands for a missing field.
+         * Only if all of them match, sets each field to its new value, or deletes it if empty.
+         * Returns 1 if written, otherwise 0.
+         */
+        static constexpr auto ROARING_UPDATE_SCRIPT =
+            "for i = 1, #ARGV, 3 do "
+            "if (redis.call('HGET', KEYS[1], ARGV[i]) or '') ~= ARGV[i + 1] then return 0 end "
+            "end "
+            "for i = 1, #ARGV, 3 do "
+            "if ARGV[i + 2] == '' then redis.call('HDEL', KEYS[1], ARGV[i]) "
+            "else redis.call('HSET', KEYS[1], ARGV[i], ARGV[i + 2]) end "
+            "end "
+            "return 1";
+
+        /** Number of times a contended write fetches the chunks again before giving up. */
+        static constexpr size_t ROARING_UPDATE_ATTEMPTS = 16;
+
+        /**
+         * @return high 16 bits of the members, sorted and without duplicates.
+         */
+        auto touched_highs(const std::vector<uint32_t> &members) -> std::vector<uint16_t>;
+
+        /**
+         * @return hash field of the chunk.
+         */
+        auto chunk_field(const uint16_t high) -> std::string;
+
+        /**
+         * @return chunk in the container format.
+         */
+        auto chunk_value(const roaring::container &chunk) -> std::string;
+    }
+
+    // implementation section
+
+    template <class V>
+    auto roaring_codec::encode(const V &value) const -> std::string {
+        static_assert(std::is_same<V, roaring::bitmap>::value,
+            "roaring_codec only stores roaring::bitmap");
+
+        std::string out;
+        roaring::serialize(value, out);
+        return out;
+    }
+
+    template <class V>
+    auto roaring_codec::decode(const char *data, const size_t size) const
+        -> rustfp::Option<V> {
+
+        static_assert(std::is_same<V, roaring::bitmap>::value,
+            "roaring_codec only stores roaring::bitmap");
+
+        V value;
+
+        if (!roaring::deserialize(data, size, value)) {
+            return rustfp::None;
+        }
+
+        return rustfp::Some(std::move(value));
+    }
+
+    inline roaring_set::roaring_set(const redis_client_ptr &client_ptr, const std::string &name) :
+        client_ptr(client_ptr),
+        name(name) {
+
+    }
+
+    inline roaring_set::roaring_set(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name) {
+
+    }
+
+    inline auto roaring_set::add(const uint32_t member) -> bool {
+        const std::vector<uint32_t> members{member};
+        return add(members.cbegin(), members.cend()) > 0;
+    }
+
+    template <class TBeginIter, class TEndIter, class>
+    auto roaring_set::add(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
+        const std::vector<uint32_t> members(begin_it, end_it);
+
+        return update_chunks(details::touched_highs(members),
+            [&members](roaring::bitmap &bm) {
+                return bm.add(members.cbegin(), members.cend());
+            });
+    }
+
+    inline auto roaring_set::card() const -> size_t {
+        return load().cardinality();
+    }
+
+    inline auto roaring_set::clear() -> bool {
+        const auto deleted = details::del_impl(client_ptr, name);
+        mark_write();
+        return deleted;
+    }
+
+    inline auto roaring_set::is_member(const uint32_t member) const -> bool {
+        return fetch_chunks({roaring::high_bits(member)}).contains(member);
+    }
+
+    inline auto roaring_set::load() const -> roaring::bitmap {
+        roaring::bitmap bm;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        bool is_malformed = false;
+
+        read_client_ptr->hgetall(name,
+            [&bm, &is_malformed](cpp_redis::reply &r) {
+                if (!r.is_array()) {
+                    is_malformed = true;
+                    return;
+                }
+
+                const auto &elems = r.as_array();
+
+                for (size_t i = 0; i + 1 < elems.size(); i += 2) {
+                    if (!elems[i].is_bulk_string() || !elems[i + 1].is_bulk_string()) {
+                        is_malformed = true;
+                        return;
+                    }
+
+                    const auto &field = elems[i].as_string();
+                    const auto &value = elems[i + 1].as_string();
+                    roaring::container chunk;
+
+                    details::decode_from_str<uint16_t>(field).match_some(
+                        [&bm, &chunk, &value, &is_malformed](const uint16_t high) {
+                            if (roaring::container::deserialize(
+                                value.data(), value.size(), chunk)) {
+
+                                bm.set_chunk(high, std::move(chunk));
+                            }
+                            else {
+                                is_malformed = true;
+                            }
+                        });
+                }
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        if (is_malformed) {
+            throw std::runtime_error("Unable to load the chunks of roaring set " + name);
+        }
+
+        return bm;
+    }
+
+    template <class TBeginIter, class TEndIter, class>
+    auto roaring_set::load(const TBeginIter &begin_it, const TEndIter &end_it) const
+        -> roaring::bitmap {
+
+        return fetch_chunks(details::touched_highs(std::vector<uint32_t>(begin_it, end_it)));
+    }
+
+    template <class TBeginIter, class TEndIter, class>
+    auto roaring_set::rem(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
+        const std::vector<uint32_t> members(begin_it, end_it);
+
+        return update_chunks(details::touched_highs(members),
+            [&members](roaring::bitmap &bm) {
+                size_t removed_count = 0;
+
+                for (const auto member : members) {
+                    if (bm.remove(member)) {
+                        ++removed_count;
+                    }
+                }
+
+                return removed_count;
+            });
+    }
+
+    inline void roaring_set::store(const roaring::bitmap &bm) {
+        const auto &chunks = bm.get_chunks();
+
+        std::vector<std::string> cmd{"EVAL", details::ROARING_STORE_SCRIPT, "1", name};
+        cmd.reserve(cmd.size() + chunks.size() * 2);
+
+        for (const auto &chunk : chunks) {
+            cmd.push_back(details::chunk_field(chunk.first));
+            cmd.push_back(details::chunk_value(chunk.second));
+        }
+
+        // a single command, so readers never observe a partially replaced set,
+        // and no other command on the shared client can interleave into it
+        client_ptr->send(cmd);
+        details::sync_commit(client_ptr);
+        mark_write();
+    }
+
+    inline auto roaring_set::inter(const roaring_set &rhs) const -> roaring::bitmap {
+        const auto lhs_highs = fetch_highs();
+        const auto rhs_highs = rhs.fetch_highs();
+
+        std::vector<uint16_t> common_highs;
+
+        std::set_intersection(
+            lhs_highs.cbegin(), lhs_highs.cend(),
+            rhs_highs.cbegin(), rhs_highs.cend(),
+            std::back_inserter(common_highs));
+
+        if (common_highs.empty()) {
+            return roaring::bitmap();
+        }
+
+        return fetch_chunks(common_highs).inter(rhs.fetch_chunks(common_highs));
+    }
+
+    inline auto roaring_set::union_(const roaring_set &rhs) const -> roaring::bitmap {
+        return load().union_(rhs.load());
+    }
+
+    inline auto roaring_set::diff(const roaring_set &rhs) const -> roaring::bitmap {
+        const auto lhs = load();
+        std::vector<uint16_t> highs;
+
+        for (const auto &chunk : lhs.get_chunks()) {
+            highs.push_back(chunk.first);
+        }
+
+        return lhs.diff(rhs.fetch_chunks(highs));
+    }
+
+    inline auto roaring_set::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    inline auto roaring_set::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    inline auto roaring_set::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    inline auto roaring_set::get_name() const -> const std::string & {
+        return name;
+    }
+
+    inline auto roaring_set::fetch_highs() const -> std::vector<uint16_t> {
+        std::vector<uint16_t> highs;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->hkeys(name,
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        details::decode_reply_array<uint16_t>(reply, std::back_inserter(highs));
+        std::sort(highs.begin(), highs.end());
+        return highs;
+    }
+
+    inline auto roaring_set::fetch_chunks(const std::vector<uint16_t> &highs) const
+        -> roaring::bitmap {
+
+        // hmget rejects an empty list of fields
+        if (highs.empty()) {
+            return roaring::bitmap();
+        }
+
+        auto lease = acquire_read();
+        return decode_chunks(highs, fetch_chunk_values(lease.get_client_ptr(), highs));
+    }
+
+    inline auto roaring_set::fetch_chunk_values(
+        redis_client_ptr &read_client_ptr,
+        const std::vector<uint16_t> &highs) const -> std::vector<std::string> {
+
+        std::vector<std::string> values;
+
+        if (highs.empty()) {
+            return values;
+        }
+
+        std::vector<std::string> fields;
+        fields.reserve(highs.size());
+
+        for (const auto high : highs) {
+            fields.push_back(details::chunk_field(high));
+        }
+
+        bool is_malformed = false;
+
+        read_client_ptr->hmget(name, fields,
+            [&values, &highs, &is_malformed](cpp_redis::reply &r) {
+                // replies in the order of the fields, with nil for missing chunks
+                if (!r.is_array() || r.as_array().size() != highs.size()) {
+                    is_malformed = true;
+                    return;
+                }
+
+                for (const auto &elem : r.as_array()) {
+                    if (elem.is_bulk_string()) {
+                        values.push_back(elem.as_string());
+                    }
+                    else if (elem.is_null()) {
+                        values.emplace_back();
+                    }
+                    else {
+                        is_malformed = true;
+                        return;
+                    }
+                }
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        if (is_malformed) {
+            throw std::runtime_error("Unable to fetch the chunks of roaring set " + name);
+        }
+
+        return values;
+    }
+
+    inline auto roaring_set::decode_chunks(
+        const std::vector<uint16_t> &highs,
+        const std::vector<std::string> &values) const -> roaring::bitmap {
+
+        roaring::bitmap bm;
+
+        for (size_t i = 0; i < highs.size(); ++i) {
+            if (values[i].empty()) {
+                continue;
+            }
+
+            roaring::container chunk;
+
+            if (!roaring::container::deserialize(values[i].data(), values[i].size(), chunk)) {
+                throw std::runtime_error("Unable to decode a chunk of roaring set " + name);
+            }
+
+            bm.set_chunk(highs[i], std::move(chunk));
+        }
+
+        return bm;
+    }
+
+    template <class F>
+    auto roaring_set::update_chunks(const std::vector<uint16_t> &highs, F &&update) -> size_t {
+        for (size_t attempt = 0; attempt < details::ROARING_UPDATE_ATTEMPTS; ++attempt) {
+            // written back to the primary, so never read from a possibly stale replica
+            const auto old_values = fetch_chunk_values(client_ptr, highs);
+
+            // throws before writing, so a stored chunk which cannot be read is never replaced
+            auto bm = decode_chunks(highs, old_values);
+            const size_t changed_count = update(bm);
+
+            if (changed_count == 0 || write_chunks(bm, highs, old_values)) {
+                return changed_count;
+            }
+        }
+
+        throw std::runtime_error("Unable to update the contended chunks of roaring set " + name);
+    }
+
+    inline auto roaring_set::write_chunks(
+        const roaring::bitmap &bm,
+        const std::vector<uint16_t> &highs,
+        const std::vector<std::string> &old_values) -> bool {
+
+        const auto &chunks = bm.get_chunks();
+
+        std::vector<std::string> cmd{"EVAL", details::ROARING_UPDATE_SCRIPT, "1", name};
+        cmd.reserve(cmd.size() + highs.size() * 3);
+
+        for (size_t i = 0; i < highs.size(); ++i) {
+            const auto it = chunks.find(highs[i]);
+
+            cmd.push_back(details::chunk_field(highs[i]));
+            cmd.push_back(old_values[i]);
+
+            // chunks which became empty are deleted
+            cmd.push_back(it != chunks.cend() ? details::chunk_value(it->second) : std::string());
+        }
+
+        bool is_failed = false;
+        bool is_written = false;
+
+        client_ptr->send(cmd,
+            [&is_failed, &is_written](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    is_written = r.as_integer() == 1;
+                }
+                else {
+                    is_failed = true;
+                }
+            });
+
+        details::sync_commit(client_ptr);
+
+        if (is_failed) {
+            throw std::runtime_error("Unable to write the chunks of roaring set " + name);
+        }
+
+        if (is_written) {
+            mark_write();
+        }
+
+        return is_written;
+    }
+
+    inline auto roaring_set::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    inline void roaring_set::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
+
+    namespace details {
+        inline auto touched_highs(const std::vector<uint32_t> &members) -> std::vector<uint16_t> {
+            std::vector<uint16_t> highs;
+            highs.reserve(members.size());
+
+            for (const auto member : members) {
+                highs.push_back(roaring::high_bits(member));
+            }
+
+            std::sort(highs.begin(), highs.end());
+            highs.erase(std::unique(highs.begin(), highs.end()), highs.end());
+            return highs;
+        }
+
+        inline auto chunk_field(const uint16_t high) -> std::string {
+            return encode_into_str(high);
+        }
+
+        inline auto chunk_value(const roaring::container &chunk) -> std::string {
+            std::string value;
+            chunk.serialize(value);
+            return value;
+        }
+    }
+}
@@ -0,0 +1,310 @@
+/**
+ * Provides routing of reads to replicas, so that the read-only container
+ * operations are load balanced away from the primary, which only takes writes.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /** Picks the replica to send a read to. */
+    enum class read_policy {
+        /** Cycles through the replicas in order. */
+        round_robin,
+
+        /** Picks the replica with the fewest reads in progress. */
+        least_outstanding,
+
+        /** Picks the replica with the lowest recent latency, weighted by its reads in progress. */
+        latency_weighted,
+    };
+
+    /**
+     * Controls how reads are routed.
+     */
+    struct replica_router_options {
+        /** Picks the replica to send a read to. */
+        read_policy policy;
+
+        /**
+         * Reads within this duration after a write go to the primary, so that
+         * they observe the write despite replication lag. 0 disables.
+         */
+        std::chrono::milliseconds read_your_writes_window;
+    };
+
+    /**
+     * @return defaults of round robin, without the read-your-writes window.
+     */
+    auto default_replica_router_options() noexcept -> replica_router_options;
+
+    namespace details {
+        /**
+         * Load statistics of a single replica.
+         */
+        struct replica_state {
+            /** Connected client to the replica. */
+            redis_client_ptr client_ptr;
+
+            /** Number of reads in progress. */
+            std::atomic<size_t> outstanding;
+
+            /** Exponentially weighted moving average of the read latency, in nanoseconds. */
+            std::atomic<uint64_t> latency_ns;
+        };
+    }
+
+    /**
+     * Client to read from, which is held for the duration of a single read
+     * so that the router can track the reads in progress and their latency.
+     */
+    class read_lease {
+    public:
+        /**
+         * Constructs the lease, with the replica statistics to update if any.
+         *
+         * @param client_ptr client to read from
+         * @param state_ptr statistics of the replica, null if not tracked
+         */
+        read_lease(redis_client_ptr client_ptr, details::replica_state *state_ptr) noexcept;
+
+        read_lease(read_lease &&rhs) noexcept;
+        read_lease(const read_lease &) = delete;
+        auto operator=(const read_lease &) -> read_lease & = delete;
+        auto operator=(read_lease &&) -> read_lease & = delete;
+
+        /** Records the end of the read. */
+        ~read_lease();
+
+        /** @return client to read from. */
+        auto get_client_ptr() noexcept -> redis_client_ptr &;
+
+    private:
+        /** Client to read from. */
+        redis_client_ptr client_ptr;
+
+        /** Statistics of the replica read from, null if not tracked. */
+        details::replica_state *state_ptr;
+
+        /** Start of the read. */
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * Sends writes to the primary and load balances reads across the replicas.
+     * Thread-safe.
+     */
+    class replica_router {
+    public:
+        /**
+         * Constructs the router over already connected clients.
+         *
+         * @param primary_ptr client to the primary, which takes all the writes
+         * @param replica_ptrs clients to the replicas, reads go to the primary if empty
+         * @param options controls how reads are routed
+         */
+        replica_router(
+            const redis_client_ptr &primary_ptr,
+            const std::vector<redis_client_ptr> &replica_ptrs,
+            const replica_router_options &options = default_replica_router_options());
+
+        /** @return client to the primary. */
+        auto get_primary() const noexcept -> const redis_client_ptr &;
+
+        /** @return number of replicas. */
+        auto replica_count() const noexcept -> size_t;
+
+        /**
+         * Picks the client to send a read to, according to the policy
+         * and the read-your-writes window.
+         */
+        auto acquire_read() -> read_lease;
+
+        /**
+         * Records that a write has just completed, which starts the read-your-writes window.
+         */
+        void mark_write() noexcept;
+
+    private:
+        /** @return index of the replica to read from. */
+        auto pick_replica() noexcept -> size_t;
+
+        /** @return nanoseconds since the steady clock epoch. */
+        static auto now_ns() noexcept -> int64_t;
+
+        /** Client to the primary. */
+        redis_client_ptr primary_ptr;
+
+        /** Replica statistics, boxed since atomics are not movable. */
+        std::vector<std::unique_ptr<details::replica_state>> replicas;
+
+        /** Controls how reads are routed. */
+        replica_router_options options;
+
+        /** Round robin counter, also used to break ties. */
+        std::atomic<size_t> next;
+
+        /** Completion time of the last write, in nanoseconds since the steady clock epoch. */
+        std::atomic<int64_t> last_write_ns;
+    };
+
+    // implementation section
+
+    inline auto default_replica_router_options() noexcept -> replica_router_options {
+        return replica_router_options{read_policy::round_robin, std::chrono::milliseconds(0)};
+    }
+
+    inline read_lease::read_lease(
+        redis_client_ptr client_ptr,
+        details::replica_state *state_ptr) noexcept :
+
+        client_ptr(std::move(client_ptr)),
+        state_ptr(state_ptr),
+        start(std::chrono::steady_clock::now()) {
+
+    }
+
+    inline read_lease::read_lease(read_lease &&rhs) noexcept :
+        client_ptr(std::move(rhs.client_ptr)),
+        state_ptr(rhs.state_ptr),
+        start(rhs.start) {
+
+        rhs.state_ptr = nullptr;
+    }
+
+    inline read_lease::~read_lease() {
+        if (!state_ptr) {
+            return;
+        }
+
+        // smoothing factor of 1/8, races between concurrent reads only lose a sample
+        static constexpr uint64_t EWMA_SHIFT = 3;
+
+        const auto sample = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+
+        const auto prev = state_ptr->latency_ns.load(std::memory_order_relaxed);
+
+        const auto next = prev == 0
+            ? sample
+            : prev - (prev >> EWMA_SHIFT) + (sample >> EWMA_SHIFT);
+
+        state_ptr->latency_ns.store(next, std::memory_order_relaxed);
+        state_ptr->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    inline auto read_lease::get_client_ptr() noexcept -> redis_client_ptr & {
+        return client_ptr;
+    }
+
+    inline replica_router::replica_router(
+        const redis_client_ptr &primary_ptr,
+        const std::vector<redis_client_ptr> &replica_ptrs,
+        const replica_router_options &options) :
+
+        primary_ptr(primary_ptr),
+        options(options),
+        next(0),
+        last_write_ns(std::numeric_limits<int64_t>::min()) {
+
+        replicas.reserve(replica_ptrs.size());
+
+        for (const auto &replica_ptr : replica_ptrs) {
+            replicas.push_back(std::unique_ptr<details::replica_state>(
+                new details::replica_state{replica_ptr, {0}, {0}}));
+        }
+    }
+
+    inline auto replica_router::get_primary() const noexcept -> const redis_client_ptr & {
+        return primary_ptr;
+    }
+
+    inline auto replica_router::replica_count() const noexcept -> size_t {
+        return replicas.size();
+    }
+
+    inline auto replica_router::acquire_read() -> read_lease {
+        if (replicas.empty()) {
+            return read_lease(primary_ptr, nullptr);
+        }
+
+        const auto window = options.read_your_writes_window;
+
+        if (window.count() > 0) {
+            const auto window_ns =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+
+            const auto last_write = last_write_ns.load(std::memory_order_acquire);
+
+            if (last_write != std::numeric_limits<int64_t>::min()
+                && now_ns() - last_write < window_ns) {
+
+                return read_lease(primary_ptr, nullptr);
+            }
+        }
+
+        auto &state = *replicas[pick_replica()];
+        state.outstanding.fetch_add(1, std::memory_order_relaxed);
+        return read_lease(state.client_ptr, &state);
+    }
+
+    inline void replica_router::mark_write() noexcept {
+        if (options.read_your_writes_window.count() > 0) {
+            last_write_ns.store(now_ns(), std::memory_order_release);
+        }
+    }
+
+    inline auto replica_router::pick_replica() noexcept -> size_t {
+        const auto count = replicas.size();
+        const auto offset = next.fetch_add(1, std::memory_order_relaxed) % count;
+
+        if (options.policy == read_policy::round_robin) {
+            return offset;
+        }
+
+        // scans from a rotating offset, so that ties are spread across the replicas
+        auto best = offset;
+        auto best_score = std::numeric_limits<uint64_t>::max();
+
+        for (size_t i = 0; i < count; ++i) {
+            const auto index = (offset + i) % count;
+            const auto &state = *replicas[index];
+
+            const auto outstanding = static_cast<uint64_t>(
+                state.outstanding.load(std::memory_order_relaxed));
+
+            // unmeasured replicas count as the fastest, so that they get measured
+            const auto score = options.policy == read_policy::least_outstanding
+                ? outstanding
+                : (state.latency_ns.load(std::memory_order_relaxed) + 1) * (outstanding + 1);
+
+            if (score < best_score) {
+                best = index;
+                best_score = score;
+            }
+        }
+
+        return best;
+    }
+
+    inline auto replica_router::now_ns() noexcept -> int64_t {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
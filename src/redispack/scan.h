@@ -0,0 +1,279 @@
+/**
+ * Provides vectorized scanning of RESP receive buffers, which pre-indexes
+ * all the CRLF positions so that the reply parser can slice elements
+ * without walking the buffer byte-by-byte.
+ *
+ * SSE2 and AVX2 variants are selected at runtime where available,
+ * with a scalar fallback for every other target.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define REDISPACK_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(REDISPACK_HAS_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define REDISPACK_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace redispack {
+namespace resp {
+
+    // declaration section
+
+    /** Instruction set used to scan a receive buffer. */
+    enum class scan_mode {
+        /** Picks the widest instruction set supported by the running CPU. */
+        automatic,
+
+        /** Uses memchr only. */
+        scalar,
+
+        /** Uses 16-byte SSE2 comparisons. */
+        sse2,
+
+        /** Uses 32-byte AVX2 comparisons. */
+        avx2,
+    };
+
+    /**
+     * Resolves automatic into the widest supported instruction set,
+     * and falls back from any unsupported instruction set.
+     *
+     * @return scan mode that can run on this CPU.
+     */
+    auto resolve_scan_mode(const scan_mode mode) noexcept -> scan_mode;
+
+    /**
+     * Appends the position of the CR byte of every CRLF in the buffer.
+     *
+     * @param data pointer to the first byte of the buffer
+     * @param size number of bytes in the buffer
+     * @param positions output positions in ascending order
+     * @param mode instruction set to use
+     */
+    void scan_crlf(
+        const char *data,
+        const size_t size,
+        std::vector<size_t> &positions,
+        const scan_mode mode = scan_mode::automatic);
+
+    namespace details {
+        /**
+         * Locates the next CRLF at or after the given position with memchr.
+         *
+         * @return position of the CR byte, or size if not found.
+         */
+        auto find_crlf(const char *data, const size_t size, const size_t from) noexcept
+            -> size_t;
+
+        /** Scalar implementation of scan_crlf from the given position. */
+        void scan_crlf_scalar(
+            const char *data, const size_t size, const size_t from,
+            std::vector<size_t> &positions);
+
+        /** @return index of the lowest set bit in the non-zero mask. */
+        auto lowest_bit(const uint32_t mask) noexcept -> uint32_t;
+
+#ifdef REDISPACK_HAS_SSE2
+        /** SSE2 implementation of scan_crlf. */
+        void scan_crlf_sse2(
+            const char *data, const size_t size, std::vector<size_t> &positions);
+#endif
+
+#ifdef REDISPACK_HAS_AVX2
+        /** AVX2 implementation of scan_crlf. */
+        __attribute__((target("avx2")))
+        void scan_crlf_avx2(
+            const char *data, const size_t size, std::vector<size_t> &positions);
+#endif
+    }
+
+    // implementation section
+
+    namespace details {
+        inline auto find_crlf(const char *data, const size_t size, const size_t from) noexcept
+            -> size_t {
+
+            size_t pos = from;
+
+            while (pos < size) {
+                const auto cr = static_cast<const char *>(
+                    std::memchr(data + pos, '\r', size - pos));
+
+                if (!cr) {
+                    return size;
+                }
+
+                pos = static_cast<size_t>(cr - data);
+
+                if (pos + 1 < size && data[pos + 1] == '\n') {
+                    return pos;
+                }
+
+                ++pos;
+            }
+
+            return size;
+        }
+
+        inline void scan_crlf_scalar(
+            const char *data, const size_t size, const size_t from,
+            std::vector<size_t> &positions) {
+
+            for (auto pos = find_crlf(data, size, from);
+                pos < size;
+                pos = find_crlf(data, size, pos + 2)) {
+
+                positions.push_back(pos);
+            }
+        }
+
+        inline auto lowest_bit(const uint32_t mask) noexcept -> uint32_t {
+#if defined(_MSC_VER)
+            unsigned long index = 0;
+            _BitScanForward(&index, mask);
+            return static_cast<uint32_t>(index);
+#else
+            return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+        }
+
+#ifdef REDISPACK_HAS_SSE2
+        inline void scan_crlf_sse2(
+            const char *data, const size_t size, std::vector<size_t> &positions) {
+
+            static constexpr size_t WIDTH = 16;
+
+            const auto crs = _mm_set1_epi8('\r');
+            const auto lfs = _mm_set1_epi8('\n');
+
+            size_t pos = 0;
+
+            // the LF comparison is shifted by one byte, so one extra byte must be readable
+            for (; pos + WIDTH + 1 <= size; pos += WIDTH) {
+                const auto curr = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(data + pos));
+
+                const auto next = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(data + pos + 1));
+
+                auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(curr, crs),
+                    _mm_cmpeq_epi8(next, lfs))));
+
+                while (mask != 0) {
+                    positions.push_back(pos + lowest_bit(mask));
+                    mask &= mask - 1;
+                }
+            }
+
+            scan_crlf_scalar(data, size, pos, positions);
+        }
+#endif
+
+#ifdef REDISPACK_HAS_AVX2
+        __attribute__((target("avx2")))
+        inline void scan_crlf_avx2(
+            const char *data, const size_t size, std::vector<size_t> &positions) {
+
+            static constexpr size_t WIDTH = 32;
+
+            const auto crs = _mm256_set1_epi8('\r');
+            const auto lfs = _mm256_set1_epi8('\n');
+
+            size_t pos = 0;
+
+            // the LF comparison is shifted by one byte, so one extra byte must be readable
+            for (; pos + WIDTH + 1 <= size; pos += WIDTH) {
+                const auto curr = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(data + pos));
+
+                const auto next = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(data + pos + 1));
+
+                auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi8(curr, crs),
+                    _mm256_cmpeq_epi8(next, lfs))));
+
+                while (mask != 0) {
+                    positions.push_back(pos + lowest_bit(mask));
+                    mask &= mask - 1;
+                }
+            }
+
+            scan_crlf_scalar(data, size, pos, positions);
+        }
+#endif
+    }
+
+    inline auto resolve_scan_mode(const scan_mode mode) noexcept -> scan_mode {
+#ifdef REDISPACK_HAS_AVX2
+        static const bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#else
+        static constexpr bool has_avx2 = false;
+#endif
+
+#ifdef REDISPACK_HAS_SSE2
+        static constexpr bool has_sse2 = true;
+#else
+        static constexpr bool has_sse2 = false;
+#endif
+
+        switch (mode) {
+        case scan_mode::automatic:
+        case scan_mode::avx2:
+            if (has_avx2) {
+                return scan_mode::avx2;
+            }
+
+            return has_sse2 ? scan_mode::sse2 : scan_mode::scalar;
+
+        case scan_mode::sse2:
+            return has_sse2 ? scan_mode::sse2 : scan_mode::scalar;
+
+        default:
+            return scan_mode::scalar;
+        }
+    }
+
+    inline void scan_crlf(
+        const char *data,
+        const size_t size,
+        std::vector<size_t> &positions,
+        const scan_mode mode) {
+
+        switch (resolve_scan_mode(mode)) {
+#ifdef REDISPACK_HAS_AVX2
+        case scan_mode::avx2:
+            details::scan_crlf_avx2(data, size, positions);
+            break;
+#endif
+
+#ifdef REDISPACK_HAS_SSE2
+        case scan_mode::sse2:
+            details::scan_crlf_sse2(data, size, positions);
+            break;
+#endif
+
+        default:
+            details::scan_crlf_scalar(data, size, 0, positions);
+            break;
+        }
+    }
+}
+}
@@ -8,6 +8,10 @@
 
 #pragma once
 
+#include "codec.h"
+#include "decode.h"
+#include "expiry.h"
+#include "router.h"
 #include "util.h"
 
 #include "cpp_redis/cpp_redis"
@@ -17,8 +21,11 @@
 #include "rustfp/map.h"
 #include "rustfp/option.h"
 
+#include <chrono>
 #include <cstddef>
 #include <exception>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -30,16 +37,36 @@ namespace redispack {
 
     // declaration section
 
-    template <class T>
+    /**
+     * Provides set like functionalities from redis.
+     *
+     * Members are stored with the Codec, which must encode equal members into equal bytes.
+     */
+    template <class T, class Codec = msgpack_codec>
     class set {
     public:
         /** Alias to the T template type, which is the member type. */
         using value_type = T;
 
+        /** Alias to the Codec template type, which stores the members. */
+        using codec_t = Codec;
+
         /**
          * Constructs this instance with the given client connection and set key (name).
          */
-        set(const redis_client_ptr &client_ptr, const std::string &name);
+        set(
+            const redis_client_ptr &client_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * Constructs this instance with the given router and set key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        set(
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
 
         /**
          * sadd
@@ -56,7 +83,8 @@ namespace redispack {
          * @param end_t end iterator of element to add into the set
          * @return number of elements successfully added into the set
          */
-        template <class TBeginIter, class TEndIter>
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
         auto add(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
 
         /**
@@ -83,14 +111,30 @@ namespace redispack {
          * @return subtraction result of *this and rhs
          */
         template <class Tx>
-        auto diff(const set<Tx> &rhs) const -> std::unordered_set<T>;
+        auto diff(const set<Tx, Codec> &rhs) const -> std::unordered_set<T>;
+
+        /**
+         * sdiff
+         * @param out output iterator to write the decoded members into
+         * @return output iterator past the last written member
+         */
+        template <class Tx, class OutIt>
+        auto diff(const set<Tx, Codec> &rhs, OutIt out) const -> OutIt;
 
         /**
          * sinter
          * @return intersection result of *this and rhs
          */
         template <class Tx>
-        auto inter(const set<Tx> &rhs) const -> std::unordered_set<T>;
+        auto inter(const set<Tx, Codec> &rhs) const -> std::unordered_set<T>;
+
+        /**
+         * sinter
+         * @param out output iterator to write the decoded members into
+         * @return output iterator past the last written member
+         */
+        template <class Tx, class OutIt>
+        auto inter(const set<Tx, Codec> &rhs, OutIt out) const -> OutIt;
 
         /**
          * sismember
@@ -104,6 +148,25 @@ namespace redispack {
          */
         auto members() const -> std::unordered_set<T>;
 
+        /**
+         * smembers, decoding straight into a set that allocates from alloc,
+         * e.g. redispack::arena_allocator for a request-scoped read.
+         * @param alloc allocator of T for the returned set
+         * @return retrieve all the members in the set
+         */
+        template <class Alloc>
+        auto members(std::allocator_arg_t, const Alloc &alloc) const
+            -> std::unordered_set<T, std::hash<T>, std::equal_to<T>, Alloc>;
+
+        /**
+         * smembers
+         * @param out output iterator to write the decoded members into,
+         * e.g. std::back_inserter or redispack::sink
+         * @return output iterator past the last written member
+         */
+        template <class OutIt>
+        auto members(OutIt out) const -> OutIt;
+
         /**
          * srem
          * @param member member to remove from the set
@@ -119,7 +182,8 @@ namespace redispack {
          * @param end_t end iterator of element to remove from the set
          * @return number of elements successfully removed from the set
          */
-        template <class TBeginIter, class TEndIter>
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
         auto rem(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t;
 
         /**
@@ -134,19 +198,99 @@ namespace redispack {
          * @return union result of *this and rhs
          */
         template <class Tx>
-        auto union_(const set<Tx> &rhs) const -> std::unordered_set<T>;
+        auto union_(const set<Tx, Codec> &rhs) const -> std::unordered_set<T>;
+
+        /**
+         * sunion
+         * @param out output iterator to write the decoded members into
+         * @return output iterator past the last written member
+         */
+        template <class Tx, class OutIt>
+        auto union_(const set<Tx, Codec> &rhs, OutIt out) const -> OutIt;
+
+        /**
+         * Performs the pexpire command on the set key.
+         *
+         * @return true if the timeout was set, false if the set does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the set key.
+         *
+         * @return Some(remaining time) if the set has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * Performs the persist command on the set key.
+         *
+         * @return true if the timeout was removed.
+         */
+        auto persist() -> bool;
+
+        /**
+         * Performs the sadd command followed by the pexpire command on the set key,
+         * pipelined into a single round trip. Sets have no per-member expiry, so the
+         * timeout applies to the whole set.
+         *
+         * @return number of members added.
+         */
+        auto add_with_ttl(const std::vector<T> &members, const std::chrono::milliseconds ttl)
+            -> size_t;
+
+        /**
+         * @return client used to access the database.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return router of the reads, null if not routed.
+         */
+        auto get_router_ptr() const -> const std::shared_ptr<replica_router> &;
+
+        /**
+         * @return set key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+        /**
+         * @return codec which stores the members.
+         */
+        auto get_codec() const noexcept -> const Codec &;
 
     private:
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
         /** Holds a shared ownership to access the database. */
         mutable redis_client_ptr client_ptr;
 
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
         /** Set key (name). */
         std::string name;
+
+        /** Stores the members. */
+        Codec codec;
     };
 
     // implementation section
 
     namespace details {
+        /**
+         * Deletes the set KEYS[1], atomically.
+         * Returns the number of members it held.
+         */
+        static constexpr auto SET_CLEAR_SCRIPT =
+            "local count = redis.call('SCARD', KEYS[1]) "
+            "redis.call('DEL', KEYS[1]) "
+            "return count";
+
         auto add_impl(
             redis_client_ptr &client_ptr,
             const std::string &name,
@@ -184,204 +328,410 @@ namespace redispack {
         }
     }
 
-    template <class T>
-    set<T>::set(const redis_client_ptr &client_ptr, const std::string &name) :
+    template <class T, class Codec>
+    set<T, Codec>::set(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
         client_ptr(client_ptr),
-        name(name) {
+        name(name),
+        codec(codec) {
 
     }
 
-    template <class T>
+    template <class T, class Codec>
+    set<T, Codec>::set(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
     template <class... Ts>
-    auto set<T>::add(const T &member, const Ts &... members) -> size_t {
-        const auto member_strs = details::str_vectorize(member, members...);
-        return details::add_impl(client_ptr, name, member_strs);
+    auto set<T, Codec>::add(const T &member, const Ts &... members) -> size_t {
+        const std::vector<std::string> member_strs{codec.encode(member), codec.encode(members)...};
+        const auto count = details::add_impl(client_ptr, name, member_strs);
+        mark_write();
+        return count;
     }
 
-    template <class T>
-    template <class TBeginIter, class TEndIter>
-    auto set<T>::add(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
-        return add(std::vector<T>(begin_it, end_it));
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto set<T, Codec>::add(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
+        const auto member_strs = details::str_vectorize_range<T>(begin_it, end_it, codec);
+        const auto count = details::add_impl(client_ptr, name, member_strs);
+        mark_write();
+        return count;
     }
 
-    template <class T>
-    auto set<T>::add(const std::vector<T> &members) -> size_t {
+    template <class T, class Codec>
+    auto set<T, Codec>::add(const std::vector<T> &members) -> size_t {
         const auto member_strs = ::rustfp::iter(members)
-            | ::rustfp::map([](const T &member) {
-                return details::encode_into_str(member);
+            | ::rustfp::map([this](const T &member) {
+                return codec.encode(member);
             })
             | ::rustfp::collect<std::vector<std::string>>();
 
-        return details::add_impl(client_ptr, name, member_strs);
+        const auto count = details::add_impl(client_ptr, name, member_strs);
+        mark_write();
+        return count;
     }
 
-    template <class T>
-    auto set<T>::card() const -> size_t {
+    template <class T, class Codec>
+    auto set<T, Codec>::card() const -> size_t {
         size_t cardinality = 0;
 
-        client_ptr->scard(name,
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->scard(name,
             [&cardinality](cpp_redis::reply &r) {
                 if (r.is_integer()) {
                     cardinality = r.as_integer();
                 }
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
         return cardinality;
     }
 
-    template <class T>
-    auto set<T>::clear() -> size_t {
-        // this is more inefficient because of
-        // packing and unpacking of msgpack values
-        const auto mems_set = members();
+    template <class T, class Codec>
+    auto set<T, Codec>::clear() -> size_t {
+        size_t removed_count = 0;
+
+        // counted and deleted by a single script on the primary, so neither a lagging
+        // replica nor a concurrent sadd can leave members behind
+        client_ptr->send({"EVAL", details::SET_CLEAR_SCRIPT, "1", name},
+            [&removed_count](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    removed_count = r.as_integer();
+                }
+            });
 
-        const auto mems = ::rustfp::iter(mems_set)
-            | ::rustfp::collect<std::vector<T>>();
-            
-        return rem(mems);
+        details::sync_commit(client_ptr);
+        mark_write();
+        return removed_count;
     }
 
-    template <class T>
+    template <class T, class Codec>
     template <class Tx>
-    auto set<T>::diff(const set<Tx> &rhs) const -> std::unordered_set<T> {
+    auto set<T, Codec>::diff(const set<Tx, Codec> &rhs) const -> std::unordered_set<T> {
         std::unordered_set<T> mems;
 
-        client_ptr->sdiff(std::vector<std::string>{name, rhs.name},
-            [&mems](cpp_redis::reply &r) {
-                if (r.is_array()) {
-                    for (const auto &sub_r : r.as_array()) {
-                        if (sub_r.is_bulk_string()) {
-                            auto mem_opt = details::decode_from_str<T>(
-                                sub_r.as_string());
-
-                            std::move(mem_opt).match_some(
-                                [&mems](T &&mem) {
-                                    mems.insert(std::move(mem));
-                                });
-                        }
-                    }
-                }
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->sdiff(std::vector<std::string>{name, rhs.name},
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
+
+        if (reply.is_array()) {
+            mems.reserve(reply.as_array().size());
+        }
+
+        details::decode_reply_array<T>(reply, std::inserter(mems, mems.end()), codec);
         return mems;
     }
 
-    template <class T>
+    template <class T, class Codec>
+    template <class Tx, class OutIt>
+    auto set<T, Codec>::diff(const set<Tx, Codec> &rhs, OutIt out) const -> OutIt {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->sdiff(std::vector<std::string>{name, rhs.name},
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        out = details::decode_reply_array<T>(reply, std::move(out), codec);
+        return out;
+    }
+
+    template <class T, class Codec>
     template <class Tx>
-    auto set<T>::inter(const set<Tx> &rhs) const -> std::unordered_set<T> {
+    auto set<T, Codec>::inter(const set<Tx, Codec> &rhs) const -> std::unordered_set<T> {
         std::unordered_set<T> mems;
 
-        client_ptr->sinter(std::vector<std::string>{name, rhs.name},
-            [&mems](cpp_redis::reply &r) {
-                if (r.is_array()) {
-                    for (const auto &sub_r : r.as_array()) {
-                        if (sub_r.is_bulk_string()) {
-                            auto mem_opt = details::decode_from_str<T>(
-                                sub_r.as_string());
-
-                            std::move(mem_opt).match_some(
-                                [&mems](T &&mem) {
-                                    mems.insert(std::move(mem));
-                                });
-                        }
-                    }
-                }
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->sinter(std::vector<std::string>{name, rhs.name},
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
+
+        if (reply.is_array()) {
+            mems.reserve(reply.as_array().size());
+        }
+
+        details::decode_reply_array<T>(reply, std::inserter(mems, mems.end()), codec);
         return mems;
     }
 
-    template <class T>
-    auto set<T>::is_member(const T &member) const -> bool {
-        const auto member_str = details::encode_into_str(member);
+    template <class T, class Codec>
+    template <class Tx, class OutIt>
+    auto set<T, Codec>::inter(const set<Tx, Codec> &rhs, OutIt out) const -> OutIt {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->sinter(std::vector<std::string>{name, rhs.name},
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        out = details::decode_reply_array<T>(reply, std::move(out), codec);
+        return out;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::is_member(const T &member) const -> bool {
+        const auto member_str = codec.encode(member);
         auto is_member_flag = false;
 
-        client_ptr->sismember(name, member_str,
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->sismember(name, member_str,
             [&is_member_flag](cpp_redis::reply &r) {
                 if (r.is_integer() && r.as_integer() == 1) {
                     is_member_flag = true;
                 }
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
         return is_member_flag;
     }
 
-    template <class T>
-    auto set<T>::members() const -> std::unordered_set<T> {
-        std::unordered_set<T> mems;
+    template <class T, class Codec>
+    auto set<T, Codec>::members() const -> std::unordered_set<T> {
+        return members(std::allocator_arg, std::allocator<T>());
+    }
 
-        client_ptr->smembers(name,
-            [&mems](cpp_redis::reply &r) {
-                if (r.is_array()) {
-                    for (const auto &sub_r : r.as_array()) {
-                        if (sub_r.is_bulk_string()) {
-                            auto mem_opt = details::decode_from_str<T>(
-                                sub_r.as_string());
-
-                            std::move(mem_opt).match_some(
-                                [&mems](T &&mem) {
-                                    mems.insert(std::move(mem));
-                                });
-                        }
-                    }
-                }
+    template <class T, class Codec>
+    template <class Alloc>
+    auto set<T, Codec>::members(std::allocator_arg_t, const Alloc &alloc) const
+        -> std::unordered_set<T, std::hash<T>, std::equal_to<T>, Alloc> {
+
+        std::unordered_set<T, std::hash<T>, std::equal_to<T>, Alloc> mems(0, std::hash<T>(),
+            std::equal_to<T>(), alloc);
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->smembers(name,
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
             });
 
-        details::sync_commit(client_ptr);
+        details::sync_commit(read_client_ptr);
+
+        if (reply.is_array()) {
+            mems.reserve(reply.as_array().size());
+        }
+
+        details::decode_reply_array<T>(reply, std::inserter(mems, mems.end()), codec);
         return mems;
     }
 
-    template <class T>
+    template <class T, class Codec>
+    template <class OutIt>
+    auto set<T, Codec>::members(OutIt out) const -> OutIt {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->smembers(name,
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        out = details::decode_reply_array<T>(reply, std::move(out), codec);
+        return out;
+    }
+
+    template <class T, class Codec>
     template <class... Ts>
-    auto set<T>::rem(const T &member, const Ts &... members) -> size_t {
-        const auto member_strs = details::str_vectorize(member, members...);
-        return details::rem_impl(client_ptr, name, member_strs);
+    auto set<T, Codec>::rem(const T &member, const Ts &... members) -> size_t {
+        const std::vector<std::string> member_strs{codec.encode(member), codec.encode(members)...};
+        const auto count = details::rem_impl(client_ptr, name, member_strs);
+        mark_write();
+        return count;
     }
 
-    template <class T>
-    template <class TBeginIter, class TEndIter>
-    auto set<T>::rem(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
-        return rem(std::vector<T>(begin_it, end_it));
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto set<T, Codec>::rem(const TBeginIter &begin_it, const TEndIter &end_it) -> size_t {
+        const auto member_strs = details::str_vectorize_range<T>(begin_it, end_it, codec);
+        const auto count = details::rem_impl(client_ptr, name, member_strs);
+        mark_write();
+        return count;
     }
 
-    template <class T>
-    auto set<T>::rem(const std::vector<T> &members) -> size_t {
+    template <class T, class Codec>
+    auto set<T, Codec>::rem(const std::vector<T> &members) -> size_t {
         const auto member_strs = ::rustfp::iter(members)
-            | ::rustfp::map([](const T &member) {
-                return details::encode_into_str(member);
+            | ::rustfp::map([this](const T &member) {
+                return codec.encode(member);
             })
             | ::rustfp::collect<std::vector<std::string>>();
 
-        return details::rem_impl(client_ptr, name, member_strs);
+        const auto count = details::rem_impl(client_ptr, name, member_strs);
+        mark_write();
+        return count;
     }
 
-    template <class T>
+    template <class T, class Codec>
     template <class Tx>
-    auto set<T>::union_(const set<Tx> &rhs) const -> std::unordered_set<T> {
+    auto set<T, Codec>::union_(const set<Tx, Codec> &rhs) const -> std::unordered_set<T> {
         std::unordered_set<T> mems;
 
-        client_ptr->sunion(std::vector<std::string>{name, rhs.name},
-            [&mems](cpp_redis::reply &r) {
-                if (r.is_array()) {
-                    for (const auto &sub_r : r.as_array()) {
-                        if (sub_r.is_bulk_string()) {
-                            auto mem_opt = details::decode_from_str<T>(
-                                sub_r.as_string());
-
-                            std::move(mem_opt).match_some(
-                                [&mems](T &&mem) {
-                                    mems.insert(std::move(mem));
-                                });
-                        }
-                    }
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->sunion(std::vector<std::string>{name, rhs.name},
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        if (reply.is_array()) {
+            mems.reserve(reply.as_array().size());
+        }
+
+        details::decode_reply_array<T>(reply, std::inserter(mems, mems.end()), codec);
+        return mems;
+    }
+
+    template <class T, class Codec>
+    template <class Tx, class OutIt>
+    auto set<T, Codec>::union_(const set<Tx, Codec> &rhs, OutIt out) const -> OutIt {
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        cpp_redis::reply reply;
+
+        read_client_ptr->sunion(std::vector<std::string>{name, rhs.name},
+            [&reply](cpp_redis::reply &r) {
+                reply = std::move(r);
+            });
+
+        details::sync_commit(read_client_ptr);
+
+        out = details::decode_reply_array<T>(reply, std::move(out), codec);
+        return out;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::get_router_ptr() const -> const std::shared_ptr<replica_router> & {
+        return router_ptr;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::get_name() const -> const std::string & {
+        return name;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::get_codec() const noexcept -> const Codec & {
+        return codec;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::persist() -> bool {
+        const auto is_removed = details::persist_impl(client_ptr, name);
+        mark_write();
+        return is_removed;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::add_with_ttl(
+        const std::vector<T> &members,
+        const std::chrono::milliseconds ttl) -> size_t {
+
+        if (members.empty()) {
+            return 0;
+        }
+
+        auto cmd = details::str_vectorize_range<T>(members.cbegin(), members.cend(), codec);
+        cmd.insert(cmd.begin(), {"SADD", name});
+
+        size_t added_count = 0;
+
+        client_ptr->send(cmd,
+            [&added_count](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    added_count = static_cast<size_t>(r.as_integer());
                 }
             });
 
+        // sent together with the write, so both travel in a single round trip
+        client_ptr->send({"PEXPIRE", name, std::to_string(ttl.count())});
+
         details::sync_commit(client_ptr);
-        return mems;
+        mark_write();
+        return added_count;
+    }
+
+    template <class T, class Codec>
+    auto set<T, Codec>::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    template <class T, class Codec>
+    void set<T, Codec>::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,950 @@
+/**
+ * Provides snapshot export and import of hash and set contents, to and from
+ * a compact file of length-prefixed msgpack records with a sorted index.
+ *
+ * Snapshots are memory-mapped when opened, so that a local process can also
+ * query them directly without going through the server.
+ * Only available on POSIX systems, where REDISPACK_HAS_SNAPSHOTS is defined.
+ *
+ * File layout, in host byte order:
+ * header | records | index
+ *
+ * - header: 8 bytes magic, u32 kind, u32 reserved, u64 record count, u64 index offset
+ * - record: u32 key length, key bytes, and for hashes also u32 value length, value bytes
+ * - index: u64 record offset per record, sorted by the encoded key bytes
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#if !defined(_WIN32)
+#define REDISPACK_HAS_SNAPSHOTS 1
+#endif
+
+#ifdef REDISPACK_HAS_SNAPSHOTS
+
+#include "alias.h"
+#include "bulk_load.h"
+#include "codec.h"
+#include "hash.h"
+#include "set.h"
+#include "util.h"
+
+#include "cpp_redis/reply.hpp"
+#include "rustfp/option.h"
+#include "rustfp/result.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace redispack {
+
+    // declaration section
+
+    namespace details {
+        static constexpr auto SNAPSHOT_MAGIC = "RPSNAP1";
+        static constexpr uint32_t SNAPSHOT_KIND_HASH = 1;
+        static constexpr uint32_t SNAPSHOT_KIND_SET = 2;
+
+        /** Number of elements requested per HSCAN / SSCAN call. */
+        static constexpr size_t SNAPSHOT_SCAN_COUNT = 1000;
+
+        /** Suffix of the file written before it replaces the snapshot. */
+        static constexpr auto SNAPSHOT_TMP_SUFFIX = ".tmp";
+
+        /**
+         * Fixed size header at the start of every snapshot file.
+         */
+        struct snapshot_header {
+            /** Same as SNAPSHOT_MAGIC, including the terminating null. */
+            char magic[8];
+
+            /** Either SNAPSHOT_KIND_HASH or SNAPSHOT_KIND_SET. */
+            uint32_t kind;
+
+            /** Always 0. */
+            uint32_t reserved;
+
+            /** Number of records, which is also the number of index entries. */
+            uint64_t count;
+
+            /** Offset of the index from the start of the file. */
+            uint64_t index_offset;
+        };
+
+        /**
+         * Encoded bytes of a key or value within the mapped file.
+         */
+        struct snapshot_bytes {
+            const char *data;
+            size_t size;
+        };
+
+        /**
+         * Single record within the mapped file, value is empty for sets.
+         */
+        struct snapshot_record {
+            snapshot_bytes key;
+            snapshot_bytes value;
+        };
+
+        /**
+         * Read-only memory mapping of a whole file, unmapped on destruction.
+         */
+        class mapped_file {
+        public:
+            /**
+             * Maps the whole file, throws std::runtime_error on failure.
+             */
+            explicit mapped_file(const std::string &path);
+
+            /** Unmaps the file. */
+            ~mapped_file();
+
+            mapped_file(const mapped_file &) = delete;
+            auto operator=(const mapped_file &) -> mapped_file & = delete;
+
+            /** @return start of the mapped file. */
+            auto data() const noexcept -> const char *;
+
+            /** @return size of the mapped file. */
+            auto size() const noexcept -> size_t;
+
+        private:
+            /** Start of the mapped file. */
+            const char *ptr;
+
+            /** Size of the mapped file. */
+            size_t len;
+        };
+
+        /**
+         * Validated view over a mapped snapshot file.
+         */
+        class snapshot_file {
+        public:
+            /**
+             * Maps and validates the snapshot, throws std::runtime_error if the file
+             * cannot be mapped, is not of the given kind or is corrupted.
+             */
+            snapshot_file(const std::string &path, const uint32_t kind);
+
+            /** @return number of records. */
+            auto size() const noexcept -> size_t;
+
+            /** @return record at the given position in sorted key order. */
+            auto record_at(const size_t index) const noexcept -> snapshot_record;
+
+            /** @return record with the given encoded key, by binary search over the index. */
+            auto find(const std::string &encoded_key) const noexcept
+                -> rustfp::Option<snapshot_record>;
+
+        private:
+            /** Mapped file. */
+            mapped_file file;
+
+            /** Either SNAPSHOT_KIND_HASH or SNAPSHOT_KIND_SET. */
+            uint32_t kind;
+
+            /** Number of records. */
+            size_t count;
+
+            /** Start of the index within the mapped file. */
+            const char *index;
+        };
+
+        /** @return u32 read from possibly unaligned memory. */
+        auto read_u32(const char *data) noexcept -> uint32_t;
+
+        /** @return u64 read from possibly unaligned memory. */
+        auto read_u64(const char *data) noexcept -> uint64_t;
+
+        /**
+         * Reads the record at the offset, checking that it lies within [begin, end).
+         * @return the record, or None if it does not fit.
+         */
+        auto read_record(
+            const char *begin,
+            const char *end,
+            const uint64_t offset,
+            const bool has_value) noexcept -> rustfp::Option<snapshot_record>;
+
+        /**
+         * @return negative, zero or positive as lhs sorts before, equal or after rhs.
+         */
+        auto compare_bytes(const snapshot_bytes &lhs, const snapshot_bytes &rhs) noexcept -> int;
+
+        /**
+         * Exports all the elements of a hash or set into a snapshot file,
+         * by scanning with the given command and copying the encoded bytes as-is.
+         * The file is written next to the path and renamed over it once complete,
+         * so that processes which have the previous snapshot mapped keep reading it.
+         * Throws std::runtime_error on failure.
+         *
+         * @return number of records written.
+         */
+        auto export_scan(
+            redis_client_ptr client_ptr,
+            const std::string &scan_cmd,
+            const std::string &name,
+            const uint32_t kind,
+            const std::string &path) -> size_t;
+
+        /**
+         * Writes the snapshot file at the path in place, then syncs it to the disk.
+         * Throws std::runtime_error on failure.
+         *
+         * @return number of records written.
+         */
+        auto export_scan_into(
+            redis_client_ptr &client_ptr,
+            const std::string &scan_cmd,
+            const std::string &name,
+            const uint32_t kind,
+            const std::string &path) -> size_t;
+    }
+
+    /**
+     * Memory-mapped hash snapshot, which can be queried without the server.
+     * Copies share the same mapping. Values are decoded with the same codec
+     * as the hash that was exported.
+     */
+    template <class K, class V, class Codec = msgpack_codec>
+    class hash_snapshot {
+    public:
+        /**
+         * Opens and validates the snapshot file.
+         *
+         * @param path of the snapshot file
+         * @param codec to decode the values with
+         * @return snapshot wrapped in Ok, any exception is caught and returned as Err
+         */
+        static auto open(const std::string &path, const Codec &codec = Codec()) noexcept
+            -> rustfp::Result<hash_snapshot, std::unique_ptr<std::exception>>;
+
+        /** @return number of entries. */
+        auto len() const noexcept -> size_t;
+
+        /** @return true if the key exists. */
+        auto exists(const K &key) const -> bool;
+
+        /** @return value of the key wrapped in Some, otherwise None. */
+        auto get(const K &key) const -> rustfp::Option<V>;
+
+        /** @return all the entries. */
+        auto key_vals() const -> std::unordered_map<K, V>;
+
+        /**
+         * Calls the function with every decoded key and value, in encoded key order.
+         */
+        template <class F>
+        void for_each(F fn) const;
+
+        /** @return underlying snapshot file. */
+        auto get_file() const noexcept -> const details::snapshot_file &;
+
+    private:
+        hash_snapshot(
+            std::shared_ptr<const details::snapshot_file> file_ptr,
+            const Codec &codec) noexcept;
+
+        /** Shared so that copies share the same mapping. */
+        std::shared_ptr<const details::snapshot_file> file_ptr;
+
+        /** Decodes the values. */
+        Codec codec;
+    };
+
+    /**
+     * Memory-mapped set snapshot, which can be queried without the server.
+     * Copies share the same mapping. Members are encoded with the same codec
+     * as the set that was exported.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class set_snapshot {
+    public:
+        /**
+         * Opens and validates the snapshot file.
+         *
+         * @param path of the snapshot file
+         * @param codec to encode and decode the members with
+         * @return snapshot wrapped in Ok, any exception is caught and returned as Err
+         */
+        static auto open(const std::string &path, const Codec &codec = Codec()) noexcept
+            -> rustfp::Result<set_snapshot, std::unique_ptr<std::exception>>;
+
+        /** @return number of members. */
+        auto card() const noexcept -> size_t;
+
+        /** @return true if the member exists. */
+        auto is_member(const T &member) const -> bool;
+
+        /** @return all the members. */
+        auto members() const -> std::unordered_set<T>;
+
+        /**
+         * Calls the function with every decoded member, in encoded member order.
+         */
+        template <class F>
+        void for_each(F fn) const;
+
+        /** @return underlying snapshot file. */
+        auto get_file() const noexcept -> const details::snapshot_file &;
+
+    private:
+        set_snapshot(
+            std::shared_ptr<const details::snapshot_file> file_ptr,
+            const Codec &codec) noexcept;
+
+        /** Shared so that copies share the same mapping. */
+        std::shared_ptr<const details::snapshot_file> file_ptr;
+
+        /** Encodes and decodes the members. */
+        Codec codec;
+    };
+
+    /**
+     * Exports the hash into a snapshot file, streaming with HSCAN.
+     * Entries modified during the export may or may not be included.
+     *
+     * @param h hash to export
+     * @param path of the snapshot file, overwritten if it exists
+     * @return number of entries written wrapped in Ok, any exception is caught and returned as Err
+     */
+    template <class K, class V, class Codec>
+    auto export_snapshot(const hash<K, V, Codec> &h, const std::string &path) noexcept
+        -> rustfp::Result<size_t, std::unique_ptr<std::exception>>;
+
+    /**
+     * Exports the set into a snapshot file, streaming with SSCAN.
+     * Members modified during the export may or may not be included.
+     *
+     * @param s set to export
+     * @param path of the snapshot file, overwritten if it exists
+     * @return number of members written wrapped in Ok, any exception is caught and returned as Err
+     */
+    template <class T, class Codec>
+    auto export_snapshot(const set<T, Codec> &s, const std::string &path) noexcept
+        -> rustfp::Result<size_t, std::unique_ptr<std::exception>>;
+
+    /**
+     * Imports the snapshot into the hash with pipelined bulk writes,
+     * the encoded bytes are sent as-is without decoding.
+     *
+     * @param h hash to import into
+     * @param snapshot to import from
+     * @param options controls the chunking and backpressure
+     * @return final progress of the import.
+     */
+    template <class K, class V, class Codec>
+    auto import_snapshot(
+        hash<K, V, Codec> &h,
+        const hash_snapshot<K, V, Codec> &snapshot,
+        const bulk_load_options &options = default_bulk_load_options()) -> bulk_load_progress;
+
+    /**
+     * Imports the snapshot into the set with pipelined bulk writes,
+     * the encoded bytes are sent as-is without decoding.
+     *
+     * @param s set to import into
+     * @param snapshot to import from
+     * @param options controls the chunking and backpressure
+     * @return final progress of the import.
+     */
+    template <class T, class Codec>
+    auto import_snapshot(
+        set<T, Codec> &s,
+        const set_snapshot<T, Codec> &snapshot,
+        const bulk_load_options &options = default_bulk_load_options()) -> bulk_load_progress;
+
+    // implementation section
+
+    namespace details {
+        inline mapped_file::mapped_file(const std::string &path) :
+            ptr(nullptr),
+            len(0) {
+
+            const auto fd = ::open(path.c_str(), O_RDONLY);
+
+            if (fd < 0) {
+                throw std::runtime_error("Unable to open snapshot file " + path);
+            }
+
+            struct stat st;
+
+            if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                throw std::runtime_error("Unable to stat snapshot file " + path);
+            }
+
+            const auto addr = ::mmap(
+                nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+            // the mapping stays valid after the descriptor is closed
+            ::close(fd);
+
+            if (addr == MAP_FAILED) {
+                throw std::runtime_error("Unable to map snapshot file " + path);
+            }
+
+            ptr = static_cast<const char *>(addr);
+            len = static_cast<size_t>(st.st_size);
+        }
+
+        inline mapped_file::~mapped_file() {
+            ::munmap(const_cast<char *>(ptr), len);
+        }
+
+        inline auto mapped_file::data() const noexcept -> const char * {
+            return ptr;
+        }
+
+        inline auto mapped_file::size() const noexcept -> size_t {
+            return len;
+        }
+
+        inline snapshot_file::snapshot_file(const std::string &path, const uint32_t kind) :
+            file(path),
+            kind(kind),
+            count(0),
+            index(nullptr) {
+
+            snapshot_header header;
+
+            if (file.size() < sizeof(header)) {
+                throw std::runtime_error("Snapshot file is too small " + path);
+            }
+
+            std::memcpy(&header, file.data(), sizeof(header));
+
+            if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+                throw std::runtime_error("Not a snapshot file " + path);
+            }
+
+            if (header.kind != kind) {
+                throw std::runtime_error("Snapshot file is of a different container type " + path);
+            }
+
+            if (header.index_offset < sizeof(header)
+                || header.index_offset > file.size()
+                || header.count > (file.size() - header.index_offset) / sizeof(uint64_t)) {
+
+                throw std::runtime_error("Snapshot file index is corrupted " + path);
+            }
+
+            count = static_cast<size_t>(header.count);
+            index = file.data() + header.index_offset;
+
+            // validates every record once, so that lookups need not check bounds
+            const auto records_end = file.data() + header.index_offset;
+
+            for (size_t i = 0; i < count; ++i) {
+                const auto offset = read_u64(index + i * sizeof(uint64_t));
+
+                if (read_record(file.data(), records_end, offset, kind == SNAPSHOT_KIND_HASH)
+                    .is_none()) {
+
+                    throw std::runtime_error("Snapshot file record is corrupted " + path);
+                }
+            }
+        }
+
+        inline auto snapshot_file::size() const noexcept -> size_t {
+            return count;
+        }
+
+        inline auto snapshot_file::record_at(const size_t i) const noexcept -> snapshot_record {
+            const auto offset = read_u64(index + i * sizeof(uint64_t));
+
+            return read_record(file.data(), index, offset, kind == SNAPSHOT_KIND_HASH)
+                .get_unchecked();
+        }
+
+        inline auto snapshot_file::find(const std::string &encoded_key) const noexcept
+            -> rustfp::Option<snapshot_record> {
+
+            const snapshot_bytes key{encoded_key.data(), encoded_key.size()};
+            size_t low = 0;
+            size_t high = count;
+
+            while (low < high) {
+                const auto mid = low + (high - low) / 2;
+                const auto record = record_at(mid);
+                const auto cmp = compare_bytes(record.key, key);
+
+                if (cmp == 0) {
+                    return rustfp::Some(record);
+                }
+                else if (cmp < 0) {
+                    low = mid + 1;
+                }
+                else {
+                    high = mid;
+                }
+            }
+
+            return rustfp::None;
+        }
+
+        inline auto read_u32(const char *data) noexcept -> uint32_t {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        inline auto read_u64(const char *data) noexcept -> uint64_t {
+            uint64_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        inline auto read_record(
+            const char *begin,
+            const char *end,
+            const uint64_t offset,
+            const bool has_value) noexcept -> rustfp::Option<snapshot_record> {
+
+            const auto available = static_cast<uint64_t>(end - begin);
+
+            // reads one length-prefixed field, advancing the position
+            auto pos = offset;
+
+            const auto read_field = [begin, available, &pos](snapshot_bytes &field) {
+                if (pos > available || available - pos < sizeof(uint32_t)) {
+                    return false;
+                }
+
+                const auto size = read_u32(begin + pos);
+                pos += sizeof(uint32_t);
+
+                if (available - pos < size) {
+                    return false;
+                }
+
+                field = snapshot_bytes{begin + pos, size};
+                pos += size;
+                return true;
+            };
+
+            snapshot_record record{{begin, 0}, {begin, 0}};
+
+            if (!read_field(record.key) || (has_value && !read_field(record.value))) {
+                return rustfp::None;
+            }
+
+            return rustfp::Some(record);
+        }
+
+        inline auto compare_bytes(const snapshot_bytes &lhs, const snapshot_bytes &rhs) noexcept
+            -> int {
+
+            const auto cmp = std::memcmp(lhs.data, rhs.data, std::min(lhs.size, rhs.size));
+
+            if (cmp != 0) {
+                return cmp;
+            }
+
+            return lhs.size < rhs.size ? -1 : (lhs.size > rhs.size ? 1 : 0);
+        }
+
+        inline auto export_scan(
+            redis_client_ptr client_ptr,
+            const std::string &scan_cmd,
+            const std::string &name,
+            const uint32_t kind,
+            const std::string &path) -> size_t {
+
+            // truncating the snapshot in place would fault the processes which have it mapped,
+            // so the new snapshot replaces it only once complete
+            const auto tmp_path = path + SNAPSHOT_TMP_SUFFIX;
+
+            try {
+                const auto count = export_scan_into(client_ptr, scan_cmd, name, kind, tmp_path);
+
+                if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                    throw std::runtime_error("Unable to replace snapshot file " + path);
+                }
+
+                return count;
+            }
+            catch (const std::exception &) {
+                std::remove(tmp_path.c_str());
+                throw;
+            }
+        }
+
+        inline auto export_scan_into(
+            redis_client_ptr &client_ptr,
+            const std::string &scan_cmd,
+            const std::string &name,
+            const uint32_t kind,
+            const std::string &path) -> size_t {
+
+            const auto has_value = kind == SNAPSHOT_KIND_HASH;
+            auto closer = [](std::FILE *f) { std::fclose(f); };
+            std::unique_ptr<std::FILE, decltype(closer)> out(std::fopen(path.c_str(), "w+b"), closer);
+
+            if (!out) {
+                throw std::runtime_error("Unable to create snapshot file " + path);
+            }
+
+            snapshot_header header;
+            std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+            header.kind = kind;
+            header.reserved = 0;
+            header.count = 0;
+            header.index_offset = 0;
+
+            std::fwrite(&header, sizeof(header), 1, out.get());
+
+            std::vector<uint64_t> offsets;
+            uint64_t offset = sizeof(header);
+
+            const auto write_field = [&out, &offset](const std::string &field) {
+                const auto size = static_cast<uint32_t>(field.size());
+                std::fwrite(&size, sizeof(size), 1, out.get());
+                std::fwrite(field.data(), 1, field.size(), out.get());
+                offset += sizeof(size) + field.size();
+            };
+
+            // streams page by page, writing the encoded bytes as they are
+            std::string cursor = "0";
+
+            do {
+                std::string next_cursor = "0";
+
+                // thrown only after sync_commit, since the callback runs on the network thread
+                bool is_malformed = false;
+
+                client_ptr->send({scan_cmd, name, cursor, "COUNT", std::to_string(SNAPSHOT_SCAN_COUNT)},
+                    [&](cpp_redis::reply &r) {
+                        // e.g. WRONGTYPE, which would otherwise end the scan as if complete
+                        if (!r.is_array() || r.as_array().size() != 2
+                            || !r.as_array()[0].is_bulk_string()
+                            || !r.as_array()[1].is_array()) {
+
+                            is_malformed = true;
+                            return;
+                        }
+
+                        const auto &page = r.as_array();
+                        next_cursor = page[0].as_string();
+
+                        const auto &elems = page[1].as_array();
+                        const size_t stride = has_value ? 2 : 1;
+
+                        for (size_t i = 0; i + stride <= elems.size(); i += stride) {
+                            if (!elems[i].is_bulk_string()
+                                || (has_value && !elems[i + 1].is_bulk_string())) {
+
+                                continue;
+                            }
+
+                            offsets.push_back(offset);
+                            write_field(elems[i].as_string());
+
+                            if (has_value) {
+                                write_field(elems[i + 1].as_string());
+                            }
+                        }
+                    });
+
+                sync_commit(client_ptr);
+
+                if (is_malformed) {
+                    throw std::runtime_error(
+                        "Unable to scan " + name + " into snapshot file " + path);
+                }
+
+                cursor = std::move(next_cursor);
+            } while (cursor != "0");
+
+            if (std::fflush(out.get()) != 0 || std::ferror(out.get())) {
+                throw std::runtime_error("Unable to write snapshot file " + path);
+            }
+
+            // sorts the index by key straight from the written records
+            {
+                const mapped_file records(path);
+                const auto begin = records.data();
+                const auto end = records.data() + offset;
+
+                const auto key_at = [begin, end, has_value](const uint64_t off) {
+                    return read_record(begin, end, off, has_value).get_unchecked().key;
+                };
+
+                std::sort(offsets.begin(), offsets.end(),
+                    [&key_at](const uint64_t lhs, const uint64_t rhs) {
+                        return compare_bytes(key_at(lhs), key_at(rhs)) < 0;
+                    });
+
+                // scanning may return an element more than once
+                offsets.erase(
+                    std::unique(offsets.begin(), offsets.end(),
+                        [&key_at](const uint64_t lhs, const uint64_t rhs) {
+                            return compare_bytes(key_at(lhs), key_at(rhs)) == 0;
+                        }),
+                    offsets.end());
+            }
+
+            std::fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out.get());
+
+            header.count = offsets.size();
+            header.index_offset = offset;
+            std::fseek(out.get(), 0, SEEK_SET);
+            std::fwrite(&header, sizeof(header), 1, out.get());
+
+            // durable before it replaces the previous snapshot
+            if (std::fflush(out.get()) != 0 || std::ferror(out.get())
+                || ::fsync(::fileno(out.get())) != 0
+                || std::fclose(out.release()) != 0) {
+
+                throw std::runtime_error("Unable to write snapshot file " + path);
+            }
+
+            return offsets.size();
+        }
+    }
+
+    template <class K, class V, class Codec>
+    hash_snapshot<K, V, Codec>::hash_snapshot(
+        std::shared_ptr<const details::snapshot_file> file_ptr,
+        const Codec &codec) noexcept :
+
+        file_ptr(std::move(file_ptr)),
+        codec(codec) {
+
+    }
+
+    template <class K, class V, class Codec>
+    auto hash_snapshot<K, V, Codec>::open(const std::string &path, const Codec &codec) noexcept
+        -> rustfp::Result<hash_snapshot, std::unique_ptr<std::exception>> {
+
+        try {
+            return rustfp::Ok(hash_snapshot(std::make_shared<const details::snapshot_file>(
+                path, details::SNAPSHOT_KIND_HASH), codec));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    template <class K, class V, class Codec>
+    auto hash_snapshot<K, V, Codec>::len() const noexcept -> size_t {
+        return file_ptr->size();
+    }
+
+    template <class K, class V, class Codec>
+    auto hash_snapshot<K, V, Codec>::exists(const K &key) const -> bool {
+        return file_ptr->find(details::encode_into_str(key)).is_some();
+    }
+
+    template <class K, class V, class Codec>
+    auto hash_snapshot<K, V, Codec>::get(const K &key) const -> rustfp::Option<V> {
+        auto record_opt = file_ptr->find(details::encode_into_str(key));
+
+        if (record_opt.is_none()) {
+            return rustfp::None;
+        }
+
+        const auto &value = record_opt.get_unchecked().value;
+        return codec.template decode<V>(value.data, value.size);
+    }
+
+    template <class K, class V, class Codec>
+    auto hash_snapshot<K, V, Codec>::key_vals() const -> std::unordered_map<K, V> {
+        std::unordered_map<K, V> kvs;
+        kvs.reserve(len());
+
+        for_each([&kvs](K &&key, V &&value) {
+            kvs.emplace(std::move(key), std::move(value));
+        });
+
+        return kvs;
+    }
+
+    template <class K, class V, class Codec>
+    template <class F>
+    void hash_snapshot<K, V, Codec>::for_each(F fn) const {
+        for (size_t i = 0; i < file_ptr->size(); ++i) {
+            const auto record = file_ptr->record_at(i);
+            auto key_opt = details::decode_from_str<K>(record.key.data, record.key.size);
+            auto value_opt = codec.template decode<V>(record.value.data, record.value.size);
+
+            if (key_opt.is_some() && value_opt.is_some()) {
+                std::move(key_opt).match_some([&fn, &value_opt](K &&key) {
+                    std::move(value_opt).match_some([&fn, &key](V &&value) {
+                        fn(std::move(key), std::move(value));
+                    });
+                });
+            }
+        }
+    }
+
+    template <class K, class V, class Codec>
+    auto hash_snapshot<K, V, Codec>::get_file() const noexcept -> const details::snapshot_file & {
+        return *file_ptr;
+    }
+
+    template <class T, class Codec>
+    set_snapshot<T, Codec>::set_snapshot(
+        std::shared_ptr<const details::snapshot_file> file_ptr,
+        const Codec &codec) noexcept :
+
+        file_ptr(std::move(file_ptr)),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    auto set_snapshot<T, Codec>::open(const std::string &path, const Codec &codec) noexcept
+        -> rustfp::Result<set_snapshot, std::unique_ptr<std::exception>> {
+
+        try {
+            return rustfp::Ok(set_snapshot(std::make_shared<const details::snapshot_file>(
+                path, details::SNAPSHOT_KIND_SET), codec));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    template <class T, class Codec>
+    auto set_snapshot<T, Codec>::card() const noexcept -> size_t {
+        return file_ptr->size();
+    }
+
+    template <class T, class Codec>
+    auto set_snapshot<T, Codec>::is_member(const T &member) const -> bool {
+        return file_ptr->find(codec.encode(member)).is_some();
+    }
+
+    template <class T, class Codec>
+    auto set_snapshot<T, Codec>::members() const -> std::unordered_set<T> {
+        std::unordered_set<T> mems;
+        mems.reserve(card());
+
+        for_each([&mems](T &&member) {
+            mems.insert(std::move(member));
+        });
+
+        return mems;
+    }
+
+    template <class T, class Codec>
+    template <class F>
+    void set_snapshot<T, Codec>::for_each(F fn) const {
+        for (size_t i = 0; i < file_ptr->size(); ++i) {
+            const auto record = file_ptr->record_at(i);
+            auto member_opt = codec.template decode<T>(record.key.data, record.key.size);
+
+            std::move(member_opt).match_some([&fn](T &&member) {
+                fn(std::move(member));
+            });
+        }
+    }
+
+    template <class T, class Codec>
+    auto set_snapshot<T, Codec>::get_file() const noexcept -> const details::snapshot_file & {
+        return *file_ptr;
+    }
+
+    template <class K, class V, class Codec>
+    auto export_snapshot(const hash<K, V, Codec> &h, const std::string &path) noexcept
+        -> rustfp::Result<size_t, std::unique_ptr<std::exception>> {
+
+        try {
+            return rustfp::Ok(details::export_scan(
+                h.get_client_ptr(), "HSCAN", h.get_name(), details::SNAPSHOT_KIND_HASH, path));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    template <class T, class Codec>
+    auto export_snapshot(const set<T, Codec> &s, const std::string &path) noexcept
+        -> rustfp::Result<size_t, std::unique_ptr<std::exception>> {
+
+        try {
+            return rustfp::Ok(details::export_scan(
+                s.get_client_ptr(), "SSCAN", s.get_name(), details::SNAPSHOT_KIND_SET, path));
+        }
+        catch (const std::exception &e) {
+            return rustfp::Err(std::make_unique<std::runtime_error>(e.what()));
+        }
+    }
+
+    template <class K, class V, class Codec>
+    auto import_snapshot(
+        hash<K, V, Codec> &h,
+        const hash_snapshot<K, V, Codec> &snapshot,
+        const bulk_load_options &options) -> bulk_load_progress {
+
+        const auto &file = snapshot.get_file();
+        size_t i = 0;
+
+        return details::bulk_load_impl(
+            h.get_client_ptr(),
+            h.get_router_ptr(),
+            {"HSET", h.get_name()},
+            [&file, &i](std::vector<std::string> &cmd, size_t &bytes) {
+                if (i == file.size()) {
+                    return false;
+                }
+
+                const auto record = file.record_at(i++);
+                cmd.emplace_back(record.key.data, record.key.size);
+                cmd.emplace_back(record.value.data, record.value.size);
+                bytes += record.key.size + record.value.size;
+
+                return true;
+            },
+            options);
+    }
+
+    template <class T, class Codec>
+    auto import_snapshot(
+        set<T, Codec> &s,
+        const set_snapshot<T, Codec> &snapshot,
+        const bulk_load_options &options) -> bulk_load_progress {
+
+        const auto &file = snapshot.get_file();
+        size_t i = 0;
+
+        return details::bulk_load_impl(
+            s.get_client_ptr(),
+            s.get_router_ptr(),
+            {"SADD", s.get_name()},
+            [&file, &i](std::vector<std::string> &cmd, size_t &bytes) {
+                if (i == file.size()) {
+                    return false;
+                }
+
+                const auto record = file.record_at(i++);
+                cmd.emplace_back(record.key.data, record.key.size);
+                bytes += record.key.size;
+
+                return true;
+            },
+            options);
+    }
+}
+
+#endif
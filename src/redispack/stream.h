@@ -0,0 +1,889 @@
+/**
+ * Provides the stream functions from redis, which makes it similar
+ * to an append-only log of values with consumer groups, and a consumer
+ * helper which keeps several batches in flight per round trip.
+ *
+ * Blocking reads hold up every other command on the same client,
+ * so they are best issued on a client of their own.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "expiry.h"
+#include "keyspace.h"
+#include "router.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Single entry of a stream.
+     */
+    template <class T>
+    struct stream_entry {
+        /** Entry id assigned by the server, e.g. 1700000000000-0. */
+        std::string id;
+
+        /** Decoded value. */
+        T value;
+    };
+
+    /**
+     * Result of claiming the stuck entries of a consumer group.
+     */
+    template <class T>
+    struct stream_claim {
+        /** Id to continue claiming from, 0-0 once the whole pending list is scanned. */
+        std::string next_id;
+
+        /** Claimed entries, without those deleted from the stream. */
+        std::vector<stream_entry<T>> entries;
+
+        /**
+         * Ids of the claimed entries whose value fails to decode, which stay pending
+         * until acknowledged, e.g. after copying them elsewhere for inspection.
+         */
+        std::vector<std::string> undecodable_ids;
+    };
+
+    /**
+     * Provides stream like functionalities from redis.
+     *
+     * All the data is stored in the redis server.
+     * Each entry holds the value stored with the Codec in a single field.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class stream {
+    public:
+        /** Alias to the T template type, which is the value type. */
+        using value_t = T;
+
+        /** Alias to the Codec template type, which stores the values. */
+        using codec_t = Codec;
+
+        /**
+         * Constructs this instance with the given client connection and stream key (name).
+         */
+        stream(
+            const redis_client_ptr &client_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * Constructs this instance with the given router and stream key (name),
+         * where the const methods read from the replicas and the rest write to the primary.
+         */
+        stream(
+            const std::shared_ptr<replica_router> &router_ptr,
+            const std::string &name,
+            const Codec &codec = Codec());
+
+        /**
+         * xadd
+         * @param value value to append
+         * @param max_len approximate number of entries to trim down to, 0 to not trim
+         * @return id of the new entry
+         */
+        auto add(const T &value, const size_t max_len = 0) -> std::string;
+
+        /**
+         * xadd for every value, pipelined into a single round trip.
+         * @param begin_it begin iterator of values to append
+         * @param end_it end iterator of values to append
+         * @param max_len approximate number of entries to trim down to, 0 to not trim
+         * @return ids of the new entries, in the order of the values
+         */
+        template <class TBeginIter, class TEndIter,
+            class = details::iterator_category_t<TBeginIter>>
+        auto add(const TBeginIter &begin_it, const TEndIter &end_it, const size_t max_len = 0)
+            -> std::vector<std::string>;
+
+        /**
+         * xlen
+         * @return number of entries
+         */
+        auto len() const -> size_t;
+
+        /**
+         * xread
+         * @param last_id id after which to read, e.g. 0 for the start or $ for only new entries
+         * @param count maximum number of entries to read
+         * @param block maximum time to wait for entries, 0 to not wait
+         * @return entries after last_id, empty if none arrived in time
+         */
+        auto read(
+            const std::string &last_id,
+            const size_t count,
+            const std::chrono::milliseconds block = std::chrono::milliseconds(0)) const
+            -> std::vector<stream_entry<T>>;
+
+        /**
+         * xgroup create with mkstream
+         * @param group consumer group name
+         * @param start_id id after which the group starts reading, $ for only new entries
+         * @return true if created, false if the group already exists
+         */
+        auto create_group(const std::string &group, const std::string &start_id = "$") -> bool;
+
+        /**
+         * xreadgroup of the entries never delivered to the group
+         * @param group consumer group name
+         * @param consumer consumer name within the group
+         * @param count maximum number of entries to read
+         * @param block maximum time to wait for entries, 0 to not wait
+         * @return entries now pending for the consumer, empty if none arrived in time.
+         * Entries whose value fails to decode are left out but stay pending,
+         * and are returned as undecodable_ids by autoclaim.
+         */
+        auto read_group(
+            const std::string &group,
+            const std::string &consumer,
+            const size_t count,
+            const std::chrono::milliseconds block = std::chrono::milliseconds(0))
+            -> std::vector<stream_entry<T>>;
+
+        /**
+         * xack of all the ids in a single command.
+         * @param group consumer group name
+         * @param ids ids of the processed entries
+         * @return number of entries acknowledged
+         */
+        auto ack(const std::string &group, const std::vector<std::string> &ids) -> size_t;
+
+        /**
+         * xautoclaim, requires Redis 6.2 or later.
+         * @param group consumer group name
+         * @param consumer consumer name to transfer the entries to
+         * @param min_idle minimum time the entries have been pending without an ack
+         * @param start_id id to start scanning the pending list from, 0-0 for the start
+         * @param count maximum number of entries to claim
+         * @return claimed entries and the id to continue from
+         */
+        auto autoclaim(
+            const std::string &group,
+            const std::string &consumer,
+            const std::chrono::milliseconds min_idle,
+            const std::string &start_id,
+            const size_t count) -> stream_claim<T>;
+
+        /**
+         * xtrim with approximate maxlen
+         * @return number of entries removed
+         */
+        auto trim(const size_t max_len) -> size_t;
+
+        /**
+         * Deletes the stream, including its consumer groups.
+         * @return true if the stream existed
+         */
+        auto clear() -> bool;
+
+        /**
+         * Performs the pexpire command on the stream key.
+         *
+         * @return true if the timeout was set, false if the stream does not exist.
+         */
+        auto expire(const std::chrono::milliseconds ttl) -> bool;
+
+        /**
+         * Performs the pttl command on the stream key.
+         *
+         * @return Some(remaining time) if the stream has a timeout, otherwise None.
+         */
+        auto ttl() const -> rustfp::Option<std::chrono::milliseconds>;
+
+        /**
+         * @return client used to access the database, which is the primary if routed.
+         */
+        auto get_client_ptr() const -> const redis_client_ptr &;
+
+        /**
+         * @return stream key (name).
+         */
+        auto get_name() const -> const std::string &;
+
+        /**
+         * @return codec used to store the values.
+         */
+        auto get_codec() const noexcept -> const Codec &;
+
+    private:
+        /** @return client to read from, which is a replica if routed. */
+        auto acquire_read() const -> read_lease;
+
+        /** Starts the read-your-writes window if routed. */
+        void mark_write() const noexcept;
+
+        /** @return xadd command for the encoded value. */
+        auto add_cmd(const T &value, const size_t max_len) const -> std::vector<std::string>;
+
+        /** Holds a shared ownership to access the database. */
+        mutable redis_client_ptr client_ptr;
+
+        /** Routes the reads to the replicas, null if not routed. */
+        std::shared_ptr<replica_router> router_ptr;
+
+        /** Stream key (name). */
+        std::string name;
+
+        /** Stores the values. */
+        Codec codec;
+    };
+
+    /**
+     * Controls how many entries the consumer keeps in flight.
+     */
+    struct stream_consumer_options {
+        /** Maximum number of entries per xreadgroup. */
+        size_t batch_size;
+
+        /** Number of xreadgroup commands pipelined per round trip. */
+        size_t batches_in_flight;
+
+        /** Maximum time the first xreadgroup waits for entries, 0 to not wait. */
+        std::chrono::milliseconds block;
+    };
+
+    /**
+     * @return defaults of 512 entries per batch, 4 batches in flight and waiting up to 1 second.
+     */
+    auto default_stream_consumer_options() noexcept -> stream_consumer_options;
+
+    /**
+     * Reads the entries of a consumer group and acknowledges them once handled.
+     *
+     * Each poll pipelines the acks of the previous poll with several xreadgroup
+     * commands, so that a single round trip delivers several batches.
+     * Only the first xreadgroup blocks, the rest return at once with whatever is left.
+     */
+    template <class T, class Codec = msgpack_codec>
+    class stream_consumer {
+    public:
+        /**
+         * Constructs the consumer of the group.
+         *
+         * @param s stream to consume, whose client should not be shared if blocking
+         * @param group consumer group name, which must already exist
+         * @param consumer consumer name within the group
+         * @param options controls how many entries are kept in flight
+         */
+        stream_consumer(
+            const stream<T, Codec> &s,
+            const std::string &group,
+            const std::string &consumer,
+            const stream_consumer_options &options = default_stream_consumer_options());
+
+        /**
+         * Reads the next batches and passes each non-empty batch to the handler.
+         * The entries are acknowledged together with the next poll or flush,
+         * and stay pending if the handler throws.
+         *
+         * Entries whose value fails to decode are never passed to the handler,
+         * and are acknowledged regardless so that they are not claimed over and over.
+         * Their ids are available from get_undecodable_ids until the next poll.
+         *
+         * @param handler callback taking const std::vector<stream_entry<T>> &
+         * @return number of entries handled.
+         */
+        template <class F>
+        auto poll(F &&handler) -> size_t;
+
+        /**
+         * Acknowledges the entries handled since the last poll.
+         * @return number of entries acknowledged.
+         */
+        auto flush() -> size_t;
+
+        /**
+         * @return ids of the entries read by the last poll whose value fails to decode.
+         */
+        auto get_undecodable_ids() const noexcept -> const std::vector<std::string> &;
+
+    private:
+        /** Stream to consume. */
+        stream<T, Codec> target;
+
+        /** Holds a shared ownership to access the database. */
+        redis_client_ptr client_ptr;
+
+        /** Consumer group name. */
+        std::string group;
+
+        /** Consumer name within the group. */
+        std::string consumer;
+
+        /** Controls how many entries are kept in flight. */
+        stream_consumer_options options;
+
+        /** Ids handled but not yet acknowledged. */
+        std::vector<std::string> handled_ids;
+
+        /** Ids read by the last poll whose value fails to decode. */
+        std::vector<std::string> undecodable_ids;
+    };
+
+    namespace details {
+        /** Field holding the encoded value of every stream entry. */
+        static constexpr auto STREAM_VALUE_FIELD = "v";
+
+        /**
+         * Decodes an array of [id, [field, value, ...]] entries into out,
+         * skipping deleted entries and appending the ids of values which fail to decode
+         * into undecodable_ids.
+         */
+        template <class T, class Codec>
+        void decode_stream_entries(
+            const cpp_redis::reply &r,
+            const Codec &codec,
+            std::vector<stream_entry<T>> &out,
+            std::vector<std::string> &undecodable_ids);
+
+        /**
+         * Decodes the entries of the only stream in an xread / xreadgroup reply into out,
+         * which is nil if no entries arrived in time.
+         */
+        template <class T, class Codec>
+        void decode_stream_read(
+            const cpp_redis::reply &r,
+            const Codec &codec,
+            std::vector<stream_entry<T>> &out,
+            std::vector<std::string> &undecodable_ids);
+
+        /**
+         * @return xreadgroup command of the entries never delivered to the group.
+         */
+        auto read_group_cmd(
+            const std::string &name,
+            const std::string &group,
+            const std::string &consumer,
+            const size_t count,
+            const std::chrono::milliseconds block) -> std::vector<std::string>;
+
+        /**
+         * @return xack command of all the ids.
+         */
+        auto ack_cmd(
+            const std::string &name,
+            const std::string &group,
+            const std::vector<std::string> &ids) -> std::vector<std::string>;
+    }
+
+    // implementation section
+
+    template <class T, class Codec>
+    stream<T, Codec>::stream(
+        const redis_client_ptr &client_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(client_ptr),
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    stream<T, Codec>::stream(
+        const std::shared_ptr<replica_router> &router_ptr,
+        const std::string &name,
+        const Codec &codec) :
+
+        client_ptr(router_ptr->get_primary()),
+        router_ptr(router_ptr),
+        name(name),
+        codec(codec) {
+
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::add(const T &value, const size_t max_len) -> std::string {
+        std::string id;
+
+        client_ptr->send(add_cmd(value, max_len),
+            [&id](cpp_redis::reply &r) {
+                if (r.is_bulk_string()) {
+                    id = r.as_string();
+                }
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return id;
+    }
+
+    template <class T, class Codec>
+    template <class TBeginIter, class TEndIter, class>
+    auto stream<T, Codec>::add(
+        const TBeginIter &begin_it,
+        const TEndIter &end_it,
+        const size_t max_len) -> std::vector<std::string> {
+
+        std::vector<std::string> ids;
+        details::reserve_range(ids, begin_it, end_it);
+
+        for (auto it = begin_it; it != end_it; ++it) {
+            const auto index = ids.size();
+            ids.emplace_back();
+
+            client_ptr->send(add_cmd(*it, max_len),
+                [&ids, index](cpp_redis::reply &r) {
+                    if (r.is_bulk_string()) {
+                        ids[index] = r.as_string();
+                    }
+                });
+        }
+
+        // all the appends travel in a single round trip
+        details::sync_commit(client_ptr);
+        mark_write();
+        return ids;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::len() const -> size_t {
+        size_t length = 0;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->send({"XLEN", name},
+            [&length](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    length = static_cast<size_t>(r.as_integer());
+                }
+            });
+
+        details::sync_commit(read_client_ptr);
+        return length;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::read(
+        const std::string &last_id,
+        const size_t count,
+        const std::chrono::milliseconds block) const -> std::vector<stream_entry<T>> {
+
+        std::vector<std::string> cmd{"XREAD", "COUNT", std::to_string(count)};
+
+        if (block.count() > 0) {
+            cmd.push_back("BLOCK");
+            cmd.push_back(std::to_string(block.count()));
+        }
+
+        cmd.push_back("STREAMS");
+        cmd.push_back(name);
+        cmd.push_back(last_id);
+
+        std::vector<stream_entry<T>> entries;
+
+        // plain reads leave nothing pending, so the undecodable entries are only skipped
+        std::vector<std::string> undecodable_ids;
+
+        auto lease = acquire_read();
+        auto &read_client_ptr = lease.get_client_ptr();
+
+        read_client_ptr->send(cmd,
+            [this, &entries, &undecodable_ids](cpp_redis::reply &r) {
+                details::decode_stream_read<T>(r, codec, entries, undecodable_ids);
+            });
+
+        details::sync_commit(read_client_ptr);
+        return entries;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::create_group(const std::string &group, const std::string &start_id)
+        -> bool {
+
+        bool is_created = false;
+
+        // replies with a BUSYGROUP error if the group already exists
+        client_ptr->send({"XGROUP", "CREATE", name, group, start_id, "MKSTREAM"},
+            [&is_created](cpp_redis::reply &r) {
+                is_created = r.is_simple_string();
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return is_created;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::read_group(
+        const std::string &group,
+        const std::string &consumer,
+        const size_t count,
+        const std::chrono::milliseconds block) -> std::vector<stream_entry<T>> {
+
+        std::vector<stream_entry<T>> entries;
+
+        // stay pending, so that autoclaim surfaces them
+        std::vector<std::string> undecodable_ids;
+
+        client_ptr->send(details::read_group_cmd(name, group, consumer, count, block),
+            [this, &entries, &undecodable_ids](cpp_redis::reply &r) {
+                details::decode_stream_read<T>(r, codec, entries, undecodable_ids);
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return entries;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::ack(const std::string &group, const std::vector<std::string> &ids)
+        -> size_t {
+
+        if (ids.empty()) {
+            return 0;
+        }
+
+        size_t acked_count = 0;
+
+        client_ptr->send(details::ack_cmd(name, group, ids),
+            [&acked_count](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    acked_count = static_cast<size_t>(r.as_integer());
+                }
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return acked_count;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::autoclaim(
+        const std::string &group,
+        const std::string &consumer,
+        const std::chrono::milliseconds min_idle,
+        const std::string &start_id,
+        const size_t count) -> stream_claim<T> {
+
+        stream_claim<T> claim{"0-0", {}, {}};
+
+        client_ptr->send(
+            {"XAUTOCLAIM", name, group, consumer, std::to_string(min_idle.count()), start_id,
+                "COUNT", std::to_string(count)},
+
+            [this, &claim](cpp_redis::reply &r) {
+                // next id, claimed entries, and the deleted ids from Redis 7.0 onwards
+                if (!r.is_array() || r.as_array().size() < 2) {
+                    return;
+                }
+
+                const auto &parts = r.as_array();
+
+                if (parts[0].is_bulk_string() || parts[0].is_simple_string()) {
+                    claim.next_id = parts[0].as_string();
+                }
+
+                details::decode_stream_entries<T>(
+                    parts[1], codec, claim.entries, claim.undecodable_ids);
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return claim;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::trim(const size_t max_len) -> size_t {
+        size_t removed_count = 0;
+
+        client_ptr->send({"XTRIM", name, "MAXLEN", "~", std::to_string(max_len)},
+            [&removed_count](cpp_redis::reply &r) {
+                if (r.is_integer()) {
+                    removed_count = static_cast<size_t>(r.as_integer());
+                }
+            });
+
+        details::sync_commit(client_ptr);
+        mark_write();
+        return removed_count;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::clear() -> bool {
+        const auto deleted = details::del_impl(client_ptr, name);
+        mark_write();
+        return deleted;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::expire(const std::chrono::milliseconds ttl) -> bool {
+        const auto is_set = details::expire_impl(client_ptr, name, ttl);
+        mark_write();
+        return is_set;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::ttl() const -> rustfp::Option<std::chrono::milliseconds> {
+        auto lease = acquire_read();
+        return details::ttl_impl(lease.get_client_ptr(), name);
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::get_client_ptr() const -> const redis_client_ptr & {
+        return client_ptr;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::get_name() const -> const std::string & {
+        return name;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::get_codec() const noexcept -> const Codec & {
+        return codec;
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::acquire_read() const -> read_lease {
+        return router_ptr ? router_ptr->acquire_read() : read_lease(client_ptr, nullptr);
+    }
+
+    template <class T, class Codec>
+    void stream<T, Codec>::mark_write() const noexcept {
+        if (router_ptr) {
+            router_ptr->mark_write();
+        }
+    }
+
+    template <class T, class Codec>
+    auto stream<T, Codec>::add_cmd(const T &value, const size_t max_len) const
+        -> std::vector<std::string> {
+
+        std::vector<std::string> cmd{"XADD", name};
+
+        // approximate trimming only removes whole macro nodes, which is much cheaper
+        if (max_len > 0) {
+            cmd.push_back("MAXLEN");
+            cmd.push_back("~");
+            cmd.push_back(std::to_string(max_len));
+        }
+
+        cmd.push_back("*");
+        cmd.push_back(details::STREAM_VALUE_FIELD);
+        cmd.push_back(codec.encode(value));
+        return cmd;
+    }
+
+    inline auto default_stream_consumer_options() noexcept -> stream_consumer_options {
+        static constexpr size_t DEFAULT_BATCH_SIZE = 512;
+        static constexpr size_t DEFAULT_BATCHES_IN_FLIGHT = 4;
+        static constexpr auto DEFAULT_BLOCK_MS = 1000;
+
+        return stream_consumer_options{
+            DEFAULT_BATCH_SIZE,
+            DEFAULT_BATCHES_IN_FLIGHT,
+            std::chrono::milliseconds(DEFAULT_BLOCK_MS)};
+    }
+
+    template <class T, class Codec>
+    stream_consumer<T, Codec>::stream_consumer(
+        const stream<T, Codec> &s,
+        const std::string &group,
+        const std::string &consumer,
+        const stream_consumer_options &options) :
+
+        target(s),
+        client_ptr(s.get_client_ptr()),
+        group(group),
+        consumer(consumer),
+        options(options) {
+
+    }
+
+    template <class T, class Codec>
+    template <class F>
+    auto stream_consumer<T, Codec>::poll(F &&handler) -> size_t {
+        const auto &name = target.get_name();
+        const auto &codec = target.get_codec();
+
+        if (!handled_ids.empty()) {
+            client_ptr->send(details::ack_cmd(name, group, handled_ids));
+            handled_ids.clear();
+        }
+
+        const auto batch_count = std::max<size_t>(1, options.batches_in_flight);
+        std::vector<std::vector<stream_entry<T>>> batches(batch_count);
+        undecodable_ids.clear();
+
+        for (size_t i = 0; i < batch_count; ++i) {
+            // only the first read waits, so the others never delay the round trip
+            const auto block = i == 0 ? options.block : std::chrono::milliseconds(0);
+            auto &batch = batches[i];
+
+            client_ptr->send(
+                details::read_group_cmd(name, group, consumer, options.batch_size, block),
+                [this, &codec, &batch](cpp_redis::reply &r) {
+                    details::decode_stream_read<T>(r, codec, batch, undecodable_ids);
+                });
+        }
+
+        details::sync_commit(client_ptr);
+
+        // acked even if the handler throws, since they would never decode on redelivery
+        handled_ids.insert(handled_ids.end(), undecodable_ids.cbegin(), undecodable_ids.cend());
+
+        size_t handled_count = 0;
+
+        for (const auto &batch : batches) {
+            if (batch.empty()) {
+                continue;
+            }
+
+            handler(batch);
+            handled_count += batch.size();
+
+            for (const auto &entry : batch) {
+                handled_ids.push_back(entry.id);
+            }
+        }
+
+        return handled_count;
+    }
+
+    template <class T, class Codec>
+    auto stream_consumer<T, Codec>::flush() -> size_t {
+        const auto acked_count = target.ack(group, handled_ids);
+        handled_ids.clear();
+        return acked_count;
+    }
+
+    template <class T, class Codec>
+    auto stream_consumer<T, Codec>::get_undecodable_ids() const noexcept
+        -> const std::vector<std::string> & {
+
+        return undecodable_ids;
+    }
+
+    namespace details {
+        template <class T, class Codec>
+        void decode_stream_entries(
+            const cpp_redis::reply &r,
+            const Codec &codec,
+            std::vector<stream_entry<T>> &out,
+            std::vector<std::string> &undecodable_ids) {
+
+            if (!r.is_array()) {
+                return;
+            }
+
+            const auto &entries = r.as_array();
+            out.reserve(out.size() + entries.size());
+
+            for (const auto &entry : entries) {
+                // deleted entries come back as nil, or with nil fields
+                if (!entry.is_array() || entry.as_array().size() != 2) {
+                    continue;
+                }
+
+                const auto &id = entry.as_array()[0];
+                const auto &fields = entry.as_array()[1];
+
+                if (!id.is_bulk_string() || !fields.is_array()) {
+                    continue;
+                }
+
+                const auto &field_vals = fields.as_array();
+                bool is_decoded = false;
+
+                for (size_t i = 0; i + 1 < field_vals.size(); i += 2) {
+                    if (!field_vals[i].is_bulk_string()
+                        || field_vals[i].as_string() != STREAM_VALUE_FIELD
+                        || !field_vals[i + 1].is_bulk_string()) {
+
+                        continue;
+                    }
+
+                    const auto &str = field_vals[i + 1].as_string();
+                    auto value_opt = codec.template decode<T>(str.data(), str.size());
+
+                    std::move(value_opt).match_some(
+                        [&out, &id, &is_decoded](T &&value) {
+                            out.push_back(stream_entry<T>{id.as_string(), std::move(value)});
+                            is_decoded = true;
+                        });
+
+                    break;
+                }
+
+                // includes entries added without the value field by other writers
+                if (!is_decoded) {
+                    undecodable_ids.push_back(id.as_string());
+                }
+            }
+        }
+
+        template <class T, class Codec>
+        void decode_stream_read(
+            const cpp_redis::reply &r,
+            const Codec &codec,
+            std::vector<stream_entry<T>> &out,
+            std::vector<std::string> &undecodable_ids) {
+
+            // [[stream name, entries]], or nil if no entries arrived in time
+            if (!r.is_array() || r.as_array().empty()) {
+                return;
+            }
+
+            const auto &first_stream = r.as_array().front();
+
+            if (!first_stream.is_array() || first_stream.as_array().size() != 2) {
+                return;
+            }
+
+            decode_stream_entries<T>(first_stream.as_array()[1], codec, out, undecodable_ids);
+        }
+
+        inline auto read_group_cmd(
+            const std::string &name,
+            const std::string &group,
+            const std::string &consumer,
+            const size_t count,
+            const std::chrono::milliseconds block) -> std::vector<std::string> {
+
+            std::vector<std::string> cmd{
+                "XREADGROUP", "GROUP", group, consumer, "COUNT", std::to_string(count)};
+
+            if (block.count() > 0) {
+                cmd.push_back("BLOCK");
+                cmd.push_back(std::to_string(block.count()));
+            }
+
+            cmd.push_back("STREAMS");
+            cmd.push_back(name);
+            cmd.push_back(">");
+            return cmd;
+        }
+
+        inline auto ack_cmd(
+            const std::string &name,
+            const std::string &group,
+            const std::vector<std::string> &ids) -> std::vector<std::string> {
+
+            std::vector<std::string> cmd{"XACK", name, group};
+            cmd.insert(cmd.end(), ids.cbegin(), ids.cend());
+            return cmd;
+        }
+    }
+}
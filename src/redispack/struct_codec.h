@@ -0,0 +1,599 @@
+/**
+ * Provides the schema-versioned struct codec, which stores structs as msgpack
+ * maps keyed by explicit field ids instead of by position, e.g.
+ *
+ * namespace redispack {
+ *     template <>
+ *     struct struct_schema<user> {
+ *         static auto get() {
+ *             return make_schema(2,
+ *                 field(1, &user::id),
+ *                 field(2, &user::name),
+ *                 field(3, &user::updated_at));
+ *         }
+ *     };
+ * }
+ *
+ * Unknown field ids are skipped and missing ones keep their default value, so
+ * fields can be added and removed without breaking the stored values, as long
+ * as field ids are never reused for a different type. Field id 0 is reserved
+ * for the schema version.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "util.h"
+
+#include "msgpack.hpp"
+#include "rustfp/option.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace redispack {
+
+    // declaration section
+
+    /**
+     * Binds a field id to a struct member.
+     */
+    template <class T, class M>
+    struct schema_field {
+        /** Id of the field, which must be unique within the struct and not 0. */
+        uint32_t id;
+
+        /** Struct member of the field. */
+        M T::*member;
+    };
+
+    /**
+     * Versioned list of the fields of a struct.
+     */
+    template <class T, class... Ms>
+    class schema {
+    public:
+        /**
+         * Constructs the schema.
+         *
+         * @param version of the schema, stored with every value
+         * @param fields of the struct
+         */
+        schema(const uint32_t version, const schema_field<T, Ms> &... fields);
+
+        /** Number of fields, excluding the version. */
+        static constexpr size_t FIELD_COUNT = sizeof...(Ms);
+
+        /** @return version of the schema. */
+        auto get_version() const noexcept -> uint32_t;
+
+        /** @return fields of the struct. */
+        auto get_fields() const noexcept -> const std::tuple<schema_field<T, Ms>...> &;
+
+    private:
+        /** Version of the schema. */
+        uint32_t version;
+
+        /** Fields of the struct. */
+        std::tuple<schema_field<T, Ms>...> fields;
+    };
+
+    /**
+     * Schema of a struct, to be specialized with a static get function
+     * which returns the schema.
+     */
+    template <class T>
+    struct struct_schema;
+
+    /** @return field binding of the id to the struct member. */
+    template <class T, class M>
+    auto field(const uint32_t id, M T::*member) noexcept -> schema_field<T, M>;
+
+    /** @return schema of the given version and fields. */
+    template <class T, class... Ms>
+    auto make_schema(const uint32_t version, const schema_field<T, Ms> &... fields)
+        -> schema<T, Ms...>;
+
+    /**
+     * Codec which stores structs with a struct_schema specialization as
+     * msgpack maps keyed by field id.
+     */
+    struct struct_codec {
+        /** @return value encoded as a msgpack map keyed by field id. */
+        template <class V>
+        auto encode(const V &value) const -> std::string;
+
+        /**
+         * @return Some(value) decoded from the map, where unknown fields are skipped
+         * and missing fields keep their default value, otherwise None.
+         */
+        template <class V>
+        auto decode(const char *data, const size_t size) const -> rustfp::Option<V>;
+
+        /**
+         * Decodes only the given field, without decoding the rest of the value.
+         *
+         * @return Some(field value) if the field is present, otherwise None.
+         */
+        template <class V, class M>
+        auto read_field(const char *data, const size_t size, M V::*member) const
+            -> rustfp::Option<M>;
+
+        /** @return Some(schema version) that the value was encoded with, otherwise None. */
+        auto read_version(const char *data, const size_t size) const -> rustfp::Option<uint32_t>;
+    };
+
+    namespace details {
+        /** Field id which holds the schema version. */
+        static constexpr uint32_t SCHEMA_VERSION_FIELD_ID = 0;
+
+        /**
+         * Calls the function with every field of the schema, in order.
+         */
+        template <class T, class... Ms, class F>
+        void for_each_field(const schema<T, Ms...> &s, F &&fn);
+
+        /**
+         * Calls the function with every element of the tuple, in order.
+         */
+        template <class Tuple, class F, size_t... Is>
+        void for_each_in_tuple(const Tuple &tuple, F &&fn, std::index_sequence<Is...>);
+
+        /** @return true if the field is bound to the member. */
+        template <class T, class M>
+        auto is_field_of(const schema_field<T, M> &f, M T::*member) noexcept -> bool;
+
+        /** @return false, since fields of a different type are never bound to the member. */
+        template <class T, class M, class N>
+        auto is_field_of(const schema_field<T, M> &f, N T::*member) noexcept -> bool;
+
+        /**
+         * Reads a msgpack unsigned integer, advancing the position.
+         * @return false if the bytes at the position are not an unsigned integer.
+         */
+        auto read_msgpack_uint(const char *&pos, const char *end, uint64_t &value) noexcept
+            -> bool;
+
+        /**
+         * Reads a msgpack map header, advancing the position.
+         * @return false if the bytes at the position are not a map.
+         */
+        auto read_msgpack_map(const char *&pos, const char *end, uint64_t &count) noexcept
+            -> bool;
+
+        /**
+         * Skips a whole msgpack object, including all its nested objects, advancing the position.
+         * @return false if the object is corrupted or truncated.
+         */
+        auto skip_msgpack(const char *&pos, const char *end) noexcept -> bool;
+
+        /** @return big endian unsigned integer of the given number of bytes. */
+        auto read_big_endian(const char *pos, const size_t size) noexcept -> uint64_t;
+
+        /**
+         * Finds the encoded value of the field id within the map.
+         *
+         * @return true if found, with the value bytes at [value, value_end).
+         */
+        auto find_field(
+            const char *data,
+            const size_t size,
+            const uint32_t id,
+            const char *&value,
+            const char *&value_end) noexcept -> bool;
+    }
+
+    // implementation section
+
+    template <class T, class... Ms>
+    schema<T, Ms...>::schema(const uint32_t version, const schema_field<T, Ms> &... fields) :
+        version(version),
+        fields(fields...) {
+
+    }
+
+    template <class T, class... Ms>
+    constexpr size_t schema<T, Ms...>::FIELD_COUNT;
+
+    template <class T, class... Ms>
+    auto schema<T, Ms...>::get_version() const noexcept -> uint32_t {
+        return version;
+    }
+
+    template <class T, class... Ms>
+    auto schema<T, Ms...>::get_fields() const noexcept
+        -> const std::tuple<schema_field<T, Ms>...> & {
+
+        return fields;
+    }
+
+    template <class T, class M>
+    auto field(const uint32_t id, M T::*member) noexcept -> schema_field<T, M> {
+        return schema_field<T, M>{id, member};
+    }
+
+    template <class T, class... Ms>
+    auto make_schema(const uint32_t version, const schema_field<T, Ms> &... fields)
+        -> schema<T, Ms...> {
+
+        return schema<T, Ms...>(version, fields...);
+    }
+
+    template <class V>
+    auto struct_codec::encode(const V &value) const -> std::string {
+        const auto value_schema = struct_schema<V>::get();
+
+        // reuses the packing buffer so that only the returned string is allocated
+        thread_local ::msgpack::sbuffer buf;
+        buf.clear();
+
+        ::msgpack::packer<::msgpack::sbuffer> packer(buf);
+        packer.pack_map(static_cast<uint32_t>(1 + value_schema.FIELD_COUNT));
+        packer.pack(details::SCHEMA_VERSION_FIELD_ID);
+        packer.pack(value_schema.get_version());
+
+        details::for_each_field(value_schema, [&packer, &value](const auto &f) {
+            packer.pack(f.id);
+            packer.pack(value.*(f.member));
+        });
+
+        return std::string(buf.data(), buf.size());
+    }
+
+    template <class V>
+    auto struct_codec::decode(const char *data, const size_t size) const -> rustfp::Option<V> {
+        const auto value_schema = struct_schema<V>::get();
+        const auto end = data + size;
+
+        auto pos = data;
+        uint64_t count = 0;
+
+        if (!details::read_msgpack_map(pos, end, count)) {
+            return rustfp::None;
+        }
+
+        V obj;
+
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t id = 0;
+            const auto key_start = pos;
+
+            // keys which are not field ids are skipped like unknown fields
+            if (!details::read_msgpack_uint(pos, end, id)) {
+                pos = key_start;
+
+                if (!details::skip_msgpack(pos, end)) {
+                    return rustfp::None;
+                }
+
+                id = details::SCHEMA_VERSION_FIELD_ID;
+            }
+
+            const auto value_start = pos;
+
+            if (!details::skip_msgpack(pos, end)) {
+                return rustfp::None;
+            }
+
+            if (id == details::SCHEMA_VERSION_FIELD_ID) {
+                continue;
+            }
+
+            auto is_valid = true;
+
+            details::for_each_field(value_schema, [&](const auto &f) {
+                if (f.id != id) {
+                    return;
+                }
+
+                using member_t = std::decay_t<decltype(obj.*(f.member))>;
+
+                auto member_opt = details::decode_from_str<member_t>(
+                    value_start, static_cast<size_t>(pos - value_start));
+
+                is_valid = is_valid && member_opt.is_some();
+
+                std::move(member_opt).match_some([&obj, &f](member_t &&member) {
+                    obj.*(f.member) = std::move(member);
+                });
+            });
+
+            // a known field of a different type means that the field id was reused
+            if (!is_valid) {
+                return rustfp::None;
+            }
+        }
+
+        return rustfp::Some(std::move(obj));
+    }
+
+    template <class V, class M>
+    auto struct_codec::read_field(const char *data, const size_t size, M V::*member) const
+        -> rustfp::Option<M> {
+
+        const auto value_schema = struct_schema<V>::get();
+
+        auto is_bound = false;
+        uint32_t id = details::SCHEMA_VERSION_FIELD_ID;
+
+        details::for_each_field(value_schema, [&is_bound, &id, member](const auto &f) {
+            if (details::is_field_of(f, member)) {
+                is_bound = true;
+                id = f.id;
+            }
+        });
+
+        const char *value = nullptr;
+        const char *value_end = nullptr;
+
+        if (!is_bound || !details::find_field(data, size, id, value, value_end)) {
+            return rustfp::None;
+        }
+
+        return details::decode_from_str<M>(value, static_cast<size_t>(value_end - value));
+    }
+
+    inline auto struct_codec::read_version(const char *data, const size_t size) const
+        -> rustfp::Option<uint32_t> {
+
+        const char *value = nullptr;
+        const char *value_end = nullptr;
+
+        if (!details::find_field(data, size, details::SCHEMA_VERSION_FIELD_ID, value, value_end)) {
+            return rustfp::None;
+        }
+
+        return details::decode_from_str<uint32_t>(value, static_cast<size_t>(value_end - value));
+    }
+
+    namespace details {
+        template <class T, class... Ms, class F>
+        void for_each_field(const schema<T, Ms...> &s, F &&fn) {
+            for_each_in_tuple(
+                s.get_fields(), std::forward<F>(fn), std::index_sequence_for<Ms...>());
+        }
+
+        template <class Tuple, class F, size_t... Is>
+        void for_each_in_tuple(const Tuple &tuple, F &&fn, std::index_sequence<Is...>) {
+            // expands into calls in order, the array only exists to allow the expansion
+            const int expansion[] = {0, (fn(std::get<Is>(tuple)), 0)...};
+            static_cast<void>(expansion);
+        }
+
+        template <class T, class M>
+        auto is_field_of(const schema_field<T, M> &f, M T::*member) noexcept -> bool {
+            return f.member == member;
+        }
+
+        template <class T, class M, class N>
+        auto is_field_of(const schema_field<T, M> &, N T::*) noexcept -> bool {
+            return false;
+        }
+
+        inline auto read_big_endian(const char *pos, const size_t size) noexcept -> uint64_t {
+            uint64_t value = 0;
+
+            for (size_t i = 0; i < size; ++i) {
+                value = (value << 8) | static_cast<unsigned char>(pos[i]);
+            }
+
+            return value;
+        }
+
+        inline auto read_msgpack_uint(const char *&pos, const char *end, uint64_t &value) noexcept
+            -> bool {
+
+            static constexpr unsigned char POSITIVE_FIXINT_MAX = 0x7f;
+            static constexpr unsigned char UINT8 = 0xcc;
+            static constexpr unsigned char UINT64 = 0xcf;
+
+            if (pos >= end) {
+                return false;
+            }
+
+            const auto b = static_cast<unsigned char>(*pos);
+
+            if (b <= POSITIVE_FIXINT_MAX) {
+                value = b;
+                ++pos;
+                return true;
+            }
+
+            if (b < UINT8 || b > UINT64) {
+                return false;
+            }
+
+            // uint8, uint16, uint32 and uint64 take 1, 2, 4 and 8 bytes
+            const size_t size = static_cast<size_t>(1) << (b - UINT8);
+
+            if (static_cast<size_t>(end - pos) < 1 + size) {
+                return false;
+            }
+
+            value = read_big_endian(pos + 1, size);
+            pos += 1 + size;
+            return true;
+        }
+
+        inline auto read_msgpack_map(const char *&pos, const char *end, uint64_t &count) noexcept
+            -> bool {
+
+            static constexpr unsigned char FIXMAP_MIN = 0x80;
+            static constexpr unsigned char FIXMAP_MAX = 0x8f;
+            static constexpr unsigned char MAP16 = 0xde;
+            static constexpr unsigned char MAP32 = 0xdf;
+
+            if (pos >= end) {
+                return false;
+            }
+
+            const auto b = static_cast<unsigned char>(*pos);
+
+            if (b >= FIXMAP_MIN && b <= FIXMAP_MAX) {
+                count = b & 0x0f;
+                ++pos;
+                return true;
+            }
+
+            if (b != MAP16 && b != MAP32) {
+                return false;
+            }
+
+            const size_t size = b == MAP16 ? 2 : 4;
+
+            if (static_cast<size_t>(end - pos) < 1 + size) {
+                return false;
+            }
+
+            count = read_big_endian(pos + 1, size);
+            pos += 1 + size;
+            return true;
+        }
+
+        inline auto skip_msgpack(const char *&pos, const char *end) noexcept -> bool {
+            // counts the objects left to skip instead of recursing,
+            // so that deeply nested values cannot overflow the stack
+            uint64_t pending = 1;
+
+            while (pending > 0) {
+                if (pos >= end) {
+                    return false;
+                }
+
+                --pending;
+
+                const auto b = static_cast<unsigned char>(*pos);
+                const auto left = static_cast<size_t>(end - pos);
+
+                // size of the header, the number of bytes of the length that follows it,
+                // and the payload size or number of nested objects
+                size_t header = 1;
+                size_t length_size = 0;
+                uint64_t payload = 0;
+                uint64_t children = 0;
+
+                if (b <= 0x7f || b >= 0xe0 || b == 0xc0 || b == 0xc2 || b == 0xc3) {
+                    // fixint, nil and bool
+                }
+                else if (b <= 0x8f) {
+                    children = 2 * static_cast<uint64_t>(b & 0x0f);
+                }
+                else if (b <= 0x9f) {
+                    children = b & 0x0f;
+                }
+                else if (b <= 0xbf) {
+                    payload = b & 0x1f;
+                }
+                else {
+                    switch (b) {
+                    case 0xc4: case 0xd9: length_size = 1; break;
+                    case 0xc5: case 0xda: length_size = 2; break;
+                    case 0xc6: case 0xdb: length_size = 4; break;
+                    case 0xc7: length_size = 1; header = 2; break;
+                    case 0xc8: length_size = 2; header = 2; break;
+                    case 0xc9: length_size = 4; header = 2; break;
+                    case 0xca: payload = 4; break;
+                    case 0xcb: payload = 8; break;
+                    case 0xcc: case 0xd0: payload = 1; break;
+                    case 0xcd: case 0xd1: payload = 2; break;
+                    case 0xce: case 0xd2: payload = 4; break;
+                    case 0xcf: case 0xd3: payload = 8; break;
+                    case 0xd4: payload = 2; break;
+                    case 0xd5: payload = 3; break;
+                    case 0xd6: payload = 5; break;
+                    case 0xd7: payload = 9; break;
+                    case 0xd8: payload = 17; break;
+                    case 0xdc: case 0xdd: break;
+                    case 0xde: case 0xdf: break;
+                    default: return false;
+                    }
+                }
+
+                // arrays and maps have their element count instead of a payload length
+                if (b >= 0xdc && b <= 0xdf) {
+                    const size_t count_size = (b == 0xdc || b == 0xde) ? 2 : 4;
+
+                    if (left < 1 + count_size) {
+                        return false;
+                    }
+
+                    children = read_big_endian(pos + 1, count_size);
+
+                    if (b >= 0xde) {
+                        children *= 2;
+                    }
+
+                    header = 1 + count_size;
+                }
+                else if (length_size > 0) {
+                    if (left < 1 + length_size) {
+                        return false;
+                    }
+
+                    payload = read_big_endian(pos + 1, length_size);
+
+                    // ext types have a type byte after the length
+                    header = header + length_size;
+                }
+
+                if (left < header || left - header < payload) {
+                    return false;
+                }
+
+                pos += header + payload;
+                pending += children;
+            }
+
+            return true;
+        }
+
+        inline auto find_field(
+            const char *data,
+            const size_t size,
+            const uint32_t id,
+            const char *&value,
+            const char *&value_end) noexcept -> bool {
+
+            const auto end = data + size;
+            auto pos = data;
+            uint64_t count = 0;
+
+            if (!read_msgpack_map(pos, end, count)) {
+                return false;
+            }
+
+            for (uint64_t i = 0; i < count; ++i) {
+                uint64_t key = 0;
+                const auto key_start = pos;
+                const auto is_id = read_msgpack_uint(pos, end, key);
+
+                if (!is_id) {
+                    pos = key_start;
+
+                    if (!skip_msgpack(pos, end)) {
+                        return false;
+                    }
+                }
+
+                const auto value_start = pos;
+
+                if (!skip_msgpack(pos, end)) {
+                    return false;
+                }
+
+                if (is_id && key == id) {
+                    value = value_start;
+                    value_end = pos;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    }
+}
@@ -11,7 +11,10 @@
 #include "msgpack.hpp"
 #include "rustfp/option.h"
 
+#include <cstddef>
+#include <iterator>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -37,6 +40,12 @@ namespace redispack {
         template <class V>
         auto decode_from_str(const std::string &str) -> rustfp::Option<V>;
 
+        /**
+         * Decodes by unpacking in place from given bytes into possibly the actual value.
+         */
+        template <class V>
+        auto decode_from_str(const char *data, const size_t size) -> rustfp::Option<V>;
+
         /**
          * Pack variadic template into vector form implementation, base case.
          */
@@ -55,6 +64,71 @@ namespace redispack {
          */
         template <class V, class... Vs>
         auto str_vectorize(V &&v, Vs &&... vs) -> std::vector<std::string>;
+
+        /**
+         * Passes through the value as-is if it is already of the member type.
+         */
+        template <class T>
+        auto as_member(const T &value) -> const T &;
+
+        /**
+         * Converts the value into the member type, so that it is encoded as the member type.
+         */
+        template <class T, class U,
+            class = std::enable_if_t<!std::is_same<std::decay_t<U>, T>::value>>
+        auto as_member(const U &value) -> T;
+
+        /**
+         * Reserves the number of elements in range, only if it is known without iterating.
+         */
+        template <class TBeginIter, class TEndIter>
+        void reserve_range(
+            std::vector<std::string> &vec,
+            const TBeginIter &begin_it,
+            const TEndIter &end_it);
+
+        /**
+         * Reserve implementation for ranges with known length.
+         */
+        template <class TBeginIter, class TEndIter>
+        void reserve_range_impl(
+            std::vector<std::string> &vec,
+            const TBeginIter &begin_it,
+            const TEndIter &end_it,
+            std::true_type);
+
+        /**
+         * Reserve implementation for ranges with unknown length.
+         */
+        template <class TBeginIter, class TEndIter>
+        void reserve_range_impl(
+            std::vector<std::string> &vec,
+            const TBeginIter &begin_it,
+            const TEndIter &end_it,
+            std::false_type);
+
+        /**
+         * Iterator category of the given type, which also removes the overloads
+         * taking iterators from consideration for non-iterator types.
+         */
+        template <class TIter>
+        using iterator_category_t = typename std::iterator_traits<TIter>::iterator_category;
+
+        /**
+         * Encodes every element in range as the member type T into vector form,
+         * without making an intermediate copy of the elements.
+         */
+        template <class T, class TBeginIter, class TEndIter>
+        auto str_vectorize_range(TBeginIter begin_it, const TEndIter &end_it)
+            -> std::vector<std::string>;
+
+        /**
+         * Encodes every element in range as the member type T with the codec into vector form,
+         * without making an intermediate copy of the elements.
+         */
+        template <class T, class TBeginIter, class TEndIter, class Codec>
+        auto str_vectorize_range(TBeginIter begin_it, const TEndIter &end_it, const Codec &codec)
+            -> std::vector<std::string>;
     }
 
     // implementation section
@@ -66,17 +140,25 @@ namespace redispack {
 
         template <class V>
         auto encode_into_str(const V &value) -> std::string {
-            std::stringstream buf;
+            // reuses the packing buffer so that only the returned string is allocated
+            thread_local ::msgpack::sbuffer buf;
+            buf.clear();
+
             ::msgpack::pack(buf, value);
-            return buf.str();
+            return std::string(buf.data(), buf.size());
         }
 
         template <class V>
         auto decode_from_str(const std::string &str) -> rustfp::Option<V> {
+            return decode_from_str<V>(str.data(), str.size());
+        }
+
+        template <class V>
+        auto decode_from_str(const char *data, const size_t size) -> rustfp::Option<V> {
             try {
                 V obj;
 
-                ::msgpack::unpack(str.data(), str.size())
+                ::msgpack::unpack(data, size)
                     .get()
                     .convert(obj);
 
@@ -111,5 +193,77 @@ namespace redispack {
                 std::forward<V>(v),
                 std::forward<Vs>(vs)...);
         }
+
+        template <class T>
+        auto as_member(const T &value) -> const T & {
+            return value;
+        }
+
+        template <class T, class U, class>
+        auto as_member(const U &value) -> T {
+            return T(value);
+        }
+
+        template <class TBeginIter, class TEndIter>
+        void reserve_range(
+            std::vector<std::string> &vec,
+            const TBeginIter &begin_it,
+            const TEndIter &end_it) {
+
+            using category_t = iterator_category_t<TBeginIter>;
+
+            reserve_range_impl(vec, begin_it, end_it,
+                std::integral_constant<bool,
+                    std::is_same<TBeginIter, TEndIter>::value
+                    && std::is_base_of<std::forward_iterator_tag, category_t>::value>());
+        }
+
+        template <class TBeginIter, class TEndIter>
+        void reserve_range_impl(
+            std::vector<std::string> &vec,
+            const TBeginIter &begin_it,
+            const TEndIter &end_it,
+            std::true_type) {
+
+            vec.reserve(static_cast<size_t>(std::distance(begin_it, end_it)));
+        }
+
+        template <class TBeginIter, class TEndIter>
+        void reserve_range_impl(
+            std::vector<std::string> &,
+            const TBeginIter &,
+            const TEndIter &,
+            std::false_type) {
+
+            // single pass or unknown length ranges grow as needed
+        }
+
+        template <class T, class TBeginIter, class TEndIter>
+        auto str_vectorize_range(TBeginIter begin_it, const TEndIter &end_it)
+            -> std::vector<std::string> {
+
+            std::vector<std::string> vec;
+            reserve_range(vec, begin_it, end_it);
+
+            for (; begin_it != end_it; ++begin_it) {
+                vec.push_back(encode_into_str(as_member<T>(*begin_it)));
+            }
+
+            return vec;
+        }
+
+        template <class T, class TBeginIter, class TEndIter, class Codec>
+        auto str_vectorize_range(TBeginIter begin_it, const TEndIter &end_it, const Codec &codec)
+            -> std::vector<std::string> {
+
+            std::vector<std::string> vec;
+            reserve_range(vec, begin_it, end_it);
+
+            for (; begin_it != end_it; ++begin_it) {
+                vec.push_back(codec.encode(as_member<T>(*begin_it)));
+            }
+
+            return vec;
+        }
     }
 }
\ No newline at end of file
@@ -0,0 +1,415 @@
+/**
+ * Provides write-behind buffering of hash field writes, which keeps only
+ * the latest value per field and flushes them together, so that fields
+ * overwritten many times between flushes cost a single write.
+ *
+ * @author Chen Weiguang
+ */
+
+#pragma once
+
+#include "alias.h"
+#include "codec.h"
+#include "hash.h"
+#include "router.h"
+#include "util.h"
+
+#include "cpp_redis/cpp_redis"
+#include "rustfp/option.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace redispack {
+
+    // declaration section
+
+    namespace details {
+        /** Number of independently locked shards of the pending fields. */
+        static constexpr size_t WRITE_BEHIND_SHARDS = 16;
+
+        /** Maximum number of fields per hset command. */
+        static constexpr size_t WRITE_BEHIND_BATCH = 1024;
+    }
+
+    /**
+     * Controls when the pending writes are flushed.
+     */
+    struct write_behind_options {
+        /** Maximum time a write stays pending. */
+        std::chrono::milliseconds flush_interval;
+
+        /** Number of distinct pending fields which triggers an immediate flush. */
+        size_t max_pending;
+    };
+
+    /**
+     * @return defaults of flushing every 100 milliseconds, or once 1024 fields are pending.
+     */
+    auto default_write_behind_options() noexcept -> write_behind_options;
+
+    /**
+     * Buffers the writes to a hash in process, keeping only the latest value per field,
+     * and flushes the distinct fields with multi-field hset commands in a single round trip.
+     *
+     * Reads through this instance see the pending writes. Writes made to the hash
+     * directly may be overwritten by the pending writes of the same fields.
+     */
+    template <class K, class V, class Codec = msgpack_codec>
+    class write_behind_hash {
+    public:
+        /**
+         * Constructs the buffer and starts the flusher thread.
+         *
+         * @param target hash to flush the writes into
+         * @param options controls when the pending writes are flushed
+         */
+        explicit write_behind_hash(
+            const hash<K, V, Codec> &target,
+            const write_behind_options &options = default_write_behind_options());
+
+        /**
+         * Stops the flusher thread and flushes the remaining writes.
+         * A destructor cannot report a failed final flush, so the writes still pending
+         * are then lost. Call close first to get the failure instead.
+         */
+        ~write_behind_hash();
+
+        write_behind_hash(const write_behind_hash &) = delete;
+        auto operator=(const write_behind_hash &) -> write_behind_hash & = delete;
+
+        /**
+         * Records the value as the latest of the field, replacing any pending value.
+         * Thread-safe.
+         */
+        void set(const K &key, const V &value);
+
+        /**
+         * Thread-safe.
+         * @return Some(pending value) if the field has one, otherwise the value from the hash.
+         */
+        auto get(const K &key) const -> rustfp::Option<V>;
+
+        /**
+         * Writes all the pending fields into the hash. Thread-safe.
+         * The fields are kept pending if the write fails, unless overwritten meanwhile.
+         *
+         * @return number of fields written.
+         * @throws std::runtime_error if the server rejects any of the writes.
+         */
+        auto flush() -> size_t;
+
+        /**
+         * Stops the flusher thread and flushes the remaining writes on the calling thread.
+         * Later writes are only written by explicit flush calls. Not thread-safe.
+         *
+         * @return number of fields written.
+         * @throws std::runtime_error if the server rejects any of the writes, which are kept
+         * pending so that flush or close can be called again.
+         */
+        auto close() -> size_t;
+
+        /**
+         * @return number of distinct fields waiting to be flushed.
+         */
+        auto get_pending_count() const noexcept -> size_t;
+
+        /**
+         * @return hash the writes are flushed into.
+         */
+        auto get_target() const -> const hash<K, V, Codec> &;
+
+    private:
+        /** Independently locked part of the pending fields. */
+        struct shard {
+            /** Guards the fields of the shard. */
+            std::mutex mutex;
+
+            /** Latest value of each field not yet flushed, keyed by the encoded field. */
+            std::unordered_map<std::string, V> pending;
+
+            /** Values being flushed, still visible to the readers until written. */
+            std::unordered_map<std::string, V> flushing;
+        };
+
+        /** Flushes periodically until stopped, leaving the final flush to the caller. */
+        void run();
+
+        /** Stops and joins the flusher thread, if still running. */
+        void stop_flusher();
+
+        /** @return shard holding the encoded field. */
+        auto shard_of(const std::string &key_str) const -> shard &;
+
+        /** Hash to flush the writes into. */
+        hash<K, V, Codec> target;
+
+        /** Holds a shared ownership to access the database. */
+        redis_client_ptr client_ptr;
+
+        /** Controls when the pending writes are flushed. */
+        write_behind_options options;
+
+        /** Pending fields, spread by the hash of the encoded field. */
+        mutable std::array<shard, details::WRITE_BEHIND_SHARDS> shards;
+
+        /** Number of distinct pending fields. */
+        std::atomic<size_t> pending_count;
+
+        /** Serializes the flushes, so that an older value never overwrites a newer one. */
+        std::mutex flush_mutex;
+
+        /** Set when the buffer is being destroyed. */
+        std::atomic<bool> is_stopping;
+
+        /** Only guards the wake-up condition of the flusher thread. */
+        std::mutex wake_mutex;
+
+        /** Wakes up the flusher thread. */
+        std::condition_variable wake_cv;
+
+        /** Flusher thread. */
+        std::thread flusher;
+    };
+
+    // implementation section
+
+    inline auto default_write_behind_options() noexcept -> write_behind_options {
+        static constexpr auto DEFAULT_FLUSH_INTERVAL_MS = 100;
+        static constexpr size_t DEFAULT_MAX_PENDING = 1024;
+
+        return write_behind_options{
+            std::chrono::milliseconds(DEFAULT_FLUSH_INTERVAL_MS),
+            DEFAULT_MAX_PENDING};
+    }
+
+    template <class K, class V, class Codec>
+    write_behind_hash<K, V, Codec>::write_behind_hash(
+        const hash<K, V, Codec> &target,
+        const write_behind_options &options) :
+
+        target(target),
+        client_ptr(target.get_client_ptr()),
+        options(options),
+        pending_count(0),
+        is_stopping(false) {
+
+        flusher = std::thread([this] { run(); });
+    }
+
+    template <class K, class V, class Codec>
+    write_behind_hash<K, V, Codec>::~write_behind_hash() {
+        stop_flusher();
+
+        try {
+            flush();
+        }
+        catch (const std::exception &) {
+            // documented as lost, since close is the way to observe the failure
+        }
+    }
+
+    template <class K, class V, class Codec>
+    void write_behind_hash<K, V, Codec>::set(const K &key, const V &value) {
+        const auto key_str = details::encode_into_str(key);
+        auto &s = shard_of(key_str);
+        size_t new_pending_count = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            const auto inserted = s.pending.emplace(key_str, value);
+
+            // counted under the lock, so that a concurrent flush never subtracts it first
+            if (inserted.second) {
+                new_pending_count = pending_count.fetch_add(1) + 1;
+            }
+            else {
+                inserted.first->second = value;
+            }
+        }
+
+        // only a new field can reach the threshold, overwrites are free
+        if (new_pending_count == options.max_pending) {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            wake_cv.notify_one();
+        }
+    }
+
+    template <class K, class V, class Codec>
+    auto write_behind_hash<K, V, Codec>::get(const K &key) const -> rustfp::Option<V> {
+        const auto key_str = details::encode_into_str(key);
+        auto &s = shard_of(key_str);
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            const auto pending_it = s.pending.find(key_str);
+
+            if (pending_it != s.pending.cend()) {
+                return rustfp::Some(pending_it->second);
+            }
+
+            const auto flushing_it = s.flushing.find(key_str);
+
+            if (flushing_it != s.flushing.cend()) {
+                return rustfp::Some(flushing_it->second);
+            }
+        }
+
+        return target.get(key);
+    }
+
+    template <class K, class V, class Codec>
+    auto write_behind_hash<K, V, Codec>::flush() -> size_t {
+        std::lock_guard<std::mutex> flush_lock(flush_mutex);
+
+        std::vector<std::string> field_vals;
+
+        for (auto &s : shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            pending_count -= s.pending.size();
+            s.flushing.swap(s.pending);
+
+            for (const auto &entry : s.flushing) {
+                field_vals.push_back(entry.first);
+                field_vals.push_back(target.get_codec().encode(entry.second));
+            }
+        }
+
+        const auto field_count = field_vals.size() / 2;
+
+        try {
+            bool is_failed = false;
+
+            for (size_t begin = 0; begin < field_count; begin += details::WRITE_BEHIND_BATCH) {
+                const auto end = std::min(field_count, begin + details::WRITE_BEHIND_BATCH);
+
+                std::vector<std::string> cmd{"HSET", target.get_name()};
+                cmd.insert(cmd.end(),
+                    field_vals.cbegin() + begin * 2, field_vals.cbegin() + end * 2);
+
+                client_ptr->send(cmd,
+                    [&is_failed](cpp_redis::reply &r) {
+                        if (r.is_error()) {
+                            is_failed = true;
+                        }
+                    });
+            }
+
+            // all the batches travel in a single round trip
+            if (field_count > 0) {
+                details::sync_commit(client_ptr);
+
+                // starts the read-your-writes window, even if only some batches were written
+                if (target.get_router_ptr()) {
+                    target.get_router_ptr()->mark_write();
+                }
+            }
+
+            if (is_failed) {
+                throw std::runtime_error("Unable to flush the writes into " + target.get_name());
+            }
+        }
+        catch (const std::exception &) {
+            // keeps the values for the next flush, unless a newer value is pending
+            for (auto &s : shards) {
+                std::lock_guard<std::mutex> lock(s.mutex);
+
+                for (auto &entry : s.flushing) {
+                    if (s.pending.emplace(entry.first, std::move(entry.second)).second) {
+                        ++pending_count;
+                    }
+                }
+
+                s.flushing.clear();
+            }
+
+            throw;
+        }
+
+        for (auto &s : shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.flushing.clear();
+        }
+
+        return field_count;
+    }
+
+    template <class K, class V, class Codec>
+    auto write_behind_hash<K, V, Codec>::close() -> size_t {
+        stop_flusher();
+        return flush();
+    }
+
+    template <class K, class V, class Codec>
+    auto write_behind_hash<K, V, Codec>::get_pending_count() const noexcept -> size_t {
+        return pending_count.load();
+    }
+
+    template <class K, class V, class Codec>
+    auto write_behind_hash<K, V, Codec>::get_target() const -> const hash<K, V, Codec> & {
+        return target;
+    }
+
+    template <class K, class V, class Codec>
+    void write_behind_hash<K, V, Codec>::run() {
+        bool is_failing = false;
+
+        while (true) {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+
+            // a failing flush is only retried after the interval, even when over the threshold
+            wake_cv.wait_for(lock, options.flush_interval, [this, is_failing] {
+                return is_stopping.load()
+                    || (!is_failing && pending_count.load() >= options.max_pending);
+            });
+
+            // the final flush runs on the stopping thread, which can observe its failure
+            if (is_stopping) {
+                break;
+            }
+
+            lock.unlock();
+
+            try {
+                flush();
+                is_failing = false;
+            }
+            catch (const std::exception &) {
+                // retried on the next flush, since the values are kept
+                is_failing = true;
+            }
+        }
+    }
+
+    template <class K, class V, class Codec>
+    void write_behind_hash<K, V, Codec>::stop_flusher() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            is_stopping = true;
+        }
+
+        wake_cv.notify_one();
+
+        if (flusher.joinable()) {
+            flusher.join();
+        }
+    }
+
+    template <class K, class V, class Codec>
+    auto write_behind_hash<K, V, Codec>::shard_of(const std::string &key_str) const -> shard & {
+        return shards[std::hash<std::string>()(key_str) % details::WRITE_BEHIND_SHARDS];
+    }
+}